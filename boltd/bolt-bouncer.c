@@ -23,7 +23,10 @@
 #include "bolt-bouncer.h"
 
 #include "bolt-log.h"
+#include "bolt-peer.h"
+#include "bolt-stats.h"
 #include "bolt-str.h"
+#include "bolt-trace.h"
 
 #include "bolt-exported.h"
 
@@ -101,6 +104,54 @@ bouncer_initialize (GInitable    *initable,
 
 /* internal methods */
 
+static PolkitSubject *
+bolt_bouncer_subject_for (GDBusMethodInvocation *inv,
+                          GError               **error)
+{
+  GDBusConnection *connection;
+  GCredentials *creds;
+  const char *sender;
+  guint64 start;
+  pid_t pid;
+  uid_t uid;
+
+  sender = g_dbus_method_invocation_get_sender (inv);
+
+  if (sender != NULL)
+    return polkit_system_bus_name_new (sender);
+
+  /* direct peer connection, no bus name: use the
+   * credentials from the socket (SO_PEERCRED) */
+  connection = g_dbus_method_invocation_get_connection (inv);
+  creds = g_dbus_connection_get_peer_credentials (connection);
+
+  if (creds == NULL)
+    {
+      g_set_error_literal (error, G_DBUS_ERROR, G_DBUS_ERROR_ACCESS_DENIED,
+                           "peer credentials unavailable");
+      return NULL;
+    }
+
+  pid = g_credentials_get_unix_pid (creds, error);
+  if (pid == -1)
+    return NULL;
+
+  uid = g_credentials_get_unix_user (creds, error);
+  if (uid == (uid_t) -1)
+    return NULL;
+
+  /* with the start time, polkit can tell if the pid got reused */
+  start = bolt_peer_get_start_time (connection);
+  if (start == 0)
+    {
+      g_set_error_literal (error, G_DBUS_ERROR, G_DBUS_ERROR_ACCESS_DENIED,
+                           "peer process unknown");
+      return NULL;
+    }
+
+  return polkit_unix_process_new_for_owner (pid, start, uid);
+}
+
 static gboolean
 bolt_bouncer_check_action (BoltBouncer           *bnc,
                            GDBusMethodInvocation *inv,
@@ -111,14 +162,18 @@ bolt_bouncer_check_action (BoltBouncer           *bnc,
   g_autoptr(PolkitSubject) subject = NULL;
   g_autoptr(PolkitDetails) details = NULL;
   g_autoptr(PolkitAuthorizationResult) res = NULL;
+  g_auto(BoltTraceSpan) span = BOLT_TRACE_SPAN_ARG ("polkit", "check-authorization",
+                                                    "action", action);
   PolkitCheckAuthorizationFlags flags;
-  const char *sender;
 
-  sender = g_dbus_method_invocation_get_sender (inv);
+  subject = bolt_bouncer_subject_for (inv, error);
+  if (subject == NULL)
+    return FALSE;
 
-  subject = polkit_system_bus_name_new (sender);
   details = polkit_details_new ();
 
+  bolt_stats_polkit_check (TRUE);
+
   flags = POLKIT_CHECK_AUTHORIZATION_FLAGS_ALLOW_USER_INTERACTION;
   res = polkit_authority_check_authorization_sync (bnc->authority,
                                                    subject,
@@ -143,15 +198,10 @@ handle_authorize_method (BoltExported          *exported,
   gboolean authorized = FALSE;
   BoltBouncer *bnc;
   const char *method_name;
-  const char *sender;
   const char *action;
 
   bnc = BOLT_BOUNCER (user_data);
   method_name = g_dbus_method_invocation_get_method_name (inv);
-  sender = g_dbus_method_invocation_get_sender (inv);
-
-  subject = polkit_system_bus_name_new (sender);
-  details = polkit_details_new ();
 
   action = NULL;
 
@@ -163,6 +213,8 @@ handle_authorize_method (BoltExported          *exported,
     action = "org.freedesktop.bolt.manage";
   else if (bolt_streq (method_name, "ForcePower"))
     action = "org.freedesktop.bolt.manage";
+  else if (bolt_streq (method_name, "DumpFlightRecorder"))
+    action = "org.freedesktop.bolt.manage";
   else if (bolt_streq (method_name, "ListDomains"))
     authorized = TRUE;
   else if (bolt_streq (method_name, "DomainById"))
@@ -178,6 +230,16 @@ handle_authorize_method (BoltExported          *exported,
     {
       PolkitCheckAuthorizationFlags flags;
       g_autoptr(PolkitAuthorizationResult) res = NULL;
+      g_auto(BoltTraceSpan) span = BOLT_TRACE_SPAN_ARG ("polkit", "check-authorization",
+                                                        "action", action);
+
+      subject = bolt_bouncer_subject_for (inv, error);
+      if (subject == NULL)
+        return FALSE;
+
+      details = polkit_details_new ();
+
+      bolt_stats_polkit_check (TRUE);
 
       flags = POLKIT_CHECK_AUTHORIZATION_FLAGS_ALLOW_USER_INTERACTION;
       res = polkit_authority_check_authorization_sync (bnc->authority,
@@ -190,6 +252,8 @@ handle_authorize_method (BoltExported          *exported,
 
       authorized = polkit_authorization_result_get_is_authorized (res);
     }
+  else if (authorized)
+    bolt_stats_polkit_check (FALSE);
 
   if (authorized == FALSE)
     g_set_error (error, G_DBUS_ERROR, G_DBUS_ERROR_ACCESS_DENIED,
@@ -0,0 +1,279 @@
+/*
+ * Copyright © 2018 Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *       Christian J. Kellner <christian@kellner.me>
+ */
+
+#include "config.h"
+
+#include "bolt-clock.h"
+
+typedef struct _BoltTimer
+{
+  guint       id;
+  gint64      due;      /* µs */
+  gint64      interval; /* µs */
+  GSourceFunc func;
+  gpointer    user_data;
+  char       *name;
+} BoltTimer;
+
+struct _BoltClock
+{
+  GObject object;
+
+  gboolean    virtual;
+
+  /* virtual time and timers */
+  gint64      now;
+  guint       last_id;
+  GHashTable *timers;   /* id -> BoltTimer */
+};
+
+G_DEFINE_TYPE (BoltClock,
+               bolt_clock,
+               G_TYPE_OBJECT);
+
+static void
+bolt_timer_free (gpointer data)
+{
+  BoltTimer *timer = data;
+
+  g_free (timer->name);
+  g_free (timer);
+}
+
+static void
+bolt_clock_finalize (GObject *object)
+{
+  BoltClock *clock = BOLT_CLOCK (object);
+
+  g_hash_table_unref (clock->timers);
+
+  G_OBJECT_CLASS (bolt_clock_parent_class)->finalize (object);
+}
+
+static void
+bolt_clock_init (BoltClock *clock)
+{
+  clock->timers = g_hash_table_new_full (NULL, NULL, NULL, bolt_timer_free);
+}
+
+static void
+bolt_clock_class_init (BoltClockClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->finalize = bolt_clock_finalize;
+}
+
+static guint
+bolt_clock_timer_add (BoltClock  *clock,
+                      gint64      interval,
+                      GSourceFunc func,
+                      gpointer    user_data,
+                      const char *name)
+{
+  BoltTimer *timer;
+
+  timer = g_new0 (BoltTimer, 1);
+  timer->id = ++clock->last_id;
+  timer->due = clock->now + interval;
+  timer->interval = interval;
+  timer->func = func;
+  timer->user_data = user_data;
+  timer->name = g_strdup (name);
+
+  g_hash_table_insert (clock->timers, GUINT_TO_POINTER (timer->id), timer);
+
+  return timer->id;
+}
+
+/* the timer that is due first, ties are broken by
+ * creation order, like for the main loop */
+static BoltTimer *
+bolt_clock_timer_next (BoltClock *clock,
+                       gint64     limit)
+{
+  BoltTimer *next = NULL;
+  GHashTableIter iter;
+  gpointer val;
+
+  g_hash_table_iter_init (&iter, clock->timers);
+  while (g_hash_table_iter_next (&iter, NULL, &val))
+    {
+      BoltTimer *timer = val;
+
+      if (timer->due > limit)
+        continue;
+
+      if (next == NULL || timer->due < next->due ||
+          (timer->due == next->due && timer->id < next->id))
+        next = timer;
+    }
+
+  return next;
+}
+
+/* public methods */
+BoltClock *
+bolt_clock_new (void)
+{
+  return g_object_new (BOLT_TYPE_CLOCK, NULL);
+}
+
+BoltClock *
+bolt_clock_new_virtual (void)
+{
+  BoltClock *clock;
+
+  clock = g_object_new (BOLT_TYPE_CLOCK, NULL);
+  clock->virtual = TRUE;
+
+  return clock;
+}
+
+gboolean
+bolt_clock_is_virtual (BoltClock *clock)
+{
+  g_return_val_if_fail (BOLT_IS_CLOCK (clock), FALSE);
+
+  return clock->virtual;
+}
+
+gint64
+bolt_clock_get_time (BoltClock *clock)
+{
+  g_return_val_if_fail (BOLT_IS_CLOCK (clock), 0);
+
+  if (clock->virtual)
+    return clock->now;
+
+  return g_get_monotonic_time ();
+}
+
+guint
+bolt_clock_timeout_add (BoltClock  *clock,
+                        guint       interval,
+                        GSourceFunc func,
+                        gpointer    user_data,
+                        const char *name)
+{
+  guint id;
+
+  g_return_val_if_fail (BOLT_IS_CLOCK (clock), 0);
+  g_return_val_if_fail (func != NULL, 0);
+
+  if (clock->virtual)
+    return bolt_clock_timer_add (clock, interval * G_GINT64_CONSTANT (1000),
+                                 func, user_data, name);
+
+  id = g_timeout_add (interval, func, user_data);
+
+  if (name != NULL)
+    g_source_set_name_by_id (id, name);
+
+  return id;
+}
+
+guint
+bolt_clock_timeout_add_seconds (BoltClock  *clock,
+                                guint       interval,
+                                GSourceFunc func,
+                                gpointer    user_data,
+                                const char *name)
+{
+  guint id;
+
+  g_return_val_if_fail (BOLT_IS_CLOCK (clock), 0);
+  g_return_val_if_fail (func != NULL, 0);
+
+  if (clock->virtual)
+    return bolt_clock_timer_add (clock, interval * G_USEC_PER_SEC,
+                                 func, user_data, name);
+
+  id = g_timeout_add_seconds (interval, func, user_data);
+
+  if (name != NULL)
+    g_source_set_name_by_id (id, name);
+
+  return id;
+}
+
+void
+bolt_clock_source_remove (BoltClock *clock,
+                          guint      id)
+{
+  g_return_if_fail (BOLT_IS_CLOCK (clock));
+  g_return_if_fail (id > 0);
+
+  if (clock->virtual)
+    g_hash_table_remove (clock->timers, GUINT_TO_POINTER (id));
+  else
+    g_source_remove (id);
+}
+
+guint
+bolt_clock_advance (BoltClock *clock,
+                    gint64     usec)
+{
+  BoltTimer *timer;
+  gint64 target;
+  guint n = 0;
+
+  g_return_val_if_fail (BOLT_IS_CLOCK (clock), 0);
+  g_return_val_if_fail (clock->virtual, 0);
+  g_return_val_if_fail (usec >= 0, 0);
+
+  target = clock->now + usec;
+
+  /* the time is moved to every due timer before it is
+   * dispatched, so the callback sees its own deadline */
+  while ((timer = bolt_clock_timer_next (clock, target)) != NULL)
+    {
+      guint id = timer->id;
+      gboolean keep;
+
+      clock->now = timer->due;
+
+      keep = timer->func (timer->user_data);
+      n++;
+
+      /* the callback might have removed the timer */
+      timer = g_hash_table_lookup (clock->timers, GUINT_TO_POINTER (id));
+
+      if (timer == NULL)
+        continue;
+
+      if (keep == G_SOURCE_CONTINUE)
+        timer->due += MAX (timer->interval, 1);
+      else
+        g_hash_table_remove (clock->timers, GUINT_TO_POINTER (id));
+    }
+
+  clock->now = target;
+
+  return n;
+}
+
+guint
+bolt_clock_pending (BoltClock *clock)
+{
+  g_return_val_if_fail (BOLT_IS_CLOCK (clock), 0);
+
+  return g_hash_table_size (clock->timers);
+}
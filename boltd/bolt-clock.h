@@ -0,0 +1,66 @@
+/*
+ * Copyright © 2018 Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *       Christian J. Kellner <christian@kellner.me>
+ */
+
+#pragma once
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/* Monotonic time and timers. The default clock uses the
+ * real monotonic clock and main loop timeouts; a virtual
+ * clock only moves forward via bolt_clock_advance, which
+ * also dispatches the timers that became due, so tests do
+ * not have to sleep. Times are in µs, like
+ * g_get_monotonic_time, intervals in ms. */
+
+#define BOLT_TYPE_CLOCK bolt_clock_get_type ()
+G_DECLARE_FINAL_TYPE (BoltClock, bolt_clock, BOLT, CLOCK, GObject);
+
+BoltClock *     bolt_clock_new (void);
+
+BoltClock *     bolt_clock_new_virtual (void);
+
+gboolean        bolt_clock_is_virtual (BoltClock *clock);
+
+gint64          bolt_clock_get_time (BoltClock *clock);
+
+guint           bolt_clock_timeout_add (BoltClock  *clock,
+                                        guint       interval,
+                                        GSourceFunc func,
+                                        gpointer    user_data,
+                                        const char *name);
+
+guint           bolt_clock_timeout_add_seconds (BoltClock  *clock,
+                                                guint       interval,
+                                                GSourceFunc func,
+                                                gpointer    user_data,
+                                                const char *name);
+
+void            bolt_clock_source_remove (BoltClock *clock,
+                                          guint      id);
+
+/* virtual clock only */
+guint           bolt_clock_advance (BoltClock *clock,
+                                    gint64     usec);
+
+guint           bolt_clock_pending (BoltClock *clock);
+
+G_END_DECLS
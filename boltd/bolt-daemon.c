@@ -20,28 +20,47 @@
 
 #include "config.h"
 
+#include "bolt-fs.h"
+#include "bolt-io.h"
 #include "bolt-log.h"
 #include "bolt-manager.h"
 #include "bolt-names.h"
+#include "bolt-peer.h"
+#include "bolt-record.h"
 #include "bolt-str.h"
 #include "bolt-term.h"
+#include "bolt-trace.h"
+#include "bolt-watchdog.h"
 
 #include "bolt-daemon-resource.h"
 
 #include <gio/gio.h>
+#include <glib-unix.h>
 
+#include <errno.h>
 #include <locale.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#define LOG_ASYNC_CAPACITY 256
+#define FLIGHT_RECORDER_FILE "flight-recorder"
+
 /* globals */
 static BoltManager *manager = NULL;
 static GMainLoop *main_loop = NULL;
 static guint name_owner_id = 0;
+static gint metrics_interval = 0;
+static gint idle_exit = 0;
+static gboolean peer_socket = FALSE;
+static char *peer_group = NULL;
 
 typedef struct _LogCfg
 {
   gboolean debug;
+  gboolean async;
+  char    *topics;
+  GStrv    domains; /* from G_MESSAGES_DEBUG, unless "all" */
   char     session_id[33];
 } LogCfg;
 
@@ -58,6 +77,11 @@ daemon_logger (GLogLevelFlags   level,
   g_return_val_if_fail (fields != NULL, G_LOG_WRITER_UNHANDLED);
   g_return_val_if_fail (n_fields > 0, G_LOG_WRITER_UNHANDLED);
 
+  /* the same mask as for our own messages, before
+   * any of the fields are looked at */
+  if (!bolt_log_level_enabled (level))
+    return G_LOG_WRITER_UNHANDLED;
+
   ctx = bolt_log_ctx_acquire (fields, n_fields);
 
   if (ctx == NULL)
@@ -66,18 +90,23 @@ daemon_logger (GLogLevelFlags   level,
   /* replace the log context field with the session id */
   bolt_log_ctx_set_id (ctx, log->session_id);
 
-  if (level & G_LOG_LEVEL_DEBUG && log->debug == FALSE)
+  /* debug is enabled, but maybe only for some domains */
+  if (level & G_LOG_LEVEL_DEBUG && log->domains != NULL)
     {
       const char *domain = blot_log_ctx_get_domain (ctx);
-      const char *env = g_getenv ("G_MESSAGES_DEBUG");
 
-      if (!env || !domain || !strstr (env, domain))
+      if (!domain || !g_strv_contains ((const char * const *) log->domains, domain))
         return G_LOG_WRITER_UNHANDLED;
     }
 
   if (fileno (stderr) < 0)
     return G_LOG_WRITER_UNHANDLED;
 
+  /* hand the record over to the writer thread, if active */
+  res = bolt_log_async_push (ctx, level);
+  if (res == G_LOG_WRITER_HANDLED)
+    return res;
+
   if (g_log_writer_is_journald (fileno (stderr)))
     res = bolt_log_journal (ctx, level, 0);
 
@@ -87,6 +116,55 @@ daemon_logger (GLogLevelFlags   level,
   return res;
 }
 
+static gboolean
+on_sigusr1 (gpointer user_data)
+{
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GVariant) events = NULL;
+  g_autofree char *path = NULL;
+  g_auto(BoltWatchdogScope) scope = BOLT_WATCHDOG_SCOPE_INIT;
+  const char *rundir;
+  gboolean ok;
+
+  bolt_watchdog_scope_enter (&scope, G_STRFUNC);
+
+  rundir = bolt_get_rundir ();
+  path = g_build_filename (rundir, FLIGHT_RECORDER_FILE, NULL);
+
+  events = g_variant_ref_sink (bolt_log_flight_dump ());
+
+  if (g_mkdir_with_parents (rundir, 0755) != 0)
+    bolt_warn (LOG_TOPIC ("log"), "could not create %s: %s",
+               rundir, g_strerror (errno));
+
+  ok = bolt_file_write_all (path,
+                            g_variant_get_data (events),
+                            g_variant_get_size (events),
+                            &error);
+
+  if (!ok)
+    bolt_warn_err (error, LOG_TOPIC ("log"), "could not dump flight recorder");
+  else
+    bolt_msg (LOG_TOPIC ("log"), "flight recorder dumped to %s", path);
+
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+on_manager_idle (BoltManager *mgr,
+                 gpointer     user_data)
+{
+  g_autoptr(GError) error = NULL;
+
+  if (!bolt_manager_save_snapshot (mgr, &error))
+    bolt_warn_err (error, LOG_TOPIC ("manager"), "could not save state");
+
+  bolt_msg (LOG_TOPIC ("manager"), "idle; shutting down...");
+
+  g_bus_unown_name (name_owner_id);
+  g_main_loop_quit (main_loop);
+}
+
 static void
 on_bus_acquired (GDBusConnection *connection,
                  const gchar     *name,
@@ -109,6 +187,28 @@ on_bus_acquired (GDBusConnection *connection,
   if (!bolt_manager_export (manager, connection, &error))
     bolt_warn_err (error, LOG_TOPIC ("dbus"), "error exporting the manager");
 
+  if (metrics_interval > 0)
+    bolt_manager_enable_metrics (manager, (guint) metrics_interval);
+
+  if (idle_exit > 0)
+    {
+      g_signal_connect (manager, "idle",
+                        G_CALLBACK (on_manager_idle),
+                        NULL);
+
+      bolt_manager_enable_idle_exit (manager, (guint) idle_exit);
+    }
+
+  if (peer_socket)
+    {
+      g_autoptr(GError) err = NULL;
+      g_autofree char *path = NULL;
+
+      path = g_build_filename (bolt_get_rundir (), BOLT_PEER_SOCKET_NAME, NULL);
+
+      if (!bolt_peer_server_start (path, peer_group, &err))
+        bolt_warn_err (err, LOG_TOPIC ("peer"), "could not start peer server");
+    }
 }
 
 static void
@@ -140,13 +240,31 @@ main (int argc, char **argv)
   gboolean replace = FALSE;
   gboolean show_version = FALSE;
   gboolean session_bus = FALSE;
+  gboolean debug = FALSE;
+  g_autofree char *trace = NULL;
+  g_autofree char *record = NULL;
+  guint sigusr1_id;
   GBusType bus_type = G_BUS_TYPE_SYSTEM;
   GBusNameOwnerFlags flags;
   LogCfg log = { FALSE, };
+  gint rate_burst = BOLT_LOG_RATELIMIT_BURST;
+  gint rate_interval = BOLT_LOG_RATELIMIT_INTERVAL;
+  gint stall_threshold = BOLT_WATCHDOG_THRESHOLD;
   const GOptionEntry options[] = {
     { "replace", 'r', 0, G_OPTION_ARG_NONE, &replace,  "Replace old daemon.", NULL },
     { "session-bus", 0, 0, G_OPTION_ARG_NONE, &session_bus, "Use the session bus.", NULL},
     { "verbose", 'v', 0, G_OPTION_ARG_NONE, &log.debug,  "Enable debug output.", NULL },
+    { "debug-topics", 0, 0, G_OPTION_ARG_STRING, &log.topics, "Limit debug output to the given topics.", "TOPIC,..." },
+    { "async-log", 0, 0, G_OPTION_ARG_NONE, &log.async, "Write log messages from a separate thread.", NULL },
+    { "log-rate-burst", 0, 0, G_OPTION_ARG_INT, &rate_burst, "Messages per call site and device before rate limiting (0 disables).", "N" },
+    { "log-rate-interval", 0, 0, G_OPTION_ARG_INT, &rate_interval, "Interval in which the burst is replenished.", "SECONDS" },
+    { "trace", 0, 0, G_OPTION_ARG_FILENAME, &trace, "Record a performance trace to FILE.", "FILE" },
+    { "record-uevents", 0, 0, G_OPTION_ARG_FILENAME, &record, "Record received uevents to FILE.", "FILE" },
+    { "stall-threshold", 0, 0, G_OPTION_ARG_INT, &stall_threshold, "Report main loop iterations longer than MS (0 disables).", "MS" },
+    { "metrics-interval", 0, 0, G_OPTION_ARG_INT, &metrics_interval, "Write changed metrics at most every SECONDS (0 disables).", "SECONDS" },
+    { "idle-exit", 0, 0, G_OPTION_ARG_INT, &idle_exit, "Exit after SECONDS without devices or clients (0 disables).", "SECONDS" },
+    { "peer-socket", 0, 0, G_OPTION_ARG_NONE, &peer_socket, "Accept direct connections on a unix socket.", NULL },
+    { "peer-group", 0, 0, G_OPTION_ARG_STRING, &peer_group, "Allow members of GROUP to use the socket.", "GROUP" },
     { "version", 0, 0, G_OPTION_ARG_NONE, &show_version, "Print daemon version.", NULL},
     { NULL }
   };
@@ -184,6 +302,45 @@ main (int argc, char **argv)
     {
       const char *domains = g_getenv ("G_MESSAGES_DEBUG");
       log.debug = bolt_streq (domains, "all");
+
+      /* split once, instead of searching it per message; the
+       * debug level must be on for the other domains too */
+      if (!log.debug)
+        log.domains = g_strsplit_set (domains, ", ", -1);
+
+      debug = *domains != '\0';
+    }
+
+  /* disabled debug messages will now not even be formatted */
+  bolt_log_set_debug (log.debug || debug);
+  bolt_log_set_debug_topics (log.topics);
+  bolt_log_set_rate_limit (MAX (rate_burst, 0), MAX (rate_interval, 1));
+
+  if (log.async && !bolt_log_async_start (LOG_ASYNC_CAPACITY, NULL, NULL, &error))
+    {
+      g_printerr ("%s: could not start log writer: %s\n",
+                  g_get_application_name (), error->message);
+      g_clear_error (&error);
+    }
+
+  if (trace && !bolt_trace_start (trace, &error))
+    {
+      g_printerr ("%s: %s\n", g_get_application_name (), error->message);
+      g_clear_error (&error);
+    }
+
+  if (record && !bolt_record_start (record, &error))
+    {
+      g_printerr ("%s: %s\n", g_get_application_name (), error->message);
+      g_clear_error (&error);
+    }
+
+  /* after the tracer, so its poll function is chained */
+  if (stall_threshold > 0 && !bolt_watchdog_start ((guint) stall_threshold, &error))
+    {
+      g_printerr ("%s: could not start watchdog: %s\n",
+                  g_get_application_name (), error->message);
+      g_clear_error (&error);
     }
 
   bolt_log_gen_id (log.session_id);
@@ -196,6 +353,10 @@ main (int argc, char **argv)
 
   bolt_debug ("session id is %s", log.session_id);
 
+  /* dump the flight recorder on demand */
+  sigusr1_id = g_unix_signal_add (SIGUSR1, on_sigusr1, NULL);
+  g_source_set_name_by_id (sigusr1_id, "[boltd] sigusr1");
+
   /* hop on the bus, Gus */
   flags = G_BUS_NAME_OWNER_FLAGS_ALLOW_REPLACEMENT;
   if (replace)
@@ -216,6 +377,19 @@ main (int argc, char **argv)
   main_loop = g_main_loop_new (NULL, FALSE);
   g_main_loop_run (main_loop);
 
+  if (bolt_log_async_is_active ())
+    bolt_msg (LOG_TOPIC ("log"), "log writer dropped %u messages",
+              bolt_log_async_get_dropped ());
+
+  bolt_peer_server_stop ();
+  bolt_watchdog_stop ();
+  bolt_trace_stop ();
+  bolt_record_stop ();
+  bolt_log_async_stop ();
+  g_free (log.topics);
+  g_strfreev (log.domains);
+  g_free (peer_group);
+
   /* When all is said and done, more is said then done.  */
   g_main_loop_unref (main_loop);
 
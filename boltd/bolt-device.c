@@ -29,10 +29,13 @@
 #include "bolt-log.h"
 #include "bolt-manager.h"
 #include "bolt-names.h"
+#include "bolt-probes.h"
+#include "bolt-stats.h"
 #include "bolt-store.h"
 #include "bolt-str.h"
 #include "bolt-sysfs.h"
 #include "bolt-time.h"
+#include "bolt-trace.h"
 
 #include <dirent.h>
 #include <libudev.h>
@@ -543,6 +546,8 @@ device_set_status_internal (BoltDevice *dev,
 
   dev->status = status;
 
+  bolt_stats_status_changed ();
+
   g_signal_emit (dev, signals[SIGNAL_STATUS_CHANGED], 0, before);
 
   if (notify)
@@ -552,11 +557,11 @@ device_set_status_internal (BoltDevice *dev,
 static const char *
 read_sysattr_name (struct udev_device *udev, const char *attr, GError **error)
 {
-  g_autofree char *s = NULL;
+  char name[64];
   const char *v;
 
-  s = g_strdup_printf ("%s_name", attr);
-  v = udev_device_get_sysattr_value (udev, s);
+  g_snprintf (name, sizeof (name), "%s_name", attr);
+  v = udev_device_get_sysattr_value (udev, name);
 
   if (v != NULL)
     return v;
@@ -723,6 +728,9 @@ typedef struct
   GAsyncReadyCallback callback;
   gpointer            user_data;
 
+  /* for the statistics */
+  gint64              started;
+
 } AuthData;
 
 static void
@@ -740,6 +748,7 @@ authorize_device_internal (BoltDevice *dev,
                            GError    **error)
 {
   g_autoptr(DIR) devdir = NULL;
+  g_auto(BoltTraceSpan) span = BOLT_TRACE_SPAN_INIT;
   BoltKey *key;
   BoltSecurity level;
   gboolean ok;
@@ -760,6 +769,7 @@ authorize_device_internal (BoltDevice *dev,
       int keyfd;
 
       bolt_debug (LOG_DEV (dev), LOG_TOPIC ("authorize"), "writing key");
+      bolt_trace_span_start (&span, "sysfs", "write-key");
 
       keyfd = bolt_openat (dirfd (devdir),
                            "key",
@@ -771,6 +781,7 @@ authorize_device_internal (BoltDevice *dev,
 
       ok = bolt_key_write_to (key, keyfd, &level, error);
       close (keyfd);
+      bolt_trace_span_end (&span);
       if (!ok)
         return FALSE;
     }
@@ -778,10 +789,12 @@ authorize_device_internal (BoltDevice *dev,
   bolt_debug (LOG_DEV (dev), LOG_TOPIC ("authorize"),
               "writing authorization");
 
+  bolt_trace_span_start (&span, "sysfs", "write-authorized");
   ok = bolt_write_char_at (dirfd (devdir),
                            "authorized",
                            level,
                            error);
+  bolt_trace_span_end (&span);
 
   if (!ok)
     authorize_adjust_error (dev, devdir, error);
@@ -799,10 +812,16 @@ authorize_in_thread (GTask        *task,
   BoltDevice *dev = source;
   AuthData *auth_data = context;
   BoltAuth *auth = auth_data->auth;
+  g_auto(BoltTraceSpan) span = BOLT_TRACE_SPAN_ARG ("authorize", "authorize-thread",
+                                                    "uid", dev->uid);
   gboolean ok;
 
+  BOLT_PROBE2 (authorize_start, dev->uid, (int) bolt_auth_get_level (auth));
+
   ok = authorize_device_internal (dev, auth, &error);
 
+  BOLT_PROBE2 (authorize_end, dev->uid, ok);
+
   if (!ok)
     g_task_return_error (task, error);
   else
@@ -831,6 +850,11 @@ authorize_thread_done (GObject      *object,
 
   ok = g_task_propagate_boolean (task, &error);
 
+  bolt_stats_observe (BOLT_STATS_AUTHORIZE,
+                      g_get_monotonic_time () - auth_data->started);
+  bolt_stats_authorize (bolt_auth_get_level (auth),
+                        ok ? BOLT_STATS_AUTH_SUCCEEDED : BOLT_STATS_AUTH_FAILED);
+
   if (!ok)
     bolt_auth_return_error (auth, &error);
 
@@ -897,11 +921,13 @@ authorize_prepare (BoltDevice         *dev,
   auth_data->callback = callback;
   auth_data->user_data = user_data;
   auth_data->auth = g_object_ref (auth);
+  auth_data->started = g_get_monotonic_time ();
   g_task_set_task_data (task, auth_data, auth_data_free);
 
   g_object_set (dev, "status", BOLT_STATUS_AUTHORIZING, NULL);
 
   lvl = bolt_auth_get_level (auth);
+  bolt_stats_authorize (lvl, BOLT_STATS_AUTH_ATTEMPTED);
   bolt_info (LOG_DEV (dev), LOG_TOPIC ("authorize"),
              "authorization prepared for '%s' level",
              bolt_security_to_string (lvl));
@@ -1068,6 +1094,81 @@ handle_authorize (BoltExported          *object,
   return NULL;
 }
 
+static BoltDevice *
+device_new_from_info (const char  *uid,
+                      const char  *name,
+                      const char  *vendor,
+                      BoltDevInfo *info,
+                      BoltDomain  *domain)
+{
+  BoltStatus status;
+  BoltAuthFlags aflags;
+  BoltDeviceType type;
+  BoltDevice *dev;
+  guint64 ct, at;
+
+  if (info->parent == NULL)
+    type = BOLT_DEVICE_HOST;
+  else
+    type = BOLT_DEVICE_PERIPHERAL;
+
+  ct = (guint64) info->ctim;
+
+  status = bolt_status_from_info (info);
+  aflags = bolt_auth_flags_from_info (info, domain, NULL);
+  at = bolt_status_is_authorized (status) ? ct : 0;
+
+  dev = g_object_new (BOLT_TYPE_DEVICE,
+                      "uid", uid,
+                      "name", name,
+                      "vendor", vendor,
+                      "type", type,
+                      "status", status,
+                      "authflags", aflags,
+                      "sysfs-path", info->syspath,
+                      "domain", domain,
+                      "parent", info->parent,
+                      "conntime", ct,
+                      "authtime", at,
+                      NULL);
+
+  return dev;
+}
+
+static BoltStatus
+device_connected_from_info (BoltDevice  *dev,
+                            BoltDomain  *domain,
+                            BoltDevInfo *info)
+{
+  BoltAuthFlags aflags;
+  BoltStatus status;
+  guint64 ct, at;
+
+  status = bolt_status_from_info (info);
+  aflags = bolt_auth_flags_from_info (info, domain, NULL);
+
+  ct = (guint64) info->ctim;
+  at = bolt_status_is_authorized (status) ? ct : 0;
+
+  g_object_set (G_OBJECT (dev),
+                "parent", info->parent,
+                "sysfs-path", info->syspath,
+                "domain", domain,
+                "status", status,
+                "authflags", aflags,
+                "conntime", ct,
+                "authtime", at,
+                NULL);
+
+  bolt_info (LOG_DEV (dev), "parent is %.13s...", dev->parent);
+
+  bolt_store_put_times (dev->store, dev->uid, NULL,
+                        "conntime", ct,
+                        "authtime", at,
+                        NULL);
+  return status;
+}
+
 /* public methods */
 
 BoltDevice *
@@ -1079,12 +1180,7 @@ bolt_device_new_for_udev (struct udev_device *udev,
   const char *uid;
   const char *name;
   const char *vendor;
-  BoltStatus status;
-  BoltAuthFlags aflags;
-  BoltDeviceType type;
-  BoltDevice *dev;
   gboolean ok;
-  guint64 ct, at;
 
   g_return_val_if_fail (udev != NULL, NULL);
   g_return_val_if_fail (domain != NULL, NULL);
@@ -1109,32 +1205,44 @@ bolt_device_new_for_udev (struct udev_device *udev,
   if (!ok)
     return NULL;
 
-  if (info.parent == NULL)
-    type = BOLT_DEVICE_HOST;
-  else
-    type = BOLT_DEVICE_PERIPHERAL;
+  return device_new_from_info (uid, name, vendor, &info, domain);
+}
 
-  ct = (guint64) info.ctim;
+BoltDevice *
+bolt_device_new_for_scan (const BoltScanEntry *entry,
+                          BoltDomain          *domain,
+                          GError             **error)
+{
+  BoltDevInfo info;
+  gboolean ok;
 
-  status = bolt_status_from_info (&info);
-  aflags = bolt_auth_flags_from_info (&info, domain, NULL);
-  at = bolt_status_is_authorized (status) ? ct : 0;
+  g_return_val_if_fail (entry != NULL, NULL);
+  g_return_val_if_fail (domain != NULL, NULL);
 
-  dev = g_object_new (BOLT_TYPE_DEVICE,
-                      "uid", uid,
-                      "name", name,
-                      "vendor", vendor,
-                      "type", type,
-                      "status", status,
-                      "authflags", aflags,
-                      "sysfs-path", info.syspath,
-                      "domain", domain,
-                      "parent", info.parent,
-                      "conntime", ct,
-                      "authtime", at,
-                      NULL);
+  if (entry->uid == NULL)
+    {
+      g_set_error (error, BOLT_ERROR, BOLT_ERROR_UDEV,
+                   "could not get unique_id for %s", entry->syspath);
+      return NULL;
+    }
 
-  return dev;
+  if (entry->name == NULL || entry->vendor == NULL)
+    {
+      g_set_error (error, BOLT_ERROR, BOLT_ERROR_UDEV,
+                   "failed to get sysfs attr: %s",
+                   entry->name == NULL ? "device" : "vendor");
+      return NULL;
+    }
+
+  ok = bolt_sysfs_info_for_entry (entry, &info, error);
+  if (!ok)
+    return NULL;
+
+  return device_new_from_info (entry->uid,
+                               entry->name,
+                               entry->vendor,
+                               &info,
+                               domain);
 }
 
 const char *
@@ -1183,13 +1291,15 @@ bolt_device_authorize_idle (BoltDevice         *dev,
                             gpointer            user_data)
 {
   GTask *task = NULL;
+  guint id;
 
   task = authorize_prepare (dev, auth, callback, user_data);
 
   if (task == NULL)
     return;
 
-  g_idle_add (authorize_device_idle, task);
+  id = g_idle_add (authorize_device_idle, task);
+  g_source_set_name_by_id (id, "[boltd] authorize");
 }
 
 BoltStatus
@@ -1198,11 +1308,8 @@ bolt_device_connected (BoltDevice         *dev,
                        struct udev_device *udev)
 {
   g_autoptr(GError) err = NULL;
-  BoltAuthFlags aflags;
   BoltDevInfo info;
-  BoltStatus status;
   gboolean ok;
-  guint64 ct, at;
 
   g_return_val_if_fail (dev != NULL, BOLT_STATUS_UNKNOWN);
   g_return_val_if_fail (domain != NULL, BOLT_STATUS_UNKNOWN);
@@ -1212,29 +1319,28 @@ bolt_device_connected (BoltDevice         *dev,
     bolt_warn_err (err, LOG_DEV (dev), LOG_TOPIC ("udev"),
                    "failed to get device info");
 
-  status = bolt_status_from_info (&info);
-  aflags = bolt_auth_flags_from_info (&info, domain, NULL);
+  return device_connected_from_info (dev, domain, &info);
+}
 
-  ct = (guint64) info.ctim;
-  at = bolt_status_is_authorized (status) ? ct : 0;
+BoltStatus
+bolt_device_connected_for_scan (BoltDevice          *dev,
+                                BoltDomain          *domain,
+                                const BoltScanEntry *entry)
+{
+  g_autoptr(GError) err = NULL;
+  BoltDevInfo info;
+  gboolean ok;
 
-  g_object_set (G_OBJECT (dev),
-                "parent", info.parent,
-                "sysfs-path", info.syspath,
-                "domain", domain,
-                "status", status,
-                "authflags", aflags,
-                "conntime", ct,
-                "authtime", at,
-                NULL);
+  g_return_val_if_fail (dev != NULL, BOLT_STATUS_UNKNOWN);
+  g_return_val_if_fail (domain != NULL, BOLT_STATUS_UNKNOWN);
+  g_return_val_if_fail (entry != NULL, BOLT_STATUS_UNKNOWN);
 
-  bolt_info (LOG_DEV (dev), "parent is %.13s...", dev->parent);
+  ok = bolt_sysfs_info_for_entry (entry, &info, &err);
+  if (!ok)
+    bolt_warn_err (err, LOG_DEV (dev), LOG_TOPIC ("udev"),
+                   "failed to get device info");
 
-  bolt_store_put_times (dev->store, dev->uid, NULL,
-                        "conntime", ct,
-                        "authtime", at,
-                        NULL);
-  return status;
+  return device_connected_from_info (dev, domain, &info);
 }
 
 BoltStatus
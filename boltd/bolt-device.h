@@ -27,6 +27,7 @@
 /* forward declaration */
 struct udev_device;
 typedef struct _BoltDomain BoltDomain;
+typedef struct _BoltScanEntry BoltScanEntry;
 
 G_BEGIN_DECLS
 
@@ -37,6 +38,10 @@ BoltDevice *      bolt_device_new_for_udev (struct udev_device *udev,
                                             BoltDomain         *domain,
                                             GError            **error);
 
+BoltDevice *      bolt_device_new_for_scan (const BoltScanEntry *entry,
+                                            BoltDomain          *domain,
+                                            GError             **error);
+
 const char *      bolt_device_export (BoltDevice      *device,
                                       GDBusConnection *connection,
                                       GError         **error);
@@ -47,6 +52,10 @@ BoltStatus        bolt_device_connected (BoltDevice         *dev,
                                          BoltDomain         *domain,
                                          struct udev_device *udev);
 
+BoltStatus        bolt_device_connected_for_scan (BoltDevice          *dev,
+                                                  BoltDomain          *domain,
+                                                  const BoltScanEntry *entry);
+
 BoltStatus        bolt_device_disconnected (BoltDevice *dev);
 
 gboolean          bolt_device_is_connected (const BoltDevice *device);
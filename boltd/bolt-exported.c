@@ -23,13 +23,15 @@
 #include "bolt-enums.h"
 #include "bolt-error.h"
 #include "bolt-log.h"
+#include "bolt-names.h"
+#include "bolt-probes.h"
+#include "bolt-stats.h"
 #include "bolt-str.h"
+#include "bolt-trace.h"
+#include "bolt-watchdog.h"
 
 #include "bolt-exported.h"
 
-/* Each element must only contain the ASCII characters "[A-Z][a-z][0-9]_" */
-#define DBUS_OPATH_VALID_CHARS "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789_"
-
 typedef struct _BoltExportedMethod BoltExportedMethod;
 typedef struct _BoltExportedProp   BoltExportedProp;
 
@@ -38,6 +40,19 @@ static GVariant * bolt_exported_get_prop (BoltExported     *exported,
 
 static char *     bolt_exported_make_object_path (BoltExported *exported);
 
+static guint      bolt_exported_register (BoltExported    *exported,
+                                          GDBusConnection *connection,
+                                          GError         **error);
+
+static void       bolt_exported_client_seen (GDBusConnection *connection,
+                                             const char      *sender);
+
+static gboolean   bolt_exported_emit (BoltExported *exported,
+                                      const char   *iface_name,
+                                      const char   *name,
+                                      GVariant     *parameters,
+                                      GError      **error);
+
 static void       bolt_exported_dispatch_properties_changed (GObject     *object,
                                                              guint        n_pspecs,
                                                              GParamSpec **pspecs);
@@ -107,6 +122,9 @@ typedef struct _BoltExportedPrivate
   /* if exported */
   guint registration;
 
+  /* direct peer connections, GDBusConnection -> registration */
+  GHashTable *peers;
+
   /* property changes */
   GPtrArray *props_changed;
   guint      props_changed_id;
@@ -116,6 +134,15 @@ typedef struct _BoltExportedPrivate
 static gpointer bolt_exported_parent_class = NULL;
 static gint BoltExported_private_offset = 0;
 
+/* all peer connections and all exported objects, so that
+ * objects can be registered on peers that connect later */
+static GPtrArray  *exported_peers = NULL;
+static GHashTable *exported_objects = NULL;
+
+/* bus clients that called a method or read a property,
+ * unique name -> name watch id, until they disconnect */
+static GHashTable *exported_clients = NULL;
+
 static void     bolt_exported_init (GTypeInstance *,
                                     gpointer g_class);
 static void     bolt_exported_class_init (BoltExportedClass *klass);
@@ -193,6 +220,7 @@ bolt_exported_finalize (GObject *object)
 
   g_clear_pointer (&priv->object_path, g_free);
   g_ptr_array_free (priv->props_changed, TRUE);
+  g_hash_table_unref (priv->peers);
 
   G_OBJECT_CLASS (bolt_exported_parent_class)->finalize (object);
 }
@@ -233,6 +261,7 @@ bolt_exported_init (GTypeInstance *instance, gpointer g_class)
   BoltExportedPrivate *priv = GET_PRIV (exported);
 
   priv->props_changed = g_ptr_array_new ();
+  priv->peers = g_hash_table_new (g_direct_hash, g_direct_equal);
 }
 
 static void
@@ -427,7 +456,7 @@ bolt_exported_make_object_path (BoltExported *exported)
   g_object_get (exported, "object-id", &id, NULL);
 
   if (id)
-    g_strcanon (id, DBUS_OPATH_VALID_CHARS, '_');
+    g_strcanon (id, BOLT_DBUS_OPATH_VALID_CHARS, '_');
 
   if (base && id)
     return g_build_path ("/", "/", base, id, NULL);
@@ -448,6 +477,8 @@ typedef struct _DispatchData
 
   gboolean               is_property;
 
+  gint64                 started;
+
   union
   {
     BoltExportedMethod *method;
@@ -510,9 +541,12 @@ dispatch_method_call (BoltExported          *exported,
                       BoltExportedMethod    *method,
                       GError               **error)
 {
+  g_auto(BoltWatchdogScope) scope = BOLT_WATCHDOG_SCOPE_INIT;
   GVariant *params = g_dbus_method_invocation_get_parameters (inv);
   GVariant *res;
 
+  bolt_watchdog_scope_enter (&scope, method->name);
+
   res = method->handler (exported, params, inv, error);
 
   return res;
@@ -525,13 +559,18 @@ query_authorization_done (GObject      *source_object,
 {
   g_autoptr(GError) err = NULL;
   g_autoptr(DispatchData) data = user_data;
+  g_auto(BoltTraceSpan) span = BOLT_TRACE_SPAN_INIT;
   GDBusMethodInvocation *inv = data->inv;
   BoltExported *exported = BOLT_EXPORTED (source_object);
+  const char *method_name;
   GVariant *ret;
   gboolean ok;
 
   ok = g_task_propagate_boolean (G_TASK (res), &err);
 
+  method_name = g_dbus_method_invocation_get_method_name (inv);
+  BOLT_PROBE2 (query_authorization_done, method_name, ok);
+
   bolt_debug (LOG_TOPIC ("dbus"), "authorization done: %s", bolt_yesno (ok));
 
   if (!ok && err == NULL)
@@ -543,15 +582,33 @@ query_authorization_done (GObject      *source_object,
 
   if (!ok)
     {
+      BOLT_PROBE2 (method_exit, method_name, FALSE);
+      bolt_stats_observe (BOLT_STATS_METHOD_CALL,
+                          g_get_monotonic_time () - data->started);
       g_dbus_method_invocation_return_gerror (inv, err);
       return;
     }
 
+  bolt_trace_span_start (&span, "dbus", "method-call");
+
+  if (data->is_property)
+    bolt_trace_span_set_arg (&span, "property", data->prop->name_bus);
+  else
+    bolt_trace_span_set_arg (&span, "method", data->method->name);
+
   if (data->is_property)
     ret = dispach_property_setter (exported, inv, data->prop, &err);
   else
     ret = dispatch_method_call (exported, inv, data->method, &err);
 
+  bolt_trace_span_end (&span);
+
+  /* the invocation is gone once the result is returned */
+  BOLT_PROBE2 (method_exit, data->is_property ? data->prop->name_bus : data->method->name,
+               ret != NULL || err == NULL);
+  bolt_stats_observe (BOLT_STATS_METHOD_CALL,
+                      g_get_monotonic_time () - data->started);
+
   if (ret == NULL && err != NULL)
     g_dbus_method_invocation_return_gerror (inv, err);
   else if (ret != NULL)
@@ -568,6 +625,7 @@ query_authorization (GTask        *task,
   GError *error = NULL;
   BoltExported *exported = source_object;
   DispatchData *data = task_data;
+  g_auto(BoltTraceSpan) span = BOLT_TRACE_SPAN ("dbus", "query-authorization");
   gboolean authorized = FALSE;
 
   if (data->is_property)
@@ -655,12 +713,17 @@ handle_dbus_method_call (GDBusConnection       *connection,
   bolt_debug (LOG_TOPIC ("dbus"), "method call: %s.%s at %s from %s",
               interface_name, method_name, object_path, sender);
 
+  bolt_exported_client_seen (connection, sender);
+
+  BOLT_PROBE2 (method_entry, interface_name, method_name);
+
   /* we also handle property setting here */
   is_property = bolt_streq (interface_name, "org.freedesktop.DBus.Properties");
 
   data = g_slice_new0 (DispatchData);
   data->inv = invocation;
   data->is_property = is_property;
+  data->started = g_get_monotonic_time ();
 
   if (is_property)
     {
@@ -695,6 +758,7 @@ handle_dbus_method_call (GDBusConnection       *connection,
   if (err != NULL)
     {
       //bolt_warn_err (err, LOG_TOPIC ("dbus"), "error dispatching call");
+      BOLT_PROBE2 (method_exit, method_name, FALSE);
       g_dbus_method_invocation_return_gerror (invocation, err);
       return;
     }
@@ -726,6 +790,8 @@ handle_dbus_get_property (GDBusConnection *connection,
   bolt_debug (LOG_TOPIC ("dbus"), "get property: %s.%s at %s from %s",
               interface_name, property_name, object_path, sender);
 
+  bolt_exported_client_seen (connection, sender);
+
   prop = bolt_exported_lookup_property (exported, property_name, &err);
   if (prop == NULL)
     {
@@ -748,6 +814,7 @@ bolt_exported_dispatch_properties_changed (GObject     *object,
   g_autoptr(GError) err = NULL;
   g_auto(GVariantBuilder) changed;
   g_auto(GVariantBuilder) invalidated;
+  g_auto(BoltTraceSpan) span = BOLT_TRACE_SPAN_INIT;
   const char *iface_name;
   BoltExported *exported;
   BoltExportedPrivate *priv;
@@ -796,13 +863,16 @@ bolt_exported_dispatch_properties_changed (GObject     *object,
                                                &changed,
                                                &invalidated));
 
-  ok = g_dbus_connection_emit_signal (priv->dbus,
-                                      NULL,
-                                      priv->object_path,
-                                      "org.freedesktop.DBus.Properties",
-                                      "PropertiesChanged",
-                                      changes,
-                                      &err);
+  bolt_trace_span_start (&span, "dbus", "properties-changed");
+  bolt_trace_span_set_arg (&span, "path", priv->object_path);
+
+  ok = bolt_exported_emit (exported,
+                           "org.freedesktop.DBus.Properties",
+                           "PropertiesChanged",
+                           changes,
+                           &err);
+
+  bolt_trace_span_end (&span);
 
   if (!ok)
     bolt_warn_err (err, LOG_TOPIC ("dbus"),
@@ -1095,6 +1165,24 @@ bolt_exported_export (BoltExported    *exported,
   priv->object_path = g_strdup (object_path);
   priv->registration = id;
 
+  if (exported_objects == NULL)
+    exported_objects = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  g_hash_table_add (exported_objects, exported);
+
+  for (guint i = 0; exported_peers && i < exported_peers->len; i++)
+    {
+      GDBusConnection *peer = g_ptr_array_index (exported_peers, i);
+      g_autoptr(GError) err = NULL;
+
+      id = bolt_exported_register (exported, peer, &err);
+
+      if (id == 0)
+        bolt_warn_err (err, LOG_TOPIC ("dbus"), "error registering on peer");
+      else
+        g_hash_table_insert (priv->peers, peer, GUINT_TO_POINTER (id));
+    }
+
   g_object_notify_by_pspec (G_OBJECT (exported), props[PROP_OBJECT_PATH]);
   g_object_notify_by_pspec (G_OBJECT (exported), props[PROP_EXPORTED]);
 
@@ -1119,6 +1207,18 @@ bolt_exported_unexport (BoltExported *exported)
 
   if (ok)
     {
+      GHashTableIter iter;
+      gpointer peer, id;
+
+      g_hash_table_iter_init (&iter, priv->peers);
+      while (g_hash_table_iter_next (&iter, &peer, &id))
+        g_dbus_connection_unregister_object (peer, GPOINTER_TO_UINT (id));
+
+      g_hash_table_remove_all (priv->peers);
+
+      if (exported_objects != NULL)
+        g_hash_table_remove (exported_objects, exported);
+
       g_clear_object (&priv->dbus);
       priv->registration = 0;
       opath = g_steal_pointer (&priv->object_path);
@@ -1188,13 +1288,7 @@ bolt_exported_emit_signal (BoltExported *exported,
 
   iface_name = bolt_exported_get_iface_name (exported);
 
-  ok = g_dbus_connection_emit_signal (priv->dbus,
-                                      NULL,
-                                      priv->object_path,
-                                      iface_name,
-                                      name,
-                                      parameters,
-                                      &err);
+  ok = bolt_exported_emit (exported, iface_name, name, parameters, &err);
 
   if (!ok)
     {
@@ -1210,6 +1304,187 @@ bolt_exported_emit_signal (BoltExported *exported,
   return ok;
 }
 
+void
+bolt_exported_peer_add (GDBusConnection *connection)
+{
+  GHashTableIter iter;
+  gpointer obj;
+
+  g_return_if_fail (G_IS_DBUS_CONNECTION (connection));
+
+  if (exported_peers == NULL)
+    exported_peers = g_ptr_array_new_with_free_func (g_object_unref);
+
+  g_ptr_array_add (exported_peers, g_object_ref (connection));
+
+  if (exported_objects == NULL)
+    return;
+
+  g_hash_table_iter_init (&iter, exported_objects);
+  while (g_hash_table_iter_next (&iter, &obj, NULL))
+    {
+      g_autoptr(GError) err = NULL;
+      BoltExported *exported = obj;
+      BoltExportedPrivate *priv = GET_PRIV (exported);
+      guint id;
+
+      id = bolt_exported_register (exported, connection, &err);
+
+      if (id == 0)
+        bolt_warn_err (err, LOG_TOPIC ("dbus"), "error registering on peer");
+      else
+        g_hash_table_insert (priv->peers, connection, GUINT_TO_POINTER (id));
+    }
+}
+
+void
+bolt_exported_peer_remove (GDBusConnection *connection)
+{
+  GHashTableIter iter;
+  gpointer obj;
+
+  g_return_if_fail (G_IS_DBUS_CONNECTION (connection));
+
+  if (exported_objects != NULL)
+    {
+      g_hash_table_iter_init (&iter, exported_objects);
+      while (g_hash_table_iter_next (&iter, &obj, NULL))
+        {
+          BoltExportedPrivate *priv = GET_PRIV (obj);
+          gpointer id;
+
+          if (!g_hash_table_lookup_extended (priv->peers, connection, NULL, &id))
+            continue;
+
+          g_dbus_connection_unregister_object (connection, GPOINTER_TO_UINT (id));
+          g_hash_table_remove (priv->peers, connection);
+        }
+    }
+
+  if (exported_peers != NULL)
+    g_ptr_array_remove (exported_peers, connection);
+}
+
+guint
+bolt_exported_count_clients (void)
+{
+  if (exported_clients == NULL)
+    return 0;
+
+  return g_hash_table_size (exported_clients);
+}
+
+/* internal methods */
+
+static void
+on_client_vanished (GDBusConnection *connection,
+                    const char      *name,
+                    gpointer         user_data)
+{
+  gpointer id;
+
+  if (!g_hash_table_lookup_extended (exported_clients, name, NULL, &id))
+    return;
+
+  bolt_debug (LOG_TOPIC ("dbus"), "client %s gone", name);
+
+  g_hash_table_remove (exported_clients, name);
+  g_bus_unwatch_name (GPOINTER_TO_UINT (id));
+}
+
+static void
+bolt_exported_client_seen (GDBusConnection *connection,
+                           const char      *sender)
+{
+  guint id;
+
+  /* peer connections have no sender, they are tracked
+   * via their connection instead */
+  if (sender == NULL)
+    return;
+
+  if (exported_clients == NULL)
+    exported_clients = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                              g_free, NULL);
+
+  if (g_hash_table_contains (exported_clients, sender))
+    return;
+
+  bolt_debug (LOG_TOPIC ("dbus"), "new client %s", sender);
+
+  /* NameOwnerChanged tells us when the client disconnects */
+  id = g_bus_watch_name_on_connection (connection, sender,
+                                       G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                       NULL,
+                                       on_client_vanished,
+                                       NULL, NULL);
+
+  g_hash_table_insert (exported_clients, g_strdup (sender),
+                       GUINT_TO_POINTER (id));
+}
+
+static guint
+bolt_exported_register (BoltExported    *exported,
+                        GDBusConnection *connection,
+                        GError         **error)
+{
+  BoltExportedPrivate *priv = GET_PRIV (exported);
+  BoltExportedClass *klass = BOLT_EXPORTED_GET_CLASS (exported);
+
+  return g_dbus_connection_register_object (connection,
+                                            priv->object_path,
+                                            klass->priv->iface_info,
+                                            &dbus_vtable,
+                                            exported,
+                                            NULL,
+                                            error);
+}
+
+static gboolean
+bolt_exported_emit (BoltExported *exported,
+                    const char   *iface_name,
+                    const char   *name,
+                    GVariant     *parameters,
+                    GError      **error)
+{
+  g_autoptr(GVariant) params = NULL;
+  BoltExportedPrivate *priv = GET_PRIV (exported);
+  GHashTableIter iter;
+  gpointer peer;
+  gboolean ok;
+
+  /* emitted more than once, so we need our own reference */
+  params = g_variant_ref_sink (parameters);
+
+  ok = g_dbus_connection_emit_signal (priv->dbus,
+                                      NULL,
+                                      priv->object_path,
+                                      iface_name,
+                                      name,
+                                      params,
+                                      error);
+
+  g_hash_table_iter_init (&iter, priv->peers);
+  while (g_hash_table_iter_next (&iter, &peer, NULL))
+    {
+      g_autoptr(GError) err = NULL;
+
+      if (g_dbus_connection_emit_signal (peer,
+                                         NULL,
+                                         priv->object_path,
+                                         iface_name,
+                                         name,
+                                         params,
+                                         &err))
+        continue;
+
+      bolt_debug (LOG_TOPIC ("dbus"), "could not emit %s to peer: %s",
+                  name, err->message);
+    }
+
+  return ok;
+}
+
 /* non BoltExported internal methods */
 
 static void
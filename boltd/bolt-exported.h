@@ -115,6 +115,14 @@ gboolean           bolt_exported_emit_signal (BoltExported *exported,
 
 void               bolt_exported_flush (BoltExported *exported);
 
+/* direct peer connections */
+void               bolt_exported_peer_add (GDBusConnection *connection);
+
+void               bolt_exported_peer_remove (GDBusConnection *connection);
+
+/* bus clients */
+guint              bolt_exported_count_clients (void);
+
 /* helper methods */
 GParamSpec *       bolt_param_spec_override (GObjectClass *object_class,
                                              const char   *name);
@@ -33,6 +33,7 @@
 #include <glib/gprintf.h>
 
 #include <stdarg.h>
+#include <string.h>
 #include <stdio.h>
 
 /* stolen from glib */
@@ -81,6 +82,73 @@ log_level_to_file (GLogLevelFlags log_level)
   return log_level & G_LOG_LEVEL_DEBUG ? stdout : stderr;
 }
 
+/* enable masks */
+guint bolt_log_level_mask = G_LOG_LEVEL_MASK;
+
+/* topic of the most recent message, for the watchdog;
+ * topics are string literals, see LOG_TOPIC */
+static gpointer last_topic = NULL;
+
+G_LOCK_DEFINE_STATIC (debug_topics);
+static GStrv debug_topics = NULL;
+static gint have_debug_topics = 0;
+
+void
+bolt_log_set_level_mask (GLogLevelFlags levels)
+{
+  /* errors, criticals and warnings can not be disabled */
+  levels |= G_LOG_LEVEL_ERROR | G_LOG_LEVEL_CRITICAL | G_LOG_LEVEL_WARNING;
+
+  g_atomic_int_set (&bolt_log_level_mask, levels);
+}
+
+GLogLevelFlags
+bolt_log_get_level_mask (void)
+{
+  return (GLogLevelFlags) g_atomic_int_get (&bolt_log_level_mask);
+}
+
+void
+bolt_log_set_debug (gboolean enabled)
+{
+  if (enabled)
+    g_atomic_int_or (&bolt_log_level_mask, G_LOG_LEVEL_DEBUG);
+  else
+    g_atomic_int_and (&bolt_log_level_mask, ~G_LOG_LEVEL_DEBUG);
+}
+
+void
+bolt_log_set_debug_topics (const char *topics)
+{
+  GStrv strv = NULL;
+
+  if (topics != NULL && *topics != '\0' && !bolt_streq (topics, "all"))
+    strv = g_strsplit (topics, ",", -1);
+
+  G_LOCK (debug_topics);
+  g_strfreev (debug_topics);
+  debug_topics = strv;
+  g_atomic_int_set (&have_debug_topics, strv != NULL);
+  G_UNLOCK (debug_topics);
+}
+
+gboolean
+bolt_log_topic_enabled (const char *topic)
+{
+  gboolean enabled;
+
+  /* fast path: no topic filter is set */
+  if (!g_atomic_int_get (&have_debug_topics))
+    return TRUE;
+
+  G_LOCK (debug_topics);
+  enabled = debug_topics == NULL ||
+            (topic && g_strv_contains ((const char * const *) debug_topics, topic));
+  G_UNLOCK (debug_topics);
+
+  return enabled;
+}
+
 #define internal_error(fmt, ...) g_fprintf (stderr, "log-ERROR: " fmt "\n", __VA_ARGS__)
 
 static const char *
@@ -91,10 +159,33 @@ bolt_color_for (FILE *out, const char *color)
   return g_log_writer_supports_color (fd) ? color : "";
 }
 
+/* well-known fields, indexed for O(1) lookups */
+typedef enum LogField {
+  LOG_FIELD_MESSAGE,
+  LOG_FIELD_PRIORITY,
+  LOG_FIELD_DOMAIN,
+
+  LOG_FIELD_CODE_FILE,
+  LOG_FIELD_CODE_LINE,
+  LOG_FIELD_CODE_FUNC,
+  LOG_FIELD_MESSAGE_ID,
+  LOG_FIELD_DEVICE_UID,
+  LOG_FIELD_SUPPRESSED,
+
+  LOG_FIELD_LAST
+} LogField;
+
+typedef enum LogCtxStorage {
+  LOG_CTX_STACK = 0,
+  LOG_CTX_HEAP,
+  LOG_CTX_POOL
+} LogCtxStorage;
+
 struct _BoltLogCtx
 {
   BoltDevice   *device;
   const GError *error;
+  BoltLogSite  *site;
 
   /* standard fields */
   GLogField *self;
@@ -105,14 +196,94 @@ struct _BoltLogCtx
 
   gboolean   is_bug;
 
+  /* index of the well-known fields */
+  const GLogField *known[LOG_FIELD_LAST];
+
   /* field storage */
   gsize     n_fields;
   GLogField fields[32];
 
-  /* heap or stack */
-  gboolean allocated;
+  /* the caller's fields, for foreign messages */
+  const GLogField *foreign;
+  gsize            n_foreign;
+
+  /* stack, heap or pool */
+  LogCtxStorage storage;
+  guint         slot;
 };
 
+static LogField
+log_field_index (const char *key)
+{
+  if (key == NULL)
+    return LOG_FIELD_LAST;
+
+  /* dispatch on the first character, so that most
+   * keys are classified with a single comparison */
+  switch (key[0])
+    {
+    case 'B':
+      if (g_str_equal (key, BOLT_LOG_DEVICE_UID))
+        return LOG_FIELD_DEVICE_UID;
+      else if (g_str_equal (key, BOLT_LOG_SUPPRESSED))
+        return LOG_FIELD_SUPPRESSED;
+      break;
+
+    case 'C':
+      if (strncmp (key, "CODE_", 5) != 0)
+        break;
+      else if (g_str_equal (key + 5, "FILE"))
+        return LOG_FIELD_CODE_FILE;
+      else if (g_str_equal (key + 5, "LINE"))
+        return LOG_FIELD_CODE_LINE;
+      else if (g_str_equal (key + 5, "FUNC"))
+        return LOG_FIELD_CODE_FUNC;
+      break;
+
+    case 'G':
+      if (g_str_equal (key, "GLIB_DOMAIN"))
+        return LOG_FIELD_DOMAIN;
+      break;
+
+    case 'M':
+      if (g_str_equal (key, "MESSAGE"))
+        return LOG_FIELD_MESSAGE;
+      else if (g_str_equal (key, "MESSAGE_ID"))
+        return LOG_FIELD_MESSAGE_ID;
+      break;
+
+    case 'P':
+      if (g_str_equal (key, "PRIORITY"))
+        return LOG_FIELD_PRIORITY;
+      break;
+    }
+
+  return LOG_FIELD_LAST;
+}
+
+static void
+log_ctx_index_field (BoltLogCtx      *ctx,
+                     const GLogField *field)
+{
+  LogField idx = log_field_index (field->key);
+
+  /* the first one wins, like for a linear search */
+  if (idx != LOG_FIELD_LAST && ctx->known[idx] == NULL)
+    ctx->known[idx] = field;
+}
+
+static const char *
+log_ctx_get_string (const BoltLogCtx *ctx,
+                    LogField          idx)
+{
+  const GLogField *f = ctx->known[idx];
+
+  if (f == NULL || f->length != -1)
+    return NULL;
+
+  return f->value;
+}
+
 static gboolean
 bolt_log_ctx_next_field (BoltLogCtx *ctx, GLogField **next)
 {
@@ -163,10 +334,33 @@ bolt_log_ctx_find_field (const BoltLogCtx *ctx,
                          const char       *name,
                          const GLogField **out)
 {
+  const GLogField *field;
+  LogField idx;
+
   g_return_val_if_fail (ctx != NULL, FALSE);
   g_return_val_if_fail (name != NULL, FALSE);
   g_return_val_if_fail (out != NULL, FALSE);
 
+  idx = log_field_index (name);
+
+  if (idx != LOG_FIELD_LAST)
+    {
+      if (idx == LOG_FIELD_MESSAGE)
+        field = ctx->message;
+      else if (idx == LOG_FIELD_PRIORITY)
+        field = ctx->priority;
+      else if (idx == LOG_FIELD_DOMAIN)
+        field = ctx->domain;
+      else
+        field = ctx->known[idx];
+
+      if (field == NULL || field->key == NULL)
+        return FALSE;
+
+      *out = field;
+      return TRUE;
+    }
+
   for (gsize i = 0; i < ctx->n_fields; i++)
     {
       const GLogField *field = ctx->fields + i;
@@ -196,6 +390,7 @@ handle_device_field (BoltLogCtx *ctx,
   field->key = BOLT_LOG_DEVICE_UID;
   field->value = bolt_device_get_uid (dev);
   field->length = -1;
+  log_ctx_index_field (ctx, field);
 
   bolt_log_ctx_next_field (ctx, &field);
   field->key = BOLT_LOG_DEVICE_NAME;
@@ -280,6 +475,8 @@ handle_special_field (BoltLogCtx *ctx,
     handle_gerror_field (ctx, key, ptr);
   else if (g_str_equal (key, "topic"))
     handle_topic_field (ctx, key, ptr);
+  else if (g_str_equal (key, "site"))
+    ctx->site = ptr;
   else
 
     handled = FALSE;
@@ -302,6 +499,8 @@ handle_passthrough_field (BoltLogCtx *ctx,
   field->value = val;
   field->length = -1;
 
+  log_ctx_index_field (ctx, field);
+
   return TRUE;
 }
 
@@ -317,208 +516,999 @@ add_bug_marker (BoltLogCtx *ctx)
   field->length = -1;
 }
 
-void
-bolt_log (const char    *domain,
-          GLogLevelFlags level,
-          ...)
+/* flight recorder */
+#define FLIGHT_ENTRIES 1024
+#define FLIGHT_MSGLEN  128
+
+typedef struct _FlightEntry
 {
-  va_list args;
+  gint        seq;     /* odd while the entry is written */
+  guint       level;
+  gint64      time;
+
+  /* static strings, i.e. literals */
+  const char *file;
+  const char *line;
+  const char *func;
+
+  /* for messages that were not emitted */
+  const BoltLogSite *site;
+
+  /* copied */
+  char        topic[16];
+  char        msgid[BOLT_LOG_MSG_IDLEN];
+  char        uid[40];
+  char        message[FLIGHT_MSGLEN];
+} FlightEntry;
+
+/* A fixed size ring that is always on: writers claim a slot
+ * with a single atomic add and use the sequence number of the
+ * entry as a seqlock, so that the (rare) readers can detect
+ * entries that were overwritten while they were copied. */
+static FlightEntry flight_ring[FLIGHT_ENTRIES];
+static gint flight_head = 0;
+
+static FlightEntry *
+flight_entry_begin (guint *idx)
+{
+  FlightEntry *e;
 
-  va_start (args, level);
-  bolt_logv (domain, level, args);
-  va_end (args);
+  *idx = (guint) g_atomic_int_add (&flight_head, 1);
+  e = &flight_ring[*idx & (FLIGHT_ENTRIES - 1)];
+
+  g_atomic_int_set (&e->seq, (gint) (*idx * 2 + 1));
+  e->time = g_get_real_time ();
+
+  return e;
 }
 
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+static void
+flight_entry_end (FlightEntry *e,
+                  guint        idx)
+{
+  g_atomic_int_set (&e->seq, (gint) (idx * 2 + 2));
+}
+
+static void
+flight_record_ctx (const BoltLogCtx *ctx,
+                   GLogLevelFlags    level,
+                   const char       *message)
+{
+  const char *topic = ctx->topic ? ctx->topic->value : NULL;
+  const char *msgid;
+  const char *uid;
+  FlightEntry *e;
+  guint idx;
+
+  msgid = log_ctx_get_string (ctx, LOG_FIELD_MESSAGE_ID);
+
+  if (ctx->device)
+    uid = bolt_device_get_uid (ctx->device);
+  else
+    uid = log_ctx_get_string (ctx, LOG_FIELD_DEVICE_UID);
+
+  e = flight_entry_begin (&idx);
+
+  e->level = level;
+  e->file = log_ctx_get_string (ctx, LOG_FIELD_CODE_FILE);
+  e->line = log_ctx_get_string (ctx, LOG_FIELD_CODE_LINE);
+  e->func = log_ctx_get_string (ctx, LOG_FIELD_CODE_FUNC);
+  e->site = NULL;
+
+  g_strlcpy (e->topic, topic ? : "", sizeof (e->topic));
+  g_strlcpy (e->msgid, msgid ? : "", sizeof (e->msgid));
+  g_strlcpy (e->uid, uid ? : "", sizeof (e->uid));
+  g_strlcpy (e->message, message ? : "", sizeof (e->message));
+
+  flight_entry_end (e, idx);
+}
 
 void
-bolt_logv (const char    *domain,
-           GLogLevelFlags level,
-           va_list        args)
+bolt_log_flight_record (const BoltLogSite *site,
+                        GLogLevelFlags     level)
 {
-  BoltLogCtx ctx = {NULL, };
-  char message[1024] = {0, };
-  const char *key;
+  FlightEntry *e;
+  guint idx;
 
-  bolt_log_ctx_next_field (&ctx, &ctx.message);
-  bolt_log_ctx_next_field (&ctx, &ctx.priority);
-  bolt_log_ctx_next_field (&ctx, &ctx.domain);
+  e = flight_entry_begin (&idx);
 
-  while ((key = va_arg (args, const char *)) != NULL)
+  e->level = level;
+  e->file = site->file;
+  e->line = site->line;
+  e->func = site->func;
+  e->site = site;
+
+  e->topic[0] = '\0';
+  e->msgid[0] = '\0';
+  e->uid[0] = '\0';
+  e->message[0] = '\0';
+
+  flight_entry_end (e, idx);
+}
+
+/* Copies the string literal(s) at 'p', as written, i.e. including
+ * escape sequences, and returns the position after them. */
+static const char *
+log_site_literal (const char *p,
+                     const char *end,
+                     GString    *out)
+{
+  while (p < end && *p == '"')
     {
-      gboolean handled;
+      for (p++; p < end && *p != '"'; p++)
+        {
+          if (*p == '\\' && p + 1 < end)
+            g_string_append_c (out, *p++);
 
-      if (*key == LOG_SPECIAL_CHAR)
+          g_string_append_c (out, *p);
+        }
+
+      /* adjacent literals are concatenated */
+      for (p++; p < end && g_ascii_isspace (*p); p++)
+        ;
+    }
+
+  return p;
+}
+
+/* Picks the topic and the format out of the argument list of
+ * a call site, which is split at the top level commas; done
+ * once per site for the topic filter, and when the flight
+ * recorder is dumped, recording just stores the site. Returns
+ * if there is a topic, which might not be a literal. */
+static gboolean
+log_site_parse (const BoltLogSite *site,
+                GString           *topic,
+                GString           *format)
+{
+  const char *p = site->args;
+  gboolean have_format = FALSE;
+  gboolean have_topic = FALSE;
+
+  while (p && *p)
+    {
+      const char *start, *end;
+      gboolean quoted = FALSE;
+      int depth = 0;
+
+      while (g_ascii_isspace (*p))
+        p++;
+
+      for (start = end = p; *end; end++)
         {
-          gpointer ptr = va_arg (args, gpointer);
-          handled = handle_special_field (&ctx, key, ptr);
+          if (quoted && *end == '\\' && end[1] != '\0')
+            end++;
+          else if (*end == '"')
+            quoted = !quoted;
+          else if (quoted)
+            continue;
+          else if (*end == '\'' && end[1] != '\0')
+            end += end[1] == '\\' ? 3 : 2; /* like ',' or '\'' */
+          else if (strchr ("([{", *end))
+            depth++;
+          else if (strchr (")]}", *end))
+            depth--;
+          else if (*end == ',' && depth == 0)
+            break;
         }
-      else if (*key == LOG_PASSTHROUGH_CHAR)
+
+      if (g_str_has_prefix (start, "LOG_TOPIC"))
         {
-          const char *val = va_arg (args, const char *);
-          handled = handle_passthrough_field (&ctx, key, val);
+          const char *q = memchr (start, '"', end - start);
+
+          if (q != NULL && topic != NULL)
+            log_site_literal (q, end, topic);
+
+          have_topic = TRUE;
         }
-      else
+      else if (*start == '"' && !have_format && format != NULL)
         {
-          break;
+          log_site_literal (start, end, format);
+          have_format = TRUE;
         }
 
-      if (!handled)
-        internal_error ("unknown field: %s", key);
+      p = *end ? end + 1 : end;
     }
 
-  g_vsnprintf (message, sizeof (message), key ? : "", args);
-  ctx.message->key = "MESSAGE";
-  ctx.message->value = message;
-  ctx.message->length = -1;
+  return have_topic;
+}
 
-  ctx.priority->key = "PRIORITY";
-  ctx.priority->value = log_level_to_priority (level);
-  ctx.priority->length = -1;
+/* sentinel for topics that are not literals */
+static const char log_site_dynamic[] = "";
 
-  ctx.domain->key = "GLIB_DOMAIN";
-  ctx.domain->value = domain ? : "boltd";
-  ctx.domain->length = -1;
+gboolean
+bolt_log_site_enabled (BoltLogSite *site)
+{
+  const char *topic;
 
-  if (ctx.is_bug)
-    add_bug_marker (&ctx);
+  /* fast path: no topic filter is set */
+  if (!g_atomic_int_get (&have_debug_topics))
+    return TRUE;
 
-  bolt_log_ctx_finish (&ctx);
+  if (g_once_init_enter (&site->topic))
+    {
+      g_autoptr(GString) str = g_string_new (NULL);
+      const char *t;
 
-  /* pass it to the normal log mechanisms;
-   * this should handle aborting on fatal
-   * error messages for us. */
-  g_log_structured_array (level, ctx.fields, ctx.n_fields);
-}
-#pragma GCC diagnostic pop
+      if (!log_site_parse (site, str, NULL))
+        t = NULL;
+      else if (str->len == 0)
+        t = log_site_dynamic;
+      else
+        t = g_intern_string (str->str);
 
-static char *
-format_device_id (BoltDevice *device, char *buffer, gsize len, int size)
-{
-  static const int u = 13;
-  const char *uid;
-  const char *name;
-  int n;
+      /* 1 for sites without a topic, since 0 means unset */
+      g_once_init_leave (&site->topic, t ? (gsize) t : 1);
+    }
 
-  uid = bolt_device_get_uid (device);
-  name = bolt_device_get_name (device);
+  topic = site->topic == 1 ? NULL : (const char *) site->topic;
 
-  n = MAX (0, size - u);
-  g_snprintf (buffer, len, "%-.*s-%-*.*s", u, uid, n, n, name);
-  return buffer;
+  /* decided in bolt_logv, after the arguments are evaluated */
+  if (topic == log_site_dynamic)
+    return TRUE;
+
+  return bolt_log_topic_enabled (topic);
 }
 
-#define TIME_MAXFMT 255
-GLogWriterOutput
-bolt_log_stdstream (const BoltLogCtx *ctx,
-                    GLogLevelFlags    log_level,
-                    guint             flags)
+GVariant *
+bolt_log_flight_dump (void)
 {
-  FILE *out = log_level_to_file (log_level);
-  const char *normal = bolt_color_for (out, ANSI_NORMAL);
-  const char *gray = bolt_color_for (out, ANSI_HIGHLIGHT_BLACK);
-  const char *blue = bolt_color_for (out, ANSI_BLUE);
-  const char *fg = normal;
-  const char *message;
-  const GLogField *f;
-  char the_time[TIME_MAXFMT];
-  time_t now;
-  struct tm *tm;
-
-  g_return_val_if_fail (ctx != NULL, G_LOG_WRITER_UNHANDLED);
-  g_return_val_if_fail (ctx->message != NULL, G_LOG_WRITER_UNHANDLED);
-
-  time (&now);
-  tm = localtime (&now);
+  GVariantBuilder b;
+  guint head, start;
 
-  if (tm && strftime (the_time, sizeof (the_time), "%T", tm) > 0)
-    g_fprintf (out, "%s%s%s ", gray, the_time, normal);
+  g_variant_builder_init (&b, G_VARIANT_TYPE (BOLT_LOG_FLIGHT_TYPE));
 
-  if (log_level == G_LOG_LEVEL_CRITICAL ||
-      log_level == G_LOG_LEVEL_ERROR)
-    fg = bolt_color_for (out, ANSI_RED);
-  else if (log_level == G_LOG_LEVEL_WARNING)
-    fg = bolt_color_for (out, ANSI_YELLOW);
-  else if (log_level == G_LOG_LEVEL_DEBUG)
-    fg = gray;
+  head = (guint) g_atomic_int_get (&flight_head);
+  start = head > FLIGHT_ENTRIES ? head - FLIGHT_ENTRIES : 0;
 
-  if (ctx->device)
+  for (guint idx = start; idx != head; idx++)
     {
-      char name[64];
+      FlightEntry *e = &flight_ring[idx & (FLIGHT_ENTRIES - 1)];
+      g_autofree char *location = NULL;
+      FlightEntry copy;
+      guint seq;
 
-      format_device_id (ctx->device, name, sizeof (name), 30);
-      g_fprintf (out, "[%s%s%s] ", blue, name, normal);
-    }
-  else if (bolt_log_ctx_find_field (ctx, BOLT_LOG_DEVICE_UID, &f))
-    {
-      const char *uid = f->value;
+      seq = (guint) g_atomic_int_get (&e->seq);
+      if (seq != idx * 2 + 2)
+        continue;
 
-      g_fprintf (out, "[%s%.13s %17s%s] ", blue, uid, " ", fg);
-    }
+      memcpy (&copy, e, sizeof (copy));
 
-  if (ctx->topic)
-    g_fprintf (out, "%s%s%s: ", blue, (const char *) ctx->topic->value, fg);
+      /* overwritten while we copied it */
+      if ((guint) g_atomic_int_get (&e->seq) != seq)
+        continue;
 
-  message = ctx->message->value;
-  g_fprintf (out, "%s%s%s", fg, message, normal);
+      copy.topic[sizeof (copy.topic) - 1] = '\0';
+      copy.msgid[sizeof (copy.msgid) - 1] = '\0';
+      copy.uid[sizeof (copy.uid) - 1] = '\0';
+      copy.message[sizeof (copy.message) - 1] = '\0';
 
-  if (ctx->error)
-    {
-      const char *yellow = bolt_color_for (out, ANSI_YELLOW);
-      const char *msg = ctx->error->message;
-      if (strlen (message) == 0)
+      if (copy.site)
         {
-          const char *lvl = log_level_to_string (log_level);
-          g_fprintf (out, "%s%s%s", fg, lvl, normal);
+          g_autoptr(GString) topic = g_string_new (NULL);
+          g_autoptr(GString) format = g_string_new (NULL);
+
+          log_site_parse (copy.site, topic, format);
+
+          g_strlcpy (copy.topic, topic->str, sizeof (copy.topic));
+          g_strlcpy (copy.message, format->str, sizeof (copy.message));
         }
-      g_fprintf (out, ": %s%s%s", yellow, msg, normal);
+
+      if (copy.file)
+        location = g_strdup_printf ("%s:%s %s",
+                                    copy.file,
+                                    copy.line ? : "?",
+                                    copy.func ? : "");
+
+      g_variant_builder_add (&b, "(xusssss)",
+                             copy.time,
+                             copy.level,
+                             copy.topic,
+                             copy.msgid,
+                             copy.uid,
+                             location ? : "",
+                             copy.message);
     }
 
-  g_fprintf (out, "\n");
-  fflush (out);
+  return g_variant_builder_end (&b);
+}
 
-  return G_LOG_WRITER_HANDLED;
+void
+bolt_log_flight_clear (void)
+{
+  for (guint i = 0; i < FLIGHT_ENTRIES; i++)
+    g_atomic_int_set (&flight_ring[i].seq, 0);
+
+  g_atomic_int_set (&flight_head, 0);
 }
 
-static int
-bolt_cat_printf (char **buffer, gsize *size, const char *fmt, ...)
+/* rate limiting */
+#define RATELIMIT_MAX_KEYS  512
+#define RATELIMIT_SUMMARIES 8
+
+typedef enum _RateLimitKind
 {
-  va_list args;
-  char *p = *buffer;
-  gsize s = *size;
-  int n;
+  RATELIMIT_MSGID,
+  RATELIMIT_CODE,
+  RATELIMIT_FORMAT
+} RateLimitKind;
 
-  va_start (args, fmt);
-  n = g_vsnprintf (p, s, fmt, args);
-  va_end (args);
+typedef struct _RateLimit
+{
+  /* key */
+  RateLimitKind  kind;
+  char          *id;         /* message id, file or format */
+  char          *line;
+  char          *uid;
+
+  gdouble        tokens;
+  gint64         last;       /* last refill, monotonic */
+  guint          suppressed;
+
+  /* static strings, from the last message */
+  const char    *domain;
+  const char    *file;
+  const char    *lineno;
+  const char    *func;
+} RateLimit;
+
+G_LOCK_DEFINE_STATIC (ratelimit);
+static GHashTable *ratelimit_table = NULL;
+static BoltClock *ratelimit_clock = NULL;
+static gint ratelimit_burst = BOLT_LOG_RATELIMIT_BURST;
+static gint ratelimit_seconds = BOLT_LOG_RATELIMIT_INTERVAL;
+static gint ratelimit_gen = 0;
+static gint ratelimit_pending = 0;
+static gint64 ratelimit_swept = 0;
+static guint ratelimit_total = 0;
 
-  /* TODO: check n */
-  *size = s - n;
-  *buffer = p + n;
+void
+bolt_log_set_rate_limit (guint burst,
+                         guint interval)
+{
+  G_LOCK (ratelimit);
 
-  return n;
+  g_clear_pointer (&ratelimit_table, g_hash_table_destroy);
+  g_atomic_int_set (&ratelimit_pending, 0);
+  g_atomic_int_set (&ratelimit_seconds, (gint) MAX (interval, 1));
+  g_atomic_int_set (&ratelimit_burst, (gint) burst);
+
+  /* invalidates the counters of all call sites */
+  g_atomic_int_inc (&ratelimit_gen);
+
+  G_UNLOCK (ratelimit);
 }
 
-GLogWriterOutput
-bolt_log_journal (const BoltLogCtx *ctx,
-                  GLogLevelFlags    log_level,
-                  guint             flags)
+/* The time source of the rate limiter, for tests; NULL restores
+ * the monotonic clock. Must not race with concurrent logging. */
+void
+bolt_log_set_clock (BoltClock *clock)
 {
-  GLogWriterOutput res;
-  const char *m;
-  const char *old = NULL;
-  char message[2048];
-  gsize size = sizeof (message);
-  char *p = message;
-  const GLogField *f;
+  G_LOCK (ratelimit);
 
-  if (ctx == NULL || ctx->message == NULL)
-    return G_LOG_WRITER_UNHANDLED;
+  g_set_object (&ratelimit_clock, clock);
+  ratelimit_swept = 0;
 
-  if (ctx->device)
-    {
-      char name[64];
+  G_UNLOCK (ratelimit);
+}
+
+const char *
+bolt_log_get_last_topic (void)
+{
+  return g_atomic_pointer_get (&last_topic);
+}
+
+guint
+bolt_log_get_suppressed (void)
+{
+  guint total;
+
+  G_LOCK (ratelimit);
+  total = ratelimit_total;
+  G_UNLOCK (ratelimit);
+
+  return total;
+}
+
+static gint64
+ratelimit_interval (void)
+{
+  return (gint64) g_atomic_int_get (&ratelimit_seconds) * G_USEC_PER_SEC;
+}
+
+static gint64
+ratelimit_now (void)
+{
+  BoltClock *clock = g_atomic_pointer_get (&ratelimit_clock);
+
+  if (clock != NULL)
+    return bolt_clock_get_time (clock);
+
+  return g_get_monotonic_time ();
+}
+
+static guint
+ratelimit_hash (gconstpointer data)
+{
+  const RateLimit *rl = data;
+  guint h = rl->kind;
+
+  /* hash the parts, no need to build a combined string */
+  h = h * 31 + g_str_hash (rl->id);
+  h = h * 31 + (rl->line ? g_str_hash (rl->line) : 0);
+  h = h * 31 + g_str_hash (rl->uid);
+
+  return h;
+}
+
+static gboolean
+ratelimit_equal (gconstpointer a,
+                 gconstpointer b)
+{
+  const RateLimit *x = a;
+  const RateLimit *y = b;
+
+  return x->kind == y->kind &&
+         bolt_streq (x->id, y->id) &&
+         g_strcmp0 (x->line, y->line) == 0 &&
+         bolt_streq (x->uid, y->uid);
+}
+
+static void
+ratelimit_free (gpointer data)
+{
+  RateLimit *rl = data;
+
+  if (rl->suppressed > 0)
+    g_atomic_int_add (&ratelimit_pending, -1);
+
+  g_free (rl->id);
+  g_free (rl->line);
+  g_free (rl->uid);
+  g_free (rl);
+}
+
+static void
+ratelimit_refill (RateLimit *rl,
+                  gint64     now,
+                  guint      burst)
+{
+  gdouble refill;
+
+  refill = (gdouble) (now - rl->last) * burst / ratelimit_interval ();
+  rl->tokens = MIN (rl->tokens + refill, (gdouble) burst);
+  rl->last = now;
+}
+
+static void
+ratelimit_summarize (RateLimit *rl,
+                     RateLimit *summary)
+{
+  *summary = *rl;
+  summary->id = g_strdup (rl->id);
+  summary->line = g_strdup (rl->line);
+  summary->uid = g_strdup (rl->uid);
+
+  rl->suppressed = 0;
+  g_atomic_int_add (&ratelimit_pending, -1);
+}
+
+static guint
+ratelimit_sweep (gint64     now,
+                 guint      burst,
+                 RateLimit *summaries,
+                 guint      n_summaries)
+{
+  GHashTableIter iter;
+  gpointer k;
+  guint n = 0;
+
+  g_hash_table_iter_init (&iter, ratelimit_table);
+  while (g_hash_table_iter_next (&iter, &k, NULL))
+    {
+      RateLimit *rl = k;
+
+      if (rl->suppressed > 0 && n < n_summaries)
+        ratelimit_summarize (rl, &summaries[n++]);
+
+      ratelimit_refill (rl, now, burst);
+
+      /* buckets that are full again carry no state */
+      if (rl->suppressed == 0 && rl->tokens >= burst)
+        g_hash_table_iter_remove (&iter);
+    }
+
+  ratelimit_swept = now;
+
+  return n;
+}
+
+static void
+ratelimit_report (RateLimit *rl)
+{
+  g_autofree char *from = NULL;
+  char count[16];
+
+  g_snprintf (count, sizeof (count), "%u", rl->suppressed);
+
+  if (rl->kind == RATELIMIT_CODE)
+    from = g_strdup_printf ("%s:%s", rl->id, rl->line);
+  else if (rl->kind == RATELIMIT_FORMAT)
+    from = g_strdup_printf ("'%s'", rl->id);
+  else
+    from = g_strdup (rl->id);
+
+  bolt_log (rl->domain, G_LOG_LEVEL_WARNING,
+            LOG_DIRECT ("CODE_FILE", rl->file ? : ""),
+            LOG_DIRECT ("CODE_LINE", rl->lineno ? : ""),
+            LOG_DIRECT ("CODE_FUNC", rl->func ? : ""),
+            LOG_DEV_UID (rl->uid),
+            LOG_TOPIC ("log"),
+            LOG_ID (LOG_SUPPRESSED),
+            LOG_DIRECT (BOLT_LOG_SUPPRESSED, count),
+            "suppressed %u messages from %s%s%s",
+            rl->suppressed, from,
+            *rl->uid ? " for " : "", rl->uid);
+
+  g_free (rl->id);
+  g_free (rl->line);
+  g_free (rl->uid);
+}
+
+/* The per-site fast path: within one interval, the first 'burst'
+ * messages of a call site for a single device pass without taking
+ * the lock or looking up the bucket. Sites that exceed that, see
+ * more than one device or have to wait for outstanding summaries
+ * take the slow path. The counters are updated without a lock, so
+ * concurrent messages at the same site may be counted loosely. */
+static gboolean
+ratelimit_site_pass (BoltLogSite *site,
+                     gint64       now,
+                     guint        burst,
+                     gint         uid)
+{
+  gint gen = g_atomic_int_get (&ratelimit_gen);
+  gint window = (gint) (now / ratelimit_interval ());
+
+  if (g_atomic_int_get (&ratelimit_pending) > 0)
+    return FALSE;
+
+  if (g_atomic_int_get (&site->rl_gen) != gen ||
+      g_atomic_int_get (&site->rl_window) != window)
+    {
+      g_atomic_int_set (&site->rl_count, 0);
+      g_atomic_int_set (&site->rl_uid, uid);
+      g_atomic_int_set (&site->rl_window, window);
+      g_atomic_int_set (&site->rl_gen, gen);
+    }
+  else if (g_atomic_int_get (&site->rl_uid) != uid)
+    {
+      return FALSE;
+    }
+
+  return (guint) g_atomic_int_add (&site->rl_count, 1) < burst;
+}
+
+/* The messages of the current window of 'site' that passed the fast
+ * path, for the device 'uid'; they are taken from a new bucket. */
+static guint
+ratelimit_site_claimed (BoltLogSite *site,
+                        gint64       now,
+                        guint        burst,
+                        gint         uid)
+{
+  gint window = (gint) (now / ratelimit_interval ());
+  guint count;
+
+  if (site == NULL)
+    return 0;
+  else if (g_atomic_int_get (&site->rl_gen) != g_atomic_int_get (&ratelimit_gen))
+    return 0;
+  else if (g_atomic_int_get (&site->rl_window) != window)
+    return 0;
+  else if (g_atomic_int_get (&site->rl_uid) != uid)
+    return 0;
+
+  count = (guint) g_atomic_int_get (&site->rl_count);
+
+  return MIN (count, burst);
+}
+
+/* Token bucket per call site (or message id) and device: each
+ * bucket holds up to 'burst' tokens and is refilled with 'burst'
+ * tokens per interval. Only informational messages are limited,
+ * debug output is opt-in and warnings must never get lost.
+ * Suppressed messages are summarized, as a warning, once the
+ * bucket has tokens again, or at the latest when the table
+ * is swept, which happens at most once per interval. */
+static gboolean
+ratelimit_check (const BoltLogCtx *ctx,
+                 const char       *domain,
+                 GLogLevelFlags    level,
+                 const char       *format)
+{
+  RateLimit summaries[RATELIMIT_SUMMARIES];
+  const char *msgid, *file, *line, *uid;
+  gboolean pass = TRUE;
+  RateLimit key = {0, };
+  RateLimit *rl;
+  gint64 now;
+  guint burst;
+  guint n = 0;
+  gint uh;
+
+  burst = (guint) g_atomic_int_get (&ratelimit_burst);
+
+  if (burst == 0)
+    return TRUE;
+  else if ((level & BOLT_LOG_RATELIMIT_LEVELS) == 0)
+    return TRUE;
+  else if (ctx->known[LOG_FIELD_SUPPRESSED] != NULL)
+    return TRUE; /* our own summary */
+
+  if (ctx->device)
+    uid = bolt_device_get_uid (ctx->device);
+  else
+    uid = log_ctx_get_string (ctx, LOG_FIELD_DEVICE_UID);
+
+  uid = uid ? : "";
+  uh = (gint) g_str_hash (uid);
+  now = ratelimit_now ();
+
+  if (ctx->site && ratelimit_site_pass (ctx->site, now, burst, uh))
+    return TRUE;
+
+  msgid = log_ctx_get_string (ctx, LOG_FIELD_MESSAGE_ID);
+  file = log_ctx_get_string (ctx, LOG_FIELD_CODE_FILE);
+  line = log_ctx_get_string (ctx, LOG_FIELD_CODE_LINE);
+
+  if (msgid)
+    {
+      key.kind = RATELIMIT_MSGID;
+      key.id = (char *) msgid;
+    }
+  else if (file && line)
+    {
+      key.kind = RATELIMIT_CODE;
+      key.id = (char *) file;
+      key.line = (char *) line;
+    }
+  else if (format)
+    {
+      key.kind = RATELIMIT_FORMAT;
+      key.id = (char *) format;
+    }
+  else
+    {
+      return TRUE;
+    }
+
+  key.uid = (char *) uid;
+
+  G_LOCK (ratelimit);
+
+  if (ratelimit_table == NULL)
+    ratelimit_table = g_hash_table_new_full (ratelimit_hash, ratelimit_equal,
+                                             ratelimit_free, NULL);
+
+  if (now - ratelimit_swept >= ratelimit_interval () ||
+      g_hash_table_size (ratelimit_table) >= RATELIMIT_MAX_KEYS)
+    n = ratelimit_sweep (now, burst, summaries, RATELIMIT_SUMMARIES);
+
+  rl = g_hash_table_lookup (ratelimit_table, &key);
+
+  if (rl == NULL && g_hash_table_size (ratelimit_table) < RATELIMIT_MAX_KEYS)
+    {
+      guint claimed = ratelimit_site_claimed (ctx->site, now, burst, uh);
+
+      rl = g_new0 (RateLimit, 1);
+      rl->kind = key.kind;
+      rl->id = g_strdup (key.id);
+      rl->line = g_strdup (key.line);
+      rl->uid = g_strdup (key.uid);
+      rl->tokens = burst - claimed;
+      rl->last = now;
+      g_hash_table_add (ratelimit_table, rl);
+    }
+
+  if (rl != NULL)
+    {
+      ratelimit_refill (rl, now, burst);
+
+      rl->domain = domain;
+      rl->file = file;
+      rl->lineno = line;
+      rl->func = log_ctx_get_string (ctx, LOG_FIELD_CODE_FUNC);
+
+      if (rl->tokens >= 1.0)
+        {
+          rl->tokens -= 1.0;
+
+          if (rl->suppressed > 0 && n < RATELIMIT_SUMMARIES)
+            ratelimit_summarize (rl, &summaries[n++]);
+        }
+      else
+        {
+          if (rl->suppressed++ == 0)
+            g_atomic_int_inc (&ratelimit_pending);
+
+          ratelimit_total++;
+          pass = FALSE;
+        }
+    }
+
+  G_UNLOCK (ratelimit);
+
+  for (guint i = 0; i < n; i++)
+    ratelimit_report (&summaries[i]);
+
+  return pass;
+}
+
+/* Collects the structured fields, stops at the format string
+ * and returns it; the format arguments are left in 'args'. */
+static const char *
+log_ctx_collect (BoltLogCtx *ctx,
+                 va_list     args)
+{
+  const char *key;
+
+  bolt_log_ctx_next_field (ctx, &ctx->message);
+  bolt_log_ctx_next_field (ctx, &ctx->priority);
+  bolt_log_ctx_next_field (ctx, &ctx->domain);
+
+  while ((key = va_arg (args, const char *)) != NULL)
+    {
+      gboolean handled;
+
+      if (*key == LOG_SPECIAL_CHAR)
+        {
+          gpointer ptr = va_arg (args, gpointer);
+          handled = handle_special_field (ctx, key, ptr);
+        }
+      else if (*key == LOG_PASSTHROUGH_CHAR)
+        {
+          const char *val = va_arg (args, const char *);
+          handled = handle_passthrough_field (ctx, key, val);
+        }
+      else
+        {
+          break;
+        }
+
+      if (!handled)
+        internal_error ("unknown field: %s", key);
+    }
+
+  return key;
+}
+
+void
+bolt_log (const char    *domain,
+          GLogLevelFlags level,
+          ...)
+{
+  va_list args;
+
+  va_start (args, level);
+  bolt_logv (domain, level, args);
+  va_end (args);
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+
+void
+bolt_logv (const char    *domain,
+           GLogLevelFlags level,
+           va_list        args)
+{
+  BoltLogCtx ctx = {NULL, };
+  char message[1024] = {0, };
+  const char *key;
+
+  if (!bolt_log_level_enabled (level))
+    return;
+
+  key = log_ctx_collect (&ctx, args);
+
+  if (ctx.topic)
+    g_atomic_pointer_set (&last_topic, (gpointer) ctx.topic->value);
+
+  /* the topic filter only applies to debug messages, and
+   * we want to bail out before doing the formatting */
+  if ((level & G_LOG_LEVEL_DEBUG) != 0)
+    {
+      const char *topic = ctx.topic ? ctx.topic->value : NULL;
+
+      if (!bolt_log_topic_enabled (topic))
+        {
+          /* record the unformatted message */
+          bolt_log_ctx_finish (&ctx);
+          flight_record_ctx (&ctx, level, key);
+          return;
+        }
+    }
+
+  if (!ratelimit_check (&ctx, domain, level, key))
+    {
+      bolt_log_ctx_finish (&ctx);
+      flight_record_ctx (&ctx, level, key);
+      return;
+    }
+
+  g_vsnprintf (message, sizeof (message), key ? : "", args);
+  ctx.message->key = "MESSAGE";
+  ctx.message->value = message;
+  ctx.message->length = -1;
+
+  ctx.priority->key = "PRIORITY";
+  ctx.priority->value = log_level_to_priority (level);
+  ctx.priority->length = -1;
+
+  ctx.domain->key = "GLIB_DOMAIN";
+  ctx.domain->value = domain ? : "boltd";
+  ctx.domain->length = -1;
+
+  if (ctx.is_bug)
+    add_bug_marker (&ctx);
+
+  bolt_log_ctx_finish (&ctx);
+  flight_record_ctx (&ctx, level, message);
+
+  /* pass it to the normal log mechanisms;
+   * this should handle aborting on fatal
+   * error messages for us. */
+  g_log_structured_array (level, ctx.fields, ctx.n_fields);
+}
+#pragma GCC diagnostic pop
+
+static char *
+format_device_id (BoltDevice *device, char *buffer, gsize len, int size)
+{
+  static const int u = 13;
+  const char *uid;
+  const char *name;
+  int n;
+
+  uid = bolt_device_get_uid (device);
+  name = bolt_device_get_name (device);
+
+  n = MAX (0, size - u);
+  g_snprintf (buffer, len, "%-.*s-%-*.*s", u, uid, n, n, name);
+  return buffer;
+}
+
+static int
+bolt_cat_printf (char **buffer, gsize *size, const char *fmt, ...)
+{
+  va_list args;
+  char *p = *buffer;
+  gsize s = *size;
+  int n;
+
+  if (s == 0)
+    return 0;
+
+  va_start (args, fmt);
+  n = g_vsnprintf (p, s, fmt, args);
+  va_end (args);
+
+  /* output was truncated */
+  if (n < 0)
+    n = 0;
+  else if ((gsize) n >= s)
+    n = (int) s - 1;
+
+  *size = s - n;
+  *buffer = p + n;
+
+  return n;
+}
+
+#define TIME_MAXFMT 255
+static void
+log_format_stream (const BoltLogCtx *ctx,
+                   GLogLevelFlags    log_level,
+                   FILE             *out,
+                   char             *buffer,
+                   gsize             size)
+{
+  const char *normal = bolt_color_for (out, ANSI_NORMAL);
+  const char *gray = bolt_color_for (out, ANSI_HIGHLIGHT_BLACK);
+  const char *blue = bolt_color_for (out, ANSI_BLUE);
+  const char *fg = normal;
+  const char *message;
+  const GLogField *f;
+  char the_time[TIME_MAXFMT];
+  char *p = buffer;
+  time_t now;
+  struct tm *tm;
+
+  time (&now);
+  tm = localtime (&now);
+
+  if (tm && strftime (the_time, sizeof (the_time), "%T", tm) > 0)
+    bolt_cat_printf (&p, &size, "%s%s%s ", gray, the_time, normal);
+
+  if (log_level == G_LOG_LEVEL_CRITICAL ||
+      log_level == G_LOG_LEVEL_ERROR)
+    fg = bolt_color_for (out, ANSI_RED);
+  else if (log_level == G_LOG_LEVEL_WARNING)
+    fg = bolt_color_for (out, ANSI_YELLOW);
+  else if (log_level == G_LOG_LEVEL_DEBUG)
+    fg = gray;
+
+  if (ctx->device)
+    {
+      char name[64];
+
+      format_device_id (ctx->device, name, sizeof (name), 30);
+      bolt_cat_printf (&p, &size, "[%s%s%s] ", blue, name, normal);
+    }
+  else if (bolt_log_ctx_find_field (ctx, BOLT_LOG_DEVICE_UID, &f))
+    {
+      const char *uid = f->value;
+
+      bolt_cat_printf (&p, &size, "[%s%.13s %17s%s] ", blue, uid, " ", fg);
+    }
+
+  if (ctx->topic)
+    bolt_cat_printf (&p, &size, "%s%s%s: ", blue,
+                     (const char *) ctx->topic->value, fg);
+
+  message = ctx->message->value;
+  bolt_cat_printf (&p, &size, "%s%s%s", fg, message, normal);
+
+  if (ctx->error)
+    {
+      const char *yellow = bolt_color_for (out, ANSI_YELLOW);
+      const char *msg = ctx->error->message;
+      if (strlen (message) == 0)
+        {
+          const char *lvl = log_level_to_string (log_level);
+          bolt_cat_printf (&p, &size, "%s%s%s", fg, lvl, normal);
+        }
+      bolt_cat_printf (&p, &size, ": %s%s%s", yellow, msg, normal);
+    }
+
+  bolt_cat_printf (&p, &size, "\n");
+}
+
+GLogWriterOutput
+bolt_log_stdstream (const BoltLogCtx *ctx,
+                    GLogLevelFlags    log_level,
+                    guint             flags)
+{
+  FILE *out = log_level_to_file (log_level);
+  char line[2048];
+
+  g_return_val_if_fail (ctx != NULL, G_LOG_WRITER_UNHANDLED);
+  g_return_val_if_fail (ctx->message != NULL, G_LOG_WRITER_UNHANDLED);
+
+  log_format_stream (ctx, log_level, out, line, sizeof (line));
+
+  fputs (line, out);
+  fflush (out);
+
+  return G_LOG_WRITER_HANDLED;
+}
+
+static void
+log_format_journal (const BoltLogCtx *ctx,
+                    GLogLevelFlags    log_level,
+                    char             *buffer,
+                    gsize             size)
+{
+  const GLogField *f;
+  const char *m;
+  char *p = buffer;
+
+  buffer[0] = '\0';
+
+  if (ctx->device)
+    {
+      char name[64];
 
       format_device_id (ctx->device, name, sizeof (name), 40);
       bolt_cat_printf (&p, &size, "[%s] ", name);
@@ -544,6 +1534,21 @@ bolt_log_journal (const BoltLogCtx *ctx,
 
       bolt_cat_printf (&p, &size, ": %s", msg);
     }
+}
+
+GLogWriterOutput
+bolt_log_journal (const BoltLogCtx *ctx,
+                  GLogLevelFlags    log_level,
+                  guint             flags)
+{
+  GLogWriterOutput res;
+  const char *old = NULL;
+  char message[2048];
+
+  if (ctx == NULL || ctx->message == NULL)
+    return G_LOG_WRITER_UNHANDLED;
+
+  log_format_journal (ctx, log_level, message, sizeof (message));
 
   old = ctx->message->value;
   ctx->message->value = message;
@@ -558,6 +1563,531 @@ bolt_log_journal (const BoltLogCtx *ctx,
   return res;
 }
 
+/* asynchronous writing */
+#define LOG_RECORD_FIELDS 32
+#define LOG_RECORD_DATA   4096
+
+typedef struct _LogRecord
+{
+  gint           seq;
+  GLogLevelFlags level;
+  gsize          n_fields;
+  GLogField      fields[LOG_RECORD_FIELDS];
+  char           data[LOG_RECORD_DATA];
+} LogRecord;
+
+typedef enum LogAsyncMode {
+  LOG_ASYNC_JOURNAL,
+  LOG_ASYNC_STREAM,
+  LOG_ASYNC_SINK
+} LogAsyncMode;
+
+/* A bounded multi-producer, single-consumer ring of
+ * records. Producers claim a slot by advancing 'head'
+ * via compare-and-swap, fill it and then publish it by
+ * updating the sequence number of the slot; the writer
+ * thread consumes the slots in order and hands them back
+ * by bumping their sequence number by the capacity.
+ * Producers never block: if the ring is full the record
+ * is dropped and counted. */
+static struct
+{
+  LogRecord     *ring;
+  guint          capacity;
+
+  gint           head;   /* next slot to be claimed */
+  gint           tail;   /* next slot to be consumed */
+  gint           dropped;
+
+  gint           running;
+  gint           waiting;
+
+  LogAsyncMode   mode;
+  GLogWriterFunc sink;
+  gpointer       sink_data;
+
+  GThread       *thread;
+  GMutex         lock;
+  GCond          wakeup;
+  GCond          drained;
+} log_async;
+
+static gboolean
+log_record_add (LogRecord    *rec,
+                gsize        *used,
+                const char   *key,
+                gconstpointer value,
+                gssize        length)
+{
+  gsize klen, vlen;
+  GLogField *field;
+  char *k, *v;
+
+  if (value == NULL)
+    value = "";
+
+  klen = strlen (key) + 1;
+  vlen = length < 0 ? strlen (value) + 1 : (gsize) length;
+
+  if (rec->n_fields >= G_N_ELEMENTS (rec->fields))
+    return FALSE;
+  else if (klen + vlen > sizeof (rec->data) - *used)
+    return FALSE;
+
+  k = rec->data + *used;
+  memcpy (k, key, klen);
+  *used += klen;
+
+  v = rec->data + *used;
+  memcpy (v, value, vlen);
+  *used += vlen;
+
+  field = &rec->fields[rec->n_fields++];
+  field->key = k;
+  field->value = v;
+  field->length = length;
+
+  return TRUE;
+}
+
+static void
+log_record_fill (LogRecord        *rec,
+                 const BoltLogCtx *ctx,
+                 GLogLevelFlags    level)
+{
+  const char *message = NULL;
+  gsize used = 0;
+
+  rec->level = level;
+  rec->n_fields = 0;
+
+  if (log_async.mode == LOG_ASYNC_STREAM)
+    {
+      FILE *out = log_level_to_file (level);
+      log_format_stream (ctx, level, out, rec->data, sizeof (rec->data));
+      return;
+    }
+
+  if (log_async.mode == LOG_ASYNC_JOURNAL)
+    {
+      /* format the message upfront, like bolt_log_journal */
+      log_format_journal (ctx, level, rec->data, 2048);
+      used = strlen (rec->data) + 1;
+      message = rec->data;
+    }
+
+  /* the standard fields might not be part of ctx->fields,
+   * if the context was created for a foreign message */
+  if (message != NULL)
+    {
+      GLogField *f = &rec->fields[rec->n_fields++];
+
+      f->key = "MESSAGE";
+      f->value = message;
+      f->length = -1;
+    }
+  else
+    {
+      log_record_add (rec, &used, "MESSAGE",
+                      ctx->message->value,
+                      ctx->message->length);
+    }
+
+  if (ctx->priority && ctx->priority->key)
+    log_record_add (rec, &used, ctx->priority->key,
+                    ctx->priority->value,
+                    ctx->priority->length);
+
+  if (ctx->domain && ctx->domain->key)
+    log_record_add (rec, &used, ctx->domain->key,
+                    ctx->domain->value,
+                    ctx->domain->length);
+
+  for (gsize i = 0; i < ctx->n_fields; i++)
+    {
+      const GLogField *field = &ctx->fields[i];
+
+      if (field->key == NULL ||
+          field == ctx->message ||
+          field == ctx->priority ||
+          field == ctx->domain)
+        continue;
+
+      /* the context itself, if the id has not been set */
+      if (field == ctx->self && field->length == 0)
+        continue;
+
+      if (!log_record_add (rec, &used, field->key,
+                           field->value, field->length))
+        return;
+    }
+
+  /* all the others of a foreign message, they are only indexed */
+  for (gsize i = 0; i < ctx->n_foreign; i++)
+    {
+      const GLogField *field = &ctx->foreign[i];
+
+      if (field->key == NULL ||
+          field == ctx->message ||
+          field == ctx->priority ||
+          field == ctx->domain)
+        continue;
+
+      if (!log_record_add (rec, &used, field->key,
+                           field->value, field->length))
+        return;
+    }
+}
+
+static void
+log_record_write (LogRecord *rec)
+{
+  switch (log_async.mode)
+    {
+    case LOG_ASYNC_STREAM:
+      fputs (rec->data, log_level_to_file (rec->level));
+      break;
+
+    case LOG_ASYNC_JOURNAL:
+      g_log_writer_journald (rec->level, rec->fields, rec->n_fields, NULL);
+      break;
+
+    case LOG_ASYNC_SINK:
+      log_async.sink (rec->level, rec->fields, rec->n_fields,
+                      log_async.sink_data);
+      break;
+    }
+}
+
+static gboolean
+log_async_claim (LogRecord **out,
+                 guint      *out_pos)
+{
+  const guint capacity = log_async.capacity;
+  guint pos = (guint) g_atomic_int_get (&log_async.head);
+
+  while (TRUE)
+    {
+      LogRecord *rec = &log_async.ring[pos & (capacity - 1)];
+      guint seq = (guint) g_atomic_int_get (&rec->seq);
+      gint diff = (gint) (seq - pos);
+
+      if (diff == 0)
+        {
+          gboolean ok;
+
+          ok = g_atomic_int_compare_and_exchange (&log_async.head,
+                                                  (gint) pos,
+                                                  (gint) (pos + 1));
+          if (ok)
+            {
+              *out = rec;
+              *out_pos = pos;
+              return TRUE;
+            }
+        }
+      else if (diff < 0)
+        {
+          /* the slot has not been consumed yet: we are full */
+          return FALSE;
+        }
+
+      pos = (guint) g_atomic_int_get (&log_async.head);
+    }
+}
+
+static gboolean
+log_async_pending (void)
+{
+  guint pos = (guint) g_atomic_int_get (&log_async.tail);
+  LogRecord *rec = &log_async.ring[pos & (log_async.capacity - 1)];
+  guint seq = (guint) g_atomic_int_get (&rec->seq);
+
+  return seq == pos + 1;
+}
+
+static guint
+log_async_drain (void)
+{
+  const guint capacity = log_async.capacity;
+  guint n = 0;
+
+  while (log_async_pending ())
+    {
+      guint pos = (guint) g_atomic_int_get (&log_async.tail);
+      LogRecord *rec = &log_async.ring[pos & (capacity - 1)];
+
+      log_record_write (rec);
+
+      /* hand the slot back to the producers */
+      g_atomic_int_set (&rec->seq, (gint) (pos + capacity));
+      g_atomic_int_set (&log_async.tail, (gint) (pos + 1));
+      n++;
+    }
+
+  if (n > 0 && log_async.mode == LOG_ASYNC_STREAM)
+    {
+      fflush (stdout);
+      fflush (stderr);
+    }
+
+  return n;
+}
+
+static gpointer
+log_async_thread (gpointer data)
+{
+  while (TRUE)
+    {
+      guint n = log_async_drain ();
+
+      if (n > 0)
+        {
+          g_mutex_lock (&log_async.lock);
+          g_cond_broadcast (&log_async.drained);
+          g_mutex_unlock (&log_async.lock);
+          continue;
+        }
+
+      if (!g_atomic_int_get (&log_async.running))
+        break;
+
+      g_mutex_lock (&log_async.lock);
+      g_atomic_int_set (&log_async.waiting, TRUE);
+
+      /* the timeout is a safety net only */
+      if (!log_async_pending () && g_atomic_int_get (&log_async.running))
+        g_cond_wait_until (&log_async.wakeup, &log_async.lock,
+                           g_get_monotonic_time () + G_TIME_SPAN_SECOND);
+
+      g_atomic_int_set (&log_async.waiting, FALSE);
+      g_mutex_unlock (&log_async.lock);
+    }
+
+  return NULL;
+}
+
+static void
+log_async_wake (gboolean force)
+{
+  if (!force && !g_atomic_int_get (&log_async.waiting))
+    return;
+
+  g_mutex_lock (&log_async.lock);
+  g_cond_signal (&log_async.wakeup);
+  g_mutex_unlock (&log_async.lock);
+}
+
+gboolean
+bolt_log_async_start (guint          capacity,
+                      GLogWriterFunc sink,
+                      gpointer       user_data,
+                      GError       **error)
+{
+  guint n = 2;
+
+  g_return_val_if_fail (log_async.thread == NULL, FALSE);
+
+  /* round up to the next power of two */
+  while (n < capacity)
+    n <<= 1;
+
+  log_async.ring = g_new0 (LogRecord, n);
+  log_async.capacity = n;
+
+  for (guint i = 0; i < n; i++)
+    log_async.ring[i].seq = (gint) i;
+
+  log_async.head = 0;
+  log_async.tail = 0;
+  log_async.dropped = 0;
+  log_async.sink = sink;
+  log_async.sink_data = user_data;
+
+  if (sink != NULL)
+    log_async.mode = LOG_ASYNC_SINK;
+  else if (g_log_writer_is_journald (fileno (stderr)))
+    log_async.mode = LOG_ASYNC_JOURNAL;
+  else
+    log_async.mode = LOG_ASYNC_STREAM;
+
+  g_atomic_int_set (&log_async.running, TRUE);
+
+  log_async.thread = g_thread_try_new ("bolt-log",
+                                       log_async_thread,
+                                       NULL,
+                                       error);
+
+  if (log_async.thread == NULL)
+    {
+      g_atomic_int_set (&log_async.running, FALSE);
+      g_clear_pointer (&log_async.ring, g_free);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+void
+bolt_log_async_stop (void)
+{
+  if (log_async.thread == NULL)
+    return;
+
+  g_atomic_int_set (&log_async.running, FALSE);
+  log_async_wake (TRUE);
+
+  /* the writer thread drains the ring before it exits */
+  g_thread_join (log_async.thread);
+  log_async.thread = NULL;
+
+  g_clear_pointer (&log_async.ring, g_free);
+}
+
+gboolean
+bolt_log_async_is_active (void)
+{
+  return g_atomic_int_get (&log_async.running);
+}
+
+GLogWriterOutput
+bolt_log_async_push (const BoltLogCtx *ctx,
+                     GLogLevelFlags    level)
+{
+  LogRecord *rec;
+  gboolean fatal;
+  gboolean ok;
+  guint pos;
+
+  g_return_val_if_fail (ctx != NULL, G_LOG_WRITER_UNHANDLED);
+
+  if (!g_atomic_int_get (&log_async.running))
+    return G_LOG_WRITER_UNHANDLED;
+
+  fatal = (level & (G_LOG_FLAG_FATAL | G_LOG_LEVEL_ERROR)) != 0;
+  ok = log_async_claim (&rec, &pos);
+
+  if (!ok)
+    {
+      g_atomic_int_inc (&log_async.dropped);
+
+      /* fatal messages must not get lost, let the
+       * caller write them out synchronously */
+      if (fatal)
+        {
+          bolt_log_async_flush ();
+          return G_LOG_WRITER_UNHANDLED;
+        }
+
+      return G_LOG_WRITER_HANDLED;
+    }
+
+  log_record_fill (rec, ctx, level);
+
+  /* publish */
+  g_atomic_int_set (&rec->seq, (gint) (pos + 1));
+  log_async_wake (FALSE);
+
+  if (fatal)
+    bolt_log_async_flush ();
+
+  return G_LOG_WRITER_HANDLED;
+}
+
+void
+bolt_log_async_flush (void)
+{
+  guint target;
+
+  if (log_async.thread == NULL || log_async.thread == g_thread_self ())
+    return;
+
+  target = (guint) g_atomic_int_get (&log_async.head);
+
+  g_mutex_lock (&log_async.lock);
+  g_cond_signal (&log_async.wakeup);
+
+  while ((gint) ((guint) g_atomic_int_get (&log_async.tail) - target) < 0)
+    {
+      gint64 deadline = g_get_monotonic_time () + 100 * G_TIME_SPAN_MILLISECOND;
+
+      g_cond_signal (&log_async.wakeup);
+      g_cond_wait_until (&log_async.drained, &log_async.lock, deadline);
+    }
+
+  g_mutex_unlock (&log_async.lock);
+}
+
+guint
+bolt_log_async_get_dropped (void)
+{
+  return (guint) g_atomic_int_get (&log_async.dropped);
+}
+
+/* contexts for foreign messages; a few per thread, since
+ * logging can happen from within a log writer */
+#define LOG_CTX_POOL_SIZE 4
+
+typedef struct _LogCtxPool
+{
+  guint      used;
+  BoltLogCtx slots[LOG_CTX_POOL_SIZE];
+} LogCtxPool;
+
+static GPrivate log_ctx_pool = G_PRIVATE_INIT (g_free);
+
+static BoltLogCtx *
+log_ctx_pool_get (void)
+{
+  LogCtxPool *pool = g_private_get (&log_ctx_pool);
+  BoltLogCtx *ctx;
+
+  if (G_UNLIKELY (pool == NULL))
+    {
+      pool = g_new0 (LogCtxPool, 1);
+      g_private_set (&log_ctx_pool, pool);
+    }
+
+  for (guint i = 0; i < LOG_CTX_POOL_SIZE; i++)
+    {
+      if (pool->used & (1U << i))
+        continue;
+
+      pool->used |= 1U << i;
+
+      ctx = &pool->slots[i];
+      memset (ctx, 0, sizeof (BoltLogCtx));
+      ctx->storage = LOG_CTX_POOL;
+      ctx->slot = i;
+
+      return ctx;
+    }
+
+  /* nested deeper than the pool is large */
+  ctx = g_new0 (BoltLogCtx, 1);
+  ctx->storage = LOG_CTX_HEAP;
+
+  return ctx;
+}
+
+static void
+log_ctx_pool_put (BoltLogCtx *ctx)
+{
+  LogCtxPool *pool;
+
+  if (ctx->storage == LOG_CTX_HEAP)
+    {
+      g_free (ctx);
+      return;
+    }
+
+  pool = g_private_get (&log_ctx_pool);
+  g_return_if_fail (pool != NULL);
+  g_return_if_fail (ctx == &pool->slots[ctx->slot]);
+
+  pool->used &= ~(1U << ctx->slot);
+}
+
 BoltLogCtx *
 bolt_log_ctx_acquire (const GLogField *fields,
                       gsize            n)
@@ -575,8 +2105,10 @@ bolt_log_ctx_acquire (const GLogField *fields,
       return ctx;
     }
 
-  ctx = g_new0 (BoltLogCtx, 1);
-  ctx->allocated = TRUE;
+  ctx = log_ctx_pool_get ();
+
+  ctx->foreign = fields;
+  ctx->n_foreign = n;
 
   bolt_log_ctx_next_field (ctx, &ctx->message);
   bolt_log_ctx_next_field (ctx, &ctx->priority);
@@ -586,17 +2118,30 @@ bolt_log_ctx_acquire (const GLogField *fields,
     {
       GLogField *field = (GLogField *) &fields[i];
 
-      if (bolt_streq (field->key, "MESSAGE"))
-        ctx->message = field;
-      else if (bolt_streq (field->key, "GLIB_DOMAIN"))
-        ctx->domain = field;
-      else if (bolt_streq (field->key, "PRIORITY"))
-        ctx->priority = field;
+      switch (log_field_index (field->key))
+        {
+        case LOG_FIELD_MESSAGE:
+          ctx->message = field;
+          break;
+
+        case LOG_FIELD_DOMAIN:
+          ctx->domain = field;
+          break;
+
+        case LOG_FIELD_PRIORITY:
+          ctx->priority = field;
+          break;
+
+        default:
+          log_ctx_index_field (ctx, field);
+          break;
+        }
     }
 
-  if (ctx->message == NULL)
+  /* no MESSAGE field, the placeholder is still empty */
+  if (ctx->message->key == NULL)
     {
-      g_free (ctx);
+      log_ctx_pool_put (ctx);
       return NULL;
     }
 
@@ -622,10 +2167,10 @@ bolt_log_ctx_set_id (BoltLogCtx *ctx,
 void
 bolt_log_ctx_free (BoltLogCtx *ctx)
 {
-  if (ctx == NULL || ctx->allocated == FALSE)
+  if (ctx == NULL || ctx->storage == LOG_CTX_STACK)
     return;
 
-  g_free (ctx);
+  log_ctx_pool_put (ctx);
 }
 
 const char *
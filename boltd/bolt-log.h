@@ -20,6 +20,7 @@
 
 #pragma once
 
+#include "bolt-clock.h"
 #include "bolt-names.h"
 
 #include <gio/gio.h>
@@ -36,28 +37,85 @@ G_BEGIN_DECLS
 #define LOG_DEV(device) "@device", device
 #define LOG_ERR(error) "@error", error
 #define LOG_TOPIC(topic) "@topic", topic
+#define LOG_SITE(site) "@site", site
 #define LOG_DEV_UID(uid) LOG_DIRECT (BOLT_LOG_DEVICE_UID, uid)
 #define LOG_MSG_ID(msg_id) LOG_DIRECT ("MESSAGE_ID", msg_id)
 #define LOG_ID(id) LOG_MSG_ID (BOLT_LOG_MSG_ID_ ## id)
 
 
-#define bolt_debug(...) bolt_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG,                 \
-                                  LOG_DIRECT ("CODE_FILE", __FILE__),               \
-                                  LOG_DIRECT ("CODE_LINE", G_STRINGIFY (__LINE__)), \
-                                  LOG_DIRECT ("CODE_FUNC", G_STRFUNC),              \
-                                  __VA_ARGS__)
+/* static call sites of the debug, info and message macros; 'args'
+ * is the argument list as written, i.e. never evaluated, from which
+ * the topic is parsed once, for the topic filter, and the format
+ * string for the flight recorder; the rate limiter keeps a per-site
+ * message count, which lets quiet sites skip its global lock */
+typedef struct _BoltLogSite
+{
+  const char *file;
+  const char *line;
+  const char *func;
+  const char *args;
+
+  /* private */
+  gsize       topic;
+  gint        rl_gen;
+  gint        rl_window;
+  gint        rl_count;
+  gint        rl_uid;
+} BoltLogSite;
+
+#define BOLT_LOG_SITE_INIT(args) \
+  {__FILE__, G_STRINGIFY (__LINE__), G_STRFUNC, args, 0, 0, 0, 0, 0}
+
+gboolean           bolt_log_site_enabled (BoltLogSite *site);
+
+void               bolt_log_flight_record (const BoltLogSite *site,
+                                           GLogLevelFlags     level);
+
+/* global mask of enabled log levels, checked by the macros below,
+ * like the debug topic filter, before any of their arguments are
+ * evaluated; disabled debug and info messages only record their
+ * static call site, including the unformatted text, in the flight
+ * recorder; see bolt_log_set_level_mask () */
+extern guint bolt_log_level_mask;
+
+#define bolt_log_level_enabled(level) \
+  ((g_atomic_int_get (&bolt_log_level_mask) & (level)) != 0)
+
+#define bolt_debug(...) G_STMT_START {                                  \
+    static BoltLogSite bolt_site__ = BOLT_LOG_SITE_INIT (#__VA_ARGS__); \
+    if (bolt_log_level_enabled (G_LOG_LEVEL_DEBUG) &&                   \
+        bolt_log_site_enabled (&bolt_site__))                           \
+      bolt_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG,                        \
+                LOG_DIRECT ("CODE_FILE", __FILE__),                     \
+                LOG_DIRECT ("CODE_LINE", G_STRINGIFY (__LINE__)),       \
+                LOG_DIRECT ("CODE_FUNC", G_STRFUNC),                    \
+                __VA_ARGS__);                                           \
+    else                                                                \
+      bolt_log_flight_record (&bolt_site__, G_LOG_LEVEL_DEBUG);         \
+} G_STMT_END
 
-#define bolt_info(...) bolt_log (G_LOG_DOMAIN, G_LOG_LEVEL_INFO,                   \
-                                 LOG_DIRECT ("CODE_FILE", __FILE__),               \
-                                 LOG_DIRECT ("CODE_LINE", G_STRINGIFY (__LINE__)), \
-                                 LOG_DIRECT ("CODE_FUNC", G_STRFUNC),              \
-                                 __VA_ARGS__)
+#define bolt_info(...) G_STMT_START {                                   \
+    static BoltLogSite bolt_site__ = BOLT_LOG_SITE_INIT (#__VA_ARGS__); \
+    if (bolt_log_level_enabled (G_LOG_LEVEL_INFO))                      \
+      bolt_log (G_LOG_DOMAIN, G_LOG_LEVEL_INFO,                         \
+                LOG_SITE (&bolt_site__),                                \
+                LOG_DIRECT ("CODE_FILE", __FILE__),                     \
+                LOG_DIRECT ("CODE_LINE", G_STRINGIFY (__LINE__)),       \
+                LOG_DIRECT ("CODE_FUNC", G_STRFUNC),                    \
+                __VA_ARGS__);                                           \
+    else                                                                \
+      bolt_log_flight_record (&bolt_site__, G_LOG_LEVEL_INFO);          \
+} G_STMT_END
 
-#define bolt_msg(...) bolt_log (G_LOG_DOMAIN, G_LOG_LEVEL_MESSAGE,                \
-                                LOG_DIRECT ("CODE_FILE", __FILE__),                \
-                                LOG_DIRECT ("CODE_LINE", G_STRINGIFY (__LINE__)),  \
-                                LOG_DIRECT ("CODE_FUNC", G_STRFUNC),               \
-                                __VA_ARGS__)
+#define bolt_msg(...) G_STMT_START {                                    \
+    static BoltLogSite bolt_site__ = BOLT_LOG_SITE_INIT (#__VA_ARGS__); \
+    bolt_log (G_LOG_DOMAIN, G_LOG_LEVEL_MESSAGE,                        \
+              LOG_SITE (&bolt_site__),                                  \
+              LOG_DIRECT ("CODE_FILE", __FILE__),                       \
+              LOG_DIRECT ("CODE_LINE", G_STRINGIFY (__LINE__)),         \
+              LOG_DIRECT ("CODE_FUNC", G_STRFUNC),                      \
+              __VA_ARGS__);                                             \
+} G_STMT_END
 
 #define bolt_warn(...) bolt_log (G_LOG_DOMAIN, G_LOG_LEVEL_WARNING,                 \
                                  LOG_DIRECT ("CODE_FILE", __FILE__),                \
@@ -112,6 +170,31 @@ void               bolt_log (const char    *domain,
                              GLogLevelFlags level,
                              ...);
 
+/* enable masks */
+void               bolt_log_set_level_mask (GLogLevelFlags levels);
+
+GLogLevelFlags     bolt_log_get_level_mask (void);
+
+void               bolt_log_set_debug (gboolean enabled);
+
+void               bolt_log_set_debug_topics (const char *topics);
+
+gboolean           bolt_log_topic_enabled (const char *topic);
+
+const char *       bolt_log_get_last_topic (void);
+
+/* rate limiting */
+#define BOLT_LOG_RATELIMIT_LEVELS   (G_LOG_LEVEL_MESSAGE | G_LOG_LEVEL_INFO)
+#define BOLT_LOG_RATELIMIT_BURST    10
+#define BOLT_LOG_RATELIMIT_INTERVAL 5
+
+void               bolt_log_set_rate_limit (guint burst,
+                                            guint interval);
+
+void               bolt_log_set_clock (BoltClock *clock);
+
+guint              bolt_log_get_suppressed (void);
+
 /* consumer functions */
 
 typedef struct _BoltLogCtx BoltLogCtx;
@@ -134,6 +217,30 @@ GLogWriterOutput    bolt_log_journal (const BoltLogCtx *ctx,
                                       GLogLevelFlags    log_level,
                                       guint             flags);
 
+/* flight recorder */
+#define BOLT_LOG_FLIGHT_TYPE "a(xusssss)"
+
+GVariant *         bolt_log_flight_dump (void);
+
+void               bolt_log_flight_clear (void);
+
+/* asynchronous writing */
+gboolean           bolt_log_async_start (guint          capacity,
+                                         GLogWriterFunc sink,
+                                         gpointer       user_data,
+                                         GError       **error);
+
+void               bolt_log_async_stop (void);
+
+gboolean           bolt_log_async_is_active (void);
+
+GLogWriterOutput   bolt_log_async_push (const BoltLogCtx *ctx,
+                                        GLogLevelFlags    level);
+
+void               bolt_log_async_flush (void);
+
+guint              bolt_log_async_get_dropped (void);
+
 void               bolt_log_gen_id (char id[BOLT_LOG_MSG_IDLEN]);
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (BoltLogCtx, bolt_log_ctx_free);
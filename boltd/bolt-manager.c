@@ -21,16 +21,23 @@
 #include "config.h"
 
 #include "bolt-bouncer.h"
+#include "bolt-clock.h"
 #include "bolt-config.h"
 #include "bolt-device.h"
 #include "bolt-domain.h"
 #include "bolt-error.h"
 #include "bolt-log.h"
+#include "bolt-metrics.h"
+#include "bolt-peer.h"
 #include "bolt-power.h"
+#include "bolt-snapshot.h"
+#include "bolt-stats.h"
 #include "bolt-store.h"
 #include "bolt-str.h"
 #include "bolt-sysfs.h"
+#include "bolt-time.h"
 #include "bolt-udev.h"
+#include "bolt-watchdog.h"
 
 #include "bolt-manager.h"
 
@@ -39,6 +46,7 @@
 
 #define MSEC_PER_USEC 1000LL
 #define PROBING_SETTLE_TIME_MS 2000 /* in milli-seconds */
+#define IDLE_CHECK_DIVISOR 4 /* checks per idle timeout */
 
 typedef struct udev_device udev_device;
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (udev_device, udev_device_unref);
@@ -84,14 +92,26 @@ static void          bolt_manager_label_device (BoltManager *mgr,
                                                 BoltDevice  *target);
 
 /* udev events */
-static void         handle_uevent_udev (BoltUdev           *udev,
-                                        const char         *action,
-                                        struct udev_device *device,
-                                        gpointer            user_data);
+static void          handle_uevent_probing (BoltUdev         *udev,
+                                            const BoltUevent *event,
+                                            gpointer          user_data);
+
+static void          handle_uevent_domain (BoltUdev         *udev,
+                                           const BoltUevent *event,
+                                           gpointer          user_data);
+
+static void          handle_uevent_device (BoltUdev         *udev,
+                                           const BoltUevent *event,
+                                           gpointer          user_data);
+
+static void          handle_udev_overflow (BoltUdev *udev,
+                                           gpointer  user_data);
+
+static void          manager_resync_thunderbolt (BoltManager *mgr);
 
 static void          handle_udev_domain_event (BoltManager        *mgr,
                                                struct udev_device *device,
-                                               const char         *action);
+                                               BoltUdevAction      action);
 
 static void          handle_udev_domain_added (BoltManager        *mgr,
                                                struct udev_device *udev);
@@ -101,7 +121,7 @@ static void          handle_udev_domain_removed (BoltManager *mgr,
 
 static void          handle_udev_device_event (BoltManager        *mgr,
                                                struct udev_device *device,
-                                               const char         *action);
+                                               BoltUdevAction      action);
 
 static void          handle_udev_device_added (BoltManager        *mgr,
                                                struct udev_device *udev);
@@ -120,6 +140,16 @@ static void          handle_udev_device_attached (BoltManager        *mgr,
 static void          handle_udev_device_detached (BoltManager *mgr,
                                                   BoltDevice  *dev);
 
+static void          manager_device_added (BoltManager *mgr,
+                                           BoltDevice  *dev);
+
+static void          manager_device_connected (BoltManager *mgr,
+                                               BoltDevice  *dev,
+                                               BoltStatus   status);
+
+static void          manager_scan_device (BoltManager         *mgr,
+                                          const BoltScanEntry *entry);
+
 /* signal callbacks */
 static void          handle_store_device_removed (BoltStore   *store,
                                                   const char  *uid,
@@ -152,6 +182,12 @@ static BoltPowerGuard *  manager_maybe_power_controller (BoltManager *mgr);
 /* config */
 static void          manager_load_user_config (BoltManager *mgr);
 
+/* idle exit and snapshots */
+static GVariant *    manager_load_snapshot (BoltManager *mgr);
+
+static gboolean      manager_restore_devices (BoltManager *mgr,
+                                              GVariant    *snapshot);
+
 /* dbus property setter */
 static gboolean handle_set_authmode (BoltExported *obj,
                                      const char   *name,
@@ -189,6 +225,11 @@ static GVariant *  handle_forget_device (BoltExported          *object,
                                          GDBusMethodInvocation *invocation,
                                          GError               **error);
 
+static GVariant *  handle_dump_flight_recorder (BoltExported          *object,
+                                                GVariant              *params,
+                                                GDBusMethodInvocation *invocation,
+                                                GError               **error);
+
 /*  */
 struct _BoltManager
 {
@@ -202,27 +243,43 @@ struct _BoltManager
   BoltDomain  *domains;
   GPtrArray   *devices;
   BoltPower   *power;
+  BoltStats   *stats;
   BoltSecurity security;
   BoltAuthMode authmode;
 
   /* policy enforcer */
   BoltBouncer *bouncer;
 
+  /* metrics text file, optional */
+  BoltMetrics *metrics;
+
   /* config */
   GKeyFile  *config;
   BoltPolicy policy;          /* default enrollment policy, unless specified */
 
+  /* time source for the timers */
+  BoltClock *clock;
+
   /* probing indicator  */
   guint      authorizing;     /* number of devices currently authorizing */
   GPtrArray *probing_roots;   /* pci device tree root */
   guint      probing_timeout; /* signal id & indicator */
   gint64     probing_tstamp;  /* time stamp of last activity */
   guint      probing_tsettle; /* how long to indicate after the last activity */
+
+  /* idle exit */
+  guint      idle_timeout;    /* seconds, 0 if disabled */
+  guint      idle_id;         /* periodic check */
+  gint64     idle_since;      /* clock time of the last activity */
+  guint64    idle_calls;      /* method calls seen until then */
 };
 
 enum {
   PROP_0,
 
+  PROP_UDEV,
+  PROP_CLOCK,
+
   PROP_VERSION,
   PROP_PROBING,
   PROP_POLICY,
@@ -236,6 +293,13 @@ enum {
 
 static GParamSpec *props[PROP_LAST] = {NULL, };
 
+enum {
+  SIGNAL_IDLE,
+  SIGNAL_LAST
+};
+
+static guint signals[SIGNAL_LAST] = {0};
+
 G_DEFINE_TYPE_WITH_CODE (BoltManager,
                          bolt_manager,
                          BOLT_TYPE_EXPORTED,
@@ -248,19 +312,32 @@ bolt_manager_finalize (GObject *object)
 {
   BoltManager *mgr = BOLT_MANAGER (object);
 
+  if (mgr->udev)
+    bolt_udev_unsubscribe_by_data (mgr->udev, mgr);
+
   g_clear_object (&mgr->udev);
 
   if (mgr->probing_timeout)
     {
-      g_source_remove (mgr->probing_timeout);
+      bolt_clock_source_remove (mgr->clock, mgr->probing_timeout);
       mgr->probing_timeout = 0;
     }
 
+  if (mgr->idle_id)
+    {
+      bolt_clock_source_remove (mgr->clock, mgr->idle_id);
+      mgr->idle_id = 0;
+    }
+
+  g_clear_object (&mgr->clock);
+
   g_clear_object (&mgr->store);
   g_ptr_array_free (mgr->devices, TRUE);
   bolt_domain_clear (&mgr->domains);
 
+  g_clear_object (&mgr->metrics);
   g_clear_object (&mgr->power);
+  g_clear_object (&mgr->stats);
 
   G_OBJECT_CLASS (bolt_manager_parent_class)->finalize (object);
 }
@@ -276,6 +353,14 @@ bolt_manager_get_property (GObject    *object,
 
   switch (prop_id)
     {
+    case PROP_UDEV:
+      g_value_set_object (value, mgr->udev);
+      break;
+
+    case PROP_CLOCK:
+      g_value_set_object (value, mgr->clock);
+      break;
+
     case PROP_VERSION:
       g_value_set_uint (value, BOLT_DBUS_API_VERSION);
       break;
@@ -305,6 +390,29 @@ bolt_manager_get_property (GObject    *object,
     }
 }
 
+static void
+bolt_manager_set_property (GObject      *object,
+                           guint         prop_id,
+                           const GValue *value,
+                           GParamSpec   *pspec)
+{
+  BoltManager *mgr = BOLT_MANAGER (object);
+
+  switch (prop_id)
+    {
+    case PROP_UDEV:
+      mgr->udev = g_value_dup_object (value);
+      break;
+
+    case PROP_CLOCK:
+      mgr->clock = g_value_dup_object (value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
 static void
 bolt_manager_init (BoltManager *mgr)
 {
@@ -333,6 +441,23 @@ bolt_manager_class_init (BoltManagerClass *klass)
 
   gobject_class->finalize = bolt_manager_finalize;
   gobject_class->get_property = bolt_manager_get_property;
+  gobject_class->set_property = bolt_manager_set_property;
+
+  props[PROP_UDEV] =
+    g_param_spec_object ("udev",
+                         NULL, NULL,
+                         BOLT_TYPE_UDEV,
+                         G_PARAM_READWRITE |
+                         G_PARAM_CONSTRUCT_ONLY |
+                         G_PARAM_STATIC_STRINGS);
+
+  props[PROP_CLOCK] =
+    g_param_spec_object ("clock",
+                         NULL, NULL,
+                         BOLT_TYPE_CLOCK,
+                         G_PARAM_READWRITE |
+                         G_PARAM_CONSTRUCT_ONLY |
+                         G_PARAM_STATIC_STRINGS);
 
   props[PROP_VERSION] =
     g_param_spec_uint ("version", "Version", "Version",
@@ -413,6 +538,20 @@ bolt_manager_class_init (BoltManagerClass *klass)
   bolt_exported_class_export_method (exported_class,
                                      "ForgetDevice",
                                      handle_forget_device);
+
+  bolt_exported_class_export_method (exported_class,
+                                     "DumpFlightRecorder",
+                                     handle_dump_flight_recorder);
+
+  signals[SIGNAL_IDLE] =
+    g_signal_new ("idle",
+                  G_TYPE_FROM_CLASS (gobject_class),
+                  G_SIGNAL_RUN_LAST,
+                  0,
+                  NULL, NULL,
+                  NULL,
+                  G_TYPE_NONE,
+                  0);
 }
 
 static void
@@ -428,12 +567,17 @@ bolt_manager_initialize (GInitable    *initable,
 {
   g_auto(GStrv) ids = NULL;
   g_autoptr(BoltPowerGuard) power = NULL;
+  g_autoptr(GPtrArray) scan = NULL;
+  g_autoptr(GError) scan_err = NULL;
+  g_autoptr(GVariant) snapshot = NULL;
   BoltManager *mgr;
-  struct udev_enumerate *enumerate;
-  struct udev_list_entry *l, *devices;
 
   mgr = BOLT_MANAGER (initable);
 
+  /* real time, unless a clock was given */
+  if (mgr->clock == NULL)
+    mgr->clock = bolt_clock_new ();
+
   /* load dynamic user configuration */
   manager_load_user_config (mgr);
 
@@ -444,17 +588,48 @@ bolt_manager_initialize (GInitable    *initable,
 
   bolt_bouncer_add_client (mgr->bouncer, mgr);
 
-  /* udev setup*/
-  bolt_info (LOG_TOPIC ("udev"), "initializing udev");
-  mgr->udev = bolt_udev_new ("udev", NULL, error);
-
+  /* udev setup, unless one was given */
   if (mgr->udev == NULL)
-    return FALSE;
+    {
+      bolt_info (LOG_TOPIC ("udev"), "initializing udev");
+      mgr->udev = bolt_udev_new ("udev", NULL, error);
 
-  g_signal_connect_object (mgr->udev, "uevent",
-                           (GCallback) handle_uevent_udev,
+      if (mgr->udev == NULL)
+        return FALSE;
+    }
+
+  /* NB: subscription order is dispatch order, i.e. probing
+   * is updated before the device and domain handlers run */
+  bolt_udev_subscribe (mgr->udev,
+                       BOLT_UDEV_SUBSYSTEM_ANY,
+                       BOLT_UDEV_DEVTYPE_ANY,
+                       handle_uevent_probing,
+                       mgr);
+
+  bolt_udev_subscribe (mgr->udev,
+                       BOLT_UDEV_SUBSYSTEM_THUNDERBOLT,
+                       BOLT_UDEV_DEVTYPE_DEVICE,
+                       handle_uevent_device,
+                       mgr);
+
+  bolt_udev_subscribe (mgr->udev,
+                       BOLT_UDEV_SUBSYSTEM_THUNDERBOLT,
+                       BOLT_UDEV_DEVTYPE_DOMAIN,
+                       handle_uevent_domain,
+                       mgr);
+
+  g_signal_connect_object (mgr->udev, "overflow",
+                           G_CALLBACK (handle_udev_overflow),
                            mgr, 0);
 
+  /* the device registry of the previous instance, if it exited
+   * when idle, saves reading the store; domains, devices and force
+   * power are live state, so sysfs is always enumerated in full */
+  snapshot = manager_load_snapshot (mgr);
+
+  if (snapshot != NULL && manager_restore_devices (mgr, snapshot))
+    goto setup_power;
+
   ids = bolt_store_list_uids (mgr->store, error);
   if (ids == NULL)
     {
@@ -483,73 +658,70 @@ bolt_manager_initialize (GInitable    *initable,
       manager_register_device (mgr, dev);
     }
 
+setup_power:
+
   /* setup the power controller */
-  mgr->power = bolt_power_new (mgr->udev);
+  mgr->power = bolt_power_new (mgr->udev, mgr->clock);
   bolt_bouncer_add_client (mgr->bouncer, mgr->power);
 
   g_signal_connect_object (mgr->power, "notify::state",
                            G_CALLBACK (handle_power_state_changed),
                            mgr, 0);
 
+  /* the statistics, exported alongside the manager */
+  mgr->stats = bolt_stats_new ();
+
   /* if we don't see any tb device, we try to force power */
   power = manager_maybe_power_controller (mgr);
 
+  /* the sysfs scan shared with the power subsystem was done
+   * before we forced the power, i.e. it is outdated now */
   if (power != NULL)
-    bolt_info (LOG_TOPIC ("manager"), "acquired power guard '%s'",
-               bolt_power_guard_get_id (power));
-
-  /* TODO: error checking */
-  enumerate =  bolt_udev_new_enumerate (mgr->udev, NULL);
-  udev_enumerate_add_match_subsystem (enumerate, "thunderbolt");
-  /* only devices (i.e. not the domain controller) */
+    {
+      bolt_info (LOG_TOPIC ("manager"), "acquired power guard '%s'",
+                 bolt_power_guard_get_id (power));
+      bolt_udev_scan_clear (mgr->udev);
+    }
 
   bolt_info (LOG_TOPIC ("udev"), "enumerating devices");
-  udev_enumerate_scan_devices (enumerate);
-  devices = udev_enumerate_get_list_entry (enumerate);
+  scan = bolt_udev_scan (mgr->udev, &scan_err);
 
-  udev_list_entry_foreach (l, devices)
+  if (scan == NULL)
+    bolt_warn_err (scan_err, LOG_TOPIC ("udev"), "failed to scan sysfs");
+
+  for (guint i = 0; scan && i < scan->len; i++)
     {
       g_autoptr(GError) err = NULL;
       g_autoptr(udev_device) udevice = NULL;
-      g_autoptr(BoltDevice) dev = NULL;
-      const char *uid;
-      const char *syspath;
-      const char *devtype;
-
-      syspath = udev_list_entry_get_name (l);
-      udevice = bolt_udev_device_new_from_syspath (mgr->udev,
-                                                   syspath,
-                                                   &err);
+      BoltScanEntry *entry = g_ptr_array_index (scan, i);
 
-      if (udevice == NULL)
+      if (entry->kind == BOLT_SCAN_DEVICE)
+        {
+          manager_scan_device (mgr, entry);
+          continue;
+        }
+      else if (entry->kind != BOLT_SCAN_DOMAIN)
         {
-          bolt_warn_err (err, "enumerating devices");
           continue;
         }
 
-      devtype = udev_device_get_devtype (udevice);
-
-      if (bolt_streq (devtype, "thunderbolt_domain"))
-        handle_udev_domain_added (mgr, udevice);
-
-      if (!bolt_streq (devtype, "thunderbolt_device"))
-        continue;
+      /* there are only ever a few domains, and the
+       * probing setup needs to walk up their parents */
+      udevice = bolt_udev_device_new_from_syspath (mgr->udev,
+                                                   entry->syspath,
+                                                   &err);
 
-      uid = udev_device_get_sysattr_value (udevice, "unique_id");
-      if (uid == NULL)
+      if (udevice == NULL)
         {
-          bolt_warn ("thunderbolt device without uid");
+          bolt_warn_err (err, "enumerating devices");
           continue;
         }
 
-      dev = manager_find_device_by_uid (mgr, uid, NULL);
-      if (dev)
-        handle_udev_device_attached (mgr, dev, udevice);
-      else
-        handle_udev_device_added (mgr, udevice);
+      handle_udev_domain_added (mgr, udevice);
     }
 
-  udev_enumerate_unref (enumerate);
+  /* startup is done, the scan results will be stale from now on */
+  bolt_udev_scan_clear (mgr->udev);
 
   return TRUE;
 }
@@ -633,6 +805,8 @@ manager_register_device (BoltManager *mgr,
   g_signal_connect_object (dev, "status-changed",
                            G_CALLBACK (handle_device_status_changed),
                            mgr, 0);
+
+  bolt_metrics_mark_dirty (mgr->metrics);
 }
 
 static void
@@ -640,6 +814,7 @@ manager_deregister_device (BoltManager *mgr,
                            BoltDevice  *dev)
 {
   g_ptr_array_remove_fast (mgr->devices, dev);
+  bolt_metrics_mark_dirty (mgr->metrics);
 }
 
 static BoltDevice *
@@ -918,55 +1093,195 @@ manager_maybe_auto_import_device (BoltManager *mgr,
 }
 
 /* udev callbacks */
+static gboolean
+handle_uevent_probing (BoltUdev         *udev,
+                       const BoltUevent *event,
+                       gpointer          user_data)
+{
+  BoltManager *mgr = BOLT_MANAGER (user_data);
+
+  if (event->action == BOLT_UDEV_ACTION_ADD)
+    manager_probing_device_added (mgr, event->device);
+  else if (event->action == BOLT_UDEV_ACTION_REMOVE)
+    manager_probing_device_removed (mgr, event->device);
+
+  /* sees every event, only for bookkeeping */
+  return FALSE;
+}
+
+static gboolean
+handle_uevent_domain (BoltUdev         *udev,
+                      const BoltUevent *event,
+                      gpointer          user_data)
+{
+  BoltManager *mgr = BOLT_MANAGER (user_data);
+
+  bolt_debug (LOG_TOPIC ("udev"), "%s (thunderbolt/domain) %s",
+              event->action_str, event->syspath);
+
+  handle_udev_domain_event (mgr, event->device, event->action);
+
+  return TRUE;
+}
+
+static gboolean
+handle_uevent_device (BoltUdev         *udev,
+                      const BoltUevent *event,
+                      gpointer          user_data)
+{
+  BoltManager *mgr = BOLT_MANAGER (user_data);
+
+  bolt_debug (LOG_TOPIC ("udev"), "%s (thunderbolt/device) %s",
+              event->action_str, event->syspath);
+
+  handle_udev_device_event (mgr, event->device, event->action);
+
+  return TRUE;
+}
+
 static void
-handle_uevent_udev (BoltUdev           *udev,
-                    const char         *action,
-                    struct udev_device *device,
-                    gpointer            user_data)
+handle_udev_overflow (BoltUdev *udev,
+                      gpointer  user_data)
 {
-  BoltManager *mgr;
-  const char *subsystem;
-  const char *devtype;
-  const char *syspath;
+  BoltManager *mgr = BOLT_MANAGER (user_data);
 
-  mgr = BOLT_MANAGER (user_data);
+  manager_resync_thunderbolt (mgr);
+}
 
-  devtype = udev_device_get_devtype (device);
-  subsystem = udev_device_get_subsystem (device);
-  syspath = udev_device_get_syspath (device);
+static void
+manager_resync_thunderbolt (BoltManager *mgr)
+{
+  g_autoptr(GError) err = NULL;
+  g_autoptr(GHashTable) seen = NULL;
+  g_autoptr(GPtrArray) stale = NULL;
+  struct udev_enumerate *enumerate;
+  struct udev_list_entry *l, *devices;
+  BoltDomain *iter;
+  guint n_domains;
+  guint n_devices = 0;
+  int r;
 
-  if (g_str_equal (action, "add"))
-    manager_probing_device_added (mgr, device);
-  else if (g_str_equal (action, "remove"))
-    manager_probing_device_removed (mgr, device);
+  bolt_info (LOG_TOPIC ("udev"), "resync: rescanning thunderbolt devices");
+  bolt_stats_udev_resync ();
+  bolt_metrics_mark_dirty (mgr->metrics);
 
-  /* beyond this point only udev device from the
-   * thunderbolt are handled */
-  if (!bolt_streq (subsystem, "thunderbolt"))
-    return;
+  enumerate = bolt_udev_new_enumerate (mgr->udev, &err);
+  if (enumerate == NULL)
+    {
+      bolt_warn_err (err, LOG_TOPIC ("udev"), "resync failed");
+      return;
+    }
+
+  udev_enumerate_add_match_subsystem (enumerate, "thunderbolt");
+
+  r = udev_enumerate_scan_devices (enumerate);
+  if (r < 0)
+    {
+      bolt_warn (LOG_TOPIC ("udev"), "resync: failed to scan udev: %s",
+                 g_strerror (-r));
+      udev_enumerate_unref (enumerate);
+      return;
+    }
 
-  bolt_debug (LOG_TOPIC ("udev"), "%s (%s%s%s) %s", action,
-              subsystem, devtype ? "/" : "", devtype ? : "",
-              syspath);
+  seen = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  devices = udev_enumerate_get_list_entry (enumerate);
+
+  /* step 1: handle everything that is present in sysfs;
+   * the event handlers take care of only doing the work that
+   * is needed, i.e. new objects are added, existing ones are
+   * attached or updated */
+  udev_list_entry_foreach (l, devices)
+    {
+      g_autoptr(udev_device) udevice = NULL;
+      const char *syspath;
+      const char *devtype;
+
+      syspath = udev_list_entry_get_name (l);
+      udevice = bolt_udev_device_new_from_syspath (mgr->udev,
+                                                   syspath,
+                                                   NULL);
+
+      if (udevice == NULL)
+        continue;
+
+      g_hash_table_add (seen, g_strdup (syspath));
+      devtype = udev_device_get_devtype (udevice);
+
+      if (bolt_streq (devtype, "thunderbolt_domain"))
+        {
+          handle_udev_domain_event (mgr, udevice, BOLT_UDEV_ACTION_ADD);
+        }
+      else if (bolt_streq (devtype, "thunderbolt_device"))
+        {
+          handle_udev_device_event (mgr, udevice, BOLT_UDEV_ACTION_CHANGE);
+          n_devices++;
+        }
+    }
+
+  udev_enumerate_unref (enumerate);
+
+  /* step 2: everything we think is connected but that is
+   * not present in sysfs anymore got removed */
+  stale = g_ptr_array_new_with_free_func (g_object_unref);
+
+  for (guint i = 0; i < mgr->devices->len; i++)
+    {
+      BoltDevice *dev = g_ptr_array_index (mgr->devices, i);
+      const char *syspath = bolt_device_get_syspath (dev);
+
+      if (!bolt_device_is_connected (dev) || syspath == NULL)
+        continue;
 
-  if (bolt_streq (devtype, "thunderbolt_device"))
-    handle_udev_device_event (mgr, device, action);
-  else if (bolt_streq (devtype, "thunderbolt_domain"))
-    handle_udev_domain_event (mgr, device, action);
+      if (g_hash_table_contains (seen, syspath))
+        continue;
+
+      g_ptr_array_add (stale, g_object_ref (dev));
+    }
+
+  for (guint i = 0; i < stale->len; i++)
+    {
+      BoltDevice *dev = g_ptr_array_index (stale, i);
+
+      if (bolt_device_get_stored (dev))
+        handle_udev_device_detached (mgr, dev);
+      else
+        handle_udev_device_removed (mgr, dev);
+    }
+
+  g_ptr_array_set_size (stale, 0);
+
+  iter = mgr->domains;
+  n_domains = bolt_domain_count (mgr->domains);
+  for (guint i = 0; i < n_domains; i++)
+    {
+      const char *syspath = bolt_domain_get_syspath (iter);
+
+      if (!g_hash_table_contains (seen, syspath))
+        g_ptr_array_add (stale, g_object_ref (iter));
+
+      iter = bolt_domain_next (iter);
+    }
+
+  for (guint i = 0; i < stale->len; i++)
+    handle_udev_domain_removed (mgr, g_ptr_array_index (stale, i));
+
+  bolt_msg (LOG_TOPIC ("udev"),
+            "resync done: %u device(s) present, %u domain(s) removed",
+            n_devices, stale->len);
 }
 
 static void
 handle_udev_domain_event (BoltManager        *mgr,
                           struct udev_device *device,
-                          const char         *action)
+                          BoltUdevAction      action)
 {
   const char *syspath;
   BoltDomain *domain;
 
   syspath = udev_device_get_syspath (device);
 
-  if (g_str_equal (action, "add") ||
-      g_str_equal (action, "change"))
+  if (action == BOLT_UDEV_ACTION_ADD ||
+      action == BOLT_UDEV_ACTION_CHANGE)
     {
       domain = manager_find_domain_by_syspath (mgr, syspath);
 
@@ -975,7 +1290,7 @@ handle_udev_domain_event (BoltManager        *mgr,
 
       handle_udev_domain_added (mgr, device);
     }
-  else if (g_str_equal (action, "remove"))
+  else if (action == BOLT_UDEV_ACTION_REMOVE)
     {
       domain = manager_find_domain_by_syspath (mgr, syspath);
 
@@ -1055,12 +1370,12 @@ handle_udev_domain_removed (BoltManager *mgr,
 static void
 handle_udev_device_event (BoltManager        *mgr,
                           struct udev_device *device,
-                          const char         *action)
+                          BoltUdevAction      action)
 {
   g_autoptr(BoltDevice) dev = NULL;
 
-  if (g_str_equal (action, "add") ||
-      g_str_equal (action, "change"))
+  if (action == BOLT_UDEV_ACTION_ADD ||
+      action == BOLT_UDEV_ACTION_CHANGE)
     {
       const char *uid;
 
@@ -1079,7 +1394,7 @@ handle_udev_device_event (BoltManager        *mgr,
       else
         handle_udev_device_changed (mgr, dev, device);
     }
-  else if (g_str_equal (action, "remove"))
+  else if (action == BOLT_UDEV_ACTION_REMOVE)
     {
       const char *syspath;
       const char *name;
@@ -1115,11 +1430,8 @@ handle_udev_device_added (BoltManager        *mgr,
                           struct udev_device *udev)
 {
   g_autoptr(GError) err = NULL;
-  GDBusConnection *bus;
   BoltDevice *dev;
-  BoltStatus status;
   BoltDomain *domain;
-  const char *opath;
   const char *syspath;
 
   syspath = udev_device_get_syspath (udev);
@@ -1140,11 +1452,25 @@ handle_udev_device_added (BoltManager        *mgr,
       return;
     }
 
+  manager_device_added (mgr, dev);
+}
+
+/* takes ownership of dev */
+static void
+manager_device_added (BoltManager *mgr,
+                      BoltDevice  *dev)
+{
+  g_autoptr(GError) err = NULL;
+  GDBusConnection *bus;
+  BoltStatus status;
+  const char *opath;
+
   manager_register_device (mgr, dev);
 
   status = bolt_device_get_status (dev);
   bolt_msg (LOG_DEV (dev), "device added, status: %s, at %s",
-            bolt_status_to_string (status), syspath);
+            bolt_status_to_string (status),
+            bolt_device_get_syspath (dev));
 
   bolt_manager_label_device (mgr, dev);
 
@@ -1221,7 +1547,6 @@ handle_udev_device_attached (BoltManager        *mgr,
                              BoltDevice         *dev,
                              struct udev_device *udev)
 {
-  g_autoptr(BoltDevice) parent = NULL;
   BoltDomain *domain;
   const char *syspath;
   BoltStatus status;
@@ -1238,9 +1563,19 @@ handle_udev_device_attached (BoltManager        *mgr,
     }
 
   status = bolt_device_connected (dev, domain, udev);
+  manager_device_connected (mgr, dev, status);
+}
+
+static void
+manager_device_connected (BoltManager *mgr,
+                          BoltDevice  *dev,
+                          BoltStatus   status)
+{
+  g_autoptr(BoltDevice) parent = NULL;
 
   bolt_msg (LOG_DEV (dev), "connected: %s (%s)",
-            bolt_status_to_string (status), syspath);
+            bolt_status_to_string (status),
+            bolt_device_get_syspath (dev));
 
   if (status != BOLT_STATUS_CONNECTED)
     return;
@@ -1276,6 +1611,52 @@ handle_udev_device_detached (BoltManager *mgr,
   bolt_device_disconnected (dev);
 }
 
+/* devices present at startup, the equivalent of the
+ * udev add event, but straight from the sysfs scan */
+static void
+manager_scan_device (BoltManager         *mgr,
+                     const BoltScanEntry *entry)
+{
+  g_autoptr(GError) err = NULL;
+  g_autoptr(BoltDevice) dev = NULL;
+  BoltDomain *domain;
+  BoltStatus status;
+
+  if (entry->uid == NULL)
+    {
+      bolt_warn ("thunderbolt device without uid");
+      return;
+    }
+
+  domain = manager_find_domain_by_syspath (mgr, entry->syspath);
+
+  if (domain == NULL)
+    {
+      bolt_warn (LOG_TOPIC ("domain"),
+                 "could not find domain for device at '%s'",
+                 entry->syspath);
+      return;
+    }
+
+  dev = manager_find_device_by_uid (mgr, entry->uid, NULL);
+
+  if (dev != NULL)
+    {
+      status = bolt_device_connected_for_scan (dev, domain, entry);
+      manager_device_connected (mgr, dev, status);
+      return;
+    }
+
+  dev = bolt_device_new_for_scan (entry, domain, &err);
+  if (dev == NULL)
+    {
+      bolt_warn_err (err, LOG_TOPIC ("udev"), "could not create device");
+      return;
+    }
+
+  manager_device_added (mgr, g_steal_pointer (&dev));
+}
+
 static void
 handle_store_device_removed (BoltStore   *store,
                              const char  *uid,
@@ -1336,6 +1717,8 @@ handle_device_status_changed (BoltDevice  *dev,
   if (now == old)
     return; /* sanity check */
 
+  bolt_metrics_mark_dirty (mgr->metrics);
+
   if (now == BOLT_STATUS_AUTHORIZING)
     mgr->authorizing += 1;
   else if (old == BOLT_STATUS_AUTHORIZING)
@@ -1372,15 +1755,18 @@ handle_power_state_changed (GObject    *gobject,
 static gboolean
 probing_timeout (gpointer user_data)
 {
+  g_auto(BoltWatchdogScope) scope = BOLT_WATCHDOG_SCOPE_INIT;
   BoltManager *mgr;
   gint64 now, dt, timeout;
 
+  bolt_watchdog_scope_enter (&scope, G_STRFUNC);
+
   mgr = BOLT_MANAGER (user_data);
 
   if (mgr->authorizing > 0)
     return G_SOURCE_CONTINUE;
 
-  now = g_get_monotonic_time ();
+  now = bolt_clock_get_time (mgr->clock);
   dt = now - mgr->probing_tstamp;
 
   /* dt is in microseconds, probing timeout in
@@ -1402,13 +1788,15 @@ manager_probing_activity (BoltManager *mgr,
 {
   guint dt;
 
-  mgr->probing_tstamp = g_get_monotonic_time ();
+  mgr->probing_tstamp = bolt_clock_get_time (mgr->clock);
   if (mgr->probing_timeout || weak)
     return;
 
   dt = mgr->probing_tsettle / 2;
   bolt_info (LOG_TOPIC ("probing"), "started [%u]", dt);
-  mgr->probing_timeout = g_timeout_add (dt, probing_timeout, mgr);
+  mgr->probing_timeout = bolt_clock_timeout_add (mgr->clock, dt,
+                                                 probing_timeout, mgr,
+                                                 "[boltd] probing");
   g_object_notify_by_pspec (G_OBJECT (mgr), props[PROP_PROBING]);
 }
 
@@ -1960,6 +2348,19 @@ handle_forget_device (BoltExported          *obj,
   return ok ? g_variant_new ("()") : NULL;
 }
 
+static GVariant *
+handle_dump_flight_recorder (BoltExported          *obj,
+                             GVariant              *params,
+                             GDBusMethodInvocation *inv,
+                             GError               **error)
+{
+  GVariant *events;
+
+  events = bolt_log_flight_dump ();
+
+  return g_variant_new_tuple (&events, 1);
+}
+
 /* public methods */
 gboolean
 bolt_manager_export (BoltManager     *mgr,
@@ -1987,6 +2388,18 @@ bolt_manager_export (BoltManager     *mgr,
       g_clear_error (&err);
     }
 
+  ok = bolt_exported_export (BOLT_EXPORTED (mgr->stats),
+                             connection,
+                             BOLT_DBUS_PATH,
+                             &err);
+
+  if (!ok)
+    {
+      bolt_warn_err (err, LOG_TOPIC ("dbus"),
+                     "failed to export stats object");
+      g_clear_error (&err);
+    }
+
   bolt_domain_foreach (mgr->domains,
                        (GFunc) bolt_domain_export,
                        connection);
@@ -2045,3 +2458,480 @@ bolt_manager_got_the_name (BoltManager *mgr)
                                  NULL);
     }
 }
+
+BoltDevice *
+bolt_manager_get_device (BoltManager *mgr,
+                         const char  *uid,
+                         GError     **error)
+{
+  g_return_val_if_fail (BOLT_IS_MANAGER (mgr), NULL);
+
+  return manager_find_device_by_uid (mgr, uid, error);
+}
+
+/* metrics */
+static void
+manager_metrics_collect (GString *out,
+                         gpointer user_data)
+{
+  g_autoptr(GEnumClass) status_class = NULL;
+  g_autoptr(GEnumClass) security_class = NULL;
+  g_autoptr(GEnumClass) power_class = NULL;
+  BoltManager *mgr = BOLT_MANAGER (user_data);
+  BoltPowerState state;
+  guint64 overflows;
+  guint64 resyncs;
+  guint64 stalls;
+  guint64 worst;
+  guint stored = 0;
+  guint guards = 0;
+
+  status_class = g_type_class_ref (BOLT_TYPE_STATUS);
+  security_class = g_type_class_ref (BOLT_TYPE_SECURITY);
+  power_class = g_type_class_ref (BOLT_TYPE_POWER_STATE);
+
+  bolt_metrics_add_family (out, "boltd_devices", "gauge",
+                           "Number of devices by status.");
+
+  for (guint i = 0; i < status_class->n_values; i++)
+    {
+      const GEnumValue *ev = &status_class->values[i];
+      guint n = 0;
+
+      for (guint k = 0; k < mgr->devices->len; k++)
+        {
+          BoltDevice *dev = g_ptr_array_index (mgr->devices, k);
+          n += bolt_device_get_status (dev) == ev->value;
+        }
+
+      bolt_metrics_add_sample (out, "boltd_devices",
+                               "status", ev->value_nick, n);
+    }
+
+  bolt_metrics_add_family (out, "boltd_devices_security", "gauge",
+                           "Number of devices by security level.");
+
+  for (guint i = 0; i < security_class->n_values; i++)
+    {
+      const GEnumValue *ev = &security_class->values[i];
+      guint n = 0;
+
+      for (guint k = 0; k < mgr->devices->len; k++)
+        {
+          BoltDevice *dev = g_ptr_array_index (mgr->devices, k);
+          n += bolt_device_get_security (dev) == ev->value;
+        }
+
+      bolt_metrics_add_sample (out, "boltd_devices_security",
+                               "security", ev->value_nick, n);
+    }
+
+  for (guint k = 0; k < mgr->devices->len; k++)
+    {
+      BoltDevice *dev = g_ptr_array_index (mgr->devices, k);
+      stored += bolt_device_get_stored (dev);
+    }
+
+  bolt_metrics_add_family (out, "boltd_store_devices", "gauge",
+                           "Number of devices in the store.");
+  bolt_metrics_add_sample (out, "boltd_store_devices", NULL, NULL, stored);
+
+  state = bolt_power_get_state (mgr->power);
+  bolt_metrics_add_family (out, "boltd_force_power", "gauge",
+                           "Force power state, 1 for the current one.");
+
+  for (guint i = 0; i < power_class->n_values; i++)
+    {
+      const GEnumValue *ev = &power_class->values[i];
+
+      bolt_metrics_add_sample (out, "boltd_force_power",
+                               "state", ev->value_nick,
+                               ev->value == (gint) state);
+    }
+
+  g_object_get (mgr->power, "guards", &guards, NULL);
+  bolt_metrics_add_family (out, "boltd_force_power_guards", "gauge",
+                           "Number of active force power guards.");
+  bolt_metrics_add_sample (out, "boltd_force_power_guards", NULL, NULL, guards);
+
+  bolt_metrics_add_histogram (out, "boltd_authorization_duration_seconds",
+                              "Time from preparing an authorization until it finished.",
+                              BOLT_STATS_AUTHORIZE);
+
+  stalls = bolt_stats_get_stalls (&worst);
+  bolt_metrics_add_family (out, "boltd_mainloop_stalls", "counter",
+                           "Main loop iterations longer than the watchdog threshold.");
+  bolt_metrics_add_sample (out, "boltd_mainloop_stalls_total", NULL, NULL, stalls);
+
+  bolt_metrics_add_family (out, "boltd_mainloop_worst_stall_seconds", "gauge",
+                           "Longest main loop iteration seen by the watchdog.");
+  bolt_metrics_add_sample (out, "boltd_mainloop_worst_stall_seconds", NULL, NULL,
+                           (double) worst / G_USEC_PER_SEC);
+
+  overflows = bolt_stats_get_overflows (&resyncs);
+  bolt_metrics_add_family (out, "boltd_uevent_overflows", "counter",
+                           "Receive buffer overflows of the udev monitor.");
+  bolt_metrics_add_sample (out, "boltd_uevent_overflows_total", NULL, NULL, overflows);
+
+  bolt_metrics_add_family (out, "boltd_uevent_resyncs", "counter",
+                           "Rescans of the device state after uevents were lost.");
+  bolt_metrics_add_sample (out, "boltd_uevent_resyncs_total", NULL, NULL, resyncs);
+}
+
+void
+bolt_manager_enable_metrics (BoltManager *mgr,
+                             guint        interval)
+{
+  g_autofree char *rundir = NULL;
+  g_autofree char *path = NULL;
+
+  g_return_if_fail (BOLT_IS_MANAGER (mgr));
+
+  if (mgr->metrics != NULL)
+    return;
+
+  g_object_get (mgr->power, "rundir", &rundir, NULL);
+  path = g_build_filename (rundir, "metrics", BOLT_METRICS_FILE, NULL);
+
+  mgr->metrics = bolt_metrics_new (path, interval,
+                                   manager_metrics_collect,
+                                   mgr);
+
+  /* device changes are tracked in the status and
+   * register paths, everything else is done here */
+  g_signal_connect_object (mgr->power, "notify::state",
+                           G_CALLBACK (bolt_metrics_mark_dirty),
+                           mgr->metrics, G_CONNECT_SWAPPED);
+
+  g_signal_connect_object (mgr->power, "notify::guards",
+                           G_CALLBACK (bolt_metrics_mark_dirty),
+                           mgr->metrics, G_CONNECT_SWAPPED);
+
+  g_signal_connect_object (mgr->store, "device-added",
+                           G_CALLBACK (bolt_metrics_mark_dirty),
+                           mgr->metrics, G_CONNECT_SWAPPED);
+
+  g_signal_connect_object (mgr->store, "device-removed",
+                           G_CALLBACK (bolt_metrics_mark_dirty),
+                           mgr->metrics, G_CONNECT_SWAPPED);
+
+  bolt_info (LOG_TOPIC ("metrics"), "writing metrics to %s every %us at most",
+             path, interval);
+
+  bolt_metrics_mark_dirty (mgr->metrics);
+}
+
+/* idle exit */
+static gboolean
+manager_is_idle (BoltManager *mgr)
+{
+  BoltPowerState state;
+  guint64 calls;
+
+  if (mgr->authorizing > 0 || mgr->probing_timeout > 0)
+    return FALSE;
+
+  state = bolt_power_get_state (mgr->power);
+  if (state == BOLT_FORCE_POWER_ON || state == BOLT_FORCE_POWER_WAIT)
+    return FALSE;
+
+  for (guint i = 0; i < mgr->devices->len; i++)
+    {
+      BoltDevice *dev = g_ptr_array_index (mgr->devices, i);
+
+      /* the host is always connected */
+      if (bolt_device_type_is_host (bolt_device_get_device_type (dev)))
+        continue;
+
+      if (bolt_device_is_connected (dev))
+        return FALSE;
+    }
+
+  if (bolt_peer_server_count_clients () > 0)
+    return FALSE;
+
+  /* bus clients that talked to us, e.g. to read properties
+   * before listening for signals, until they disconnect */
+  if (bolt_exported_count_clients () > 0)
+    return FALSE;
+
+  /* every method call or property access counts as activity */
+  calls = bolt_stats_get_histogram (BOLT_STATS_METHOD_CALL, NULL, NULL);
+  if (calls != mgr->idle_calls)
+    {
+      mgr->idle_calls = calls;
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+manager_idle_check (gpointer user_data)
+{
+  g_auto(BoltWatchdogScope) scope = BOLT_WATCHDOG_SCOPE_INIT;
+  BoltManager *mgr = BOLT_MANAGER (user_data);
+  gint64 now, dt;
+
+  bolt_watchdog_scope_enter (&scope, G_STRFUNC);
+
+  now = bolt_clock_get_time (mgr->clock);
+
+  if (!manager_is_idle (mgr))
+    {
+      mgr->idle_since = now;
+      return G_SOURCE_CONTINUE;
+    }
+
+  dt = now - mgr->idle_since;
+  if (dt < (gint64) mgr->idle_timeout * G_USEC_PER_SEC)
+    return G_SOURCE_CONTINUE;
+
+  bolt_msg (LOG_TOPIC ("manager"), "idle for %us", mgr->idle_timeout);
+
+  mgr->idle_id = 0;
+  g_signal_emit (mgr, signals[SIGNAL_IDLE], 0);
+
+  return G_SOURCE_REMOVE;
+}
+
+void
+bolt_manager_enable_idle_exit (BoltManager *mgr,
+                               guint        timeout)
+{
+  guint interval;
+
+  g_return_if_fail (BOLT_IS_MANAGER (mgr));
+  g_return_if_fail (timeout > 0);
+
+  if (mgr->idle_id != 0)
+    return;
+
+  mgr->idle_timeout = timeout;
+  mgr->idle_since = bolt_clock_get_time (mgr->clock);
+  mgr->idle_calls = bolt_stats_get_histogram (BOLT_STATS_METHOD_CALL,
+                                              NULL, NULL);
+
+  interval = MAX (timeout / IDLE_CHECK_DIVISOR, 1);
+  mgr->idle_id = bolt_clock_timeout_add_seconds (mgr->clock,
+                                                 interval,
+                                                 manager_idle_check,
+                                                 mgr,
+                                                 "[boltd] idle");
+
+  bolt_info (LOG_TOPIC ("manager"), "exiting after %us of inactivity",
+             timeout);
+}
+
+/* snapshots */
+static GVariant *
+manager_snapshot_devices (BoltManager *mgr)
+{
+  GVariantBuilder b;
+
+  g_variant_builder_init (&b, G_VARIANT_TYPE ("aa{sv}"));
+
+  /* the registry, i.e. what would be loaded from the store */
+  for (guint i = 0; i < mgr->devices->len; i++)
+    {
+      BoltDevice *dev = g_ptr_array_index (mgr->devices, i);
+      const char *label;
+
+      if (!bolt_device_get_stored (dev))
+        continue;
+
+      g_variant_builder_open (&b, G_VARIANT_TYPE_VARDICT);
+
+      g_variant_builder_add (&b, "{sv}", "uid",
+                             g_variant_new_string (bolt_device_get_uid (dev)));
+      g_variant_builder_add (&b, "{sv}", "name",
+                             g_variant_new_string (bolt_device_get_name (dev)));
+      g_variant_builder_add (&b, "{sv}", "vendor",
+                             g_variant_new_string (bolt_device_get_vendor (dev)));
+      g_variant_builder_add (&b, "{sv}", "type",
+                             g_variant_new_uint32 (bolt_device_get_device_type (dev)));
+      g_variant_builder_add (&b, "{sv}", "policy",
+                             g_variant_new_uint32 (bolt_device_get_policy (dev)));
+      g_variant_builder_add (&b, "{sv}", "key",
+                             g_variant_new_uint32 (bolt_device_get_keystate (dev)));
+      g_variant_builder_add (&b, "{sv}", "storetime",
+                             g_variant_new_uint64 (bolt_device_get_storetime (dev)));
+      g_variant_builder_add (&b, "{sv}", "conntime",
+                             g_variant_new_uint64 (bolt_device_get_conntime (dev)));
+      g_variant_builder_add (&b, "{sv}", "authtime",
+                             g_variant_new_uint64 (bolt_device_get_authtime (dev)));
+
+      label = bolt_device_get_label (dev);
+      if (label != NULL)
+        g_variant_builder_add (&b, "{sv}", "label",
+                               g_variant_new_string (label));
+
+      g_variant_builder_close (&b);
+    }
+
+  return g_variant_builder_end (&b);
+}
+
+gboolean
+bolt_manager_save_snapshot (BoltManager *mgr,
+                            GError     **error)
+{
+  g_autofree char *stamp = NULL;
+  g_autofree char *path = NULL;
+  GVariantBuilder b;
+  gboolean ok;
+
+  g_return_val_if_fail (BOLT_IS_MANAGER (mgr), FALSE);
+
+  stamp = bolt_store_get_stamp (mgr->store);
+
+  g_variant_builder_init (&b, G_VARIANT_TYPE_VARDICT);
+
+  g_variant_builder_add (&b, "{sv}", "time",
+                         g_variant_new_uint64 (bolt_now_in_seconds ()));
+  g_variant_builder_add (&b, "{sv}", "store",
+                         g_variant_new_string (stamp));
+  g_variant_builder_add (&b, "{sv}", "devices",
+                         manager_snapshot_devices (mgr));
+
+  path = bolt_snapshot_path ();
+  ok = bolt_snapshot_save (path, g_variant_builder_end (&b), error);
+
+  if (ok)
+    bolt_info (LOG_TOPIC ("manager"), "state saved to %s", path);
+
+  return ok;
+}
+
+static GVariant *
+manager_load_snapshot (BoltManager *mgr)
+{
+  g_autoptr(GError) err = NULL;
+  g_autofree char *path = NULL;
+  GVariant *snapshot;
+  guint64 then = 0;
+  guint64 now;
+
+  path = bolt_snapshot_path ();
+  snapshot = bolt_snapshot_load (path, &err);
+
+  if (snapshot == NULL)
+    {
+      if (!bolt_err_notfound (err))
+        bolt_warn_err (err, LOG_TOPIC ("manager"), "could not load snapshot");
+      return NULL;
+    }
+
+  now = bolt_now_in_seconds ();
+  g_variant_lookup (snapshot, "time", "t", &then);
+
+  bolt_info (LOG_TOPIC ("manager"), "loaded snapshot from %s, %" G_GUINT64_FORMAT "s old",
+             path, now > then ? now - then : 0);
+
+  return snapshot;
+}
+
+static BoltDevice *
+manager_device_from_snapshot (BoltManager *mgr,
+                              GVariant    *entry)
+{
+  const char *uid;
+  const char *name;
+  const char *vendor;
+  const char *label = NULL;
+  guint32 type, policy, key;
+  guint64 stime, ctime, atime;
+  gboolean ok;
+
+  ok = g_variant_lookup (entry, "uid", "&s", &uid) &&
+       g_variant_lookup (entry, "name", "&s", &name) &&
+       g_variant_lookup (entry, "vendor", "&s", &vendor) &&
+       g_variant_lookup (entry, "type", "u", &type) &&
+       g_variant_lookup (entry, "policy", "u", &policy) &&
+       g_variant_lookup (entry, "key", "u", &key) &&
+       g_variant_lookup (entry, "storetime", "t", &stime) &&
+       g_variant_lookup (entry, "conntime", "t", &ctime) &&
+       g_variant_lookup (entry, "authtime", "t", &atime);
+
+  if (!ok)
+    return NULL;
+
+  ok = bolt_enum_validate (BOLT_TYPE_DEVICE_TYPE, (gint) type, NULL) &&
+       bolt_enum_validate (BOLT_TYPE_POLICY, (gint) policy, NULL) &&
+       bolt_enum_validate (BOLT_TYPE_KEY_STATE, (gint) key, NULL);
+
+  if (!ok)
+    return NULL;
+
+  g_variant_lookup (entry, "label", "&s", &label);
+
+  return g_object_new (BOLT_TYPE_DEVICE,
+                       "uid", uid,
+                       "name", name,
+                       "vendor", vendor,
+                       "type", type,
+                       "status", BOLT_STATUS_DISCONNECTED,
+                       "store", mgr->store,
+                       "policy", policy,
+                       "key", key,
+                       "storetime", stime,
+                       "conntime", ctime,
+                       "authtime", atime,
+                       "label", label,
+                       NULL);
+}
+
+static gboolean
+manager_restore_devices (BoltManager *mgr,
+                         GVariant    *snapshot)
+{
+  g_autoptr(GPtrArray) restored = NULL;
+  g_autoptr(GVariant) devices = NULL;
+  g_autofree char *stamp = NULL;
+  const char *have = NULL;
+  gsize n;
+
+  /* devices or keys added or removed behind our back */
+  stamp = bolt_store_get_stamp (mgr->store);
+
+  if (!g_variant_lookup (snapshot, "store", "&s", &have) ||
+      !bolt_streq (have, stamp))
+    {
+      bolt_info (LOG_TOPIC ("store"), "store changed since the snapshot");
+      return FALSE;
+    }
+
+  devices = g_variant_lookup_value (snapshot, "devices",
+                                    G_VARIANT_TYPE ("aa{sv}"));
+
+  if (devices == NULL)
+    return FALSE;
+
+  n = g_variant_n_children (devices);
+  restored = g_ptr_array_new_full (n, g_object_unref);
+
+  /* all or nothing, so we can fall back to the store */
+  for (gsize i = 0; i < n; i++)
+    {
+      g_autoptr(GVariant) entry = g_variant_get_child_value (devices, i);
+      BoltDevice *dev;
+
+      dev = manager_device_from_snapshot (mgr, entry);
+
+      if (dev == NULL)
+        {
+          bolt_warn (LOG_TOPIC ("store"), "invalid device in snapshot");
+          return FALSE;
+        }
+
+      g_ptr_array_add (restored, dev);
+    }
+
+  for (guint i = 0; i < restored->len; i++)
+    manager_register_device (mgr, g_object_ref (g_ptr_array_index (restored, i)));
+
+  bolt_info (LOG_TOPIC ("store"), "restored %u devices from snapshot",
+             restored->len);
+
+  return TRUE;
+}
@@ -20,6 +20,7 @@
 
 #pragma once
 
+#include "bolt-device.h"
 #include "bolt-exported.h"
 
 G_BEGIN_DECLS
@@ -33,4 +34,17 @@ gboolean         bolt_manager_export (BoltManager     *mgr,
 
 void             bolt_manager_got_the_name (BoltManager *mgr);
 
+BoltDevice *     bolt_manager_get_device (BoltManager *mgr,
+                                          const char  *uid,
+                                          GError     **error);
+
+void             bolt_manager_enable_metrics (BoltManager *mgr,
+                                              guint        interval);
+
+void             bolt_manager_enable_idle_exit (BoltManager *mgr,
+                                                guint        timeout);
+
+gboolean         bolt_manager_save_snapshot (BoltManager *mgr,
+                                             GError     **error);
+
 G_END_DECLS
@@ -0,0 +1,245 @@
+/*
+ * Copyright © 2018 Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *       Christian J. Kellner <christian@kellner.me>
+ */
+
+#include "config.h"
+
+#include "bolt-metrics.h"
+
+#include "bolt-log.h"
+#include "bolt-watchdog.h"
+
+#include <errno.h>
+
+struct _BoltMetrics
+{
+  GObject object;
+
+  char              *path;
+  guint              interval;
+
+  BoltMetricsCollect collect;
+  gpointer           user_data;
+
+  /* pending write, doubles as dirty flag */
+  guint              write_id;
+};
+
+G_DEFINE_TYPE (BoltMetrics,
+               bolt_metrics,
+               G_TYPE_OBJECT);
+
+static void
+bolt_metrics_finalize (GObject *object)
+{
+  BoltMetrics *metrics = BOLT_METRICS (object);
+
+  if (metrics->write_id)
+    {
+      g_source_remove (metrics->write_id);
+      metrics->write_id = 0;
+    }
+
+  g_free (metrics->path);
+
+  G_OBJECT_CLASS (bolt_metrics_parent_class)->finalize (object);
+}
+
+static void
+bolt_metrics_init (BoltMetrics *metrics)
+{
+}
+
+static void
+bolt_metrics_class_init (BoltMetricsClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->finalize = bolt_metrics_finalize;
+}
+
+static gboolean
+metrics_write_timeout (gpointer user_data)
+{
+  g_autoptr(GError) err = NULL;
+  g_auto(BoltWatchdogScope) scope = BOLT_WATCHDOG_SCOPE_INIT;
+  BoltMetrics *metrics = BOLT_METRICS (user_data);
+  gboolean ok;
+
+  bolt_watchdog_scope_enter (&scope, G_STRFUNC);
+
+  metrics->write_id = 0;
+
+  ok = bolt_metrics_flush (metrics, &err);
+  if (!ok)
+    bolt_warn_err (err, LOG_TOPIC ("metrics"),
+                   "could not write metrics to %s", metrics->path);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* public methods */
+BoltMetrics *
+bolt_metrics_new (const char        *path,
+                  guint              interval,
+                  BoltMetricsCollect collect,
+                  gpointer           user_data)
+{
+  BoltMetrics *metrics;
+
+  g_return_val_if_fail (path != NULL, NULL);
+  g_return_val_if_fail (collect != NULL, NULL);
+
+  metrics = g_object_new (BOLT_TYPE_METRICS, NULL);
+
+  metrics->path = g_strdup (path);
+  metrics->interval = MAX (interval, 1);
+  metrics->collect = collect;
+  metrics->user_data = user_data;
+
+  return metrics;
+}
+
+void
+bolt_metrics_mark_dirty (BoltMetrics *metrics)
+{
+  /* NULL, i.e. disabled metrics, is fine */
+  if (metrics == NULL || metrics->write_id != 0)
+    return;
+
+  /* changes are batched: the first one arms the timer,
+   * all others until it fires are free */
+  metrics->write_id = g_timeout_add_seconds (metrics->interval,
+                                             metrics_write_timeout,
+                                             metrics);
+  g_source_set_name_by_id (metrics->write_id, "[boltd] metrics-write");
+}
+
+gboolean
+bolt_metrics_is_dirty (BoltMetrics *metrics)
+{
+  g_return_val_if_fail (BOLT_IS_METRICS (metrics), FALSE);
+
+  return metrics->write_id != 0;
+}
+
+gboolean
+bolt_metrics_flush (BoltMetrics *metrics,
+                    GError     **error)
+{
+  g_autoptr(GString) out = NULL;
+  g_autofree char *dir = NULL;
+
+  g_return_val_if_fail (BOLT_IS_METRICS (metrics), FALSE);
+
+  if (metrics->write_id)
+    {
+      g_source_remove (metrics->write_id);
+      metrics->write_id = 0;
+    }
+
+  out = g_string_sized_new (4096);
+  metrics->collect (out, metrics->user_data);
+  g_string_append (out, "# EOF\n");
+
+  dir = g_path_get_dirname (metrics->path);
+  if (g_mkdir_with_parents (dir, 0755) != 0)
+    {
+      int code = errno;
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (code),
+                   "could not create '%s': %s", dir, g_strerror (code));
+      return FALSE;
+    }
+
+  /* write to a temporary file and rename, so that
+   * the collector never sees a partial file */
+  return g_file_set_contents (metrics->path, out->str, out->len, error);
+}
+
+/* formatting */
+void
+bolt_metrics_add_family (GString    *out,
+                         const char *name,
+                         const char *type,
+                         const char *help)
+{
+  g_string_append_printf (out, "# TYPE %s %s\n", name, type);
+
+  if (help)
+    g_string_append_printf (out, "# HELP %s %s\n", name, help);
+}
+
+void
+bolt_metrics_add_sample (GString    *out,
+                         const char *name,
+                         const char *label,
+                         const char *value,
+                         double      sample)
+{
+  char buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+  /* the daemon runs with the user's locale,
+   * OpenMetrics wants a '.' as decimal point */
+  g_ascii_formatd (buf, sizeof (buf), "%.15g", sample);
+
+  if (label && value)
+    g_string_append_printf (out, "%s{%s=\"%s\"} %s\n", name, label, value, buf);
+  else
+    g_string_append_printf (out, "%s %s\n", name, buf);
+}
+
+void
+bolt_metrics_add_histogram (GString           *out,
+                            const char        *name,
+                            const char        *help,
+                            BoltStatsHistogram hist)
+{
+  g_autofree char *bucket = NULL;
+  g_autofree char *count = NULL;
+  g_autofree char *sum = NULL;
+  guint64 buckets[BOLT_STATS_BUCKETS];
+  guint64 usec;
+  guint64 total = 0;
+
+  bolt_stats_get_histogram (hist, &usec, buckets);
+
+  bucket = g_strdup_printf ("%s_bucket", name);
+  count = g_strdup_printf ("%s_count", name);
+  sum = g_strdup_printf ("%s_sum", name);
+
+  bolt_metrics_add_family (out, name, "histogram", help);
+
+  /* the last bucket is open ended and becomes +Inf */
+  for (guint k = 0; k < BOLT_STATS_BUCKETS - 1; k++)
+    {
+      char le[G_ASCII_DTOSTR_BUF_SIZE];
+      double upper = (double) (G_GUINT64_CONSTANT (1) << (k + 1)) / G_USEC_PER_SEC;
+
+      total += buckets[k];
+      g_ascii_formatd (le, sizeof (le), "%g", upper);
+      bolt_metrics_add_sample (out, bucket, "le", le, (double) total);
+    }
+
+  /* the count is derived from the buckets, so that it
+   * is consistent with them even if it changed meanwhile */
+  total += buckets[BOLT_STATS_BUCKETS - 1];
+  bolt_metrics_add_sample (out, bucket, "le", "+Inf", (double) total);
+  bolt_metrics_add_sample (out, count, NULL, NULL, (double) total);
+  bolt_metrics_add_sample (out, sum, NULL, NULL, (double) usec / G_USEC_PER_SEC);
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright © 2018 Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *       Christian J. Kellner <christian@kellner.me>
+ */
+
+#pragma once
+
+#include "bolt-stats.h"
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/* OpenMetrics text file writer, e.g. for the textfile
+ * collector of the prometheus node exporter. Nothing is
+ * written unless the metrics have been marked dirty. */
+
+#define BOLT_METRICS_FILE "boltd.prom"
+
+typedef void (*BoltMetricsCollect) (GString *out,
+                                    gpointer user_data);
+
+#define BOLT_TYPE_METRICS bolt_metrics_get_type ()
+G_DECLARE_FINAL_TYPE (BoltMetrics, bolt_metrics, BOLT, METRICS, GObject);
+
+BoltMetrics *   bolt_metrics_new (const char        *path,
+                                  guint              interval,
+                                  BoltMetricsCollect collect,
+                                  gpointer           user_data);
+
+void            bolt_metrics_mark_dirty (BoltMetrics *metrics);
+
+gboolean        bolt_metrics_is_dirty (BoltMetrics *metrics);
+
+gboolean        bolt_metrics_flush (BoltMetrics *metrics,
+                                    GError     **error);
+
+/* formatting helpers */
+void            bolt_metrics_add_family (GString    *out,
+                                         const char *name,
+                                         const char *type,
+                                         const char *help);
+
+void            bolt_metrics_add_sample (GString    *out,
+                                         const char *name,
+                                         const char *label,
+                                         const char *value,
+                                         double      sample);
+
+void            bolt_metrics_add_histogram (GString           *out,
+                                            const char        *name,
+                                            const char        *help,
+                                            BoltStatsHistogram hist);
+
+G_END_DECLS
@@ -0,0 +1,416 @@
+/*
+ * Copyright © 2018 Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *       Christian J. Kellner <christian@kellner.me>
+ */
+
+#include "config.h"
+
+#include "bolt-peer.h"
+
+#include "bolt-error.h"
+#include "bolt-exported.h"
+#include "bolt-log.h"
+#include "bolt-str.h"
+#include "bolt-unix.h"
+
+#include <gio/gio.h>
+
+#include <errno.h>
+#include <grp.h>
+#include <pwd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define PEER_START_TIME_KEY "bolt-peer-start-time"
+#define PEER_MAX_GROUPS     256
+
+static GDBusServer *peer_server = NULL;
+static char        *peer_path = NULL;
+static GPtrArray   *peer_connections = NULL;
+static gid_t        peer_gid = (gid_t) -1;
+
+static gboolean
+on_allow_mechanism (GDBusAuthObserver *observer,
+                    const char        *mechanism,
+                    gpointer           user_data)
+{
+  /* we need the credentials, i.e. SO_PEERCRED */
+  return bolt_streq (mechanism, "EXTERNAL");
+}
+
+static gboolean
+groups_contain (const gid_t *groups,
+                int          n,
+                gid_t        gid)
+{
+  for (int i = 0; i < n; i++)
+    if (groups[i] == gid)
+      return TRUE;
+
+  return FALSE;
+}
+
+/* The primary group is part of the credentials; the supplementary
+ * groups of the peer are, as of linux 4.13, available from the
+ * socket as well, otherwise they are looked up for its uid. */
+static gboolean
+peer_in_group (GIOStream    *stream,
+               GCredentials *credentials,
+               uid_t         uid,
+               gid_t         gid)
+{
+  gid_t groups[PEER_MAX_GROUPS];
+  struct passwd *pw;
+  struct ucred *cred;
+  int n;
+
+  cred = g_credentials_get_native (credentials, G_CREDENTIALS_TYPE_LINUX_UCRED);
+
+  if (cred != NULL && cred->gid == gid)
+    return TRUE;
+
+#ifdef SO_PEERGROUPS
+  if (G_IS_SOCKET_CONNECTION (stream))
+    {
+      GSocket *socket;
+      socklen_t len = sizeof (groups);
+      int r;
+
+      socket = g_socket_connection_get_socket (G_SOCKET_CONNECTION (stream));
+      r = getsockopt (g_socket_get_fd (socket), SOL_SOCKET, SO_PEERGROUPS,
+                      groups, &len);
+
+      if (r == 0)
+        return groups_contain (groups, len / sizeof (gid_t), gid);
+    }
+#endif
+
+  pw = getpwuid (uid);
+
+  if (pw == NULL)
+    return FALSE;
+
+  n = G_N_ELEMENTS (groups);
+  if (getgrouplist (pw->pw_name, pw->pw_gid, groups, &n) == -1)
+    return FALSE;
+
+  return groups_contain (groups, n, gid);
+}
+
+static gboolean
+on_authorize_peer (GDBusAuthObserver *observer,
+                   GIOStream         *stream,
+                   GCredentials      *credentials,
+                   gpointer           user_data)
+{
+  g_autoptr(GError) err = NULL;
+  uid_t uid;
+
+  if (credentials == NULL)
+    {
+      bolt_warn (LOG_TOPIC ("peer"), "rejecting peer without credentials");
+      return FALSE;
+    }
+
+  uid = g_credentials_get_unix_user (credentials, &err);
+
+  if (uid == (uid_t) -1)
+    {
+      bolt_warn_err (err, LOG_TOPIC ("peer"), "rejecting peer");
+      return FALSE;
+    }
+
+  if (uid == 0 || uid == geteuid ())
+    return TRUE;
+
+  /* the socket mode should already prevent this, but
+   * do not rely on the file system alone */
+  if (peer_gid != (gid_t) -1 &&
+      peer_in_group (stream, credentials, uid, peer_gid))
+    return TRUE;
+
+  bolt_warn (LOG_TOPIC ("peer"), "rejecting peer with uid %u", (guint) uid);
+  return FALSE;
+}
+
+static void
+on_connection_closed (GDBusConnection *connection,
+                      gboolean         remote_peer_vanished,
+                      GError          *error,
+                      gpointer         user_data)
+{
+  bolt_debug (LOG_TOPIC ("peer"), "peer connection closed");
+
+  bolt_exported_peer_remove (connection);
+
+  g_signal_handlers_disconnect_by_func (connection,
+                                        on_connection_closed,
+                                        user_data);
+
+  if (peer_connections != NULL)
+    g_ptr_array_remove (peer_connections, connection);
+}
+
+static gboolean
+on_new_connection (GDBusServer     *server,
+                   GDBusConnection *connection,
+                   gpointer         user_data)
+{
+  g_autoptr(GError) err = NULL;
+  GCredentials *creds;
+  guint64 *start;
+  pid_t pid = -1;
+
+  creds = g_dbus_connection_get_peer_credentials (connection);
+
+  if (creds != NULL)
+    pid = g_credentials_get_unix_pid (creds, &err);
+
+  if (pid == -1)
+    {
+      bolt_warn_err (err, LOG_TOPIC ("peer"), "peer connection without pid");
+      return FALSE;
+    }
+
+  /* pin down the process, the pid alone could be reused
+   * by the time a method call needs to be authorized */
+  start = g_new (guint64, 1);
+  *start = bolt_pid_get_start_time (pid, &err);
+
+  if (*start == 0)
+    {
+      bolt_warn_err (err, LOG_TOPIC ("peer"), "peer connection for pid %d",
+                     (int) pid);
+      g_free (start);
+      return FALSE;
+    }
+
+  g_object_set_data_full (G_OBJECT (connection), PEER_START_TIME_KEY,
+                          start, g_free);
+
+  bolt_debug (LOG_TOPIC ("peer"), "new peer connection: pid %d", (int) pid);
+
+  g_ptr_array_add (peer_connections, g_object_ref (connection));
+
+  g_signal_connect (connection, "closed",
+                    G_CALLBACK (on_connection_closed),
+                    NULL);
+
+  bolt_exported_peer_add (connection);
+
+  return TRUE;
+}
+
+static gboolean
+peer_lookup_group (const char *group,
+                   gid_t      *gid,
+                   GError    **error)
+{
+  struct group *gr;
+
+  errno = 0;
+  gr = getgrnam (group);
+
+  if (gr == NULL)
+    {
+      g_set_error (error, BOLT_ERROR, BOLT_ERROR_FAILED,
+                   "unknown group '%s': %s", group,
+                   errno ? g_strerror (errno) : "not found");
+      return FALSE;
+    }
+
+  *gid = gr->gr_gid;
+  return TRUE;
+}
+
+static gboolean
+peer_socket_setup (const char *path,
+                   gid_t       gid,
+                   GError    **error)
+{
+  int r;
+
+  /* the socket was created with mode 0600 */
+  if (gid == (gid_t) -1)
+    return TRUE;
+
+  r = chown (path, (uid_t) -1, gid);
+
+  if (r == -1)
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   "could not change group of '%s': %s",
+                   path, g_strerror (errno));
+      return FALSE;
+    }
+
+  r = chmod (path, 0660);
+
+  if (r == -1)
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   "could not change mode of '%s': %s",
+                   path, g_strerror (errno));
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+gboolean
+bolt_peer_server_start (const char *path,
+                        const char *group,
+                        GError    **error)
+{
+  g_autoptr(GDBusAuthObserver) observer = NULL;
+  g_autoptr(GDBusServer) server = NULL;
+  g_autofree char *dirname = NULL;
+  g_autofree char *escaped = NULL;
+  g_autofree char *address = NULL;
+  g_autofree char *guid = NULL;
+  gid_t gid = (gid_t) -1;
+  mode_t mask;
+
+  g_return_val_if_fail (path != NULL, FALSE);
+  g_return_val_if_fail (peer_server == NULL, FALSE);
+
+  if (group != NULL && !peer_lookup_group (group, &gid, error))
+    return FALSE;
+
+  dirname = g_path_get_dirname (path);
+
+  if (g_mkdir_with_parents (dirname, 0755) != 0)
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   "could not create directory '%s': %s",
+                   dirname, g_strerror (errno));
+      return FALSE;
+    }
+
+  /* a stale socket from a previous instance */
+  if (unlink (path) == -1 && errno != ENOENT)
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   "could not remove '%s': %s",
+                   path, g_strerror (errno));
+      return FALSE;
+    }
+
+  observer = g_dbus_auth_observer_new ();
+
+  g_signal_connect (observer, "allow-mechanism",
+                    G_CALLBACK (on_allow_mechanism),
+                    NULL);
+
+  g_signal_connect (observer, "authorize-authenticated-peer",
+                    G_CALLBACK (on_authorize_peer),
+                    NULL);
+
+  escaped = g_dbus_address_escape_value (path);
+  address = g_strdup_printf ("unix:path=%s", escaped);
+  guid = g_dbus_generate_guid ();
+
+  /* the socket must never be accessible to everybody, not
+   * even between bind () and changing its mode afterwards */
+  mask = umask (0177);
+  server = g_dbus_server_new_sync (address,
+                                   G_DBUS_SERVER_FLAGS_NONE,
+                                   guid,
+                                   observer,
+                                   NULL,
+                                   error);
+  umask (mask);
+
+  if (server == NULL)
+    return FALSE;
+
+  if (!peer_socket_setup (path, gid, error))
+    {
+      unlink (path);
+      return FALSE;
+    }
+
+  g_signal_connect (server, "new-connection",
+                    G_CALLBACK (on_new_connection),
+                    NULL);
+
+  peer_connections = g_ptr_array_new_with_free_func (g_object_unref);
+  peer_path = g_strdup (path);
+  peer_gid = gid;
+  peer_server = g_steal_pointer (&server);
+
+  g_dbus_server_start (peer_server);
+
+  bolt_info (LOG_TOPIC ("peer"), "listening on %s", path);
+
+  return TRUE;
+}
+
+void
+bolt_peer_server_stop (void)
+{
+  if (peer_server == NULL)
+    return;
+
+  g_dbus_server_stop (peer_server);
+  g_clear_object (&peer_server);
+
+  for (guint i = 0; i < peer_connections->len; i++)
+    {
+      GDBusConnection *connection = g_ptr_array_index (peer_connections, i);
+
+      g_signal_handlers_disconnect_by_func (connection,
+                                            on_connection_closed,
+                                            NULL);
+
+      bolt_exported_peer_remove (connection);
+      g_dbus_connection_close (connection, NULL, NULL, NULL);
+    }
+
+  g_clear_pointer (&peer_connections, g_ptr_array_unref);
+
+  unlink (peer_path);
+  g_clear_pointer (&peer_path, g_free);
+  peer_gid = (gid_t) -1;
+}
+
+gboolean
+bolt_peer_server_is_active (void)
+{
+  return peer_server != NULL;
+}
+
+guint64
+bolt_peer_get_start_time (GDBusConnection *connection)
+{
+  guint64 *start;
+
+  start = g_object_get_data (G_OBJECT (connection), PEER_START_TIME_KEY);
+
+  return start ? *start : 0;
+}
+
+guint
+bolt_peer_server_count_clients (void)
+{
+  if (peer_connections == NULL)
+    return 0;
+
+  return peer_connections->len;
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright © 2018 Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *       Christian J. Kellner <christian@kellner.me>
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/* Private D-Bus server for direct peer-to-peer connections
+ * on a unix socket. All exported objects are available on
+ * every peer connection, calls are authorized by the bouncer
+ * via the credentials of the socket (SO_PEERCRED). */
+
+gboolean         bolt_peer_server_start (const char *path,
+                                         const char *group,
+                                         GError    **error);
+
+void             bolt_peer_server_stop (void);
+
+gboolean         bolt_peer_server_is_active (void);
+
+guint            bolt_peer_server_count_clients (void);
+
+/* start time of the peer process, read when the connection was
+ * accepted; 0 if the connection is not a peer connection */
+guint64          bolt_peer_get_start_time (GDBusConnection *connection);
+
+G_END_DECLS
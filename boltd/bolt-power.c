@@ -22,13 +22,17 @@
 
 #include "bolt-power.h"
 
+#include "bolt-clock.h"
 #include "bolt-enums.h"
 #include "bolt-error.h"
 #include "bolt-fs.h"
 #include "bolt-log.h"
 #include "bolt-io.h"
+#include "bolt-probes.h"
 #include "bolt-str.h"
+#include "bolt-sysfs.h"
 #include "bolt-unix.h"
+#include "bolt-watchdog.h"
 
 #include <gio/gunixfdlist.h>
 
@@ -38,7 +42,6 @@
 
 #define POWER_WAIT_TIMEOUT 20 * 1000 // 20 seconds
 #define POWER_REAPER_TIMEOUT 20 // seconds
-#define DEFAULT_RUNDIR "/run/boltd/"
 #define DEFAULT_STATEDIR "power"
 #define STATE_FILENAME "on"
 
@@ -517,6 +520,7 @@ bolt_power_guard_monitor (BoltPowerGuard *guard,
                                       power_guard_has_event,
                                       g_object_ref (guard),
                                       guard_watch_release);
+  g_source_set_name_by_id (guard->watch, "[boltd] power-guard");
 
   return fd;
 }
@@ -573,10 +577,13 @@ static gboolean bolt_power_wait_timeout (gpointer user_data);
 static gboolean bolt_power_reaper_timeout (gpointer user_data);
 
 
-static void     handle_uevent_udev (BoltUdev           *udev,
-                                    const char         *action,
-                                    struct udev_device *device,
-                                    gpointer            user_data);
+static void     handle_uevent_thunderbolt (BoltUdev         *udev,
+                                           const BoltUevent *event,
+                                           gpointer          user_data);
+
+static void     handle_uevent_wmi (BoltUdev         *udev,
+                                   const BoltUevent *event,
+                                   gpointer          user_data);
 
 /* dbus methods */
 static GVariant *  handle_list_guards (BoltExported          *object,
@@ -601,6 +608,9 @@ struct _BoltPower
   /* connection to udev */
   BoltUdev *udev;
 
+  /* time source for all timers */
+  BoltClock *clock;
+
   /* the path to the sysfs device file,
    * or NULL if force power is unavailable */
   char          *path;
@@ -622,6 +632,8 @@ enum {
   PROP_RUNDIR,
   PROP_STATEDIR,
   PROP_UDEV,
+  PROP_CLOCK,
+  PROP_GUARDS,
   PROP_SUPPORTED,
   PROP_STATE,
   PROP_TIMEOUT,
@@ -644,17 +656,21 @@ bolt_power_finalize (GObject *object)
 
   if (power->wait_id != 0)
     {
-      g_source_remove (power->wait_id);
+      bolt_clock_source_remove (power->clock, power->wait_id);
       bolt_power_wait_timeout (power);
     }
 
   if (power->reaper != 0)
-    g_source_remove (power->reaper);
+    bolt_clock_source_remove (power->clock, power->reaper);
+
+  if (power->udev)
+    bolt_udev_unsubscribe_by_data (power->udev, power);
 
   g_clear_pointer (&power->runpath, g_free);
   g_clear_object (&power->statedir);
   g_clear_object (&power->statefile);
   g_clear_object (&power->udev);
+  g_clear_object (&power->clock);
   g_clear_pointer (&power->path, g_free);
   g_clear_pointer (&power->guards, g_hash_table_unref);
 
@@ -692,6 +708,14 @@ bolt_power_get_property (GObject    *object,
       g_value_set_object (value, power->udev);
       break;
 
+    case PROP_CLOCK:
+      g_value_set_object (value, power->clock);
+      break;
+
+    case PROP_GUARDS:
+      g_value_set_uint (value, g_hash_table_size (power->guards));
+      break;
+
     case PROP_SUPPORTED:
       g_value_set_boolean (value, power->path != NULL);
       break;
@@ -727,6 +751,10 @@ bolt_power_set_property (GObject      *object,
       power->udev = g_value_dup_object (value);
       break;
 
+    case PROP_CLOCK:
+      power->clock = g_value_dup_object (value);
+      break;
+
     case PROP_TIMEOUT:
       power->timeout = g_value_get_uint (value);
       break;
@@ -751,7 +779,7 @@ bolt_power_class_init (BoltPowerClass *klass)
   power_props[PROP_RUNDIR] =
     g_param_spec_string ("rundir",
                          NULL, NULL,
-                         DEFAULT_RUNDIR,
+                         NULL,
                          G_PARAM_READWRITE |
                          G_PARAM_CONSTRUCT_ONLY |
                          G_PARAM_STATIC_STRINGS);
@@ -759,7 +787,7 @@ bolt_power_class_init (BoltPowerClass *klass)
   power_props[PROP_STATEDIR] =
     g_param_spec_string ("statedir",
                          NULL, NULL,
-                         DEFAULT_RUNDIR,
+                         NULL,
                          G_PARAM_READABLE |
                          G_PARAM_STATIC_STRINGS);
 
@@ -771,6 +799,21 @@ bolt_power_class_init (BoltPowerClass *klass)
                          G_PARAM_CONSTRUCT_ONLY |
                          G_PARAM_STATIC_STRINGS);
 
+  power_props[PROP_CLOCK] =
+    g_param_spec_object ("clock",
+                         NULL, NULL,
+                         BOLT_TYPE_CLOCK,
+                         G_PARAM_READWRITE |
+                         G_PARAM_CONSTRUCT_ONLY |
+                         G_PARAM_STATIC_STRINGS);
+
+  power_props[PROP_GUARDS] =
+    g_param_spec_uint ("guards",
+                       NULL, NULL,
+                       0, G_MAXUINT, 0,
+                       G_PARAM_READABLE |
+                       G_PARAM_STATIC_STRINGS);
+
   power_props[PROP_SUPPORTED] =
     g_param_spec_boolean ("supported",
                           "Supported", NULL,
@@ -830,13 +873,19 @@ bolt_power_initialize (GInitable    *initable,
   g_autoptr(GError) err = NULL;
   g_autoptr(BoltPowerGuard) guard = NULL;
   g_autofree char *statedir = NULL;
+  g_autoptr(GPtrArray) scan = NULL;
   BoltPower *power = BOLT_POWER (initable);
-  struct udev_enumerate *e;
-  struct udev_list_entry *l, *devices;
   gboolean on = FALSE;
   gboolean ok;
   guint guards;
 
+  /* real time, unless a clock was given */
+  if (power->clock == NULL)
+    power->clock = bolt_clock_new ();
+
+  if (power->runpath == NULL)
+    power->runpath = g_strdup (bolt_get_rundir ());
+
   statedir = g_build_filename (power->runpath, DEFAULT_STATEDIR, NULL);
   power->statedir = g_file_new_for_path (statedir);
   power->statefile = g_file_get_child (power->statedir, STATE_FILENAME);
@@ -847,33 +896,36 @@ bolt_power_initialize (GInitable    *initable,
                    "failed to create guarddir at %s", statedir);
   g_clear_error (&err);
 
-  g_signal_connect_object (power->udev, "uevent",
-                           (GCallback) handle_uevent_udev,
-                           power, 0);
+  bolt_udev_subscribe (power->udev,
+                       BOLT_UDEV_SUBSYSTEM_THUNDERBOLT,
+                       BOLT_UDEV_DEVTYPE_ANY,
+                       handle_uevent_thunderbolt,
+                       power);
 
-  e = bolt_udev_new_enumerate (power->udev, NULL);
-  udev_enumerate_add_match_subsystem (e, "wmi");
-  udev_enumerate_add_match_property (e, "DRIVER", "intel-wmi-thunderbolt");
+  bolt_udev_subscribe (power->udev,
+                       BOLT_UDEV_SUBSYSTEM_WMI,
+                       BOLT_UDEV_DEVTYPE_ANY,
+                       handle_uevent_wmi,
+                       power);
 
-  udev_enumerate_scan_devices (e);
-  devices = udev_enumerate_get_list_entry (e);
+  scan = bolt_udev_scan (power->udev, &err);
 
-  udev_list_entry_foreach (l, devices)
+  if (scan == NULL)
     {
-      g_autofree char *path = NULL;
-      const char *syspath;
+      bolt_warn_err (err, LOG_TOPIC ("power"), "failed to scan sysfs");
+      g_clear_error (&err);
+    }
 
-      syspath = udev_list_entry_get_name (l);
-      path = g_build_filename (syspath, "force_power", NULL);
+  for (guint i = 0; scan && i < scan->len; i++)
+    {
+      BoltScanEntry *entry = g_ptr_array_index (scan, i);
 
-      if (g_file_test (path, G_FILE_TEST_IS_REGULAR))
-        {
-          power->path = g_steal_pointer (&path);
-          break;
-        }
-    }
+      if (entry->kind != BOLT_SCAN_FORCE_POWER)
+        continue;
 
-  udev_enumerate_unref (e);
+      power->path = g_build_filename (entry->syspath, "force_power", NULL);
+      break;
+    }
 
   bolt_msg (LOG_TOPIC ("power"), "force power support: %s",
             bolt_yesno (power->path != NULL));
@@ -995,9 +1047,12 @@ static gboolean
 bolt_power_wait_timeout (gpointer user_data)
 {
   g_autoptr(GError) err = NULL;
+  g_auto(BoltWatchdogScope) scope = BOLT_WATCHDOG_SCOPE_INIT;
   BoltPower *power = user_data;
   gboolean ok;
 
+  bolt_watchdog_scope_enter (&scope, G_STRFUNC);
+
   /* we just removed the last active guard */
   ok = bolt_power_switch_toggle (power, FALSE, &err);
 
@@ -1013,8 +1068,11 @@ static gboolean
 bolt_power_reaper_timeout (gpointer user_data)
 {
   g_autoptr(GList) keys = NULL;
+  g_auto(BoltWatchdogScope) scope = BOLT_WATCHDOG_SCOPE_INIT;
   BoltPower *power = user_data;
 
+  bolt_watchdog_scope_enter (&scope, G_STRFUNC);
+
   bolt_debug (LOG_TOPIC ("power"), "looking for dead processes");
 
   if (g_hash_table_size (power->guards) == 0)
@@ -1045,50 +1103,55 @@ bolt_power_reaper_timeout (gpointer user_data)
   return TRUE;
 }
 
-static void
-handle_uevent_thunderbolt (BoltPower          *power,
-                           const char         *action,
-                           struct udev_device *device)
+static gboolean
+handle_uevent_thunderbolt (BoltUdev         *udev,
+                           const BoltUevent *event,
+                           gpointer          user_data)
 {
-/* no callback scheduled, nothing to do */
+  BoltPower *power = BOLT_POWER (user_data);
+
+  /* no callback scheduled, nothing to do */
   if (power->wait_id == 0)
-    return;
+    return FALSE;
 
   /* only interested in added devices */
-  if (!bolt_streq (action, "add"))
-    return;
+  if (event->action != BOLT_UDEV_ACTION_ADD)
+    return FALSE;
 
   /* if we are not in WAIT state, we don't
    * do anything, but if we are, we want
    * to reset the timeout */
   if (power->state != BOLT_FORCE_POWER_WAIT)
-    return;
+    return FALSE;
 
   bolt_info (LOG_TOPIC ("power"), "resetting timeout (uevent %s)",
-             udev_device_get_syspath (device));
+             event->syspath);
 
   bolt_power_timeout_reset (power);
+
+  return TRUE;
 }
 
-static void
-handle_uevent_wmi (BoltPower          *power,
-                   const char         *action,
-                   struct udev_device *device)
+static gboolean
+handle_uevent_wmi (BoltUdev         *udev,
+                   const BoltUevent *event,
+                   gpointer          user_data)
 {
   g_autofree char *path = NULL;
+  BoltPower *power = BOLT_POWER (user_data);
   const char *name;
   const char *syspath;
   gboolean changed = FALSE;
 
-  syspath = udev_device_get_syspath (device);
-  name = udev_device_get_sysname (device);
+  syspath = event->syspath;
+  name = udev_device_get_sysname (event->device);
 
   bolt_debug (LOG_TOPIC ("power"), "uevent: wmi %s [%s %s]",
               name, syspath, power->path ? : "<unset>");
 
   path = g_build_filename (syspath, "force_power", NULL);
 
-  if (bolt_streq (action, "bind") &&
+  if (event->action == BOLT_UDEV_ACTION_BIND &&
       bolt_streq (name, INTEL_WMI_THUNDERBOLT_GUID))
     {
 
@@ -1099,7 +1162,7 @@ handle_uevent_wmi (BoltPower          *power,
           changed = TRUE;
         }
     }
-  else if (bolt_streq (action, "unbind") &&
+  else if (event->action == BOLT_UDEV_ACTION_UNBIND &&
            bolt_streq (path, power->path))
     {
       if (power->state > BOLT_FORCE_POWER_OFF)
@@ -1118,34 +1181,21 @@ handle_uevent_wmi (BoltPower          *power,
       g_object_notify_by_pspec (G_OBJECT (power),
                                 power_props[PROP_SUPPORTED]);
     }
-}
 
-static void
-handle_uevent_udev (BoltUdev           *udev,
-                    const char         *action,
-                    struct udev_device *device,
-                    gpointer            user_data)
-{
-  BoltPower *power = BOLT_POWER (user_data);
-  const char *subsystem;
-
-  subsystem = udev_device_get_subsystem (device);
-
-  if (bolt_streq (subsystem, "thunderbolt"))
-    handle_uevent_thunderbolt (power, action, device);
-  else if (bolt_streq (subsystem, "wmi"))
-    handle_uevent_wmi (power, action, device);
+  return changed;
 }
 
 static void
 bolt_power_timeout_reset (BoltPower *power)
 {
   if (power->wait_id > 0)
-    g_source_remove (power->wait_id);
+    bolt_clock_source_remove (power->clock, power->wait_id);
 
-  power->wait_id = g_timeout_add (power->timeout,
-                                  bolt_power_wait_timeout,
-                                  power);
+  power->wait_id = bolt_clock_timeout_add (power->clock,
+                                           power->timeout,
+                                           bolt_power_wait_timeout,
+                                           power,
+                                           "[boltd] power-wait");
 
   if (power->state != BOLT_FORCE_POWER_WAIT)
     {
@@ -1185,6 +1235,8 @@ bolt_power_switch_toggle (BoltPower *power,
   ok = bolt_write_all (fd, on ? "1" : "0", 1, error);
   bolt_close (fd, NULL);
 
+  BOLT_PROBE2 (force_power, on, ok);
+
   if (!ok)
     return FALSE;
 
@@ -1261,6 +1313,9 @@ bolt_power_release (BoltPower *power, BoltPowerGuard *guard)
   bolt_info (LOG_TOPIC ("power"), "guard '%s' for '%s' deactivated",
              guard->id, guard->who);
 
+  g_object_notify_by_pspec (G_OBJECT (power),
+                            power_props[PROP_GUARDS]);
+
   /* we still have active guards */
   if (g_hash_table_size (power->guards) != 0)
     return;
@@ -1309,26 +1364,52 @@ handle_force_power (BoltExported          *object,
   con = g_dbus_method_invocation_get_connection (invocation);
   sender = g_dbus_method_invocation_get_sender (invocation);
 
-  res = g_dbus_connection_call_sync (con,
-                                     "org.freedesktop.DBus",
-                                     "/",
-                                     "org.freedesktop.DBus",
-                                     "GetConnectionUnixProcessID",
-                                     g_variant_new ("(s)", sender),
-                                     G_VARIANT_TYPE ("(u)"),
-                                     G_DBUS_CALL_FLAGS_NONE,
-                                     -1, NULL,
-                                     &err);
-
-  if (res == NULL)
+  if (sender == NULL)
     {
-      g_set_error (error, BOLT_ERROR, BOLT_ERROR_FAILED,
-                   "could not get pid of caller: %s",
-                   err->message);
-      return NULL;
+      GCredentials *creds;
+      pid_t peer = -1;
+
+      /* direct peer connection */
+      creds = g_dbus_connection_get_peer_credentials (con);
+      if (creds != NULL)
+        peer = g_credentials_get_unix_pid (creds, &err);
+      else
+        g_set_error_literal (&err, BOLT_ERROR, BOLT_ERROR_FAILED,
+                             "no peer credentials");
+
+      if (peer == -1)
+        {
+          g_set_error (error, BOLT_ERROR, BOLT_ERROR_FAILED,
+                       "could not get pid of caller: %s",
+                       err->message);
+          return NULL;
+        }
+
+      pid = (guint) peer;
     }
+  else
+    {
+      res = g_dbus_connection_call_sync (con,
+                                         "org.freedesktop.DBus",
+                                         "/",
+                                         "org.freedesktop.DBus",
+                                         "GetConnectionUnixProcessID",
+                                         g_variant_new ("(s)", sender),
+                                         G_VARIANT_TYPE ("(u)"),
+                                         G_DBUS_CALL_FLAGS_NONE,
+                                         -1, NULL,
+                                         &err);
+
+      if (res == NULL)
+        {
+          g_set_error (error, BOLT_ERROR, BOLT_ERROR_FAILED,
+                       "could not get pid of caller: %s",
+                       err->message);
+          return NULL;
+        }
 
-  g_variant_get (res, "(u)", &pid);
+      g_variant_get (res, "(u)", &pid);
+    }
 
   g_variant_get (params, "(&s&s)", &who, &flags);
 
@@ -1376,13 +1457,15 @@ handle_list_guards (BoltExported          *object,
 
 /* public methods */
 BoltPower *
-bolt_power_new (BoltUdev *udev)
+bolt_power_new (BoltUdev  *udev,
+                BoltClock *clock)
 {
   BoltPower *power;
 
   power = g_initable_new (BOLT_TYPE_POWER,
                           NULL, NULL,
                           "udev", udev,
+                          "clock", clock,
                           NULL);
 
   return power;
@@ -1442,7 +1525,7 @@ bolt_power_acquire_full (BoltPower  *power,
 
   if (power->state == BOLT_FORCE_POWER_WAIT)
     {
-      g_source_remove (power->wait_id);
+      bolt_clock_source_remove (power->clock, power->wait_id);
       power->wait_id = 0;
       power->state = BOLT_FORCE_POWER_ON;
       g_object_notify_by_pspec (G_OBJECT (power),
@@ -1480,10 +1563,17 @@ bolt_power_acquire_full (BoltPower  *power,
   bolt_info (LOG_TOPIC ("power"), "guard '%s' for '%s' active",
              guard->id, guard->who);
 
+  g_object_notify_by_pspec (G_OBJECT (power),
+                            power_props[PROP_GUARDS]);
+
   if (power->reaper == 0)
-    power->reaper = g_timeout_add_seconds (POWER_REAPER_TIMEOUT,
-                                           bolt_power_reaper_timeout,
-                                           power);
+    {
+      power->reaper = bolt_clock_timeout_add_seconds (power->clock,
+                                                      POWER_REAPER_TIMEOUT,
+                                                      bolt_power_reaper_timeout,
+                                                      power,
+                                                      "[boltd] power-reaper");
+    }
 
   /* guard is saved so we can recover our state if we
    * were to crash or restarted */
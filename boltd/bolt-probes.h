@@ -0,0 +1,53 @@
+/*
+ * Copyright © 2018 Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *       Christian J. Kellner <christian@kellner.me>
+ */
+
+#pragma once
+
+#include <glib.h>
+
+/* USDT static probes, in the 'boltd' provider, e.g.:
+ *   bpftrace -e 'usdt:/usr/libexec/boltd:boltd:authorize_end { ... }'
+ * A probe site is a single nop, if nobody is attached;
+ * without the 'usdt' build option they compile to nothing.
+ *
+ *  uevent_received          (action, syspath)
+ *  authorize_start          (uid, level)
+ *  authorize_end            (uid, ok)
+ *  method_entry             (interface, method)
+ *  method_exit              (method, ok)
+ *  query_authorization_done (method, authorized)
+ *  store_read               (what, uid)
+ *  store_write              (what, uid)
+ *  force_power              (on, ok)
+ */
+
+#if HAVE_USDT
+
+#include <sys/sdt.h>
+
+#define BOLT_PROBE1(name, a)    DTRACE_PROBE1 (boltd, name, a)
+#define BOLT_PROBE2(name, a, b) DTRACE_PROBE2 (boltd, name, a, b)
+
+#else
+
+#define BOLT_PROBE1(name, a)    G_STMT_START { (void) 0; } G_STMT_END
+#define BOLT_PROBE2(name, a, b) G_STMT_START { (void) 0; } G_STMT_END
+
+#endif
@@ -0,0 +1,398 @@
+/*
+ * Copyright © 2018 Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *       Christian J. Kellner <christian@kellner.me>
+ */
+
+#include "config.h"
+
+#include "bolt-record.h"
+
+#include "bolt-str.h"
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+#include <libudev.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+gint bolt_record_active = 0;
+
+G_LOCK_DEFINE_STATIC (record);
+static FILE *record_out = NULL;
+static gint64 record_start = 0;
+
+/* the attributes the daemon looks at, i.e. what is
+ * needed to recreate the devices in a mock sysfs */
+static const char *domain_attrs[] = {
+  "security",
+  "boot_acl",
+  "iommu_dma_protection",
+  NULL
+};
+
+static const char *device_attrs[] = {
+  "unique_id",
+  "authorized",
+  "key",
+  "boot",
+  "device",
+  "device_name",
+  "vendor",
+  "vendor_name",
+  "generation",
+  NULL
+};
+
+static const char * const *
+record_attrs_for (const char *subsystem,
+                  const char *devtype)
+{
+  if (!bolt_streq (subsystem, "thunderbolt"))
+    return NULL;
+
+  if (bolt_streq (devtype, "thunderbolt_domain"))
+    return domain_attrs;
+  else if (bolt_streq (devtype, "thunderbolt_device"))
+    return device_attrs;
+
+  return NULL;
+}
+
+static void
+record_write_escaped (FILE *out, const char *str)
+{
+  g_autofree char *escaped = g_strescape (str, NULL);
+
+  fputs (escaped, out);
+}
+
+static void
+record_write (FILE               *out,
+              gint64              time,
+              const char         *action,
+              struct udev_device *udev)
+{
+  const char * const *attrs;
+  const char *subsystem;
+  const char *devtype;
+
+  subsystem = udev_device_get_subsystem (udev);
+  devtype = udev_device_get_devtype (udev);
+
+  fprintf (out, "%" G_GINT64_FORMAT "\t%s\t%s\t%s\t",
+           time, action, subsystem ? : "-", devtype ? : "-");
+
+  record_write_escaped (out, udev_device_get_syspath (udev));
+
+  attrs = record_attrs_for (subsystem, devtype);
+
+  for (guint i = 0; attrs && attrs[i]; i++)
+    {
+      const char *val = udev_device_get_sysattr_value (udev, attrs[i]);
+
+      if (val == NULL)
+        continue;
+
+      fprintf (out, "\t%s=", attrs[i]);
+
+      /* keys are secrets; only their size matters */
+      if (bolt_streq (attrs[i], "key"))
+        for (const char *c = val; *c; c++)
+          fputc ('0', out);
+      else
+        record_write_escaped (out, val);
+    }
+
+  fputc ('\n', out);
+
+  /* the daemon might not get to stop the recording */
+  fflush (out);
+}
+
+static gint
+record_cmp_syspath (gconstpointer a,
+                    gconstpointer b)
+{
+  struct udev_device *x = *((struct udev_device **) a);
+  struct udev_device *y = *((struct udev_device **) b);
+
+  return g_strcmp0 (udev_device_get_syspath (x),
+                    udev_device_get_syspath (y));
+}
+
+static void
+record_write_present (FILE *out)
+{
+  g_autoptr(GPtrArray) devices = NULL;
+  struct udev_enumerate *enumerate;
+  struct udev_list_entry *l, *devlist;
+  struct udev *udev;
+
+  udev = udev_new ();
+  if (udev == NULL)
+    return;
+
+  enumerate = udev_enumerate_new (udev);
+  udev_enumerate_add_match_subsystem (enumerate, "thunderbolt");
+  udev_enumerate_scan_devices (enumerate);
+
+  devices = g_ptr_array_new_with_free_func ((GDestroyNotify) udev_device_unref);
+  devlist = udev_enumerate_get_list_entry (enumerate);
+
+  udev_list_entry_foreach (l, devlist)
+    {
+      const char *syspath = udev_list_entry_get_name (l);
+      struct udev_device *dev;
+
+      dev = udev_device_new_from_syspath (udev, syspath);
+      if (dev != NULL)
+        g_ptr_array_add (devices, dev);
+    }
+
+  /* parents sort before their children */
+  g_ptr_array_sort (devices, record_cmp_syspath);
+
+  for (guint i = 0; i < devices->len; i++)
+    record_write (out, 0, BOLT_RECORD_PRESENT,
+                  g_ptr_array_index (devices, i));
+
+  g_clear_pointer (&devices, g_ptr_array_unref);
+  udev_enumerate_unref (enumerate);
+  udev_unref (udev);
+}
+
+/* public methods */
+gboolean
+bolt_record_start (const char *path,
+                   GError    **error)
+{
+  FILE *out;
+
+  g_return_val_if_fail (path != NULL, FALSE);
+  g_return_val_if_fail (record_out == NULL, FALSE);
+
+  out = g_fopen (path, "we");
+
+  if (out == NULL)
+    {
+      int code = errno;
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (code),
+                   "could not open record file '%s': %s",
+                   path, g_strerror (code));
+      return FALSE;
+    }
+
+  G_LOCK (record);
+
+  record_out = out;
+  record_start = g_get_monotonic_time ();
+
+  fputs (BOLT_RECORD_HEADER "\n", record_out);
+  record_write_present (record_out);
+
+  G_UNLOCK (record);
+
+  g_atomic_int_set (&bolt_record_active, TRUE);
+
+  return TRUE;
+}
+
+void
+bolt_record_stop (void)
+{
+  FILE *out;
+
+  if (!g_atomic_int_get (&bolt_record_active))
+    return;
+
+  g_atomic_int_set (&bolt_record_active, FALSE);
+
+  G_LOCK (record);
+
+  out = record_out;
+  record_out = NULL;
+
+  G_UNLOCK (record);
+
+  if (out != NULL)
+    fclose (out);
+}
+
+void
+bolt_record_uevent (const BoltUevent *event)
+{
+  gint64 now;
+
+  g_return_if_fail (event != NULL);
+
+  if (!bolt_record_enabled ())
+    return;
+
+  now = g_get_monotonic_time ();
+
+  G_LOCK (record);
+
+  if (record_out != NULL)
+    record_write (record_out, now - record_start,
+                  event->action_str, event->device);
+
+  G_UNLOCK (record);
+}
+
+void
+bolt_record_free (BoltRecord *record)
+{
+  if (record == NULL)
+    return;
+
+  g_free (record->action);
+  g_free (record->subsystem);
+  g_free (record->devtype);
+  g_free (record->syspath);
+  g_strfreev (record->attrs);
+  g_free (record);
+}
+
+BoltRecord *
+bolt_record_parse (const char *line,
+                   GError    **error)
+{
+  g_autoptr(BoltRecord) rec = NULL;
+  g_auto(GStrv) fields = NULL;
+  guint n;
+  char *end;
+
+  g_return_val_if_fail (line != NULL, NULL);
+
+  fields = g_strsplit (line, "\t", -1);
+  n = g_strv_length (fields);
+
+  if (n < 5)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "expected at least 5 fields, got %u", n);
+      return NULL;
+    }
+
+  rec = g_new0 (BoltRecord, 1);
+
+  rec->time = g_ascii_strtoll (fields[0], &end, 10);
+  if (end == fields[0] || *end != '\0' || rec->time < 0)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "invalid time '%s'", fields[0]);
+      return NULL;
+    }
+
+  rec->action = g_strdup (fields[1]);
+
+  if (!bolt_streq (fields[2], "-"))
+    rec->subsystem = g_strdup (fields[2]);
+
+  if (!bolt_streq (fields[3], "-"))
+    rec->devtype = g_strdup (fields[3]);
+
+  rec->syspath = g_strcompress (fields[4]);
+  rec->attrs = g_new0 (char *, n - 5 + 1);
+
+  for (guint i = 5; i < n; i++)
+    {
+      if (strchr (fields[i], '=') == NULL)
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                       "invalid attribute '%s'", fields[i]);
+          return NULL;
+        }
+
+      rec->attrs[i - 5] = g_strcompress (fields[i]);
+    }
+
+  return g_steal_pointer (&rec);
+}
+
+const char *
+bolt_record_get_attr (const BoltRecord *record,
+                      const char       *name)
+{
+  gsize len;
+
+  g_return_val_if_fail (record != NULL, NULL);
+  g_return_val_if_fail (name != NULL, NULL);
+
+  len = strlen (name);
+
+  for (guint i = 0; record->attrs && record->attrs[i]; i++)
+    {
+      const char *attr = record->attrs[i];
+
+      if (strncmp (attr, name, len) == 0 && attr[len] == '=')
+        return attr + len + 1;
+    }
+
+  return NULL;
+}
+
+GPtrArray *
+bolt_record_load (const char *path,
+                  GError    **error)
+{
+  g_autoptr(GPtrArray) records = NULL;
+  g_autofree char *data = NULL;
+  g_auto(GStrv) lines = NULL;
+  gboolean ok;
+
+  g_return_val_if_fail (path != NULL, NULL);
+
+  ok = g_file_get_contents (path, &data, NULL, error);
+  if (!ok)
+    return NULL;
+
+  lines = g_strsplit (data, "\n", -1);
+
+  if (!bolt_streq (lines[0], BOLT_RECORD_HEADER))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "'%s' is not a uevent record", path);
+      return NULL;
+    }
+
+  records = g_ptr_array_new_with_free_func ((GDestroyNotify) bolt_record_free);
+
+  for (guint i = 1; lines[i] != NULL; i++)
+    {
+      BoltRecord *rec;
+
+      if (*lines[i] == '\0' || *lines[i] == '#')
+        continue;
+
+      rec = bolt_record_parse (lines[i], error);
+
+      if (rec == NULL)
+        {
+          g_prefix_error (error, "%s:%u: ", path, i + 1);
+          return NULL;
+        }
+
+      g_ptr_array_add (records, rec);
+    }
+
+  return g_steal_pointer (&records);
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright © 2018 Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *       Christian J. Kellner <christian@kellner.me>
+ */
+
+#pragma once
+
+#include "bolt-udev.h"
+
+G_BEGIN_DECLS
+
+/* Recording of the uevent stream, one event per line:
+ *   TIME ACTION SUBSYSTEM DEVTYPE SYSPATH [NAME=VALUE ...]
+ * separated by tabs, with TIME in µs since the start of the
+ * recording and escaped values. Devices that exist when the
+ * recording starts are written with the "present" action. */
+#define BOLT_RECORD_HEADER "# boltd uevent record 1"
+#define BOLT_RECORD_PRESENT "present"
+
+extern gint bolt_record_active;
+
+#define bolt_record_enabled() G_UNLIKELY (g_atomic_int_get (&bolt_record_active))
+
+gboolean         bolt_record_start (const char *path,
+                                    GError    **error);
+
+void             bolt_record_stop (void);
+
+void             bolt_record_uevent (const BoltUevent *event);
+
+/* reading recordings back */
+typedef struct _BoltRecord
+{
+  gint64 time;
+
+  char  *action;
+  char  *subsystem;  /* NULL if not set */
+  char  *devtype;    /* NULL if not set */
+  char  *syspath;
+
+  GStrv  attrs;      /* NAME=VALUE, unescaped */
+} BoltRecord;
+
+void             bolt_record_free (BoltRecord *record);
+
+BoltRecord *     bolt_record_parse (const char *line,
+                                    GError    **error);
+
+const char *     bolt_record_get_attr (const BoltRecord *record,
+                                       const char       *name);
+
+GPtrArray *      bolt_record_load (const char *path,
+                                   GError    **error);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (BoltRecord, bolt_record_free);
+
+G_END_DECLS
@@ -0,0 +1,117 @@
+/*
+ * Copyright © 2018 Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *       Christian J. Kellner <christian@kellner.me>
+ */
+
+#include "config.h"
+
+#include "bolt-snapshot.h"
+
+#include "bolt-fs.h"
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+#include <errno.h>
+
+#define SNAPSHOT_TYPE G_VARIANT_TYPE ("(ua{sv})")
+
+char *
+bolt_snapshot_path (void)
+{
+  return g_build_filename (bolt_get_rundir (),
+                           BOLT_SNAPSHOT_FILE,
+                           NULL);
+}
+
+gboolean
+bolt_snapshot_save (const char *path,
+                    GVariant   *state,
+                    GError    **error)
+{
+  g_autoptr(GVariant) data = NULL;
+  g_autofree char *dir = NULL;
+
+  g_return_val_if_fail (path != NULL, FALSE);
+  g_return_val_if_fail (state != NULL, FALSE);
+  g_return_val_if_fail (g_variant_is_of_type (state, G_VARIANT_TYPE_VARDICT), FALSE);
+
+  data = g_variant_new ("(u@a{sv})", BOLT_SNAPSHOT_VERSION, state);
+  g_variant_ref_sink (data);
+
+  dir = g_path_get_dirname (path);
+
+  if (g_mkdir_with_parents (dir, 0755) != 0)
+    {
+      int code = errno;
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (code),
+                   "could not create '%s': %s", dir, g_strerror (code));
+      return FALSE;
+    }
+
+  /* write to a temporary file and rename, so that the next
+   * instance never sees a partial snapshot */
+  return g_file_set_contents (path,
+                              g_variant_get_data (data),
+                              g_variant_get_size (data),
+                              error);
+}
+
+GVariant *
+bolt_snapshot_load (const char *path,
+                    GError    **error)
+{
+  g_autoptr(GVariant) data = NULL;
+  g_autoptr(GVariant) state = NULL;
+  g_autofree char *contents = NULL;
+  gsize len;
+  guint version;
+
+  g_return_val_if_fail (path != NULL, NULL);
+
+  if (!g_file_get_contents (path, &contents, &len, error))
+    return NULL;
+
+  /* a snapshot is only ever good for one start */
+  (void) g_unlink (path);
+
+  data = g_variant_new_from_data (SNAPSHOT_TYPE,
+                                  contents, len,
+                                  FALSE,
+                                  g_free,
+                                  g_steal_pointer (&contents));
+  g_variant_ref_sink (data);
+
+  if (!g_variant_is_normal_form (data))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "snapshot '%s' is corrupt", path);
+      return NULL;
+    }
+
+  g_variant_get (data, "(u@a{sv})", &version, &state);
+
+  if (version != BOLT_SNAPSHOT_VERSION)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                   "snapshot version %u is not supported", version);
+      return NULL;
+    }
+
+  return g_steal_pointer (&state);
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright © 2018 Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *       Christian J. Kellner <christian@kellner.me>
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Persisted state of the manager, written to the runtime
+ * directory when the daemon exits because it was idle and
+ * consumed by the next start. The state is an a{sv}
+ * dictionary, stored with a version as GVariant in its
+ * serialized form, i.e. '(ua{sv})'. */
+
+#define BOLT_SNAPSHOT_VERSION 1
+#define BOLT_SNAPSHOT_FILE "state"
+
+char *          bolt_snapshot_path (void);
+
+gboolean        bolt_snapshot_save (const char *path,
+                                    GVariant   *state,
+                                    GError    **error);
+
+GVariant *      bolt_snapshot_load (const char *path,
+                                    GError    **error);
+
+G_END_DECLS
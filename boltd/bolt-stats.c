@@ -0,0 +1,545 @@
+/*
+ * Copyright © 2018 Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *       Christian J. Kellner <christian@kellner.me>
+ */
+
+#include "config.h"
+
+#include "bolt-stats.h"
+
+#include "bolt-names.h"
+
+#include <string.h>
+
+/* GLib only has 32 bit atomics, use the compiler
+ * builtins for the 64 bit counters */
+#define stats_add(ptr, val) __atomic_fetch_add ((ptr), (val), __ATOMIC_RELAXED)
+#define stats_inc(ptr) stats_add (ptr, 1)
+#define stats_get(ptr) __atomic_load_n ((ptr), __ATOMIC_RELAXED)
+
+static const BoltSecurity security_levels[] = {
+  BOLT_SECURITY_UNKNOWN,
+  BOLT_SECURITY_NONE,
+  BOLT_SECURITY_DPONLY,
+  BOLT_SECURITY_USER,
+  BOLT_SECURITY_SECURE,
+  BOLT_SECURITY_USBONLY,
+};
+
+#define N_SECURITY_LEVELS G_N_ELEMENTS (security_levels)
+
+static const char *histogram_names[BOLT_STATS_HISTOGRAM_LAST] = {
+  "method-call",
+  "authorize",
+  "uevent-status",
+};
+
+typedef struct _StatsHistogram
+{
+  guint64 count;
+  guint64 sum;
+  guint64 buckets[BOLT_STATS_BUCKETS];
+} StatsHistogram;
+
+static struct
+{
+  guint64 uevents[BOLT_UDEV_ACTION_LAST][2];
+  guint64 authorize[N_SECURITY_LEVELS][BOLT_STATS_AUTH_LAST];
+  guint64 store_reads;
+  guint64 store_writes;
+  guint64 polkit_checks;
+  guint64 polkit_skipped;
+  guint64 stalls;
+  guint64 stall_worst;
+  guint64 udev_overflows;
+  guint64 udev_resyncs;
+
+  StatsHistogram hist[BOLT_STATS_HISTOGRAM_LAST];
+} counters;
+
+/* start of the uevent that is currently being dispatched,
+ * only ever touched from the main thread */
+static gint64 uevent_start = 0;
+
+static guint
+security_slot (BoltSecurity level)
+{
+  for (guint i = 0; i < N_SECURITY_LEVELS; i++)
+    if (security_levels[i] == level)
+      return i;
+
+  return 0;
+}
+
+/* recording */
+void
+bolt_stats_uevent_received (BoltUdevAction action)
+{
+  if ((guint) action >= BOLT_UDEV_ACTION_LAST)
+    action = BOLT_UDEV_ACTION_UNKNOWN;
+
+  stats_inc (&counters.uevents[action][0]);
+}
+
+void
+bolt_stats_uevent_handled (BoltUdevAction action)
+{
+  if ((guint) action >= BOLT_UDEV_ACTION_LAST)
+    action = BOLT_UDEV_ACTION_UNKNOWN;
+
+  stats_inc (&counters.uevents[action][1]);
+}
+
+void
+bolt_stats_uevent_begin (void)
+{
+  uevent_start = g_get_monotonic_time ();
+}
+
+void
+bolt_stats_uevent_end (void)
+{
+  uevent_start = 0;
+}
+
+void
+bolt_stats_status_changed (void)
+{
+  gint64 now;
+
+  /* only status changes caused by a uevent are of interest */
+  if (uevent_start == 0)
+    return;
+
+  now = g_get_monotonic_time ();
+  bolt_stats_observe (BOLT_STATS_UEVENT_STATUS, now - uevent_start);
+}
+
+void
+bolt_stats_authorize (BoltSecurity  level,
+                      BoltStatsAuth what)
+{
+  g_return_if_fail ((guint) what < BOLT_STATS_AUTH_LAST);
+
+  stats_inc (&counters.authorize[security_slot (level)][what]);
+}
+
+void
+bolt_stats_store_read (void)
+{
+  stats_inc (&counters.store_reads);
+}
+
+void
+bolt_stats_store_write (void)
+{
+  stats_inc (&counters.store_writes);
+}
+
+void
+bolt_stats_polkit_check (gboolean needed)
+{
+  if (needed)
+    stats_inc (&counters.polkit_checks);
+  else
+    stats_inc (&counters.polkit_skipped);
+}
+
+void
+bolt_stats_stall (gint64 usec)
+{
+  guint64 val = (guint64) MAX (usec, 0);
+  guint64 worst;
+
+  stats_inc (&counters.stalls);
+
+  worst = stats_get (&counters.stall_worst);
+  while (val > worst &&
+         !__atomic_compare_exchange_n (&counters.stall_worst, &worst, val, TRUE,
+                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    ;
+}
+
+guint64
+bolt_stats_get_stalls (guint64 *worst)
+{
+  if (worst)
+    *worst = stats_get (&counters.stall_worst);
+
+  return stats_get (&counters.stalls);
+}
+
+void
+bolt_stats_udev_overflow (void)
+{
+  stats_inc (&counters.udev_overflows);
+}
+
+void
+bolt_stats_udev_resync (void)
+{
+  stats_inc (&counters.udev_resyncs);
+}
+
+guint64
+bolt_stats_get_overflows (guint64 *resyncs)
+{
+  if (resyncs)
+    *resyncs = stats_get (&counters.udev_resyncs);
+
+  return stats_get (&counters.udev_overflows);
+}
+
+guint
+bolt_stats_bucket_for (gint64 usec)
+{
+  guint bucket;
+
+  if (usec < 2)
+    return 0;
+
+  bucket = g_bit_storage ((gulong) usec) - 1;
+
+  return MIN (bucket, BOLT_STATS_BUCKETS - 1);
+}
+
+void
+bolt_stats_observe (BoltStatsHistogram hist,
+                    gint64             usec)
+{
+  StatsHistogram *h;
+
+  g_return_if_fail ((guint) hist < BOLT_STATS_HISTOGRAM_LAST);
+
+  if (usec < 0)
+    usec = 0;
+
+  h = &counters.hist[hist];
+
+  stats_add (&h->buckets[bolt_stats_bucket_for (usec)], 1);
+  stats_add (&h->sum, (guint64) usec);
+  stats_inc (&h->count);
+}
+
+guint64
+bolt_stats_get_histogram (BoltStatsHistogram hist,
+                          guint64           *sum,
+                          guint64           *buckets)
+{
+  StatsHistogram *h;
+
+  g_return_val_if_fail ((guint) hist < BOLT_STATS_HISTOGRAM_LAST, 0);
+
+  h = &counters.hist[hist];
+
+  if (sum)
+    *sum = stats_get (&h->sum);
+
+  /* buckets must hold BOLT_STATS_BUCKETS elements */
+  for (guint k = 0; buckets && k < BOLT_STATS_BUCKETS; k++)
+    buckets[k] = stats_get (&h->buckets[k]);
+
+  return stats_get (&h->count);
+}
+
+const char *
+bolt_stats_histogram_name (BoltStatsHistogram hist)
+{
+  g_return_val_if_fail ((guint) hist < BOLT_STATS_HISTOGRAM_LAST, NULL);
+
+  return histogram_names[hist];
+}
+
+void
+bolt_stats_reset (void)
+{
+  /* not atomic as a whole; meant for tests */
+  memset (&counters, 0, sizeof (counters));
+  uevent_start = 0;
+}
+
+/* reading; the individual values are read atomically, but
+ * the result is not a consistent snapshot across counters */
+GVariant *
+bolt_stats_get_uevents (void)
+{
+  GVariantBuilder b;
+
+  g_variant_builder_init (&b, G_VARIANT_TYPE ("a{s(tt)}"));
+
+  for (guint i = 0; i < BOLT_UDEV_ACTION_LAST; i++)
+    g_variant_builder_add (&b, "{s(tt)}",
+                           bolt_udev_action_to_string ((BoltUdevAction) i),
+                           stats_get (&counters.uevents[i][0]),
+                           stats_get (&counters.uevents[i][1]));
+
+  return g_variant_builder_end (&b);
+}
+
+GVariant *
+bolt_stats_get_authorizations (void)
+{
+  GVariantBuilder b;
+
+  g_variant_builder_init (&b, G_VARIANT_TYPE ("a{s(ttt)}"));
+
+  for (guint i = 0; i < N_SECURITY_LEVELS; i++)
+    {
+      guint64 *c = counters.authorize[i];
+
+      g_variant_builder_add (&b, "{s(ttt)}",
+                             bolt_security_to_string (security_levels[i]),
+                             stats_get (&c[BOLT_STATS_AUTH_ATTEMPTED]),
+                             stats_get (&c[BOLT_STATS_AUTH_SUCCEEDED]),
+                             stats_get (&c[BOLT_STATS_AUTH_FAILED]));
+    }
+
+  return g_variant_builder_end (&b);
+}
+
+GVariant *
+bolt_stats_get_store (void)
+{
+  GVariantBuilder b;
+
+  g_variant_builder_init (&b, G_VARIANT_TYPE ("a{st}"));
+  g_variant_builder_add (&b, "{st}", "reads", stats_get (&counters.store_reads));
+  g_variant_builder_add (&b, "{st}", "writes", stats_get (&counters.store_writes));
+
+  return g_variant_builder_end (&b);
+}
+
+GVariant *
+bolt_stats_get_polkit (void)
+{
+  GVariantBuilder b;
+
+  g_variant_builder_init (&b, G_VARIANT_TYPE ("a{st}"));
+  g_variant_builder_add (&b, "{st}", "checks", stats_get (&counters.polkit_checks));
+  g_variant_builder_add (&b, "{st}", "skipped", stats_get (&counters.polkit_skipped));
+
+  return g_variant_builder_end (&b);
+}
+
+GVariant *
+bolt_stats_get_latency (void)
+{
+  GVariantBuilder b;
+
+  g_variant_builder_init (&b, G_VARIANT_TYPE ("a{s(ttat)}"));
+
+  for (guint i = 0; i < BOLT_STATS_HISTOGRAM_LAST; i++)
+    {
+      StatsHistogram *h = &counters.hist[i];
+      GVariantBuilder bb;
+
+      g_variant_builder_init (&bb, G_VARIANT_TYPE ("at"));
+      for (guint k = 0; k < BOLT_STATS_BUCKETS; k++)
+        g_variant_builder_add (&bb, "t", stats_get (&h->buckets[k]));
+
+      g_variant_builder_add (&b, "{s(ttat)}",
+                             histogram_names[i],
+                             stats_get (&h->count),
+                             stats_get (&h->sum),
+                             &bb);
+    }
+
+  return g_variant_builder_end (&b);
+}
+
+GVariant *
+bolt_stats_get_mainloop (void)
+{
+  GVariantBuilder b;
+
+  g_variant_builder_init (&b, G_VARIANT_TYPE ("a{st}"));
+  g_variant_builder_add (&b, "{st}", "stalls", stats_get (&counters.stalls));
+  g_variant_builder_add (&b, "{st}", "worst-stall", stats_get (&counters.stall_worst));
+
+  return g_variant_builder_end (&b);
+}
+
+GVariant *
+bolt_stats_get_udev (void)
+{
+  GVariantBuilder b;
+
+  g_variant_builder_init (&b, G_VARIANT_TYPE ("a{st}"));
+  g_variant_builder_add (&b, "{st}", "overflows", stats_get (&counters.udev_overflows));
+  g_variant_builder_add (&b, "{st}", "resyncs", stats_get (&counters.udev_resyncs));
+
+  return g_variant_builder_end (&b);
+}
+
+/* BoltStats */
+
+struct _BoltStats
+{
+  BoltExported object;
+};
+
+enum {
+  PROP_0,
+
+  PROP_UEVENTS,
+  PROP_AUTHORIZATIONS,
+  PROP_STORE,
+  PROP_POLKIT,
+  PROP_LATENCY,
+  PROP_MAINLOOP,
+  PROP_UDEV,
+
+  PROP_LAST
+};
+
+static GParamSpec *stats_props[PROP_LAST] = { NULL, };
+
+G_DEFINE_TYPE (BoltStats,
+               bolt_stats,
+               BOLT_TYPE_EXPORTED);
+
+static void
+bolt_stats_get_property (GObject    *object,
+                         guint       prop_id,
+                         GValue     *value,
+                         GParamSpec *pspec)
+{
+  switch (prop_id)
+    {
+    case PROP_UEVENTS:
+      g_value_take_variant (value, bolt_stats_get_uevents ());
+      break;
+
+    case PROP_AUTHORIZATIONS:
+      g_value_take_variant (value, bolt_stats_get_authorizations ());
+      break;
+
+    case PROP_STORE:
+      g_value_take_variant (value, bolt_stats_get_store ());
+      break;
+
+    case PROP_POLKIT:
+      g_value_take_variant (value, bolt_stats_get_polkit ());
+      break;
+
+    case PROP_LATENCY:
+      g_value_take_variant (value, bolt_stats_get_latency ());
+      break;
+
+    case PROP_MAINLOOP:
+      g_value_take_variant (value, bolt_stats_get_mainloop ());
+      break;
+
+    case PROP_UDEV:
+      g_value_take_variant (value, bolt_stats_get_udev ());
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+bolt_stats_init (BoltStats *stats)
+{
+}
+
+static void
+bolt_stats_class_init (BoltStatsClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  BoltExportedClass *exported_class = BOLT_EXPORTED_CLASS (klass);
+
+  gobject_class->get_property = bolt_stats_get_property;
+
+  stats_props[PROP_UEVENTS] =
+    g_param_spec_variant ("uevents",
+                          "Uevents", NULL,
+                          G_VARIANT_TYPE ("a{s(tt)}"),
+                          NULL,
+                          G_PARAM_READABLE |
+                          G_PARAM_STATIC_STRINGS);
+
+  stats_props[PROP_AUTHORIZATIONS] =
+    g_param_spec_variant ("authorizations",
+                          "Authorizations", NULL,
+                          G_VARIANT_TYPE ("a{s(ttt)}"),
+                          NULL,
+                          G_PARAM_READABLE |
+                          G_PARAM_STATIC_STRINGS);
+
+  stats_props[PROP_STORE] =
+    g_param_spec_variant ("store",
+                          "Store", NULL,
+                          G_VARIANT_TYPE ("a{st}"),
+                          NULL,
+                          G_PARAM_READABLE |
+                          G_PARAM_STATIC_STRINGS);
+
+  stats_props[PROP_POLKIT] =
+    g_param_spec_variant ("polkit",
+                          "Polkit", NULL,
+                          G_VARIANT_TYPE ("a{st}"),
+                          NULL,
+                          G_PARAM_READABLE |
+                          G_PARAM_STATIC_STRINGS);
+
+  stats_props[PROP_LATENCY] =
+    g_param_spec_variant ("latency",
+                          "Latency", NULL,
+                          G_VARIANT_TYPE ("a{s(ttat)}"),
+                          NULL,
+                          G_PARAM_READABLE |
+                          G_PARAM_STATIC_STRINGS);
+
+  stats_props[PROP_MAINLOOP] =
+    g_param_spec_variant ("mainloop",
+                          "Mainloop", NULL,
+                          G_VARIANT_TYPE ("a{st}"),
+                          NULL,
+                          G_PARAM_READABLE |
+                          G_PARAM_STATIC_STRINGS);
+
+  stats_props[PROP_UDEV] =
+    g_param_spec_variant ("udev",
+                          "Udev", NULL,
+                          G_VARIANT_TYPE ("a{st}"),
+                          NULL,
+                          G_PARAM_READABLE |
+                          G_PARAM_STATIC_STRINGS);
+
+  g_object_class_install_properties (gobject_class,
+                                     PROP_LAST,
+                                     stats_props);
+
+  bolt_exported_class_set_interface_info (exported_class,
+                                          BOLT_DBUS_STATS_INTERFACE,
+                                          "/boltd/org.freedesktop.bolt.xml");
+
+  bolt_exported_class_export_properties (exported_class,
+                                         PROP_UEVENTS,
+                                         PROP_LAST,
+                                         stats_props);
+}
+
+/* public methods */
+BoltStats *
+bolt_stats_new (void)
+{
+  return g_object_new (BOLT_TYPE_STATS, NULL);
+}
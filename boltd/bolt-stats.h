@@ -0,0 +1,116 @@
+/*
+ * Copyright © 2018 Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *       Christian J. Kellner <christian@kellner.me>
+ */
+
+#pragma once
+
+#include "bolt-enums.h"
+#include "bolt-exported.h"
+#include "bolt-udev.h"
+
+G_BEGIN_DECLS
+
+/* Daemon wide counters and latency histograms. Updating
+ * them is lock-free and safe from any thread; the values
+ * are exported via the BoltStats object. */
+
+typedef enum BoltStatsHistogram {
+  BOLT_STATS_METHOD_CALL = 0,
+  BOLT_STATS_AUTHORIZE,
+  BOLT_STATS_UEVENT_STATUS,
+
+  BOLT_STATS_HISTOGRAM_LAST
+} BoltStatsHistogram;
+
+/* bucket 0 holds [0, 2) µs, bucket n holds [2^n, 2^(n+1)) µs,
+ * the last one everything from 2^23 µs (~8 s) upwards */
+#define BOLT_STATS_BUCKETS 24
+
+typedef enum BoltStatsAuth {
+  BOLT_STATS_AUTH_ATTEMPTED = 0,
+  BOLT_STATS_AUTH_SUCCEEDED,
+  BOLT_STATS_AUTH_FAILED,
+
+  BOLT_STATS_AUTH_LAST
+} BoltStatsAuth;
+
+void          bolt_stats_uevent_received (BoltUdevAction action);
+
+void          bolt_stats_uevent_handled (BoltUdevAction action);
+
+void          bolt_stats_uevent_begin (void);
+
+void          bolt_stats_uevent_end (void);
+
+void          bolt_stats_status_changed (void);
+
+void          bolt_stats_authorize (BoltSecurity  level,
+                                    BoltStatsAuth what);
+
+void          bolt_stats_store_read (void);
+
+void          bolt_stats_store_write (void);
+
+void          bolt_stats_polkit_check (gboolean needed);
+
+void          bolt_stats_stall (gint64 usec);
+
+guint64       bolt_stats_get_stalls (guint64 *worst);
+
+void          bolt_stats_udev_overflow (void);
+
+void          bolt_stats_udev_resync (void);
+
+guint64       bolt_stats_get_overflows (guint64 *resyncs);
+
+void          bolt_stats_observe (BoltStatsHistogram hist,
+                                  gint64             usec);
+
+guint         bolt_stats_bucket_for (gint64 usec);
+
+guint64       bolt_stats_get_histogram (BoltStatsHistogram hist,
+                                        guint64           *sum,
+                                        guint64           *buckets);
+
+const char *  bolt_stats_histogram_name (BoltStatsHistogram hist);
+
+void          bolt_stats_reset (void);
+
+/* BoltStats - the D-Bus object */
+
+#define BOLT_TYPE_STATS bolt_stats_get_type ()
+G_DECLARE_FINAL_TYPE (BoltStats, bolt_stats, BOLT, STATS, BoltExported);
+
+BoltStats *   bolt_stats_new (void);
+
+GVariant *    bolt_stats_get_uevents (void);
+
+GVariant *    bolt_stats_get_authorizations (void);
+
+GVariant *    bolt_stats_get_store (void);
+
+GVariant *    bolt_stats_get_polkit (void);
+
+GVariant *    bolt_stats_get_latency (void);
+
+GVariant *    bolt_stats_get_mainloop (void);
+
+GVariant *    bolt_stats_get_udev (void);
+
+G_END_DECLS
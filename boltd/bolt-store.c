@@ -26,10 +26,14 @@
 #include "bolt-fs.h"
 #include "bolt-io.h"
 #include "bolt-log.h"
+#include "bolt-probes.h"
+#include "bolt-stats.h"
 #include "bolt-str.h"
 #include "bolt-time.h"
+#include "bolt-trace.h"
 
 #include <string.h>
+#include <sys/stat.h>
 
 /* ************************************  */
 /* BoltStore */
@@ -293,6 +297,37 @@ bolt_store_list_uids (BoltStore *store,
   return bolt_strv_from_ptr_array (&ids);
 }
 
+/* changes to the set of entries, i.e. devices or keys
+ * that were added or removed, change the stamp */
+char *
+bolt_store_get_stamp (BoltStore *store)
+{
+  GFile *dirs[] = {store->devices, store->keys, store->times};
+  GString *stamp;
+
+  g_return_val_if_fail (BOLT_IS_STORE (store), NULL);
+
+  stamp = g_string_new ("");
+
+  for (guint i = 0; i < G_N_ELEMENTS (dirs); i++)
+    {
+      g_autofree char *path = g_file_get_path (dirs[i]);
+      struct stat st;
+
+      if (i > 0)
+        g_string_append_c (stamp, ':');
+
+      if (stat (path, &st) != 0)
+        g_string_append_c (stamp, '-');
+      else
+        g_string_append_printf (stamp, "%" G_GINT64_FORMAT ".%09ld",
+                                (gint64) st.st_mtim.tv_sec,
+                                (long) st.st_mtim.tv_nsec);
+    }
+
+  return g_string_free (stamp, FALSE);
+}
+
 gboolean
 bolt_store_put_device (BoltStore  *store,
                        BoltDevice *device,
@@ -300,6 +335,7 @@ bolt_store_put_device (BoltStore  *store,
                        BoltKey    *key,
                        GError    **error)
 {
+  g_auto(BoltTraceSpan) span = BOLT_TRACE_SPAN ("store", "put-device");
   g_autoptr(GFile) entry = NULL;
   g_autoptr(GKeyFile) kf = NULL;
   g_autofree char *data  = NULL;
@@ -319,6 +355,9 @@ bolt_store_put_device (BoltStore  *store,
   uid = bolt_device_get_uid (device);
   g_assert (uid);
 
+  BOLT_PROBE2 (store_write, "device", uid);
+  bolt_stats_store_write ();
+
   entry = g_file_get_child (store->devices, uid);
 
   ok = bolt_fs_make_parent_dirs (entry, error);
@@ -400,6 +439,7 @@ bolt_store_put_device (BoltStore  *store,
 BoltDevice *
 bolt_store_get_device (BoltStore *store, const char *uid, GError **error)
 {
+  g_auto(BoltTraceSpan) span = BOLT_TRACE_SPAN_ARG ("store", "get-device", "uid", uid);
   g_autoptr(GKeyFile) kf = NULL;
   g_autoptr(GFile) db = NULL;
   g_autoptr(GError) err = NULL;
@@ -421,6 +461,9 @@ bolt_store_get_device (BoltStore *store, const char *uid, GError **error)
   g_return_val_if_fail (store != NULL, FALSE);
   g_return_val_if_fail (uid != NULL, FALSE);
 
+  BOLT_PROBE2 (store_read, "device", uid);
+  bolt_stats_store_read ();
+
   db = g_file_get_child (store->devices, uid);
   ok = g_file_load_contents (db, NULL,
                              &data, &len,
@@ -522,9 +565,13 @@ bolt_store_del_device (BoltStore  *store,
                        const char *uid,
                        GError    **error)
 {
+  g_auto(BoltTraceSpan) span = BOLT_TRACE_SPAN_ARG ("store", "del-device", "uid", uid);
   g_autoptr(GFile) devpath = NULL;
   gboolean ok;
 
+  BOLT_PROBE2 (store_write, "device-delete", uid);
+  bolt_stats_store_write ();
+
   devpath = g_file_get_child (store->devices, uid);
   ok = g_file_delete (devpath, NULL, error);
 
@@ -571,6 +618,7 @@ bolt_store_get_times (BoltStore  *store,
                       GError    **error,
                       ...)
 {
+  g_auto(BoltTraceSpan) span = BOLT_TRACE_SPAN_ARG ("store", "get-times", "uid", uid);
   gboolean res = TRUE;
   gboolean ok = TRUE;
   const char *ts;
@@ -580,6 +628,9 @@ bolt_store_get_times (BoltStore  *store,
   g_return_val_if_fail (uid != NULL, FALSE);
   g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
+  BOLT_PROBE2 (store_read, "times", uid);
+  bolt_stats_store_read ();
+
   va_start (args, error);
   while ((ts = va_arg (args, const char *)) != NULL)
     {
@@ -642,6 +693,7 @@ bolt_store_put_times (BoltStore  *store,
                       GError    **error,
                       ...)
 {
+  g_auto(BoltTraceSpan) span = BOLT_TRACE_SPAN_ARG ("store", "put-times", "uid", uid);
   gboolean res = TRUE;
   gboolean ok = TRUE;
   const char *ts;
@@ -658,6 +710,9 @@ bolt_store_put_times (BoltStore  *store,
   g_return_val_if_fail (uid != NULL, FALSE);
   g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
+  BOLT_PROBE2 (store_write, "times", uid);
+  bolt_stats_store_write ();
+
   va_start (args, error);
   while ((ts = va_arg (args, const char *)) != NULL)
     {
@@ -757,9 +812,13 @@ bolt_store_put_key (BoltStore  *store,
                     BoltKey    *key,
                     GError    **error)
 {
+  g_auto(BoltTraceSpan) span = BOLT_TRACE_SPAN_ARG ("store", "put-key", "uid", uid);
   g_autoptr(GFile) keypath = NULL;
   gboolean ok;
 
+  BOLT_PROBE2 (store_write, "key", uid);
+  bolt_stats_store_write ();
+
   keypath = g_file_get_child (store->keys, uid);
   ok = bolt_fs_make_parent_dirs (keypath, error);
 
@@ -794,8 +853,12 @@ bolt_store_get_key (BoltStore  *store,
                     const char *uid,
                     GError    **error)
 {
+  g_auto(BoltTraceSpan) span = BOLT_TRACE_SPAN_ARG ("store", "get-key", "uid", uid);
   g_autoptr(GFile) keypath = NULL;
 
+  BOLT_PROBE2 (store_read, "key", uid);
+  bolt_stats_store_read ();
+
   keypath = g_file_get_child (store->keys, uid);
 
   return bolt_key_load_file (keypath, error);
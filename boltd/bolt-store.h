@@ -45,6 +45,8 @@ gboolean          bolt_store_config_save (BoltStore *store,
 GStrv             bolt_store_list_uids (BoltStore *store,
                                         GError   **error);
 
+char *            bolt_store_get_stamp (BoltStore *store);
+
 gboolean          bolt_store_del (BoltStore  *store,
                                   BoltDevice *dev,
                                   GError    **error);
@@ -23,11 +23,14 @@
 #include "bolt-sysfs.h"
 
 #include "bolt-error.h"
+#include "bolt-io.h"
 #include "bolt-str.h"
 #include "bolt-log.h"
 
 #include <errno.h>
 #include <libudev.h>
+#include <limits.h>
+#include <string.h>
 #include <sys/stat.h>
 
 gint64
@@ -172,20 +175,18 @@ bolt_sysfs_count_domains (struct udev *udev,
 }
 
 static gint
-sysfs_get_sysattr_value_as_int (struct udev_device *udev,
-                                const char         *attr)
+sysfs_attr_as_int (const BoltAttr *attr)
 {
-  const char *str;
   gboolean ok;
   gint val;
 
-  g_return_val_if_fail (udev != NULL, FALSE);
-
-  str = udev_device_get_sysattr_value (udev, attr);
-  if (str == NULL)
-    return -errno;
+  if (attr->len < 0)
+    {
+      errno = (int) -attr->len;
+      return (gint) attr->len;
+    }
 
-  ok = bolt_str_parse_as_int (str, &val);
+  ok = bolt_str_parse_as_int (attr->value, &val);
 
   if (!ok)
     return -errno;
@@ -193,20 +194,13 @@ sysfs_get_sysattr_value_as_int (struct udev_device *udev,
   return val;
 }
 
-static gssize
-sysfs_get_sysattr_size (struct udev_device *udev,
-                        const char         *attr)
-{
-  const char *str;
-
-  g_return_val_if_fail (udev != NULL, FALSE);
-
-  str = udev_device_get_sysattr_value (udev, attr);
-  if (str == NULL)
-    return -errno;
+enum {
+  INFO_ATTR_AUTHORIZED = 0,
+  INFO_ATTR_KEY,
+  INFO_ATTR_BOOT,
 
-  return strlen (str);
-}
+  INFO_ATTR_LAST
+};
 
 gboolean
 bolt_sysfs_info_for_device (struct udev_device *udev,
@@ -214,7 +208,11 @@ bolt_sysfs_info_for_device (struct udev_device *udev,
                             BoltDevInfo        *info,
                             GError            **error)
 {
+  bolt_autoclose int fd = -1;
   struct udev_device *parent;
+  BoltAttr attrs[INFO_ATTR_LAST];
+  struct stat sb;
+  const char *syspath;
   int auth;
 
   g_return_val_if_fail (udev != NULL, FALSE);
@@ -225,7 +223,24 @@ bolt_sysfs_info_for_device (struct udev_device *udev,
   info->full = FALSE;
   info->parent = NULL;
 
-  auth = sysfs_get_sysattr_value_as_int (udev, "authorized");
+  syspath = udev_device_get_syspath (udev);
+  fd = bolt_open (syspath, O_DIRECTORY | O_RDONLY | O_CLOEXEC, 0, error);
+
+  if (fd < 0)
+    {
+      info->authorized = -1;
+      return FALSE;
+    }
+
+  /* read all the attributes we need in one go via the
+   * directory fd, bypassing udev's sysattr machinery */
+  attrs[INFO_ATTR_AUTHORIZED].name = "authorized";
+  attrs[INFO_ATTR_KEY].name = "key";
+  attrs[INFO_ATTR_BOOT].name = "boot";
+
+  bolt_read_attrs_at (fd, attrs, INFO_ATTR_LAST);
+
+  auth = sysfs_attr_as_int (&attrs[INFO_ATTR_AUTHORIZED]);
   info->authorized = auth;
 
   if (auth < 0)
@@ -237,15 +252,19 @@ bolt_sysfs_info_for_device (struct udev_device *udev,
       return FALSE;
     }
 
-  info->keysize = sysfs_get_sysattr_size (udev, "key");
-  info->boot = sysfs_get_sysattr_value_as_int (udev, "boot");
+  info->keysize = attrs[INFO_ATTR_KEY].len;
+  info->boot = sysfs_attr_as_int (&attrs[INFO_ATTR_BOOT]);
 
   if (full == FALSE)
     return TRUE;
 
   info->full = TRUE;
-  info->ctim = bolt_sysfs_device_get_time (udev, BOLT_ST_CTIME);
-  info->syspath = udev_device_get_syspath (udev);
+  info->syspath = syspath;
+
+  if (fstat (fd, &sb) == 0)
+    info->ctim = MAX ((gint64) sb.st_ctim.tv_sec, 0);
+  else
+    info->ctim = 0;
 
   parent = udev_device_get_parent (udev);
 
@@ -254,3 +273,394 @@ bolt_sysfs_info_for_device (struct udev_device *udev,
 
   return TRUE;
 }
+
+gboolean
+bolt_sysfs_info_for_entry (const BoltScanEntry *entry,
+                           BoltDevInfo         *info,
+                           GError             **error)
+{
+  g_return_val_if_fail (entry != NULL, FALSE);
+  g_return_val_if_fail (entry->kind == BOLT_SCAN_DEVICE, FALSE);
+  g_return_val_if_fail (info != NULL, FALSE);
+
+  info->authorized = entry->authorized;
+  info->keysize = entry->keysize;
+  info->boot = entry->boot;
+
+  info->full = TRUE;
+  info->ctim = entry->ctim;
+  info->syspath = entry->syspath;
+  info->parent = entry->parent;
+
+  if (entry->authorized < 0)
+    {
+      int code = g_io_error_from_errno (-entry->authorized);
+      g_set_error (error, G_IO_ERROR, code,
+                   "could not read 'authorized': %s",
+                   g_strerror (-entry->authorized));
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* startup scanning */
+#define SCAN_THREAD_THRESHOLD 16
+#define SCAN_UEVENT_MAX 4096
+
+static void
+scan_entry_free (gpointer data)
+{
+  BoltScanEntry *entry = data;
+
+  g_free (entry->syspath);
+  g_free (entry->sysname);
+  g_free (entry->uid);
+  g_free (entry->name);
+  g_free (entry->vendor);
+  g_free (entry->parent);
+  g_slice_free (BoltScanEntry, entry);
+}
+
+static const char *
+scan_uevent_lookup (const char *uevent,
+                    const char *key)
+{
+  gsize len = strlen (key);
+  const char *l;
+
+  for (l = uevent; l && *l; l = strchr (l, '\n'))
+    {
+      if (*l == '\n')
+        l++;
+
+      if (strncmp (l, key, len) == 0 && l[len] == '=')
+        return l + len + 1;
+    }
+
+  return NULL;
+}
+
+static gboolean
+scan_uevent_has (const char *uevent,
+                 const char *key,
+                 const char *value)
+{
+  const char *v = scan_uevent_lookup (uevent, key);
+  gsize len = strlen (value);
+
+  if (v == NULL)
+    return FALSE;
+
+  return strncmp (v, value, len) == 0 && (v[len] == '\n' || v[len] == '\0');
+}
+
+enum {
+  SCAN_ATTR_UID = 0,
+  SCAN_ATTR_AUTHORIZED,
+  SCAN_ATTR_KEY,
+  SCAN_ATTR_BOOT,
+  SCAN_ATTR_DEVICE_NAME,
+  SCAN_ATTR_DEVICE,
+  SCAN_ATTR_VENDOR_NAME,
+  SCAN_ATTR_VENDOR,
+
+  SCAN_ATTR_LAST
+};
+
+static char *
+scan_attr_name (const BoltAttr *name,
+                const BoltAttr *fallback)
+{
+  /* like read_sysattr_name in bolt-device.c: prefer the
+   * "<attr>_name" over the numeric "<attr>" attribute */
+  if (name->len > 0)
+    return g_strndup (name->value, name->len);
+  else if (fallback->len > 0)
+    return g_strndup (fallback->value, fallback->len);
+
+  return NULL;
+}
+
+static void
+scan_entry_load (gpointer data,
+                 gpointer user_data)
+{
+  bolt_autoclose int fd = -1;
+  BoltScanEntry *entry = data;
+  char uevent[SCAN_UEVENT_MAX];
+  BoltAttr attrs[SCAN_ATTR_LAST];
+  struct stat sb;
+  gboolean wmi;
+  ssize_t n;
+  int ufd;
+
+  fd = bolt_open (entry->syspath, O_DIRECTORY | O_RDONLY | O_CLOEXEC, 0, NULL);
+  if (fd < 0)
+    return;
+
+  ufd = openat (fd, "uevent", O_NOFOLLOW | O_CLOEXEC | O_RDONLY);
+  if (ufd < 0)
+    return;
+
+  do
+    n = pread (ufd, uevent, sizeof (uevent) - 1, 0);
+  while (n < 0 && errno == EINTR);
+
+  (void) close (ufd);
+
+  if (n < 0)
+    return;
+
+  uevent[n] = '\0';
+
+  /* the kind of the entry was pre-set according to the bus it
+   * was found on, i.e. DEVICE for thunderbolt, FORCE_POWER for
+   * wmi; refine that with the information in the uevent file */
+  wmi = entry->kind == BOLT_SCAN_FORCE_POWER;
+  entry->kind = BOLT_SCAN_OTHER;
+
+  if (wmi)
+    {
+      struct stat st;
+
+      if (!scan_uevent_has (uevent, "DRIVER", "intel-wmi-thunderbolt"))
+        return;
+
+      if (fstatat (fd, "force_power", &st, 0) == 0 && S_ISREG (st.st_mode))
+        entry->kind = BOLT_SCAN_FORCE_POWER;
+
+      return;
+    }
+
+  if (scan_uevent_has (uevent, "DEVTYPE", "thunderbolt_domain"))
+    {
+      entry->kind = BOLT_SCAN_DOMAIN;
+      return;
+    }
+  else if (!scan_uevent_has (uevent, "DEVTYPE", "thunderbolt_device"))
+    {
+      return;
+    }
+
+  entry->kind = BOLT_SCAN_DEVICE;
+
+  /* everything bolt_device_new_for_udev would read */
+  attrs[SCAN_ATTR_UID].name = "unique_id";
+  attrs[SCAN_ATTR_AUTHORIZED].name = "authorized";
+  attrs[SCAN_ATTR_KEY].name = "key";
+  attrs[SCAN_ATTR_BOOT].name = "boot";
+  attrs[SCAN_ATTR_DEVICE_NAME].name = "device_name";
+  attrs[SCAN_ATTR_DEVICE].name = "device";
+  attrs[SCAN_ATTR_VENDOR_NAME].name = "vendor_name";
+  attrs[SCAN_ATTR_VENDOR].name = "vendor";
+
+  bolt_read_attrs_at (fd, attrs, SCAN_ATTR_LAST);
+
+  if (attrs[SCAN_ATTR_UID].len > 0)
+    entry->uid = g_strndup (attrs[SCAN_ATTR_UID].value,
+                            attrs[SCAN_ATTR_UID].len);
+
+  entry->authorized = sysfs_attr_as_int (&attrs[SCAN_ATTR_AUTHORIZED]);
+  entry->keysize = attrs[SCAN_ATTR_KEY].len;
+  entry->boot = sysfs_attr_as_int (&attrs[SCAN_ATTR_BOOT]);
+
+  entry->name = scan_attr_name (&attrs[SCAN_ATTR_DEVICE_NAME],
+                                &attrs[SCAN_ATTR_DEVICE]);
+  entry->vendor = scan_attr_name (&attrs[SCAN_ATTR_VENDOR_NAME],
+                                  &attrs[SCAN_ATTR_VENDOR]);
+
+  if (fstat (fd, &sb) == 0)
+    entry->ctim = MAX ((gint64) sb.st_ctim.tv_sec, 0);
+  else
+    entry->ctim = 0;
+}
+
+static char *
+scan_resolve_link (const char *root,
+                   int         dirfd,
+                   const char *name)
+{
+  char target[PATH_MAX];
+  const char *p;
+  ssize_t n;
+
+  n = readlinkat (dirfd, name, target, sizeof (target) - 1);
+
+  if (n < 0)
+    return NULL;
+
+  target[n] = '\0';
+
+  /* the links in bus/<subsystem>/devices are relative to the
+   * sysfs root, i.e. "../../../devices/..."; should we ever see
+   * absolute links, re-root them at the "devices" directory */
+  if (target[0] == '/')
+    {
+      p = strstr (target, "/devices/");
+      if (p == NULL)
+        return NULL;
+      p++;
+    }
+  else
+    {
+      for (p = target; g_str_has_prefix (p, "../"); p += 3)
+        ;
+    }
+
+  return g_build_filename (root, p, NULL);
+}
+
+static gboolean
+scan_bus (GPtrArray    *entries,
+          const char   *root,
+          const char   *bus,
+          BoltScanKind  kind,
+          GError      **error)
+{
+  g_autoptr(GError) err = NULL;
+  g_autoptr(DIR) d = NULL;
+  g_autofree char *path = NULL;
+  struct dirent *de;
+
+  path = g_build_filename (root, "bus", bus, "devices", NULL);
+  d = bolt_opendir (path, &err);
+
+  /* some sysfs layouts, e.g. the ones of testbeds, expose
+   * the devices via class/<subsystem> instead */
+  if (d == NULL && g_error_matches (err, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+    {
+      g_clear_error (&err);
+      g_free (path);
+
+      path = g_build_filename (root, "class", bus, NULL);
+      d = bolt_opendir (path, &err);
+    }
+
+  if (d == NULL)
+    {
+      /* module not loaded, i.e. no such bus: nothing to do */
+      if (g_error_matches (err, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+        return TRUE;
+
+      g_propagate_error (error, g_steal_pointer (&err));
+      return FALSE;
+    }
+
+  while ((de = readdir (d)) != NULL)
+    {
+      BoltScanEntry *entry;
+      char *syspath;
+
+      if (de->d_name[0] == '.')
+        continue;
+
+      syspath = scan_resolve_link (root, dirfd (d), de->d_name);
+      if (syspath == NULL)
+        continue;
+
+      entry = g_slice_new0 (BoltScanEntry);
+      entry->kind = kind;
+      entry->syspath = syspath;
+      entry->sysname = g_strdup (de->d_name);
+      entry->authorized = -1;
+      entry->keysize = -1;
+      entry->boot = -1;
+      entry->ctim = -1;
+
+      g_ptr_array_add (entries, entry);
+    }
+
+  return TRUE;
+}
+
+static gint
+scan_entry_compare (gconstpointer a,
+                    gconstpointer b)
+{
+  const BoltScanEntry *ea = *((BoltScanEntry **) a);
+  const BoltScanEntry *eb = *((BoltScanEntry **) b);
+
+  return strcmp (ea->syspath, eb->syspath);
+}
+
+static void
+scan_link_parents (GPtrArray *entries)
+{
+  g_autoptr(GHashTable) devices = NULL;
+
+  devices = g_hash_table_new (g_str_hash, g_str_equal);
+
+  /* parents come before their children, see below */
+  for (guint i = 0; i < entries->len; i++)
+    {
+      BoltScanEntry *entry = g_ptr_array_index (entries, i);
+      g_autofree char *dir = NULL;
+      BoltScanEntry *parent;
+
+      if (entry->kind != BOLT_SCAN_DEVICE)
+        continue;
+
+      dir = g_path_get_dirname (entry->syspath);
+      parent = g_hash_table_lookup (devices, dir);
+
+      /* the parent of a host is the domain */
+      if (parent != NULL)
+        entry->parent = g_strdup (parent->uid);
+
+      g_hash_table_insert (devices, entry->syspath, entry);
+    }
+}
+
+/* Scan the thunderbolt and the wmi bus directly via sysfs and
+ * gather all attributes that are needed at startup, without
+ * going through libudev's enumeration and device machinery.
+ * The per entry work is optionally spread over n_threads
+ * worker threads. The returned entries are sorted by syspath,
+ * which means that parents come before their children, i.e.
+ * domains come before the devices attached to them; entries
+ * that are of no interest have kind BOLT_SCAN_OTHER. */
+GPtrArray *
+bolt_sysfs_scan (const char *root,
+                 guint       n_threads,
+                 GError    **error)
+{
+  g_autoptr(GPtrArray) entries = NULL;
+  GThreadPool *pool = NULL;
+  gboolean ok;
+
+  if (root == NULL)
+    root = "/sys";
+
+  entries = g_ptr_array_new_with_free_func (scan_entry_free);
+
+  ok = scan_bus (entries, root, "thunderbolt", BOLT_SCAN_DEVICE, error) &&
+       scan_bus (entries, root, "wmi", BOLT_SCAN_FORCE_POWER, error);
+
+  if (!ok)
+    return NULL;
+
+  if (n_threads > 1 && entries->len >= SCAN_THREAD_THRESHOLD)
+    pool = g_thread_pool_new (scan_entry_load, NULL,
+                              (gint) n_threads, TRUE, NULL);
+
+  for (guint i = 0; i < entries->len; i++)
+    {
+      BoltScanEntry *entry = g_ptr_array_index (entries, i);
+
+      if (pool != NULL)
+        g_thread_pool_push (pool, entry, NULL);
+      else
+        scan_entry_load (entry, NULL);
+    }
+
+  /* wait for all the queued work to be done */
+  if (pool != NULL)
+    g_thread_pool_free (pool, FALSE, TRUE);
+
+  g_ptr_array_sort (entries, scan_entry_compare);
+
+  scan_link_parents (entries);
+
+  return g_steal_pointer (&entries);
+}
@@ -48,6 +48,36 @@ BoltSecurity         bolt_sysfs_security_for_device (struct udev_device *udev,
 
 int                  bolt_sysfs_count_domains (struct udev *udev,
                                                GError     **error);
+/* fast startup scanning of sysfs */
+typedef enum BoltScanKind {
+  BOLT_SCAN_OTHER = 0,
+  BOLT_SCAN_DOMAIN,
+  BOLT_SCAN_DEVICE,
+  BOLT_SCAN_FORCE_POWER,
+} BoltScanKind;
+
+typedef struct _BoltScanEntry
+{
+  BoltScanKind kind;
+  char        *syspath;
+  char        *sysname;
+
+  /* thunderbolt devices only, like in BoltDevInfo */
+  char  *uid;
+  char  *name;
+  char  *vendor;
+  char  *parent;          /* the uid, NULL for hosts */
+  gint   authorized;
+  gssize keysize;
+  gint   boot;
+  gint64 ctim;
+
+} BoltScanEntry;
+
+GPtrArray *          bolt_sysfs_scan (const char *root,
+                                      guint       n_threads,
+                                      GError    **error);
+
 typedef struct _BoltDevInfo
 {
 
@@ -69,4 +99,8 @@ gboolean             bolt_sysfs_info_for_device (struct udev_device *udev,
                                                  BoltDevInfo        *info,
                                                  GError            **error);
 
+gboolean             bolt_sysfs_info_for_entry (const BoltScanEntry *entry,
+                                                BoltDevInfo         *info,
+                                                GError             **error);
+
 G_END_DECLS
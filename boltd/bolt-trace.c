@@ -0,0 +1,232 @@
+/*
+ * Copyright © 2018 Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *       Christian J. Kellner <christian@kellner.me>
+ */
+
+#include "config.h"
+
+#include "bolt-trace.h"
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+gint bolt_trace_active = 0;
+
+G_LOCK_DEFINE_STATIC (trace);
+static FILE *trace_out = NULL;
+static gint64 trace_pid = 0;
+static GPollFunc trace_poll_chain = NULL;
+
+/* per-thread track id; the thread name is emitted
+ * as metadata the first time a thread records */
+typedef struct _TraceThread
+{
+  gint64 tid;
+  guint  generation;
+} TraceThread;
+
+static GPrivate trace_thread = G_PRIVATE_INIT (g_free);
+static guint trace_generation = 0;
+
+static void
+trace_write_string (FILE *out, const char *str)
+{
+  fputc ('"', out);
+
+  for (const char *c = str; c && *c; c++)
+    {
+      if (*c == '"' || *c == '\\')
+        fprintf (out, "\\%c", *c);
+      else if ((guchar) *c < 0x20)
+        fprintf (out, "\\u%04x", (guint) (guchar) *c);
+      else
+        fputc (*c, out);
+    }
+
+  fputc ('"', out);
+}
+
+static gint64
+trace_thread_id (void)
+{
+  TraceThread *t = g_private_get (&trace_thread);
+  char name[17] = {0, };
+
+  if (t == NULL)
+    {
+      t = g_new0 (TraceThread, 1);
+      t->tid = (gint64) syscall (SYS_gettid);
+      g_private_set (&trace_thread, t);
+    }
+
+  if (t->generation == trace_generation)
+    return t->tid;
+
+  /* first event of this thread in this trace */
+  t->generation = trace_generation;
+
+  if (prctl (PR_GET_NAME, name, 0, 0, 0) != 0)
+    g_snprintf (name, sizeof (name), "thread-%" G_GINT64_FORMAT, t->tid);
+
+  fprintf (trace_out,
+           "{\"name\":\"thread_name\",\"ph\":\"M\","
+           "\"pid\":%" G_GINT64_FORMAT ",\"tid\":%" G_GINT64_FORMAT ","
+           "\"args\":{\"name\":",
+           trace_pid, t->tid);
+  trace_write_string (trace_out, name);
+  fputs ("}},\n", trace_out);
+
+  return t->tid;
+}
+
+void
+bolt_trace_record (const char *category,
+                   const char *name,
+                   gint64      start,
+                   gint64      end,
+                   const char *arg_name,
+                   const char *arg_value)
+{
+  gint64 tid;
+
+  G_LOCK (trace);
+
+  if (trace_out == NULL)
+    {
+      G_UNLOCK (trace);
+      return;
+    }
+
+  tid = trace_thread_id ();
+
+  fprintf (trace_out,
+           "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\","
+           "\"ts\":%" G_GINT64_FORMAT ",\"dur\":%" G_GINT64_FORMAT ","
+           "\"pid\":%" G_GINT64_FORMAT ",\"tid\":%" G_GINT64_FORMAT,
+           name, category, start, end - start, trace_pid, tid);
+
+  if (arg_name != NULL)
+    {
+      fprintf (trace_out, ",\"args\":{\"%s\":", arg_name);
+      trace_write_string (trace_out, arg_value);
+      fputc ('}', trace_out);
+    }
+
+  fputs ("},\n", trace_out);
+
+  G_UNLOCK (trace);
+}
+
+/* main loop idle time, i.e. the time spent in poll */
+static gint
+trace_poll (GPollFD *fds,
+            guint    nfds,
+            gint     timeout)
+{
+  gint64 start;
+  gint res;
+
+  if (timeout == 0)
+    return trace_poll_chain (fds, nfds, timeout);
+
+  start = g_get_monotonic_time ();
+  res = trace_poll_chain (fds, nfds, timeout);
+  bolt_trace_record ("mainloop", "idle", start,
+                     g_get_monotonic_time (), NULL, NULL);
+
+  return res;
+}
+
+gboolean
+bolt_trace_start (const char *path,
+                  GError    **error)
+{
+  FILE *out;
+
+  g_return_val_if_fail (path != NULL, FALSE);
+  g_return_val_if_fail (trace_out == NULL, FALSE);
+
+  out = g_fopen (path, "we");
+
+  if (out == NULL)
+    {
+      int code = errno;
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (code),
+                   "could not open trace file '%s': %s",
+                   path, g_strerror (code));
+      return FALSE;
+    }
+
+  G_LOCK (trace);
+
+  trace_out = out;
+  trace_pid = (gint64) getpid ();
+  trace_generation++;
+
+  fputs ("[\n", trace_out);
+  fprintf (trace_out,
+           "{\"name\":\"process_name\",\"ph\":\"M\","
+           "\"pid\":%" G_GINT64_FORMAT ",\"tid\":0,"
+           "\"args\":{\"name\":\"boltd\"}},\n",
+           trace_pid);
+
+  G_UNLOCK (trace);
+
+  trace_poll_chain = g_main_context_get_poll_func (NULL);
+  g_main_context_set_poll_func (NULL, trace_poll);
+
+  g_atomic_int_set (&bolt_trace_active, TRUE);
+
+  return TRUE;
+}
+
+void
+bolt_trace_stop (void)
+{
+  FILE *out;
+
+  if (!g_atomic_int_get (&bolt_trace_active))
+    return;
+
+  g_atomic_int_set (&bolt_trace_active, FALSE);
+
+  if (g_main_context_get_poll_func (NULL) == trace_poll)
+    g_main_context_set_poll_func (NULL, trace_poll_chain);
+
+  G_LOCK (trace);
+
+  out = trace_out;
+  trace_out = NULL;
+
+  /* the last entry must not have a trailing comma */
+  fprintf (out,
+           "{\"name\":\"trace_end\",\"ph\":\"i\",\"s\":\"g\","
+           "\"ts\":%" G_GINT64_FORMAT ",\"pid\":%" G_GINT64_FORMAT ",\"tid\":0}\n"
+           "]\n",
+           g_get_monotonic_time (), trace_pid);
+
+  G_UNLOCK (trace);
+
+  fclose (out);
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright © 2018 Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *       Christian J. Kellner <christian@kellner.me>
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Spans in the trace event format, as understood by
+ * Perfetto and chrome://tracing. When tracing is not
+ * active, a span costs an atomic load and a branch. */
+extern gint bolt_trace_active;
+
+#define bolt_trace_enabled() G_UNLIKELY (g_atomic_int_get (&bolt_trace_active))
+
+gboolean         bolt_trace_start (const char *path,
+                                   GError    **error);
+
+void             bolt_trace_stop (void);
+
+void             bolt_trace_record (const char *category,
+                                    const char *name,
+                                    gint64      start,
+                                    gint64      end,
+                                    const char *arg_name,
+                                    const char *arg_value);
+
+typedef struct _BoltTraceSpan
+{
+  const char *category;
+  const char *name;
+  gint64      start;
+
+  /* optional argument, must outlive the span */
+  const char *arg_name;
+  const char *arg_value;
+} BoltTraceSpan;
+
+#define BOLT_TRACE_SPAN_ARG(category, name, arg_name, arg_value) \
+  { category, name, bolt_trace_enabled () ? g_get_monotonic_time () : 0, arg_name, arg_value }
+
+#define BOLT_TRACE_SPAN(category, name) BOLT_TRACE_SPAN_ARG (category, name, NULL, NULL)
+
+#define BOLT_TRACE_SPAN_INIT { NULL, NULL, 0, NULL, NULL }
+
+static inline void
+bolt_trace_span_start (BoltTraceSpan *span,
+                       const char    *category,
+                       const char    *name)
+{
+  span->category = category;
+  span->name = name;
+  span->start = bolt_trace_enabled () ? g_get_monotonic_time () : 0;
+}
+
+static inline void
+bolt_trace_span_set_arg (BoltTraceSpan *span,
+                         const char    *name,
+                         const char    *value)
+{
+  span->arg_name = name;
+  span->arg_value = value;
+}
+
+static inline void
+bolt_trace_span_end (BoltTraceSpan *span)
+{
+  if (G_LIKELY (span->start == 0))
+    return;
+
+  bolt_trace_record (span->category, span->name,
+                     span->start, g_get_monotonic_time (),
+                     span->arg_name, span->arg_value);
+
+  span->start = 0;
+}
+
+G_DEFINE_AUTO_CLEANUP_CLEAR_FUNC (BoltTraceSpan, bolt_trace_span_end);
+
+G_END_DECLS
@@ -23,7 +23,13 @@
 #include "bolt-udev.h"
 
 #include "bolt-error.h"
+#include "bolt-log.h"
+#include "bolt-probes.h"
+#include "bolt-record.h"
+#include "bolt-stats.h"
 #include "bolt-sysfs.h"
+#include "bolt-trace.h"
+#include "bolt-watchdog.h"
 
 #include <libudev.h>
 
@@ -40,6 +46,20 @@ static void     udev_initable_iface_init (GInitableIface *iface);
 static gboolean bolt_udev_initialize (GInitable    *initable,
                                       GCancellable *cancellable,
                                       GError      **error);
+
+/* typed subscriptions */
+typedef struct _UeventSub
+{
+  guint             id;
+  BoltUdevSubsystem subsystem;
+  BoltUdevDevtype   devtype;
+
+  BoltUeventFunc    func;
+  gpointer          user_data;
+} UeventSub;
+
+static void     udev_dispatch_rebuild (BoltUdev *udev);
+
 /*  */
 struct _BoltUdev
 {
@@ -53,6 +73,20 @@ struct _BoltUdev
   /* properties */
   char *name;
   GStrv filter;
+
+  /* subscriptions, and the dispatch table that is
+   * derived from them: [subsystem][devtype] -> UeventSub[] */
+  GArray *subs;
+  GArray *table[BOLT_UDEV_SUBSYSTEM_LAST][BOLT_UDEV_DEVTYPE_LAST];
+  guint   sub_id;
+  guint   sub_gen;
+
+  /* receive buffer overflow tracking */
+  guint64 overflows;
+  guint   resync_id;
+
+  /* cached startup scan of sysfs */
+  GPtrArray *scan;
 };
 
 enum {
@@ -67,6 +101,7 @@ static GParamSpec *props[PROP_LAST] = { NULL, };
 
 enum {
   SIGNAL_UEVENT,
+  SIGNAL_OVERFLOW,
   SIGNAL_LAST,
 };
 
@@ -84,6 +119,12 @@ bolt_udev_finalize (GObject *object)
 {
   BoltUdev *udev = BOLT_UDEV (object);
 
+  if (udev->resync_id)
+    {
+      g_source_remove (udev->resync_id);
+      udev->resync_id = 0;
+    }
+
   if (udev->monitor)
     {
       udev_monitor_unref (udev->monitor);
@@ -95,10 +136,15 @@ bolt_udev_finalize (GObject *object)
     }
 
   g_clear_pointer (&udev->udev, udev_unref);
+  g_clear_pointer (&udev->scan, g_ptr_array_unref);
 
   g_clear_pointer (&udev->name, g_free);
   g_clear_pointer (&udev->filter, g_strfreev);
 
+  g_array_set_size (udev->subs, 0);
+  udev_dispatch_rebuild (udev);
+  g_clear_pointer (&udev->subs, g_array_unref);
+
   G_OBJECT_CLASS (bolt_udev_parent_class)->finalize (object);
 }
 
@@ -152,6 +198,7 @@ bolt_udev_set_property (GObject      *object,
 static void
 bolt_udev_init (BoltUdev *udev)
 {
+  udev->subs = g_array_new (FALSE, FALSE, sizeof (UeventSub));
 }
 
 static void
@@ -195,6 +242,17 @@ bolt_udev_class_init (BoltUdevClass *klass)
                   2,
                   G_TYPE_STRING,
                   G_TYPE_POINTER);
+
+  signals[SIGNAL_OVERFLOW] =
+    g_signal_new ("overflow",
+                  G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_LAST,
+                  0,
+                  NULL,
+                  NULL,
+                  NULL,
+                  G_TYPE_NONE,
+                  0);
 }
 
 static void
@@ -204,6 +262,146 @@ udev_initable_iface_init (GInitableIface *iface)
 }
 
 /* internal methods */
+static const char *action_names[BOLT_UDEV_ACTION_LAST] = {
+  [BOLT_UDEV_ACTION_UNKNOWN] = "unknown",
+  [BOLT_UDEV_ACTION_ADD]     = "add",
+  [BOLT_UDEV_ACTION_REMOVE]  = "remove",
+  [BOLT_UDEV_ACTION_CHANGE]  = "change",
+  [BOLT_UDEV_ACTION_MOVE]    = "move",
+  [BOLT_UDEV_ACTION_ONLINE]  = "online",
+  [BOLT_UDEV_ACTION_OFFLINE] = "offline",
+  [BOLT_UDEV_ACTION_BIND]    = "bind",
+  [BOLT_UDEV_ACTION_UNBIND]  = "unbind",
+};
+
+static const char *subsystem_names[BOLT_UDEV_SUBSYSTEM_LAST] = {
+  [BOLT_UDEV_SUBSYSTEM_OTHER]       = NULL,
+  [BOLT_UDEV_SUBSYSTEM_THUNDERBOLT] = "thunderbolt",
+  [BOLT_UDEV_SUBSYSTEM_WMI]         = "wmi",
+  [BOLT_UDEV_SUBSYSTEM_PCI]         = "pci",
+};
+
+static const char *devtype_names[BOLT_UDEV_DEVTYPE_LAST] = {
+  [BOLT_UDEV_DEVTYPE_NONE]   = NULL,
+  [BOLT_UDEV_DEVTYPE_OTHER]  = NULL,
+  [BOLT_UDEV_DEVTYPE_DOMAIN] = "thunderbolt_domain",
+  [BOLT_UDEV_DEVTYPE_DEVICE] = "thunderbolt_device",
+};
+
+static BoltUdevSubsystem
+udev_subsystem_from_string (const char *str)
+{
+  if (str == NULL)
+    return BOLT_UDEV_SUBSYSTEM_OTHER;
+
+  for (guint i = 1; i < BOLT_UDEV_SUBSYSTEM_LAST; i++)
+    if (g_str_equal (str, subsystem_names[i]))
+      return (BoltUdevSubsystem) i;
+
+  return BOLT_UDEV_SUBSYSTEM_OTHER;
+}
+
+static BoltUdevDevtype
+udev_devtype_from_string (const char *str)
+{
+  if (str == NULL)
+    return BOLT_UDEV_DEVTYPE_NONE;
+
+  for (guint i = BOLT_UDEV_DEVTYPE_DOMAIN; i < BOLT_UDEV_DEVTYPE_LAST; i++)
+    if (g_str_equal (str, devtype_names[i]))
+      return (BoltUdevDevtype) i;
+
+  return BOLT_UDEV_DEVTYPE_OTHER;
+}
+
+static inline gboolean
+uevent_sub_matches (const UeventSub  *sub,
+                    BoltUdevSubsystem subsystem,
+                    BoltUdevDevtype   devtype)
+{
+  return (sub->subsystem == BOLT_UDEV_SUBSYSTEM_ANY ||
+          sub->subsystem == subsystem) &&
+         (sub->devtype == BOLT_UDEV_DEVTYPE_ANY ||
+          sub->devtype == devtype);
+}
+
+static void
+udev_dispatch_rebuild (BoltUdev *udev)
+{
+  for (guint s = 0; s < BOLT_UDEV_SUBSYSTEM_LAST; s++)
+    for (guint d = 0; d < BOLT_UDEV_DEVTYPE_LAST; d++)
+      {
+        GArray *cell = NULL;
+
+        for (guint i = 0; i < udev->subs->len; i++)
+          {
+            UeventSub *sub = &g_array_index (udev->subs, UeventSub, i);
+
+            if (!uevent_sub_matches (sub, s, d))
+              continue;
+
+            if (cell == NULL)
+              cell = g_array_new (FALSE, FALSE, sizeof (UeventSub));
+
+            g_array_append_val (cell, *sub);
+          }
+
+        /* cells currently being dispatched hold a reference */
+        g_clear_pointer (&udev->table[s][d], g_array_unref);
+        udev->table[s][d] = cell;
+      }
+
+  udev->sub_gen++;
+}
+
+static gboolean
+udev_subscription_active (BoltUdev *udev,
+                          guint     id)
+{
+  for (guint i = 0; i < udev->subs->len; i++)
+    {
+      UeventSub *sub = &g_array_index (udev->subs, UeventSub, i);
+
+      if (sub->id == id)
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static gboolean
+udev_dispatch (BoltUdev         *udev,
+               const BoltUevent *event)
+{
+  g_autoptr(GArray) cell = NULL;
+  gboolean handled = FALSE;
+  guint gen;
+
+  cell = udev->table[event->subsystem][event->devtype];
+
+  if (cell == NULL)
+    return FALSE;
+
+  g_array_ref (cell);
+  gen = udev->sub_gen;
+
+  for (guint i = 0; i < cell->len; i++)
+    {
+      const UeventSub *sub = &g_array_index (cell, UeventSub, i);
+
+      /* a handler changed the subscriptions, make sure
+       * we don't call into one that was removed */
+      if (gen != udev->sub_gen &&
+          !udev_subscription_active (udev, sub->id))
+        continue;
+
+      if (sub->func (udev, event, sub->user_data))
+        handled = TRUE;
+    }
+
+  return handled;
+}
+
 static gboolean
 monitor_add_filter (struct udev_monitor *monitor,
                     const char          *subsystem_devtype,
@@ -286,6 +484,7 @@ setup_monitor (BoltUdev      *udev,
   watch   = g_io_create_watch (channel, G_IO_IN);
 
   g_source_set_callback (watch, callback, udev, NULL);
+  g_source_set_name (watch, "[boltd] udev-monitor");
   g_source_attach (watch, g_main_context_get_thread_default ());
 
   *monitor_out = udev_monitor_ref (monitor);
@@ -294,21 +493,72 @@ setup_monitor (BoltUdev      *udev,
   return TRUE;
 }
 
+static gboolean
+udev_overflow_resync (gpointer user_data)
+{
+  g_auto(BoltWatchdogScope) scope = BOLT_WATCHDOG_SCOPE_INIT;
+  BoltUdev *udev = BOLT_UDEV (user_data);
+
+  bolt_watchdog_scope_enter (&scope, G_STRFUNC);
+
+  udev->resync_id = 0;
+
+  bolt_info (LOG_TOPIC ("udev"), "requesting resync after overflow");
+  g_signal_emit (udev, signals[SIGNAL_OVERFLOW], 0);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+udev_handle_overflow (BoltUdev *udev)
+{
+  udev->overflows++;
+  bolt_stats_udev_overflow ();
+
+  bolt_warn (LOG_TOPIC ("udev"), LOG_ID (UEVENT_OVERFLOW),
+             "receive buffer overflow, uevents lost (overflows: %"
+             G_GUINT64_FORMAT ")", udev->overflows);
+
+  if (udev->resync_id != 0)
+    return;
+
+  /* the resync runs at idle priority, so that all the events
+   * still queued in the socket are handled before, and multiple
+   * overflows in a row are coalesced into a single resync */
+  udev->resync_id = g_idle_add (udev_overflow_resync, udev);
+  g_source_set_name_by_id (udev->resync_id, "[boltd] udev-resync");
+}
+
 static gboolean
 handle_uevent_udev (GIOChannel  *source,
                     GIOCondition condition,
                     gpointer     user_data)
 {
   g_autoptr(udev_device) device = NULL;
+  g_auto(BoltTraceSpan) span = BOLT_TRACE_SPAN ("udev", "uevent");
+  g_auto(BoltWatchdogScope) scope = BOLT_WATCHDOG_SCOPE_INIT;
   BoltUdev *udev;
+  BoltUevent event;
   const char *action;
   const char *syspath;
+  gboolean handled;
+
+  bolt_watchdog_scope_enter (&scope, G_STRFUNC);
 
   udev = BOLT_UDEV (user_data);
+
+  errno = 0;
   device = udev_monitor_receive_device (udev->monitor);
 
   if (device == NULL)
-    return G_SOURCE_CONTINUE;
+    {
+      /* the kernel dropped messages, because our
+       * receive buffer was full */
+      if (errno == ENOBUFS)
+        udev_handle_overflow (udev);
+
+      return G_SOURCE_CONTINUE;
+    }
 
   action = udev_device_get_action (device);
   if (action == NULL)
@@ -318,8 +568,34 @@ handle_uevent_udev (GIOChannel  *source,
   if (syspath == NULL)
     return G_SOURCE_CONTINUE;
 
-  g_signal_emit (udev, signals[SIGNAL_UEVENT], 0,
-                 action, device);
+  event.action = bolt_udev_action_from_string (action);
+  event.subsystem = udev_subsystem_from_string (udev_device_get_subsystem (device));
+  event.devtype = udev_devtype_from_string (udev_device_get_devtype (device));
+  event.action_str = action;
+  event.syspath = syspath;
+  event.device = device;
+
+  bolt_trace_span_set_arg (&span, "action", action);
+  BOLT_PROBE2 (uevent_received, action, syspath);
+  bolt_stats_uevent_received (event.action);
+  bolt_stats_uevent_begin ();
+
+  if (bolt_record_enabled ())
+    bolt_record_uevent (&event);
+
+  handled = udev_dispatch (udev, &event);
+
+  /* the generic signal is only emitted if somebody
+   * is listening, to avoid the marshalling overhead; its
+   * handlers can't report back, they only observe */
+  if (g_signal_has_handler_pending (udev, signals[SIGNAL_UEVENT], 0, FALSE))
+    g_signal_emit (udev, signals[SIGNAL_UEVENT], 0,
+                   action, device);
+
+  bolt_stats_uevent_end ();
+
+  if (handled)
+    bolt_stats_uevent_handled (event.action);
 
   return G_SOURCE_CONTINUE;
 }
@@ -349,6 +625,28 @@ bolt_udev_initialize (GInitable    *initable,
 }
 
 /* public methods */
+const char *
+bolt_udev_action_to_string (BoltUdevAction action)
+{
+  if ((guint) action >= BOLT_UDEV_ACTION_LAST)
+    action = BOLT_UDEV_ACTION_UNKNOWN;
+
+  return action_names[action];
+}
+
+BoltUdevAction
+bolt_udev_action_from_string (const char *str)
+{
+  if (str == NULL)
+    return BOLT_UDEV_ACTION_UNKNOWN;
+
+  for (guint i = 1; i < BOLT_UDEV_ACTION_LAST; i++)
+    if (g_str_equal (str, action_names[i]))
+      return (BoltUdevAction) i;
+
+  return BOLT_UDEV_ACTION_UNKNOWN;
+}
+
 BoltUdev  *
 bolt_udev_new (const char         *name,
                const char * const *filter,
@@ -404,6 +702,102 @@ bolt_udev_device_new_from_syspath (BoltUdev   *udev,
   return dev;
 }
 
+/* typed uevent subscriptions */
+guint
+bolt_udev_subscribe (BoltUdev         *udev,
+                     BoltUdevSubsystem subsystem,
+                     BoltUdevDevtype   devtype,
+                     BoltUeventFunc    func,
+                     gpointer          user_data)
+{
+  UeventSub sub;
+
+  g_return_val_if_fail (BOLT_IS_UDEV (udev), 0);
+  g_return_val_if_fail (func != NULL, 0);
+  g_return_val_if_fail (subsystem >= BOLT_UDEV_SUBSYSTEM_ANY &&
+                        subsystem < BOLT_UDEV_SUBSYSTEM_LAST, 0);
+  g_return_val_if_fail (devtype >= BOLT_UDEV_DEVTYPE_ANY &&
+                        devtype < BOLT_UDEV_DEVTYPE_LAST, 0);
+
+  if (++udev->sub_id == 0)
+    udev->sub_id = 1;
+
+  sub.id = udev->sub_id;
+  sub.subsystem = subsystem;
+  sub.devtype = devtype;
+  sub.func = func;
+  sub.user_data = user_data;
+
+  g_array_append_val (udev->subs, sub);
+  udev_dispatch_rebuild (udev);
+
+  return sub.id;
+}
+
+void
+bolt_udev_unsubscribe (BoltUdev *udev,
+                       guint     id)
+{
+  g_return_if_fail (BOLT_IS_UDEV (udev));
+
+  for (guint i = 0; i < udev->subs->len; i++)
+    {
+      UeventSub *sub = &g_array_index (udev->subs, UeventSub, i);
+
+      if (sub->id != id)
+        continue;
+
+      g_array_remove_index (udev->subs, i);
+      udev_dispatch_rebuild (udev);
+      return;
+    }
+
+  g_warning ("udev: no subscription with id %u", id);
+}
+
+guint
+bolt_udev_unsubscribe_by_data (BoltUdev *udev,
+                               gpointer  user_data)
+{
+  guint count = 0;
+
+  g_return_val_if_fail (BOLT_IS_UDEV (udev), 0);
+
+  for (guint i = udev->subs->len; i > 0; i--)
+    {
+      UeventSub *sub = &g_array_index (udev->subs, UeventSub, i - 1);
+
+      if (sub->user_data != user_data)
+        continue;
+
+      g_array_remove_index (udev->subs, i - 1);
+      count++;
+    }
+
+  if (count > 0)
+    udev_dispatch_rebuild (udev);
+
+  return count;
+}
+
+guint64
+bolt_udev_get_overflows (BoltUdev *udev)
+{
+  g_return_val_if_fail (BOLT_IS_UDEV (udev), 0);
+
+  return udev->overflows;
+}
+
+void
+bolt_udev_inject_overflow (BoltUdev *udev)
+{
+  g_return_if_fail (BOLT_IS_UDEV (udev));
+
+  /* the kernel side cannot be provoked reliably,
+   * this goes through the very same path instead */
+  udev_handle_overflow (udev);
+}
+
 /* thunderbolt specific helpers */
 int
 bolt_udev_count_domains (BoltUdev *udev,
@@ -413,3 +807,37 @@ bolt_udev_count_domains (BoltUdev *udev,
 
   return bolt_sysfs_count_domains (udev->udev, error);
 }
+
+/* the result of the sysfs scan is cached, so that all the
+ * subsystems can share it during startup; once that is over
+ * bolt_udev_scan_clear should be called to drop it */
+GPtrArray *
+bolt_udev_scan (BoltUdev *udev,
+                GError  **error)
+{
+  guint n_threads;
+
+  g_return_val_if_fail (BOLT_IS_UDEV (udev), NULL);
+
+  if (udev->scan != NULL)
+    return g_ptr_array_ref (udev->scan);
+
+  n_threads = MIN (g_get_num_processors (), 4);
+  udev->scan = bolt_sysfs_scan (NULL, n_threads, error);
+
+  if (udev->scan == NULL)
+    return NULL;
+
+  bolt_debug (LOG_TOPIC ("udev"), "scanned sysfs: %u entries",
+              udev->scan->len);
+
+  return g_ptr_array_ref (udev->scan);
+}
+
+void
+bolt_udev_scan_clear (BoltUdev *udev)
+{
+  g_return_if_fail (BOLT_IS_UDEV (udev));
+
+  g_clear_pointer (&udev->scan, g_ptr_array_unref);
+}
@@ -29,6 +29,57 @@ struct udev;
 struct udev_device;
 struct udev_enumerate;
 
+/* pre-parsed uevent information */
+typedef enum BoltUdevAction {
+  BOLT_UDEV_ACTION_UNKNOWN = 0,
+  BOLT_UDEV_ACTION_ADD,
+  BOLT_UDEV_ACTION_REMOVE,
+  BOLT_UDEV_ACTION_CHANGE,
+  BOLT_UDEV_ACTION_MOVE,
+  BOLT_UDEV_ACTION_ONLINE,
+  BOLT_UDEV_ACTION_OFFLINE,
+  BOLT_UDEV_ACTION_BIND,
+  BOLT_UDEV_ACTION_UNBIND,
+
+  BOLT_UDEV_ACTION_LAST
+} BoltUdevAction;
+
+typedef enum BoltUdevSubsystem {
+  BOLT_UDEV_SUBSYSTEM_ANY = -1,  /* only valid as subscription key */
+  BOLT_UDEV_SUBSYSTEM_OTHER = 0,
+  BOLT_UDEV_SUBSYSTEM_THUNDERBOLT,
+  BOLT_UDEV_SUBSYSTEM_WMI,
+  BOLT_UDEV_SUBSYSTEM_PCI,
+
+  BOLT_UDEV_SUBSYSTEM_LAST
+} BoltUdevSubsystem;
+
+typedef enum BoltUdevDevtype {
+  BOLT_UDEV_DEVTYPE_ANY = -1,    /* only valid as subscription key */
+  BOLT_UDEV_DEVTYPE_NONE = 0,
+  BOLT_UDEV_DEVTYPE_OTHER,
+  BOLT_UDEV_DEVTYPE_DOMAIN,      /* thunderbolt_domain */
+  BOLT_UDEV_DEVTYPE_DEVICE,      /* thunderbolt_device */
+
+  BOLT_UDEV_DEVTYPE_LAST
+} BoltUdevDevtype;
+
+typedef struct _BoltUevent
+{
+  BoltUdevAction    action;
+  BoltUdevSubsystem subsystem;
+  BoltUdevDevtype   devtype;
+
+  /* raw data, owned by the device */
+  const char         *action_str;
+  const char         *syspath;
+  struct udev_device *device;
+} BoltUevent;
+
+const char *         bolt_udev_action_to_string (BoltUdevAction action);
+
+BoltUdevAction       bolt_udev_action_from_string (const char *str);
+
 /* BoltUdev - small udev abstraction */
 #define BOLT_TYPE_UDEV bolt_udev_get_type ()
 G_DECLARE_FINAL_TYPE (BoltUdev, bolt_udev, BOLT, UDEV, GObject);
@@ -44,8 +95,36 @@ struct udev_device * bolt_udev_device_new_from_syspath (BoltUdev   *udev,
                                                         const char *syspath,
                                                         GError    **error);
 
+/* typed uevent subscriptions; handlers return TRUE if they
+ * acted on the event, which is what the "handled" statistics
+ * count, and FALSE if they only observed it */
+typedef gboolean (*BoltUeventFunc) (BoltUdev         *udev,
+                                    const BoltUevent *event,
+                                    gpointer          user_data);
+
+guint                bolt_udev_subscribe (BoltUdev         *udev,
+                                          BoltUdevSubsystem subsystem,
+                                          BoltUdevDevtype   devtype,
+                                          BoltUeventFunc    func,
+                                          gpointer          user_data);
+
+void                 bolt_udev_unsubscribe (BoltUdev *udev,
+                                            guint     id);
+
+guint                bolt_udev_unsubscribe_by_data (BoltUdev *udev,
+                                                    gpointer  user_data);
+
+guint64              bolt_udev_get_overflows (BoltUdev *udev);
+
+void                 bolt_udev_inject_overflow (BoltUdev *udev);
+
 /* thunderbolt specific helpers */
 int                  bolt_udev_count_domains (BoltUdev *udev,
                                               GError  **error);
 
+GPtrArray *          bolt_udev_scan (BoltUdev *udev,
+                                     GError  **error);
+
+void                 bolt_udev_scan_clear (BoltUdev *udev);
+
 G_END_DECLS
@@ -0,0 +1,336 @@
+/*
+ * Copyright © 2018 Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *       Christian J. Kellner <christian@kellner.me>
+ */
+
+#include "config.h"
+
+#include "bolt-watchdog.h"
+
+#include "bolt-log.h"
+#include "bolt-stats.h"
+
+#include <gio/gio.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+
+#define WATCHDOG_SIGNAL (SIGRTMIN + 3)
+#define WATCHDOG_CAPTURE_TRIES 10 /* times 10 ms */
+
+#define atomic_load(ptr) __atomic_load_n ((ptr), __ATOMIC_SEQ_CST)
+#define atomic_store(ptr, val) __atomic_store_n ((ptr), (val), __ATOMIC_SEQ_CST)
+
+static GMutex    watchdog_lock;
+static GCond     watchdog_cond;
+static GThread  *watchdog_thread = NULL;
+static gboolean  watchdog_running = FALSE;
+static gint64    watchdog_threshold = 0; /* usec */
+static GPollFunc watchdog_poll_chain = NULL;
+static pthread_t watchdog_main;
+
+/* the current iteration of the main loop; the start is
+ * reset to 0 while the loop is sitting in poll */
+static gint64 iteration_start = 0;
+static gint   iteration_gen = 0;
+static gint   iteration_reported = 0;
+static gint   watchdog_parked = 0;
+static gint   watchdog_active = 0;
+
+/* the innermost scope, only ever written by the main thread */
+static const BoltWatchdogScope *watchdog_scope = NULL;
+
+/* filled in by the signal handler on the main thread */
+static char   capture_source[64];
+static char   capture_callback[64];
+static gint   capture_done = 0;
+
+/* main thread */
+static void
+watchdog_iteration_begin (void)
+{
+  g_atomic_int_inc (&iteration_gen);
+  atomic_store (&iteration_start, g_get_monotonic_time ());
+
+  /* the watchdog only needs a wakeup if it is idle */
+  if (g_atomic_int_get (&watchdog_parked))
+    {
+      g_mutex_lock (&watchdog_lock);
+      g_cond_signal (&watchdog_cond);
+      g_mutex_unlock (&watchdog_lock);
+    }
+}
+
+static void
+watchdog_iteration_end (void)
+{
+  gint64 start = atomic_load (&iteration_start);
+  gint64 duration;
+
+  if (start == 0)
+    return;
+
+  atomic_store (&iteration_start, 0);
+  duration = g_get_monotonic_time () - start;
+
+  if (duration < watchdog_threshold)
+    return;
+
+  bolt_stats_stall (duration);
+
+  if (g_atomic_int_get (&iteration_reported) == g_atomic_int_get (&iteration_gen))
+    bolt_info (LOG_TOPIC ("watchdog"),
+               "main loop stall ended after %" G_GINT64_FORMAT " ms",
+               duration / 1000);
+}
+
+static gint
+watchdog_poll (GPollFD *fds,
+               guint    nfds,
+               gint     timeout)
+{
+  gint res;
+
+  watchdog_iteration_end ();
+  res = watchdog_poll_chain (fds, nfds, timeout);
+  watchdog_iteration_begin ();
+
+  return res;
+}
+
+static void
+capture_copy (char       *buf,
+              gsize       len,
+              const char *str)
+{
+  gsize i;
+
+  for (i = 0; str && str[i] && i < len - 1; i++)
+    buf[i] = str[i];
+  buf[i] = '\0';
+}
+
+static void
+watchdog_capture (int sig)
+{
+  const BoltWatchdogScope *scope;
+  int saved = errno;
+
+  /* the main thread is interrupted, so the scope and its
+   * strings stay valid; only plain memory accesses here */
+  scope = atomic_load (&watchdog_scope);
+
+  capture_copy (capture_source, sizeof (capture_source),
+                scope ? scope->source : NULL);
+  capture_copy (capture_callback, sizeof (capture_callback),
+                scope ? scope->callback : NULL);
+
+  g_atomic_int_set (&capture_done, 1);
+
+  errno = saved;
+}
+
+/* watchdog thread */
+static void
+watchdog_report (gint64 duration)
+{
+  const char *topic;
+  gboolean captured = FALSE;
+
+  topic = bolt_log_get_last_topic ();
+
+  g_atomic_int_set (&capture_done, 0);
+  if (pthread_kill (watchdog_main, WATCHDOG_SIGNAL) == 0)
+    for (guint i = 0; i < WATCHDOG_CAPTURE_TRIES && !captured; i++)
+      {
+        g_usleep (10 * 1000);
+        captured = g_atomic_int_get (&capture_done);
+      }
+
+  bolt_warn (LOG_TOPIC ("watchdog"),
+             "main loop stalled for %" G_GINT64_FORMAT " ms, "
+             "source: '%s', callback: %s, topic: '%s'",
+             duration / 1000,
+             captured && *capture_source ? capture_source : "<none>",
+             captured && *capture_callback ? capture_callback : "<unknown>",
+             topic ? : "<none>");
+}
+
+static gpointer
+watchdog_thread_main (gpointer data)
+{
+  g_mutex_lock (&watchdog_lock);
+
+  while (watchdog_running)
+    {
+      gint64 start, now;
+      gint gen;
+
+      gen = g_atomic_int_get (&iteration_gen);
+      start = atomic_load (&iteration_start);
+
+      if (start == 0)
+        {
+          /* the main loop is idle, sleep until it is not */
+          g_atomic_int_set (&watchdog_parked, 1);
+          if (atomic_load (&iteration_start) == 0)
+            g_cond_wait (&watchdog_cond, &watchdog_lock);
+          g_atomic_int_set (&watchdog_parked, 0);
+          continue;
+        }
+
+      now = g_get_monotonic_time ();
+
+      if (now - start < watchdog_threshold)
+        {
+          g_cond_wait_until (&watchdog_cond, &watchdog_lock,
+                             start + watchdog_threshold);
+          continue;
+        }
+
+      /* report every stall once, while it is still ongoing */
+      if (gen != g_atomic_int_get (&iteration_reported) &&
+          start == atomic_load (&iteration_start))
+        {
+          g_atomic_int_set (&iteration_reported, gen);
+
+          g_mutex_unlock (&watchdog_lock);
+          watchdog_report (now - start);
+          g_mutex_lock (&watchdog_lock);
+        }
+
+      g_cond_wait_until (&watchdog_cond, &watchdog_lock,
+                         g_get_monotonic_time () + watchdog_threshold);
+    }
+
+  g_mutex_unlock (&watchdog_lock);
+
+  return NULL;
+}
+
+/* public methods */
+gboolean
+bolt_watchdog_start (guint    threshold,
+                     GError **error)
+{
+  struct sigaction sa;
+
+  g_return_val_if_fail (threshold > 0, FALSE);
+
+  if (watchdog_thread != NULL)
+    return TRUE;
+
+  memset (&sa, 0, sizeof (sa));
+  sa.sa_handler = watchdog_capture;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset (&sa.sa_mask);
+
+  if (sigaction (WATCHDOG_SIGNAL, &sa, NULL) != 0)
+    {
+      int code = errno;
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (code),
+                   "could not install watchdog signal handler: %s",
+                   g_strerror (code));
+      return FALSE;
+    }
+
+  watchdog_main = pthread_self ();
+  watchdog_threshold = (gint64) threshold * 1000;
+  watchdog_running = TRUE;
+
+  watchdog_poll_chain = g_main_context_get_poll_func (NULL);
+  g_main_context_set_poll_func (NULL, watchdog_poll);
+
+  watchdog_thread = g_thread_try_new ("watchdog",
+                                      watchdog_thread_main,
+                                      NULL,
+                                      error);
+
+  if (watchdog_thread == NULL)
+    {
+      g_main_context_set_poll_func (NULL, watchdog_poll_chain);
+      watchdog_running = FALSE;
+      signal (WATCHDOG_SIGNAL, SIG_DFL);
+      return FALSE;
+    }
+
+  g_atomic_int_set (&watchdog_active, 1);
+
+  return TRUE;
+}
+
+void
+bolt_watchdog_stop (void)
+{
+  if (watchdog_thread == NULL)
+    return;
+
+  g_atomic_int_set (&watchdog_active, 0);
+
+  g_mutex_lock (&watchdog_lock);
+  watchdog_running = FALSE;
+  g_cond_signal (&watchdog_cond);
+  g_mutex_unlock (&watchdog_lock);
+
+  g_thread_join (watchdog_thread);
+  watchdog_thread = NULL;
+
+  if (g_main_context_get_poll_func (NULL) == watchdog_poll)
+    g_main_context_set_poll_func (NULL, watchdog_poll_chain);
+
+  atomic_store (&iteration_start, 0);
+  signal (WATCHDOG_SIGNAL, SIG_DFL);
+}
+
+gboolean
+bolt_watchdog_is_active (void)
+{
+  return watchdog_thread != NULL;
+}
+
+void
+bolt_watchdog_scope_enter (BoltWatchdogScope *scope,
+                           const char        *callback)
+{
+  GSource *source;
+
+  if (!g_atomic_int_get (&watchdog_active) ||
+      !pthread_equal (pthread_self (), watchdog_main))
+    return;
+
+  source = g_main_current_source ();
+
+  scope->source = source ? g_source_get_name (source) : NULL;
+  scope->callback = callback;
+  scope->outer = watchdog_scope;
+  scope->entered = TRUE;
+
+  atomic_store (&watchdog_scope, scope);
+}
+
+void
+bolt_watchdog_scope_leave (BoltWatchdogScope *scope)
+{
+  if (!scope->entered)
+    return;
+
+  atomic_store (&watchdog_scope, scope->outer);
+  scope->entered = FALSE;
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright © 2018 Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *       Christian J. Kellner <christian@kellner.me>
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Main loop stall detection: a thread that watches the
+ * iterations of the default main context, which must be
+ * run by the thread calling bolt_watchdog_start(). */
+
+#define BOLT_WATCHDOG_THRESHOLD 500 /* in milli-seconds */
+
+gboolean         bolt_watchdog_start (guint    threshold,
+                                      GError **error);
+
+void             bolt_watchdog_stop (void);
+
+gboolean         bolt_watchdog_is_active (void);
+
+/* The callback that is currently dispatched on the main thread,
+ * together with the name of its source; this is what a stall is
+ * attributed to. Scopes nest and must be left in reverse order,
+ * which g_auto() takes care of. */
+typedef struct _BoltWatchdogScope BoltWatchdogScope;
+
+struct _BoltWatchdogScope
+{
+  const char              *source;
+  const char              *callback;
+  const BoltWatchdogScope *outer;
+  gboolean                 entered;
+};
+
+#define BOLT_WATCHDOG_SCOPE_INIT { NULL, NULL, NULL, FALSE }
+
+void             bolt_watchdog_scope_enter (BoltWatchdogScope *scope,
+                                            const char        *callback);
+
+void             bolt_watchdog_scope_leave (BoltWatchdogScope *scope);
+
+G_DEFINE_AUTO_CLEANUP_CLEAR_FUNC (BoltWatchdogScope, bolt_watchdog_scope_leave);
+
+G_END_DECLS
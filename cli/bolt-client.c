@@ -22,6 +22,7 @@
 
 #include "bolt-device.h"
 #include "bolt-error.h"
+#include "bolt-fs.h"
 #include "bolt-names.h"
 
 #include <gio/gio.h>
@@ -42,6 +43,10 @@ static void         handle_dbus_domain_removed (GObject    *self,
 struct _BoltClient
 {
   BoltProxy parent;
+
+  /* filtered subscriptions */
+  GHashTable *subscriptions;
+  guint       last_subscription;
 };
 
 enum {
@@ -76,6 +81,16 @@ G_DEFINE_TYPE (BoltClient,
                BOLT_TYPE_PROXY);
 
 
+static void
+bolt_client_finalize (GObject *object)
+{
+  BoltClient *cli = BOLT_CLIENT (object);
+
+  g_clear_pointer (&cli->subscriptions, g_hash_table_unref);
+
+  G_OBJECT_CLASS (bolt_client_parent_class)->finalize (object);
+}
+
 static void
 bolt_client_get_property (GObject    *object,
                           guint       prop_id,
@@ -110,6 +125,7 @@ bolt_client_class_init (BoltClientClass *klass)
   GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
   BoltProxyClass *proxy_class = BOLT_PROXY_CLASS (klass);
 
+  gobject_class->finalize = bolt_client_finalize;
   gobject_class->get_property = bolt_client_get_property;
 
   proxy_class->get_dbus_signals = bolt_client_get_dbus_signals;
@@ -218,6 +234,129 @@ bolt_client_init (BoltClient *cli)
 
 }
 
+/* filtered subscriptions */
+typedef struct Subscription
+{
+  GDBusConnection      *bus;
+  GArray               *ids;
+  GHashTable           *props;
+
+  BoltClientChangedFunc func;
+  gpointer              client;
+  gpointer              user_data;
+  GDestroyNotify        notify;
+
+  guint                 ref_count;
+} Subscription;
+
+static void
+subscription_unref (gpointer data)
+{
+  Subscription *sub = data;
+
+  if (--sub->ref_count > 0)
+    return;
+
+  if (sub->notify)
+    sub->notify (sub->user_data);
+
+  g_clear_pointer (&sub->props, g_hash_table_unref);
+  g_array_unref (sub->ids);
+  g_object_unref (sub->bus);
+  g_slice_free (Subscription, sub);
+}
+
+static void
+subscription_cancel (gpointer data)
+{
+  Subscription *sub = data;
+
+  /* the subscription is freed once the last
+   * signal subscription is gone */
+  for (guint i = 0; i < sub->ids->len; i++)
+    {
+      guint id = g_array_index (sub->ids, guint, i);
+      g_dbus_connection_signal_unsubscribe (sub->bus, id);
+    }
+}
+
+static void
+subscription_handle_changed (GDBusConnection *bus,
+                             const char      *sender,
+                             const char      *opath,
+                             const char      *iface,
+                             const char      *signal,
+                             GVariant        *params,
+                             gpointer         user_data)
+{
+  g_autoptr(GVariant) changed = NULL;
+  Subscription *sub = user_data;
+  GVariantBuilder builder;
+  GVariantIter iter;
+  gboolean have_any = FALSE;
+  const char *key;
+  GVariant *val;
+
+  if (!g_variant_is_of_type (params, G_VARIANT_TYPE ("(sa{sv}as)")))
+    return;
+
+  changed = g_variant_get_child_value (params, 1);
+
+  if (sub->props == NULL)
+    {
+      sub->func (sub->client, opath, changed, sub->user_data);
+      return;
+    }
+
+  /* D-Bus match rules can not look into the dictionary,
+   * so the property allowlist is applied here */
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+
+  g_variant_iter_init (&iter, changed);
+  while (g_variant_iter_next (&iter, "{&sv}", &key, &val))
+    {
+      if (g_hash_table_contains (sub->props, key))
+        {
+          g_variant_builder_add (&builder, "{sv}", key, val);
+          have_any = TRUE;
+        }
+
+      g_variant_unref (val);
+    }
+
+  if (!have_any)
+    {
+      g_variant_builder_clear (&builder);
+      return;
+    }
+
+  g_clear_pointer (&changed, g_variant_unref);
+  changed = g_variant_ref_sink (g_variant_builder_end (&builder));
+
+  sub->func (sub->client, opath, changed, sub->user_data);
+}
+
+static void
+subscription_add_match (Subscription *sub,
+                        const char   *opath)
+{
+  guint id;
+
+  sub->ref_count++;
+  id = g_dbus_connection_signal_subscribe (sub->bus,
+                                           bolt_proxy_name_for_connection (sub->bus),
+                                           "org.freedesktop.DBus.Properties",
+                                           "PropertiesChanged",
+                                           opath,
+                                           BOLT_DBUS_DEVICE_INTERFACE,
+                                           G_DBUS_SIGNAL_FLAGS_NONE,
+                                           subscription_handle_changed,
+                                           sub,
+                                           subscription_unref);
+
+  g_array_append_val (sub->ids, id);
+}
+
 /* dbus signals */
 
 static void
@@ -263,13 +402,48 @@ handle_dbus_domain_removed (GObject *self, GDBusProxy *bus_proxy, GVariant *para
 
 /* public methods */
 
+static char *
+peer_address (void)
+{
+  g_autofree char *escaped = NULL;
+  g_autofree char *path = NULL;
+  const char *env;
+
+  env = g_getenv ("BOLT_PEER_SOCKET");
+
+  /* explicitly disabled */
+  if (env != NULL && *env == '\0')
+    return NULL;
+
+  if (env != NULL)
+    path = g_strdup (env);
+  else
+    path = g_build_filename (bolt_get_rundir (), BOLT_PEER_SOCKET_NAME, NULL);
+
+  escaped = g_dbus_address_escape_value (path);
+  return g_strdup_printf ("unix:path=%s", escaped);
+}
+
 BoltClient *
 bolt_client_new (GError **error)
 {
+  g_autoptr(GError) err = NULL;
+  g_autofree char *address = NULL;
+  GDBusConnection *bus = NULL;
   BoltClient *cli;
-  GDBusConnection *bus;
 
-  bus = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, error);
+  /* try the direct connection first, usually only
+   * available for privileged clients */
+  address = peer_address ();
+
+  if (address != NULL)
+    bus = g_dbus_connection_new_for_address_sync (address,
+                                                  G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT,
+                                                  NULL, NULL, &err);
+
+  if (bus == NULL)
+    bus = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, error);
+
   if (bus == NULL)
     {
       g_prefix_error (error, "Error connecting to D-Bus: ");
@@ -280,7 +454,7 @@ bolt_client_new (GError **error)
                         NULL, error,
                         "g-flags", G_DBUS_PROXY_FLAGS_NONE,
                         "g-connection", bus,
-                        "g-name", BOLT_DBUS_NAME,
+                        "g-name", bolt_proxy_name_for_connection (bus),
                         "g-object-path", BOLT_DBUS_PATH,
                         "g-interface-name", BOLT_DBUS_INTERFACE,
                         NULL);
@@ -311,6 +485,25 @@ got_the_client (GObject      *source,
   g_object_unref (task);
 }
 
+static void
+got_the_connection (GTask           *task,
+                    GDBusConnection *bus)
+{
+  GCancellable *cancellable;
+
+  cancellable = g_task_get_cancellable (task);
+  g_async_initable_new_async (BOLT_TYPE_CLIENT,
+                              G_PRIORITY_DEFAULT,
+                              cancellable,
+                              got_the_client, task,
+                              "g-flags", G_DBUS_PROXY_FLAGS_NONE,
+                              "g-connection", bus,
+                              "g-name", bolt_proxy_name_for_connection (bus),
+                              "g-object-path", BOLT_DBUS_PATH,
+                              "g-interface-name", BOLT_DBUS_INTERFACE,
+                              NULL);
+}
+
 static void
 got_the_bus (GObject      *source,
              GAsyncResult *res,
@@ -318,7 +511,6 @@ got_the_bus (GObject      *source,
 {
   g_autoptr(GError) error = NULL;
   GTask *task = user_data;
-  GCancellable *cancellable;
   GDBusConnection *bus;
 
   bus = g_bus_get_finish (res, &error);
@@ -329,17 +521,30 @@ got_the_bus (GObject      *source,
       return;
     }
 
-  cancellable = g_task_get_cancellable (task);
-  g_async_initable_new_async (BOLT_TYPE_CLIENT,
-                              G_PRIORITY_DEFAULT,
-                              cancellable,
-                              got_the_client, task,
-                              "g-flags", G_DBUS_PROXY_FLAGS_NONE,
-                              "g-connection", bus,
-                              "g-name", BOLT_DBUS_NAME,
-                              "g-object-path", BOLT_DBUS_PATH,
-                              "g-interface-name", BOLT_DBUS_INTERFACE,
-                              NULL);
+  got_the_connection (task, bus);
+  g_object_unref (bus);
+}
+
+static void
+got_the_peer (GObject      *source,
+              GAsyncResult *res,
+              gpointer      user_data)
+{
+  g_autoptr(GError) error = NULL;
+  GTask *task = user_data;
+  GDBusConnection *bus;
+
+  bus = g_dbus_connection_new_for_address_finish (res, &error);
+  if (bus == NULL)
+    {
+      /* fall back to the system bus */
+      g_bus_get (G_BUS_TYPE_SYSTEM,
+                 g_task_get_cancellable (task),
+                 got_the_bus, task);
+      return;
+    }
+
+  got_the_connection (task, bus);
   g_object_unref (bus);
 }
 
@@ -348,10 +553,24 @@ bolt_client_new_async (GCancellable       *cancellable,
                        GAsyncReadyCallback callback,
                        gpointer            user_data)
 {
+  g_autofree char *address = NULL;
   GTask *task;
 
   task = g_task_new (NULL, cancellable, callback, user_data);
-  g_bus_get (G_BUS_TYPE_SYSTEM, cancellable, got_the_bus, task);
+  address = peer_address ();
+
+  if (address == NULL)
+    {
+      g_bus_get (G_BUS_TYPE_SYSTEM, cancellable, got_the_bus, task);
+      return;
+    }
+
+  g_dbus_connection_new_for_address (address,
+                                     G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT,
+                                     NULL,
+                                     cancellable,
+                                     got_the_peer,
+                                     task);
 }
 
 BoltClient *
@@ -447,6 +666,303 @@ bolt_client_list_devices (BoltClient   *client,
   return g_steal_pointer (&devices);
 }
 
+/* list objects asynchronously: all proxies are initialized
+ * concurrently and the task completes with the last one */
+typedef struct ListData
+{
+  GType       type;
+  const char *iface;
+
+  GPtrArray  *objects;
+  guint       pending;
+  GError     *error;
+} ListData;
+
+typedef struct ListItem
+{
+  GTask *task;
+  guint  index;
+} ListItem;
+
+static void
+list_object_free (gpointer data)
+{
+  /* slots of failed initializations stay empty */
+  if (data != NULL)
+    g_object_unref (data);
+}
+
+static void
+list_data_free (gpointer data)
+{
+  ListData *ld = data;
+
+  g_clear_pointer (&ld->objects, g_ptr_array_unref);
+  g_clear_error (&ld->error);
+  g_slice_free (ListData, ld);
+}
+
+static void
+list_got_object (GObject      *source,
+                 GAsyncResult *res,
+                 gpointer      user_data)
+{
+  g_autoptr(GError) err = NULL;
+  ListItem *item = user_data;
+  GTask *task = item->task;
+  ListData *ld;
+  GObject *obj;
+
+  ld = g_task_get_task_data (task);
+  obj = g_async_initable_new_finish (G_ASYNC_INITABLE (source), res, &err);
+
+  if (obj != NULL)
+    g_ptr_array_index (ld->objects, item->index) = obj;
+  else if (ld->error == NULL)
+    ld->error = g_steal_pointer (&err);
+
+  g_slice_free (ListItem, item);
+
+  if (--ld->pending > 0)
+    return;
+
+  if (ld->error != NULL)
+    g_task_return_error (task, g_steal_pointer (&ld->error));
+  else
+    g_task_return_pointer (task,
+                           g_steal_pointer (&ld->objects),
+                           (GDestroyNotify) g_ptr_array_unref);
+
+  g_object_unref (task);
+}
+
+static void
+list_got_paths (GObject      *source,
+                GAsyncResult *res,
+                gpointer      user_data)
+{
+  g_autoptr(GVariant) val = NULL;
+  g_autoptr(GError) err = NULL;
+  g_autofree const char **paths = NULL;
+  GTask *task = user_data;
+  GCancellable *cancel;
+  GDBusConnection *bus;
+  ListData *ld;
+  gsize n;
+
+  val = g_dbus_proxy_call_finish (G_DBUS_PROXY (source), res, &err);
+  if (val == NULL)
+    {
+      if (g_dbus_error_is_remote_error (err))
+        g_dbus_error_strip_remote_error (err);
+
+      g_task_return_error (task, g_steal_pointer (&err));
+      g_object_unref (task);
+      return;
+    }
+
+  ld = g_task_get_task_data (task);
+  g_variant_get (val, "(^a&o)", &paths);
+  n = g_strv_length ((char **) paths);
+
+  ld->objects = g_ptr_array_new_full (n, list_object_free);
+  g_ptr_array_set_size (ld->objects, n);
+
+  if (n == 0)
+    {
+      g_task_return_pointer (task,
+                             g_steal_pointer (&ld->objects),
+                             (GDestroyNotify) g_ptr_array_unref);
+      g_object_unref (task);
+      return;
+    }
+
+  bus = g_dbus_proxy_get_connection (G_DBUS_PROXY (source));
+  cancel = g_task_get_cancellable (task);
+  ld->pending = n;
+
+  for (guint i = 0; i < n; i++)
+    {
+      ListItem *item = g_slice_new (ListItem);
+
+      item->task = task;
+      item->index = i;
+
+      g_async_initable_new_async (ld->type,
+                                  G_PRIORITY_DEFAULT,
+                                  cancel,
+                                  list_got_object, item,
+                                  "g-flags", G_DBUS_PROXY_FLAGS_NONE,
+                                  "g-connection", bus,
+                                  "g-name", bolt_proxy_name_for_connection (bus),
+                                  "g-object-path", paths[i],
+                                  "g-interface-name", ld->iface,
+                                  NULL);
+    }
+}
+
+static void
+list_objects_async (BoltClient         *client,
+                    const char         *method,
+                    GType               type,
+                    const char         *iface,
+                    gpointer            source_tag,
+                    GCancellable       *cancellable,
+                    GAsyncReadyCallback callback,
+                    gpointer            user_data)
+{
+  ListData *ld;
+  GTask *task;
+
+  ld = g_slice_new0 (ListData);
+  ld->type = type;
+  ld->iface = iface;
+
+  task = g_task_new (client, cancellable, callback, user_data);
+  g_task_set_source_tag (task, source_tag);
+  g_task_set_task_data (task, ld, list_data_free);
+
+  g_dbus_proxy_call (G_DBUS_PROXY (client),
+                     method,
+                     NULL,
+                     G_DBUS_CALL_FLAGS_NONE,
+                     -1,
+                     cancellable,
+                     list_got_paths,
+                     task);
+}
+
+void
+bolt_client_list_domains_async (BoltClient         *client,
+                                GCancellable       *cancellable,
+                                GAsyncReadyCallback callback,
+                                gpointer            user_data)
+{
+  g_return_if_fail (BOLT_IS_CLIENT (client));
+
+  list_objects_async (client,
+                      "ListDomains",
+                      BOLT_TYPE_DOMAIN,
+                      BOLT_DBUS_DOMAIN_INTERFACE,
+                      bolt_client_list_domains_async,
+                      cancellable,
+                      callback,
+                      user_data);
+}
+
+GPtrArray *
+bolt_client_list_domains_finish (BoltClient   *client,
+                                 GAsyncResult *res,
+                                 GError      **error)
+{
+  g_return_val_if_fail (BOLT_IS_CLIENT (client), NULL);
+  g_return_val_if_fail (g_task_is_valid (res, client), NULL);
+
+  return g_task_propagate_pointer (G_TASK (res), error);
+}
+
+void
+bolt_client_list_devices_async (BoltClient         *client,
+                                GCancellable       *cancellable,
+                                GAsyncReadyCallback callback,
+                                gpointer            user_data)
+{
+  g_return_if_fail (BOLT_IS_CLIENT (client));
+
+  list_objects_async (client,
+                      "ListDevices",
+                      BOLT_TYPE_DEVICE,
+                      BOLT_DBUS_DEVICE_INTERFACE,
+                      bolt_client_list_devices_async,
+                      cancellable,
+                      callback,
+                      user_data);
+}
+
+GPtrArray *
+bolt_client_list_devices_finish (BoltClient   *client,
+                                 GAsyncResult *res,
+                                 GError      **error)
+{
+  g_return_val_if_fail (BOLT_IS_CLIENT (client), NULL);
+  g_return_val_if_fail (g_task_is_valid (res, client), NULL);
+
+  return g_task_propagate_pointer (G_TASK (res), error);
+}
+
+guint
+bolt_client_subscribe_devices (BoltClient           *client,
+                               const char * const   *uids,
+                               const char * const   *properties,
+                               BoltClientChangedFunc func,
+                               gpointer              user_data,
+                               GDestroyNotify        notify)
+{
+  Subscription *sub;
+  guint id;
+
+  g_return_val_if_fail (BOLT_IS_CLIENT (client), 0);
+  g_return_val_if_fail (func != NULL, 0);
+
+  sub = g_slice_new0 (Subscription);
+  sub->bus = g_object_ref (g_dbus_proxy_get_connection (G_DBUS_PROXY (client)));
+  sub->ids = g_array_new (FALSE, FALSE, sizeof (guint));
+  sub->func = func;
+  sub->client = client;
+  sub->user_data = user_data;
+  sub->notify = notify;
+  sub->ref_count = 1;
+
+  if (properties != NULL && *properties != NULL)
+    {
+      sub->props = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                          g_free, NULL);
+
+      for (guint i = 0; properties[i] != NULL; i++)
+        g_hash_table_add (sub->props, g_strdup (properties[i]));
+    }
+
+  /* one rule for the PropertiesChanged signal of each device
+   * path, or a single rule matching the device interface (arg0)
+   * on any path, so the bus daemon does the filtering */
+  if (uids != NULL && *uids != NULL)
+    {
+      for (guint i = 0; uids[i] != NULL; i++)
+        {
+          g_autofree char *opath = bolt_device_path_for_uid (uids[i]);
+          subscription_add_match (sub, opath);
+        }
+    }
+  else
+    {
+      subscription_add_match (sub, NULL);
+    }
+
+  if (client->subscriptions == NULL)
+    client->subscriptions = g_hash_table_new_full (NULL, NULL, NULL,
+                                                   subscription_cancel);
+
+  id = ++client->last_subscription;
+  g_hash_table_insert (client->subscriptions, GUINT_TO_POINTER (id), sub);
+
+  /* the signal subscriptions keep sub alive from here on */
+  subscription_unref (sub);
+
+  return id;
+}
+
+void
+bolt_client_unsubscribe (BoltClient *client,
+                         guint       id)
+{
+  g_return_if_fail (BOLT_IS_CLIENT (client));
+  g_return_if_fail (id > 0);
+
+  if (client->subscriptions == NULL ||
+      !g_hash_table_remove (client->subscriptions, GUINT_TO_POINTER (id)))
+    g_warning ("no subscription with id %u", id);
+}
+
 BoltDevice *
 bolt_client_get_device (BoltClient   *client,
                         const char   *uid,
@@ -603,6 +1119,86 @@ bolt_client_enroll_device_finish (BoltClient   *client,
   return TRUE;
 }
 
+static void
+authorize_device_done (GObject      *source,
+                       GAsyncResult *res,
+                       gpointer      user_data)
+{
+  g_autoptr(GTask) task = user_data;
+  g_autoptr(GVariant) val = NULL;
+  g_autoptr(GError) err = NULL;
+
+  val = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source), res, &err);
+
+  if (val == NULL)
+    {
+      if (g_dbus_error_is_remote_error (err))
+        g_dbus_error_strip_remote_error (err);
+
+      g_task_return_error (task, g_steal_pointer (&err));
+      return;
+    }
+
+  g_task_return_boolean (task, TRUE);
+}
+
+void
+bolt_client_authorize_device_async (BoltClient         *client,
+                                    const char         *uid,
+                                    BoltAuthCtrl        flags,
+                                    GCancellable       *cancellable,
+                                    GAsyncReadyCallback callback,
+                                    gpointer            user_data)
+{
+  g_autofree char *fstr = NULL;
+  g_autofree char *opath = NULL;
+  GDBusConnection *bus;
+  GError *err = NULL;
+  GTask *task;
+
+  g_return_if_fail (BOLT_IS_CLIENT (client));
+  g_return_if_fail (uid != NULL);
+
+  fstr = bolt_flags_to_string (BOLT_TYPE_AUTH_CTRL, flags, &err);
+  if (fstr == NULL)
+    {
+      g_task_report_error (client, callback, user_data, NULL, err);
+      return;
+    }
+
+  /* call the device object directly, which saves the
+   * DeviceByUid round trip and the proxy creation */
+  bus = g_dbus_proxy_get_connection (G_DBUS_PROXY (client));
+  opath = bolt_device_path_for_uid (uid);
+
+  task = g_task_new (client, cancellable, callback, user_data);
+  g_task_set_source_tag (task, bolt_client_authorize_device_async);
+
+  g_dbus_connection_call (bus,
+                          bolt_proxy_name_for_connection (bus),
+                          opath,
+                          BOLT_DBUS_DEVICE_INTERFACE,
+                          "Authorize",
+                          g_variant_new ("(s)", fstr),
+                          NULL,
+                          G_DBUS_CALL_FLAGS_NONE,
+                          -1,
+                          cancellable,
+                          authorize_device_done,
+                          task);
+}
+
+gboolean
+bolt_client_authorize_device_finish (BoltClient   *client,
+                                     GAsyncResult *res,
+                                     GError      **error)
+{
+  g_return_val_if_fail (BOLT_IS_CLIENT (client), FALSE);
+  g_return_val_if_fail (g_task_is_valid (res, client), FALSE);
+
+  return g_task_propagate_boolean (G_TASK (res), error);
+}
+
 gboolean
 bolt_client_forget_device (BoltClient *client,
                            const char *uid,
@@ -669,6 +1265,35 @@ bolt_client_forget_device_finish (BoltClient   *client,
   return TRUE;
 }
 
+GVariant *
+bolt_client_dump_flight_recorder (BoltClient *client,
+                                  GError    **error)
+{
+  g_autoptr(GVariant) val = NULL;
+  g_autoptr(GError) err = NULL;
+  GVariant *events = NULL;
+
+  g_return_val_if_fail (BOLT_IS_CLIENT (client), NULL);
+
+  val = g_dbus_proxy_call_sync (G_DBUS_PROXY (client),
+                                "DumpFlightRecorder",
+                                NULL,
+                                G_DBUS_CALL_FLAGS_NONE,
+                                -1,
+                                NULL,
+                                &err);
+
+  if (val == NULL)
+    {
+      bolt_error_propagate_stripped (error, &err);
+      return NULL;
+    }
+
+  g_variant_get (val, "(@a(xusssss))", &events);
+
+  return events;
+}
+
 BoltPower *
 bolt_client_new_power_client (BoltClient   *client,
                               GCancellable *cancellable,
@@ -43,10 +43,43 @@ GPtrArray *     bolt_client_list_domains (BoltClient   *client,
                                           GCancellable *cancellable,
                                           GError      **error);
 
+void            bolt_client_list_domains_async (BoltClient         *client,
+                                                GCancellable       *cancellable,
+                                                GAsyncReadyCallback callback,
+                                                gpointer            user_data);
+
+GPtrArray *     bolt_client_list_domains_finish (BoltClient   *client,
+                                                 GAsyncResult *res,
+                                                 GError      **error);
+
 GPtrArray *     bolt_client_list_devices (BoltClient   *client,
                                           GCancellable *cancellable,
                                           GError      **error);
 
+void            bolt_client_list_devices_async (BoltClient         *client,
+                                                GCancellable       *cancellable,
+                                                GAsyncReadyCallback callback,
+                                                gpointer            user_data);
+
+GPtrArray *     bolt_client_list_devices_finish (BoltClient   *client,
+                                                 GAsyncResult *res,
+                                                 GError      **error);
+
+typedef void (*BoltClientChangedFunc) (BoltClient *client,
+                                       const char *object_path,
+                                       GVariant   *changed,
+                                       gpointer    user_data);
+
+guint           bolt_client_subscribe_devices (BoltClient           *client,
+                                               const char * const   *uids,
+                                               const char * const   *properties,
+                                               BoltClientChangedFunc func,
+                                               gpointer              user_data,
+                                               GDestroyNotify        notify);
+
+void            bolt_client_unsubscribe (BoltClient *client,
+                                         guint       id);
+
 BoltDevice *    bolt_client_get_device (BoltClient   *client,
                                         const char   *uid,
                                         GCancellable *cancellable,
@@ -71,6 +104,17 @@ gboolean        bolt_client_enroll_device_finish (BoltClient   *client,
                                                   char        **path,
                                                   GError      **error);
 
+void            bolt_client_authorize_device_async (BoltClient         *client,
+                                                    const char         *uid,
+                                                    BoltAuthCtrl        flags,
+                                                    GCancellable       *cancellable,
+                                                    GAsyncReadyCallback callback,
+                                                    gpointer            user_data);
+
+gboolean        bolt_client_authorize_device_finish (BoltClient   *client,
+                                                     GAsyncResult *res,
+                                                     GError      **error);
+
 gboolean        bolt_client_forget_device (BoltClient *client,
                                            const char *uid,
                                            GError    **error);
@@ -85,6 +129,9 @@ gboolean        bolt_client_forget_device_finish (BoltClient   *client,
                                                   GAsyncResult *res,
                                                   GError      **error);
 
+GVariant *      bolt_client_dump_flight_recorder (BoltClient *client,
+                                                  GError    **error);
+
 BoltPower *     bolt_client_new_power_client (BoltClient   *client,
                                               GCancellable *cancellable,
                                               GError      **error);
@@ -226,7 +226,7 @@ bolt_device_new_for_object_path (GDBusConnection *bus,
                         cancel, error,
                         "g-flags", G_DBUS_PROXY_FLAGS_NONE,
                         "g-connection", bus,
-                        "g-name", BOLT_DBUS_NAME,
+                        "g-name", bolt_proxy_name_for_connection (bus),
                         "g-object-path", path,
                         "g-interface-name", BOLT_DBUS_DEVICE_INTERFACE,
                         NULL);
@@ -234,6 +234,54 @@ bolt_device_new_for_object_path (GDBusConnection *bus,
   return dev;
 }
 
+void
+bolt_device_new_for_object_path_async (GDBusConnection    *bus,
+                                       const char         *path,
+                                       GCancellable       *cancellable,
+                                       GAsyncReadyCallback callback,
+                                       gpointer            user_data)
+{
+  g_async_initable_new_async (BOLT_TYPE_DEVICE,
+                              G_PRIORITY_DEFAULT,
+                              cancellable,
+                              callback, user_data,
+                              "g-flags", G_DBUS_PROXY_FLAGS_NONE,
+                              "g-connection", bus,
+                              "g-name", bolt_proxy_name_for_connection (bus),
+                              "g-object-path", path,
+                              "g-interface-name", BOLT_DBUS_DEVICE_INTERFACE,
+                              NULL);
+}
+
+BoltDevice *
+bolt_device_new_for_object_path_finish (GAsyncResult *res,
+                                        GError      **error)
+{
+  g_autoptr(GObject) source = NULL;
+  GObject *obj;
+
+  source = g_async_result_get_source_object (res);
+  obj = g_async_initable_new_finish (G_ASYNC_INITABLE (source), res, error);
+
+  if (obj == NULL)
+    return NULL;
+
+  return BOLT_DEVICE (obj);
+}
+
+char *
+bolt_device_path_for_uid (const char *uid)
+{
+  g_autofree char *id = NULL;
+
+  g_return_val_if_fail (uid != NULL, NULL);
+
+  /* mirrors the way the daemon exports devices */
+  id = g_strcanon (g_strdup (uid), BOLT_DBUS_OPATH_VALID_CHARS, '_');
+
+  return g_build_path ("/", BOLT_DBUS_PATH_DEVICES, id, NULL);
+}
+
 gboolean
 bolt_device_authorize (BoltDevice   *dev,
                        BoltAuthCtrl  flags,
@@ -111,7 +111,7 @@ bolt_domain_new_for_object_path (GDBusConnection *bus,
                         cancel, error,
                         "g-flags", G_DBUS_PROXY_FLAGS_NONE,
                         "g-connection", bus,
-                        "g-name", BOLT_DBUS_NAME,
+                        "g-name", bolt_proxy_name_for_connection (bus),
                         "g-object-path", path,
                         "g-interface-name", BOLT_DBUS_DOMAIN_INTERFACE,
                         NULL);
@@ -0,0 +1,203 @@
+/*
+ * Copyright © 2018 Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *       Christian J. Kellner <christian@kellner.me>
+ */
+
+#include "config.h"
+
+#include "bolt-json.h"
+
+#include <math.h>
+
+void
+bolt_json_append_string (GString    *out,
+                         const char *str)
+{
+  g_string_append_c (out, '"');
+
+  for (const char *p = str; *p != '\0'; p++)
+    {
+      guchar c = (guchar) *p;
+
+      if (c == '"' || c == '\\')
+        {
+          g_string_append_printf (out, "\\%c", c);
+        }
+      else if (c == '\n')
+        {
+          g_string_append (out, "\\n");
+        }
+      else if (c == '\t')
+        {
+          g_string_append (out, "\\t");
+        }
+      else if (c < 0x20 || c == 0x7f)
+        {
+          g_string_append_printf (out, "\\u%04x", c);
+        }
+      else if (c < 0x80)
+        {
+          g_string_append_c (out, c);
+        }
+      else
+        {
+          const char *next = g_utf8_next_char (p);
+          gunichar uc;
+
+          /* valid UTF-8 is passed through as is, invalid
+           * sequences would make the whole line invalid */
+          uc = g_utf8_get_char_validated (p, -1);
+          if (uc == (gunichar) -1 || uc == (gunichar) -2)
+            {
+              g_string_append (out, "\\ufffd");
+              continue;
+            }
+
+          g_string_append_len (out, p, next - p);
+          p = next - 1;
+        }
+    }
+
+  g_string_append_c (out, '"');
+}
+
+void
+bolt_json_append_variant (GString  *out,
+                          GVariant *v)
+{
+  g_autoptr(GVariant) child = NULL;
+  const GVariantType *et;
+  char buf[G_ASCII_DTOSTR_BUF_SIZE];
+  GVariantIter iter;
+  gboolean first = TRUE;
+
+  switch (g_variant_classify (v))
+    {
+    case G_VARIANT_CLASS_BOOLEAN:
+      g_string_append (out, g_variant_get_boolean (v) ? "true" : "false");
+      break;
+
+    case G_VARIANT_CLASS_BYTE:
+      g_string_append_printf (out, "%u", g_variant_get_byte (v));
+      break;
+
+    case G_VARIANT_CLASS_INT16:
+      g_string_append_printf (out, "%d", g_variant_get_int16 (v));
+      break;
+
+    case G_VARIANT_CLASS_UINT16:
+      g_string_append_printf (out, "%u", g_variant_get_uint16 (v));
+      break;
+
+    case G_VARIANT_CLASS_INT32:
+      g_string_append_printf (out, "%d", g_variant_get_int32 (v));
+      break;
+
+    case G_VARIANT_CLASS_HANDLE:
+      g_string_append_printf (out, "%d", g_variant_get_handle (v));
+      break;
+
+    case G_VARIANT_CLASS_UINT32:
+      g_string_append_printf (out, "%u", g_variant_get_uint32 (v));
+      break;
+
+    case G_VARIANT_CLASS_INT64:
+      g_string_append_printf (out, "%" G_GINT64_FORMAT, g_variant_get_int64 (v));
+      break;
+
+    case G_VARIANT_CLASS_UINT64:
+      g_string_append_printf (out, "%" G_GUINT64_FORMAT, g_variant_get_uint64 (v));
+      break;
+
+    case G_VARIANT_CLASS_DOUBLE:
+      /* JSON has no representation for nan and infinity */
+      if (isfinite (g_variant_get_double (v)))
+        g_string_append (out, g_ascii_dtostr (buf, sizeof (buf), g_variant_get_double (v)));
+      else
+        g_string_append (out, "null");
+      break;
+
+    case G_VARIANT_CLASS_STRING:
+    case G_VARIANT_CLASS_OBJECT_PATH:
+    case G_VARIANT_CLASS_SIGNATURE:
+      bolt_json_append_string (out, g_variant_get_string (v, NULL));
+      break;
+
+    case G_VARIANT_CLASS_VARIANT:
+      child = g_variant_get_variant (v);
+      bolt_json_append_variant (out, child);
+      break;
+
+    case G_VARIANT_CLASS_MAYBE:
+      child = g_variant_get_maybe (v);
+      if (child != NULL)
+        bolt_json_append_variant (out, child);
+      else
+        g_string_append (out, "null");
+      break;
+
+    case G_VARIANT_CLASS_ARRAY:
+      et = g_variant_type_element (g_variant_get_type (v));
+
+      if (g_variant_type_is_dict_entry (et))
+        {
+          GVariant *key, *val;
+
+          g_string_append_c (out, '{');
+          g_variant_iter_init (&iter, v);
+          while (g_variant_iter_loop (&iter, "{@?@*}", &key, &val))
+            {
+              if (!first)
+                g_string_append (out, ", ");
+
+              if (g_variant_is_of_type (key, G_VARIANT_TYPE_STRING))
+                {
+                  bolt_json_append_string (out, g_variant_get_string (key, NULL));
+                }
+              else
+                {
+                  g_autofree char *str = g_variant_print (key, FALSE);
+                  bolt_json_append_string (out, str);
+                }
+
+              g_string_append (out, ": ");
+              bolt_json_append_variant (out, val);
+              first = FALSE;
+            }
+          g_string_append_c (out, '}');
+          break;
+        }
+
+      /* fall through */
+    case G_VARIANT_CLASS_TUPLE:
+    case G_VARIANT_CLASS_DICT_ENTRY:
+      g_string_append_c (out, '[');
+      g_variant_iter_init (&iter, v);
+      while ((child = g_variant_iter_next_value (&iter)) != NULL)
+        {
+          if (!first)
+            g_string_append (out, ", ");
+
+          bolt_json_append_variant (out, child);
+          g_clear_pointer (&child, g_variant_unref);
+          first = FALSE;
+        }
+      g_string_append_c (out, ']');
+      break;
+    }
+}
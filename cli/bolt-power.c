@@ -112,7 +112,7 @@ bolt_power_new_for_object_path (GDBusConnection *bus,
                         cancel, error,
                         "g-flags", G_DBUS_PROXY_FLAGS_NONE,
                         "g-connection", bus,
-                        "g-name", BOLT_DBUS_NAME,
+                        "g-name", bolt_proxy_name_for_connection (bus),
                         "g-object-path", BOLT_DBUS_PATH,
                         "g-interface-name", BOLT_DBUS_POWER_INTERFACE,
                         NULL);
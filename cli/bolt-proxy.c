@@ -220,16 +220,37 @@ bolt_proxy_get_object_path (BoltProxy *proxy)
 gboolean
 bolt_proxy_has_name_owner (BoltProxy *proxy)
 {
+  GDBusConnection *bus;
   const char *name_owner;
 
   g_return_val_if_fail (proxy != NULL, FALSE);
   g_return_val_if_fail (BOLT_IS_PROXY (proxy), FALSE);
 
+  /* direct connection: the daemon is the peer */
+  if (g_dbus_proxy_get_name (G_DBUS_PROXY (proxy)) == NULL)
+    {
+      bus = g_dbus_proxy_get_connection (G_DBUS_PROXY (proxy));
+      return !g_dbus_connection_is_closed (bus);
+    }
+
   name_owner = g_dbus_proxy_get_name_owner (G_DBUS_PROXY (proxy));
 
   return name_owner != NULL;
 }
 
+const char *
+bolt_proxy_name_for_connection (GDBusConnection *bus)
+{
+  g_return_val_if_fail (G_IS_DBUS_CONNECTION (bus), NULL);
+
+  /* peer-to-peer connections have no unique name,
+   * and messages must not carry a destination */
+  if (g_dbus_connection_get_unique_name (bus) == NULL)
+    return NULL;
+
+  return BOLT_DBUS_NAME;
+}
+
 static GParamSpec *
 find_property (BoltProxy  *proxy,
                const char *name,
@@ -51,6 +51,8 @@ gboolean          bolt_proxy_get_dbus_property (GObject    *proxy,
 
 gboolean          bolt_proxy_has_name_owner (BoltProxy *proxy);
 
+const char *      bolt_proxy_name_for_connection (GDBusConnection *bus);
+
 const char *      bolt_proxy_get_object_path (BoltProxy *proxy)
 G_DEPRECATED_FOR (g_dbus_proxy_get_object_path);
 
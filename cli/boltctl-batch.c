@@ -0,0 +1,374 @@
+/*
+ * Copyright © 2018 Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *       Christian J. Kellner <christian@kellner.me>
+ */
+
+#include "config.h"
+
+#include "boltctl-cmds.h"
+
+#include "bolt-str.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#define BATCH_DEFAULT_JOBS 8
+
+typedef enum BatchOp {
+  BATCH_AUTHORIZE,
+  BATCH_ENROLL,
+  BATCH_FORGET
+} BatchOp;
+
+static const char *batch_op_names[] = {"authorize", "enroll", "forget"};
+
+typedef struct Batch Batch;
+
+typedef struct BatchJob
+{
+  Batch     *batch;
+  guint      line;
+  BatchOp    op;
+  char      *uid;
+  BoltPolicy policy;
+
+  gboolean   started;
+  gboolean   done;
+  GError    *error;
+} BatchJob;
+
+struct Batch
+{
+  BoltClient *client;
+  GPtrArray  *jobs;
+  GHashTable *busy;      /* uids of running jobs */
+  GMainLoop  *loop;
+
+  guint       max_jobs;
+  guint       running;
+  guint       next_report;
+  guint       failed;
+};
+
+static void
+batch_job_free (gpointer data)
+{
+  BatchJob *job = data;
+
+  g_free (job->uid);
+  g_clear_error (&job->error);
+  g_free (job);
+}
+
+static BatchJob *
+batch_job_parse (const char *str,
+                 guint       line,
+                 GError    **error)
+{
+  g_auto(GStrv) argv = NULL;
+  BatchJob *job;
+  int argc;
+
+  if (!g_shell_parse_argv (str, &argc, &argv, error))
+    return NULL;
+
+  job = g_new0 (BatchJob, 1);
+  job->line = line;
+  job->policy = BOLT_POLICY_DEFAULT;
+
+  if (bolt_streq (argv[0], "authorize") && argc == 2)
+    {
+      job->op = BATCH_AUTHORIZE;
+    }
+  else if (bolt_streq (argv[0], "forget") && argc == 2)
+    {
+      job->op = BATCH_FORGET;
+    }
+  else if (bolt_streq (argv[0], "enroll") && (argc == 2 || argc == 3))
+    {
+      job->op = BATCH_ENROLL;
+
+      if (argc == 3)
+        job->policy = bolt_policy_from_string (argv[2]);
+
+      if (!bolt_policy_validate (job->policy))
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                       "invalid policy '%s'", argv[2]);
+          batch_job_free (job);
+          return NULL;
+        }
+    }
+  else
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                   "invalid command '%s'", str);
+      batch_job_free (job);
+      return NULL;
+    }
+
+  job->uid = g_strdup (argv[1]);
+
+  return job;
+}
+
+static void
+batch_report (Batch *batch)
+{
+  /* results are reported in input order */
+  while (batch->next_report < batch->jobs->len)
+    {
+      BatchJob *job = g_ptr_array_index (batch->jobs, batch->next_report);
+
+      if (!job->done)
+        break;
+
+      if (job->error == NULL)
+        g_print ("%u: ok %s %s\n", job->line,
+                 batch_op_names[job->op], job->uid);
+      else if (job->uid != NULL)
+        g_print ("%u: error %s %s: %s\n", job->line,
+                 batch_op_names[job->op], job->uid,
+                 job->error->message);
+      else
+        g_print ("%u: error: %s\n", job->line, job->error->message);
+
+      batch->next_report++;
+    }
+
+  if (batch->next_report == batch->jobs->len)
+    g_main_loop_quit (batch->loop);
+}
+
+static void batch_schedule (Batch *batch);
+
+static void
+batch_job_done (GObject      *source,
+                GAsyncResult *res,
+                gpointer      user_data)
+{
+  BatchJob *job = user_data;
+  Batch *batch = job->batch;
+  BoltClient *client = batch->client;
+
+  switch (job->op)
+    {
+    case BATCH_AUTHORIZE:
+      bolt_client_authorize_device_finish (client, res, &job->error);
+      break;
+
+    case BATCH_ENROLL:
+      bolt_client_enroll_device_finish (client, res, NULL, &job->error);
+      break;
+
+    case BATCH_FORGET:
+      bolt_client_forget_device_finish (client, res, &job->error);
+      break;
+    }
+
+  if (job->error != NULL)
+    batch->failed++;
+
+  job->done = TRUE;
+  batch->running--;
+  g_hash_table_remove (batch->busy, job->uid);
+
+  batch_schedule (batch);
+  batch_report (batch);
+}
+
+static void
+batch_job_start (BatchJob *job)
+{
+  Batch *batch = job->batch;
+  BoltClient *client = batch->client;
+
+  job->started = TRUE;
+  batch->running++;
+  g_hash_table_add (batch->busy, job->uid);
+
+  switch (job->op)
+    {
+    case BATCH_AUTHORIZE:
+      bolt_client_authorize_device_async (client, job->uid,
+                                          BOLT_AUTHCTRL_NONE,
+                                          NULL,
+                                          batch_job_done,
+                                          job);
+      break;
+
+    case BATCH_ENROLL:
+      bolt_client_enroll_device_async (client, job->uid,
+                                       job->policy,
+                                       BOLT_AUTHCTRL_NONE,
+                                       NULL,
+                                       batch_job_done,
+                                       job);
+      break;
+
+    case BATCH_FORGET:
+      bolt_client_forget_device_async (client, job->uid,
+                                       NULL,
+                                       batch_job_done,
+                                       job);
+      break;
+    }
+}
+
+static void
+batch_schedule (Batch *batch)
+{
+  g_autoptr(GHashTable) waiting = NULL;
+
+  /* operations on different devices are independent and run
+   * concurrently, the ones for the same device in input order */
+  waiting = g_hash_table_new (g_str_hash, g_str_equal);
+
+  for (guint i = batch->next_report; i < batch->jobs->len; i++)
+    {
+      BatchJob *job = g_ptr_array_index (batch->jobs, i);
+
+      if (batch->running >= batch->max_jobs)
+        break;
+
+      if (job->started || job->done)
+        continue;
+
+      if (g_hash_table_contains (batch->busy, job->uid) ||
+          g_hash_table_contains (waiting, job->uid))
+        {
+          g_hash_table_add (waiting, job->uid);
+          continue;
+        }
+
+      batch_job_start (job);
+    }
+}
+
+static gboolean
+batch_read_input (const char *filename,
+                  char      **contents,
+                  GError    **error)
+{
+  g_autoptr(GIOChannel) channel = NULL;
+  GIOStatus status;
+  gsize len;
+
+  if (filename != NULL && !bolt_streq (filename, "-"))
+    return g_file_get_contents (filename, contents, NULL, error);
+
+  channel = g_io_channel_unix_new (STDIN_FILENO);
+  status = g_io_channel_read_to_end (channel, contents, &len, error);
+
+  return status == G_IO_STATUS_NORMAL;
+}
+
+int
+batch (BoltClient *client, int argc, char **argv)
+{
+  g_autoptr(GOptionContext) optctx = NULL;
+  g_autoptr(GMainLoop) main_loop = NULL;
+  g_autoptr(GHashTable) busy = NULL;
+  g_autoptr(GPtrArray) jobs = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree char *contents = NULL;
+  g_autofree char *filename = NULL;
+  g_auto(GStrv) lines = NULL;
+  gint max_jobs = BATCH_DEFAULT_JOBS;
+  Batch batch = {NULL, };
+  GOptionEntry options[] = {
+    { "file", 'f', 0, G_OPTION_ARG_FILENAME, &filename, "Read commands from FILE instead of stdin", "FILE" },
+    { "jobs", 'j', 0, G_OPTION_ARG_INT, &max_jobs, "Number of operations to run concurrently", "N" },
+    { NULL }
+  };
+
+  optctx = g_option_context_new ("- Run commands read from stdin");
+  g_option_context_set_description (optctx,
+                                    "Commands, one per line:\n"
+                                    "  authorize DEVICE\n"
+                                    "  enroll DEVICE [POLICY]\n"
+                                    "  forget DEVICE\n");
+  g_option_context_add_main_entries (optctx, options, NULL);
+
+  if (!g_option_context_parse (optctx, &argc, &argv, &error))
+    return usage_error (error);
+
+  if (argc > 1)
+    return usage_error_too_many_args ();
+
+  if (max_jobs < 1)
+    {
+      g_set_error (&error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                   "invalid number of jobs: %d", max_jobs);
+      return usage_error (error);
+    }
+
+  if (!batch_read_input (filename, &contents, &error))
+    {
+      g_printerr ("Could not read commands: %s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  jobs = g_ptr_array_new_with_free_func (batch_job_free);
+  lines = g_strsplit (contents, "\n", -1);
+
+  for (guint i = 0; lines[i] != NULL; i++)
+    {
+      g_autoptr(GError) err = NULL;
+      const char *str = g_strstrip (lines[i]);
+      BatchJob *job;
+
+      if (*str == '\0' || *str == '#')
+        continue;
+
+      job = batch_job_parse (str, i + 1, &err);
+
+      /* parse errors are reported like failed operations */
+      if (job == NULL)
+        {
+          job = g_new0 (BatchJob, 1);
+          job->line = i + 1;
+          job->done = TRUE;
+          job->error = g_steal_pointer (&err);
+          batch.failed++;
+        }
+
+      job->batch = &batch;
+      g_ptr_array_add (jobs, job);
+    }
+
+  if (jobs->len == 0)
+    return EXIT_SUCCESS;
+
+  main_loop = g_main_loop_new (NULL, FALSE);
+  busy = g_hash_table_new (g_str_hash, g_str_equal);
+
+  batch.client = client;
+  batch.jobs = jobs;
+  batch.busy = busy;
+  batch.loop = main_loop;
+  batch.max_jobs = (guint) max_jobs;
+
+  batch_schedule (&batch);
+  batch_report (&batch);
+
+  if (batch.next_report < jobs->len)
+    g_main_loop_run (main_loop);
+
+  return batch.failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
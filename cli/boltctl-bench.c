@@ -0,0 +1,658 @@
+/*
+ * Copyright © 2018 Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *       Christian J. Kellner <christian@kellner.me>
+ */
+
+#include "config.h"
+
+#include "boltctl-cmds.h"
+
+#include "bolt-names.h"
+#include "bolt-str.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#define BENCH_RELEASE_TIMEOUT (5 * G_USEC_PER_SEC)
+#define BENCH_RELEASE_POLL    5 /* ms */
+
+typedef struct BenchResult
+{
+  char   *name;
+  GArray *samples;   /* gint64, in µs */
+  guint   errors;
+  gint64  start;
+  gint64  wall;      /* duration of the whole run, µs */
+} BenchResult;
+
+typedef struct Bench
+{
+  BoltClient *client;
+  BoltDevice *device;
+  guint       iterations;
+  GPtrArray  *results;
+} Bench;
+
+static BenchResult *
+bench_result_new (Bench *bench, const char *name)
+{
+  BenchResult *r = g_new0 (BenchResult, 1);
+
+  r->name = g_strdup (name);
+  r->samples = g_array_sized_new (FALSE, FALSE,
+                                  sizeof (gint64),
+                                  bench->iterations);
+  r->start = g_get_monotonic_time ();
+
+  g_ptr_array_add (bench->results, r);
+  return r;
+}
+
+static void
+bench_result_free (gpointer data)
+{
+  BenchResult *r = data;
+
+  g_free (r->name);
+  g_array_unref (r->samples);
+  g_free (r);
+}
+
+static void
+bench_result_add (BenchResult *r,
+                  gint64       start,
+                  GError     **error)
+{
+  gint64 now = g_get_monotonic_time ();
+
+  if (error != NULL && *error != NULL)
+    {
+      r->errors++;
+      g_clear_error (error);
+    }
+  else
+    {
+      gint64 delta = now - start;
+      g_array_append_val (r->samples, delta);
+    }
+
+  r->wall = now - r->start;
+}
+
+static int
+cmp_sample (gconstpointer ap, gconstpointer bp)
+{
+  const gint64 a = *(const gint64 *) ap;
+  const gint64 b = *(const gint64 *) bp;
+
+  return (a > b) - (a < b);
+}
+
+/* nearest-rank percentile, samples must be sorted */
+static gint64
+bench_percentile (GArray *samples, guint p)
+{
+  guint rank;
+
+  if (samples->len == 0)
+    return 0;
+
+  rank = (p * samples->len + 99) / 100;
+  rank = CLAMP (rank, 1, samples->len);
+
+  return g_array_index (samples, gint64, rank - 1);
+}
+
+static double
+bench_mean (GArray *samples)
+{
+  double sum = 0;
+
+  if (samples->len == 0)
+    return 0;
+
+  for (guint i = 0; i < samples->len; i++)
+    sum += g_array_index (samples, gint64, i);
+
+  return sum / samples->len;
+}
+
+static double
+bench_ops (BenchResult *r)
+{
+  if (r->wall <= 0)
+    return 0;
+
+  return (double) r->samples->len * G_USEC_PER_SEC / r->wall;
+}
+
+/* the individual benchmarks */
+static void
+bench_list_devices (Bench *bench)
+{
+  g_autoptr(GError) err = NULL;
+  BenchResult *r;
+
+  r = bench_result_new (bench, "list-devices");
+
+  for (guint i = 0; i < bench->iterations; i++)
+    {
+      g_autoptr(GVariant) val = NULL;
+      gint64 start = g_get_monotonic_time ();
+
+      val = g_dbus_proxy_call_sync (G_DBUS_PROXY (bench->client),
+                                    "ListDevices",
+                                    NULL,
+                                    G_DBUS_CALL_FLAGS_NONE,
+                                    -1,
+                                    NULL,
+                                    &err);
+
+      bench_result_add (r, start, &err);
+    }
+}
+
+static void
+bench_device_by_uid (Bench *bench)
+{
+  g_autoptr(GError) err = NULL;
+  BenchResult *r;
+  const char *uid;
+
+  uid = bolt_device_get_uid (bench->device);
+  r = bench_result_new (bench, "device-by-uid");
+
+  for (guint i = 0; i < bench->iterations; i++)
+    {
+      g_autoptr(GVariant) val = NULL;
+      gint64 start = g_get_monotonic_time ();
+
+      val = g_dbus_proxy_call_sync (G_DBUS_PROXY (bench->client),
+                                    "DeviceByUid",
+                                    g_variant_new ("(s)", uid),
+                                    G_DBUS_CALL_FLAGS_NONE,
+                                    -1,
+                                    NULL,
+                                    &err);
+
+      bench_result_add (r, start, &err);
+    }
+}
+
+static void
+bench_property_get (Bench *bench)
+{
+  g_autoptr(GError) err = NULL;
+  GDBusConnection *bus;
+  BenchResult *r;
+  const char *iface;
+  const char *path;
+  const char *prop;
+
+  if (bench->device != NULL)
+    {
+      path = bolt_proxy_get_object_path (BOLT_PROXY (bench->device));
+      iface = BOLT_DBUS_DEVICE_INTERFACE;
+      prop = "Status";
+    }
+  else
+    {
+      path = BOLT_DBUS_PATH;
+      iface = BOLT_DBUS_INTERFACE;
+      prop = "Version";
+    }
+
+  bus = g_dbus_proxy_get_connection (G_DBUS_PROXY (bench->client));
+  r = bench_result_new (bench, "property-get");
+
+  for (guint i = 0; i < bench->iterations; i++)
+    {
+      g_autoptr(GVariant) val = NULL;
+      gint64 start = g_get_monotonic_time ();
+
+      val = g_dbus_connection_call_sync (bus,
+                                         bolt_proxy_name_for_connection (bus),
+                                         path,
+                                         "org.freedesktop.DBus.Properties",
+                                         "Get",
+                                         g_variant_new ("(ss)", iface, prop),
+                                         G_VARIANT_TYPE ("(v)"),
+                                         G_DBUS_CALL_FLAGS_NONE,
+                                         -1,
+                                         NULL,
+                                         &err);
+
+      bench_result_add (r, start, &err);
+    }
+}
+
+static void
+bench_authorize (Bench *bench)
+{
+  g_autoptr(GError) err = NULL;
+  BenchResult *r;
+  BoltStatus status;
+  gint64 start;
+
+  /* authorization is a one way street, it can only be
+   * measured once per connection of the device */
+  status = bolt_device_get_status (bench->device);
+  if (bolt_status_is_authorized (status))
+    {
+      g_printerr ("authorize: device is already authorized, skipping\n");
+      return;
+    }
+
+  r = bench_result_new (bench, "authorize");
+
+  start = g_get_monotonic_time ();
+  bolt_device_authorize (bench->device, BOLT_AUTHCTRL_NONE, NULL, &err);
+
+  if (err != NULL)
+    g_printerr ("authorize: %s\n", err->message);
+
+  bench_result_add (r, start, &err);
+}
+
+static void
+bench_enroll (Bench *bench)
+{
+  g_autoptr(GError) err = NULL;
+  BenchResult *enroll;
+  BenchResult *forget;
+  const char *uid;
+
+  if (bolt_device_is_stored (bench->device))
+    {
+      g_printerr ("enroll: device is already stored, skipping\n");
+      return;
+    }
+
+  uid = bolt_device_get_uid (bench->device);
+
+  enroll = bench_result_new (bench, "enroll");
+  forget = bench_result_new (bench, "forget");
+
+  for (guint i = 0; i < bench->iterations; i++)
+    {
+      g_autoptr(BoltDevice) dev = NULL;
+      gint64 start = g_get_monotonic_time ();
+      gboolean ok;
+
+      dev = bolt_client_enroll_device (bench->client,
+                                       uid,
+                                       BOLT_POLICY_DEFAULT,
+                                       BOLT_AUTHCTRL_NONE,
+                                       &err);
+
+      if (dev == NULL)
+        {
+          g_printerr ("enroll: %s\n", err->message);
+          bench_result_add (enroll, start, &err);
+          break;
+        }
+
+      bench_result_add (enroll, start, &err);
+
+      start = g_get_monotonic_time ();
+      ok = bolt_client_forget_device (bench->client, uid, &err);
+
+      if (!ok)
+        {
+          g_printerr ("forget: %s\n", err->message);
+          bench_result_add (forget, start, &err);
+          break;
+        }
+
+      bench_result_add (forget, start, &err);
+    }
+}
+
+static gboolean
+power_count_guards (BoltPower *power,
+                    guint     *n,
+                    GError   **error)
+{
+  g_autoptr(GPtrArray) guards = NULL;
+
+  guards = bolt_power_list_guards (power, NULL, error);
+
+  if (guards == NULL)
+    return FALSE;
+
+  *n = guards->len;
+  return TRUE;
+}
+
+typedef struct
+{
+  BoltPower *power;
+  guint      before;
+  gint64     start;
+  GError    *error;
+  GMainLoop *loop;
+} PowerRelease;
+
+static gboolean
+power_release_check (gpointer user_data)
+{
+  PowerRelease *pr = user_data;
+  guint now = 0;
+
+  if (!power_count_guards (pr->power, &now, &pr->error))
+    {
+      g_main_loop_quit (pr->loop);
+      return G_SOURCE_REMOVE;
+    }
+
+  if (now <= pr->before)
+    {
+      g_main_loop_quit (pr->loop);
+      return G_SOURCE_REMOVE;
+    }
+
+  if (g_get_monotonic_time () - pr->start > BENCH_RELEASE_TIMEOUT)
+    {
+      g_set_error_literal (&pr->error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
+                           "timeout waiting for guard release");
+      g_main_loop_quit (pr->loop);
+      return G_SOURCE_REMOVE;
+    }
+
+  return G_SOURCE_CONTINUE;
+}
+
+/* The guard is released when the daemon notices that the fd got
+ * closed, which is not signalled; check the guards at a fixed
+ * interval from the main loop, so the daemon is not flooded with
+ * calls. The result is thus accurate to BENCH_RELEASE_POLL. */
+static gboolean
+power_wait_release (BoltPower *power,
+                    guint      before,
+                    gint64     start,
+                    GError   **error)
+{
+  g_autoptr(GMainLoop) loop = g_main_loop_new (NULL, FALSE);
+  PowerRelease pr = {power, before, start, NULL, loop};
+  guint id;
+
+  id = g_timeout_add (BENCH_RELEASE_POLL, power_release_check, &pr);
+  g_source_set_name_by_id (id, "[boltctl] power-release");
+
+  g_main_loop_run (loop);
+
+  if (pr.error != NULL)
+    {
+      g_propagate_error (error, pr.error);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static void
+bench_power (Bench *bench)
+{
+  g_autoptr(BoltPower) power = NULL;
+  g_autoptr(GError) err = NULL;
+  BenchResult *acquire;
+  BenchResult *release;
+
+  power = bolt_client_new_power_client (bench->client, NULL, &err);
+
+  if (power == NULL)
+    {
+      g_printerr ("power: %s\n", err->message);
+      return;
+    }
+
+  if (!bolt_power_is_supported (power))
+    {
+      g_printerr ("power: force power is not supported, skipping\n");
+      return;
+    }
+
+  acquire = bench_result_new (bench, "power-acquire");
+  release = bench_result_new (bench, "power-release");
+
+  for (guint i = 0; i < bench->iterations; i++)
+    {
+      gint64 start;
+      guint before = 0;
+      int fd;
+
+      if (!power_count_guards (power, &before, &err))
+        {
+          g_printerr ("power: %s\n", err->message);
+          break;
+        }
+
+      start = g_get_monotonic_time ();
+      fd = bolt_power_force_power (power, &err);
+
+      if (fd < 0)
+        {
+          g_printerr ("power: %s\n", err->message);
+          bench_result_add (acquire, start, &err);
+          break;
+        }
+
+      bench_result_add (acquire, start, &err);
+
+      start = g_get_monotonic_time ();
+      (void) close (fd);
+
+      if (!power_wait_release (power, before, start, &err))
+        g_printerr ("power: %s\n", err->message);
+
+      bench_result_add (release, start, &err);
+    }
+}
+
+/* output */
+static void
+bench_print_table (GPtrArray *results)
+{
+  g_print ("%-16s %6s %6s %9s %9s %9s %9s %9s %9s %10s\n",
+           "benchmark", "n", "errors",
+           "min", "mean", "p50", "p90", "p99", "max", "ops/s");
+
+  for (guint i = 0; i < results->len; i++)
+    {
+      BenchResult *r = g_ptr_array_index (results, i);
+      GArray *s = r->samples;
+
+      g_print ("%-16s %6u %6u %9" G_GINT64_FORMAT " %9.0f"
+               " %9" G_GINT64_FORMAT " %9" G_GINT64_FORMAT
+               " %9" G_GINT64_FORMAT " %9" G_GINT64_FORMAT
+               " %10.1f\n",
+               r->name, s->len, r->errors,
+               bench_percentile (s, 0),
+               bench_mean (s),
+               bench_percentile (s, 50),
+               bench_percentile (s, 90),
+               bench_percentile (s, 99),
+               bench_percentile (s, 100),
+               bench_ops (r));
+    }
+
+  g_print ("\nlatencies in µs\n");
+}
+
+static void
+json_append_double (GString *out, double val)
+{
+  char buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+  g_string_append (out, g_ascii_formatd (buf, sizeof (buf), "%.3f", val));
+}
+
+static char *
+bench_to_json (Bench *bench)
+{
+  GPtrArray *results = bench->results;
+  GString *out;
+
+  out = g_string_new ("{\n");
+
+  g_string_append_printf (out, "  \"version\": \"%s\",\n", PACKAGE_VERSION);
+  g_string_append_printf (out, "  \"iterations\": %u,\n", bench->iterations);
+  g_string_append (out, "  \"unit\": \"us\",\n");
+
+  if (bench->device != NULL)
+    g_string_append_printf (out, "  \"device\": \"%s\",\n",
+                            bolt_device_get_uid (bench->device));
+
+  g_string_append (out, "  \"benchmarks\": [");
+
+  for (guint i = 0; i < results->len; i++)
+    {
+      BenchResult *r = g_ptr_array_index (results, i);
+      GArray *s = r->samples;
+
+      g_string_append_printf (out, "%s\n    {\n", i > 0 ? "," : "");
+      g_string_append_printf (out, "      \"name\": \"%s\",\n", r->name);
+      g_string_append_printf (out, "      \"samples\": %u,\n", s->len);
+      g_string_append_printf (out, "      \"errors\": %u,\n", r->errors);
+      g_string_append_printf (out, "      \"min\": %" G_GINT64_FORMAT ",\n",
+                              bench_percentile (s, 0));
+      g_string_append (out, "      \"mean\": ");
+      json_append_double (out, bench_mean (s));
+      g_string_append_printf (out, ",\n      \"p50\": %" G_GINT64_FORMAT ",\n",
+                              bench_percentile (s, 50));
+      g_string_append_printf (out, "      \"p90\": %" G_GINT64_FORMAT ",\n",
+                              bench_percentile (s, 90));
+      g_string_append_printf (out, "      \"p99\": %" G_GINT64_FORMAT ",\n",
+                              bench_percentile (s, 99));
+      g_string_append_printf (out, "      \"max\": %" G_GINT64_FORMAT ",\n",
+                              bench_percentile (s, 100));
+      g_string_append (out, "      \"ops\": ");
+      json_append_double (out, bench_ops (r));
+      g_string_append (out, "\n    }");
+    }
+
+  g_string_append (out, "\n  ]\n}\n");
+
+  return g_string_free (out, FALSE);
+}
+
+int
+bench (BoltClient *client, int argc, char **argv)
+{
+  g_autoptr(GOptionContext) optctx = NULL;
+  g_autoptr(BoltDevice) dev = NULL;
+  g_autoptr(GPtrArray) results = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree char *json = NULL;
+  g_autofree char *outfile = NULL;
+  gboolean do_authorize = FALSE;
+  gboolean do_enroll = FALSE;
+  gboolean do_power = FALSE;
+  gint iterations = 100;
+  Bench bench;
+  GOptionEntry options[] = {
+    { "iterations", 'n', 0, G_OPTION_ARG_INT, &iterations, "Number of iterations per benchmark", "N" },
+    { "authorize", 0, 0, G_OPTION_ARG_NONE, &do_authorize, "Measure authorization of DEVICE", NULL },
+    { "enroll", 0, 0, G_OPTION_ARG_NONE, &do_enroll, "Measure enrolling and forgetting DEVICE", NULL },
+    { "power", 0, 0, G_OPTION_ARG_NONE, &do_power, "Measure acquiring and releasing force power", NULL },
+    { "json", 'j', 0, G_OPTION_ARG_FILENAME, &outfile, "Write results as JSON to FILE ('-' for stdout)", "FILE" },
+    { NULL }
+  };
+
+  optctx = g_option_context_new ("[DEVICE] - Measure daemon latency");
+  g_option_context_add_main_entries (optctx, options, NULL);
+
+  if (!g_option_context_parse (optctx, &argc, &argv, &error))
+    return usage_error (error);
+
+  if (argc > 2)
+    return usage_error_too_many_args ();
+
+  if (iterations < 1)
+    {
+      g_set_error (&error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                   "invalid number of iterations: %d", iterations);
+      return usage_error (error);
+    }
+
+  if ((do_authorize || do_enroll) && argc < 2)
+    return usage_error_need_arg ("DEVICE");
+
+  if (argc > 1)
+    {
+      dev = bolt_client_get_device (client, argv[1], NULL, &error);
+      if (dev == NULL)
+        {
+          g_printerr ("%s\n", error->message);
+          return EXIT_FAILURE;
+        }
+    }
+
+  results = g_ptr_array_new_with_free_func (bench_result_free);
+
+  bench.client = client;
+  bench.device = dev;
+  bench.iterations = (guint) iterations;
+  bench.results = results;
+
+  bench_list_devices (&bench);
+
+  if (dev != NULL)
+    bench_device_by_uid (&bench);
+
+  bench_property_get (&bench);
+
+  if (do_authorize)
+    bench_authorize (&bench);
+
+  if (do_enroll)
+    bench_enroll (&bench);
+
+  if (do_power)
+    bench_power (&bench);
+
+  for (guint i = 0; i < results->len; i++)
+    {
+      BenchResult *r = g_ptr_array_index (results, i);
+      g_array_sort (r->samples, cmp_sample);
+    }
+
+  if (outfile == NULL)
+    {
+      bench_print_table (results);
+      return EXIT_SUCCESS;
+    }
+
+  json = bench_to_json (&bench);
+
+  if (bolt_streq (outfile, "-"))
+    {
+      g_print ("%s", json);
+    }
+  else if (!g_file_set_contents (outfile, json, -1, &error))
+    {
+      g_printerr ("Could not write results: %s\n", error->message);
+      return EXIT_FAILURE;
+    }
+  else
+    {
+      bench_print_table (results);
+    }
+
+  return EXIT_SUCCESS;
+}
@@ -31,6 +31,12 @@ typedef int (*BoltctlCommand) (BoltClient *client,
 int authorize (BoltClient *client,
                int         argc,
                char      **argv);
+int batch (BoltClient *client,
+           int         argc,
+           char      **argv);
+int bench (BoltClient *client,
+           int         argc,
+           char      **argv);
 int enroll (BoltClient *client,
             int         argc,
             char      **argv);
@@ -52,5 +58,8 @@ int monitor (BoltClient *client,
 int power (BoltClient *client,
            int         argc,
            char      **argv);
+int recorder (BoltClient *client,
+              int         argc,
+              char      **argv);
 
 G_END_DECLS
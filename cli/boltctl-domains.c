@@ -58,6 +58,7 @@ list_domains (BoltClient *client, int argc, char **argv)
   g_autoptr(GOptionContext) optctx = NULL;
   g_autoptr(GError) err = NULL;
   g_autoptr(GPtrArray) domains = NULL;
+  g_autoptr(GAsyncResult) res = NULL;
   gboolean details = FALSE;
   GOptionEntry options[] = {
     { "verbose", 'v', 0, G_OPTION_ARG_NONE, &details, "Show more details", NULL },
@@ -70,7 +71,10 @@ list_domains (BoltClient *client, int argc, char **argv)
   if (!g_option_context_parse (optctx, &argc, &argv, &err))
     return usage_error (err);
 
-  domains = bolt_client_list_domains (client, NULL, &err);
+  bolt_client_list_domains_async (client, NULL, capture_result, &res);
+  wait_for_result (&res);
+
+  domains = bolt_client_list_domains_finish (client, res, &err);
 
   if (domains == NULL)
     {
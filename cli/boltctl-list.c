@@ -30,6 +30,7 @@ list_devices (BoltClient *client, int argc, char **argv)
   g_autoptr(GOptionContext) optctx = NULL;
   g_autoptr(GError) error = NULL;
   g_autoptr(GPtrArray) devices = NULL;
+  g_autoptr(GAsyncResult) res = NULL;
   gboolean show_all = FALSE;
   GOptionEntry options[] = {
     { "all", 'a', 0, G_OPTION_ARG_NONE, &show_all, "Show all devices", NULL },
@@ -42,7 +43,10 @@ list_devices (BoltClient *client, int argc, char **argv)
   if (!g_option_context_parse (optctx, &argc, &argv, &error))
     return usage_error (error);
 
-  devices = bolt_client_list_devices (client, NULL, &error);
+  bolt_client_list_devices_async (client, NULL, capture_result, &res);
+  wait_for_result (&res);
+
+  devices = bolt_client_list_devices_finish (client, res, &error);
   if (devices == NULL)
     {
       g_printerr ("Failed to list devices: %s",
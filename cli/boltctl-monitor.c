@@ -22,8 +22,88 @@
 
 #include "boltctl-cmds.h"
 
+#include "bolt-json.h"
 #include "bolt-str.h"
 
+#include <stdio.h>
+
+/* --json: one event per line (NDJSON) */
+static gboolean monitor_json = FALSE;
+
+static GString *
+json_event_new (const char *event,
+                const char *opath)
+{
+  GString *line;
+
+  line = g_string_new (NULL);
+  g_string_append_printf (line, "{\"ts\": %" G_GINT64_FORMAT ", \"event\": ",
+                          g_get_monotonic_time ());
+  bolt_json_append_string (line, event);
+  g_string_append (line, ", \"path\": ");
+  bolt_json_append_string (line, opath);
+
+  return line;
+}
+
+static void
+json_event_emit (GString *line)
+{
+  g_string_append (line, "}\n");
+
+  /* stdout is line buffered, see monitor () */
+  fputs (line->str, stdout);
+  g_string_free (line, TRUE);
+}
+
+static void
+handle_properties_changed_json (GDBusProxy *proxy,
+                                GVariant   *changed,
+                                GStrv       invalidated,
+                                gpointer    user_data)
+{
+  GString *line;
+  const char *opath;
+  const char *iface;
+
+  opath = g_dbus_proxy_get_object_path (proxy);
+  iface = g_dbus_proxy_get_interface_name (proxy);
+
+  line = json_event_new ("properties-changed", opath);
+
+  g_string_append (line, ", \"interface\": ");
+  bolt_json_append_string (line, iface);
+
+  g_string_append (line, ", \"changed\": ");
+  bolt_json_append_variant (line, changed);
+
+  if (invalidated != NULL && *invalidated != NULL)
+    {
+      g_string_append (line, ", \"invalidated\": [");
+      for (guint i = 0; invalidated[i] != NULL; i++)
+        {
+          if (i > 0)
+            g_string_append (line, ", ");
+          bolt_json_append_string (line, invalidated[i]);
+        }
+      g_string_append_c (line, ']');
+    }
+
+  json_event_emit (line);
+}
+
+static void
+monitor_proxy (gpointer proxy,
+               GCallback notify)
+{
+  if (monitor_json)
+    g_signal_connect (proxy, "g-properties-changed",
+                      G_CALLBACK (handle_properties_changed_json),
+                      NULL);
+  else if (notify != NULL)
+    g_signal_connect (proxy, "notify", notify, NULL);
+}
+
 static void
 handle_domain_added (BoltClient *cli,
                      const char *opath,
@@ -43,9 +123,12 @@ handle_domain_added (BoltClient *cli,
       return;
     }
 
+  if (monitor_json)
+    json_event_emit (json_event_new ("domain-added", opath));
+  else
+    g_print (" DomainAdded: %s\n", opath);
 
-  g_print (" DomainAdded: %s\n", opath);
-
+  monitor_proxy (dom, NULL);
   g_ptr_array_add (domains, dom);
 }
 
@@ -75,7 +158,10 @@ handle_domain_removed (BoltClient *cli,
       return;
     }
 
-  g_print (" DomainRemoved: %s\n", opath);
+  if (monitor_json)
+    json_event_emit (json_event_new ("domain-removed", opath));
+  else
+    g_print (" DomainRemoved: %s\n", opath);
 
   g_ptr_array_remove_fast (domains, domain);
 }
@@ -116,31 +202,91 @@ handle_device_changed (GObject    *gobject,
   g_value_unset (&prop_val);
 }
 
+/* proxies for added devices are created asynchronously, so that
+ * a slow daemon does not stall the output of other events; the
+ * ones that are still being set up are tracked by object path */
+static GHashTable *pending_devices = NULL;
+
+typedef struct
+{
+  GPtrArray    *devices;
+  char         *opath;
+  GCancellable *cancel;
+} DeviceAdd;
+
 static void
-handle_device_added (BoltClient *cli,
-                     const char *opath,
-                     gpointer    user_data)
+device_add_free (DeviceAdd *da)
+{
+  g_ptr_array_unref (da->devices);
+  g_free (da->opath);
+  g_object_unref (da->cancel);
+  g_slice_free (DeviceAdd, da);
+}
+
+static void
+handle_device_ready (GObject      *source,
+                     GAsyncResult *res,
+                     gpointer      user_data)
 {
   g_autoptr(GError) err = NULL;
-  GDBusConnection *bus;
+  DeviceAdd *da = user_data;
   BoltDevice *dev;
-  GPtrArray *devices = user_data;
 
-  g_print (" DeviceAdded: %s\n", opath);
+  dev = bolt_device_new_for_object_path_finish (res, &err);
 
-  bus = g_dbus_proxy_get_connection (G_DBUS_PROXY (cli));
-  dev = bolt_device_new_for_object_path (bus, opath, NULL, &err);
+  /* removed again in the meantime */
+  if (g_cancellable_is_cancelled (da->cancel))
+    {
+      g_clear_object (&dev);
+      device_add_free (da);
+      return;
+    }
 
-  if (err != NULL)
+  g_hash_table_remove (pending_devices, da->opath);
+
+  if (dev == NULL)
     {
-      g_warning ("Could not create proxy object for %s", opath);
+      g_warning ("Could not create proxy object for %s", da->opath);
+      device_add_free (da);
       return;
     }
 
-  g_ptr_array_add (devices, dev);
-  g_signal_connect (dev, "notify",
-                    G_CALLBACK (handle_device_changed),
-                    NULL);
+  g_ptr_array_add (da->devices, dev);
+  monitor_proxy (dev, G_CALLBACK (handle_device_changed));
+
+  device_add_free (da);
+}
+
+static void
+handle_device_added (BoltClient *cli,
+                     const char *opath,
+                     gpointer    user_data)
+{
+  GDBusConnection *bus;
+  GPtrArray *devices = user_data;
+  DeviceAdd *da;
+
+  if (monitor_json)
+    json_event_emit (json_event_new ("device-added", opath));
+  else
+    g_print (" DeviceAdded: %s\n", opath);
+
+  if (pending_devices == NULL)
+    pending_devices = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                             g_free, g_object_unref);
+
+  da = g_slice_new (DeviceAdd);
+  da->devices = g_ptr_array_ref (devices);
+  da->opath = g_strdup (opath);
+  da->cancel = g_cancellable_new ();
+
+  g_hash_table_insert (pending_devices,
+                       g_strdup (opath),
+                       g_object_ref (da->cancel));
+
+  bus = g_dbus_proxy_get_connection (G_DBUS_PROXY (cli));
+  bolt_device_new_for_object_path_async (bus, opath, da->cancel,
+                                         handle_device_ready, da);
 }
 
 static void
@@ -151,7 +297,10 @@ handle_device_removed (BoltClient *cli,
   GPtrArray *devices = user_data;
   BoltDevice *device = NULL;
 
-  g_print (" DeviceRemoved: %s\n", opath);
+  if (monitor_json)
+    json_event_emit (json_event_new ("device-removed", opath));
+  else
+    g_print (" DeviceRemoved: %s\n", opath);
 
   for (guint i = 0; i < devices->len; i++)
     {
@@ -165,6 +314,18 @@ handle_device_removed (BoltClient *cli,
         }
     }
 
+  if (device == NULL && pending_devices != NULL)
+    {
+      GCancellable *cancel = g_hash_table_lookup (pending_devices, opath);
+
+      if (cancel != NULL)
+        {
+          g_cancellable_cancel (cancel);
+          g_hash_table_remove (pending_devices, opath);
+          return;
+        }
+    }
+
   if (device == NULL)
     {
       g_warning ("DeviceRemoved signal for unknown device: %s", opath);
@@ -175,6 +336,86 @@ handle_device_removed (BoltClient *cli,
   g_ptr_array_remove_fast (devices, device);
 }
 
+/* filtered mode: maps the object path of each device that
+ * is watched to its uid; empty if all devices are watched */
+static const char *
+filter_lookup (GHashTable *filter,
+               const char *opath)
+{
+  if (g_hash_table_size (filter) == 0)
+    return opath;
+
+  return g_hash_table_lookup (filter, opath);
+}
+
+static void
+handle_filtered_changed (BoltClient *client,
+                         const char *opath,
+                         GVariant   *changed,
+                         gpointer    user_data)
+{
+  GHashTable *filter = user_data;
+  const char *label;
+  GVariantIter iter;
+  const char *key;
+  GVariant *val;
+
+  if (monitor_json)
+    {
+      GString *line = json_event_new ("properties-changed", opath);
+
+      g_string_append (line, ", \"interface\": ");
+      bolt_json_append_string (line, BOLT_DBUS_DEVICE_INTERFACE);
+      g_string_append (line, ", \"changed\": ");
+      bolt_json_append_variant (line, changed);
+      json_event_emit (line);
+      return;
+    }
+
+  label = filter_lookup (filter, opath) ? : opath;
+
+  g_variant_iter_init (&iter, changed);
+  while (g_variant_iter_loop (&iter, "{&sv}", &key, &val))
+    {
+      g_autofree char *str = NULL;
+
+      if (g_variant_is_of_type (val, G_VARIANT_TYPE_STRING))
+        str = g_variant_dup_string (val, NULL);
+      else
+        str = g_variant_print (val, FALSE);
+
+      g_print ("[%s] %10s -> %s\n", label, key, str);
+    }
+}
+
+static void
+handle_filtered_device_added (BoltClient *cli,
+                              const char *opath,
+                              gpointer    user_data)
+{
+  if (filter_lookup (user_data, opath) == NULL)
+    return;
+
+  if (monitor_json)
+    json_event_emit (json_event_new ("device-added", opath));
+  else
+    g_print (" DeviceAdded: %s\n", opath);
+}
+
+static void
+handle_filtered_device_removed (BoltClient *cli,
+                                const char *opath,
+                                gpointer    user_data)
+{
+  if (filter_lookup (user_data, opath) == NULL)
+    return;
+
+  if (monitor_json)
+    json_event_emit (json_event_new ("device-removed", opath));
+  else
+    g_print (" DeviceRemoved: %s\n", opath);
+}
+
 static void
 handle_probing_changed (BoltClient *client,
                         GParamSpec *pspec,
@@ -196,34 +437,71 @@ monitor (BoltClient *client, int argc, char **argv)
   g_autoptr(GMainLoop) main_loop = NULL;
   g_autoptr(GPtrArray) devices = NULL;
   g_autoptr(GPtrArray) domains = NULL;
+  g_autoptr(GAsyncResult) dom_res = NULL;
+  g_autoptr(GAsyncResult) dev_res = NULL;
+  g_autoptr(GHashTable) filter = NULL;
   g_autofree char *amstr = NULL;
+  g_auto(GStrv) uids = NULL;
+  g_auto(GStrv) properties = NULL;
   BoltSecurity security;
   BoltAuthMode authmode;
+  gboolean filtered;
   guint version = 0;
+  guint sub_id = 0;
+  GOptionEntry options[] = {
+    { "json", 'j', 0, G_OPTION_ARG_NONE, &monitor_json, "Print one JSON object per event", NULL },
+    { "device", 'd', 0, G_OPTION_ARG_STRING_ARRAY, &uids, "Only watch the device with the given UID", "UID" },
+    { "property", 'p', 0, G_OPTION_ARG_STRING_ARRAY, &properties, "Only show changes of the given PROPERTY", "PROPERTY" },
+    { NULL }
+  };
 
   optctx = g_option_context_new ("- Watch for changes");
+  g_option_context_add_main_entries (optctx, options, NULL);
 
   if (!g_option_context_parse (optctx, &argc, &argv, &error))
     return usage_error (error);
 
+  filtered = uids != NULL || properties != NULL;
+
+  /* domains and devices are fetched concurrently; in filtered
+   * mode no device proxies are needed */
+  bolt_client_list_domains_async (client, NULL, capture_result, &dom_res);
+
+  if (!filtered)
+    bolt_client_list_devices_async (client, NULL, capture_result, &dev_res);
+
+  if (monitor_json)
+    setvbuf (stdout, NULL, _IOLBF, 0);
+
   version = bolt_client_get_version (client);
   security = bolt_client_get_security (client);
   authmode = bolt_client_get_authmode (client);
   amstr = bolt_flags_to_string (BOLT_TYPE_AUTH_MODE, authmode, NULL);
 
-  if (!bolt_proxy_has_name_owner (BOLT_PROXY (client)))
-    g_print ("%s no name owner for bolt (not running?)\n",
-             bolt_glyph (WARNING_SIGN));
+  if (monitor_json)
+    {
+      GString *line = json_event_new ("ready", BOLT_DBUS_PATH);
 
-  g_print ("Bolt Version  : %d.%d\n", VERSION_MAJOR, VERSION_MINOR);
-  g_print ("Daemon API    : %u\n", version);
-  g_print ("Client API    : %u\n", BOLT_DBUS_API_VERSION);
-  g_print ("Security Level: %s\n", bolt_security_to_string (security));
-  g_print ("Auth Mode     : %s\n", amstr);
-  g_print ("Ready\n");
+      g_string_append_printf (line, ", \"api\": %u", version);
+      json_event_emit (line);
+    }
+  else
+    {
+      if (!bolt_proxy_has_name_owner (BOLT_PROXY (client)))
+        g_print ("%s no name owner for bolt (not running?)\n",
+                 bolt_glyph (WARNING_SIGN));
+
+      g_print ("Bolt Version  : %d.%d\n", VERSION_MAJOR, VERSION_MINOR);
+      g_print ("Daemon API    : %u\n", version);
+      g_print ("Client API    : %u\n", BOLT_DBUS_API_VERSION);
+      g_print ("Security Level: %s\n", bolt_security_to_string (security));
+      g_print ("Auth Mode     : %s\n", amstr);
+      g_print ("Ready\n");
+    }
 
   /* domains */
-  domains = bolt_client_list_domains (client, NULL, &error);
+  wait_for_result (&dom_res);
+  domains = bolt_client_list_domains_finish (client, dom_res, &error);
 
   if (domains == NULL)
     {
@@ -232,6 +510,9 @@ monitor (BoltClient *client, int argc, char **argv)
       g_clear_error (&error);
     }
 
+  for (guint i = 0; i < domains->len; i++)
+    monitor_proxy (g_ptr_array_index (domains, i), NULL);
+
   g_signal_connect (client, "domain-added",
                     G_CALLBACK (handle_domain_added), domains);
 
@@ -240,32 +521,60 @@ monitor (BoltClient *client, int argc, char **argv)
 
 
   /* devices */
-  devices = bolt_client_list_devices (client, NULL, &error);
-
-  if (devices == NULL)
+  if (filtered)
     {
-      g_warning ("Could not list devices: %s", error->message);
-      devices = g_ptr_array_new_with_free_func (g_object_unref);
-      g_clear_error (&error);
+      filter = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                      g_free, g_free);
+
+      for (guint i = 0; uids != NULL && uids[i] != NULL; i++)
+        g_hash_table_insert (filter,
+                             bolt_device_path_for_uid (uids[i]),
+                             g_strdup (uids[i]));
+
+      sub_id = bolt_client_subscribe_devices (client,
+                                              (const char * const *) uids,
+                                              (const char * const *) properties,
+                                              handle_filtered_changed,
+                                              filter,
+                                              NULL);
+
+      g_signal_connect (client, "device-added",
+                        G_CALLBACK (handle_filtered_device_added), filter);
+
+      g_signal_connect (client, "device-removed",
+                        G_CALLBACK (handle_filtered_device_removed), filter);
     }
-
-  bolt_devices_sort_by_syspath (devices, FALSE);
-  for (guint i = 0; i < devices->len; i++)
+  else
     {
-      BoltDevice *dev = g_ptr_array_index (devices, i);
-      g_signal_connect (dev, "notify",
-                        G_CALLBACK (handle_device_changed),
-                        NULL);
-    }
+      wait_for_result (&dev_res);
+      devices = bolt_client_list_devices_finish (client, dev_res, &error);
+
+      if (devices == NULL)
+        {
+          g_warning ("Could not list devices: %s", error->message);
+          devices = g_ptr_array_new_with_free_func (g_object_unref);
+          g_clear_error (&error);
+        }
+
+      bolt_devices_sort_by_syspath (devices, FALSE);
+      for (guint i = 0; i < devices->len; i++)
+        {
+          BoltDevice *dev = g_ptr_array_index (devices, i);
+          monitor_proxy (dev, G_CALLBACK (handle_device_changed));
+        }
 
-  g_signal_connect (client, "device-added",
-                    G_CALLBACK (handle_device_added), devices);
+      g_signal_connect (client, "device-added",
+                        G_CALLBACK (handle_device_added), devices);
 
-  g_signal_connect (client, "device-removed",
-                    G_CALLBACK (handle_device_removed), devices);
+      g_signal_connect (client, "device-removed",
+                        G_CALLBACK (handle_device_removed), devices);
+    }
 
-  g_signal_connect (client, "notify::probing",
-                    G_CALLBACK (handle_probing_changed), NULL);
+  if (monitor_json)
+    monitor_proxy (client, NULL);
+  else
+    g_signal_connect (client, "notify::probing",
+                      G_CALLBACK (handle_probing_changed), NULL);
 
   main_loop = g_main_loop_new (NULL, FALSE);
   g_main_loop_run (main_loop);
@@ -274,5 +583,8 @@ monitor (BoltClient *client, int argc, char **argv)
                                         G_CALLBACK (handle_probing_changed),
                                         NULL);
 
+  if (sub_id > 0)
+    bolt_client_unsubscribe (client, sub_id);
+
   return EXIT_SUCCESS;
 }
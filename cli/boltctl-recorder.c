@@ -0,0 +1,148 @@
+/*
+ * Copyright © 2018 Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *       Christian J. Kellner <christian@kellner.me>
+ */
+
+#include "config.h"
+
+#include "boltctl-cmds.h"
+
+#include "bolt-str.h"
+
+static const char *
+level_to_string (guint level)
+{
+  if (level & G_LOG_LEVEL_ERROR)
+    return "error";
+  else if (level & G_LOG_LEVEL_CRITICAL)
+    return "critical";
+  else if (level & G_LOG_LEVEL_WARNING)
+    return "warning";
+  else if (level & G_LOG_LEVEL_MESSAGE)
+    return "message";
+  else if (level & G_LOG_LEVEL_INFO)
+    return "info";
+  else if (level & G_LOG_LEVEL_DEBUG)
+    return "debug";
+
+  return "user";
+}
+
+static GVariant *
+load_recorder_file (const char *path,
+                    GError    **error)
+{
+  g_autoptr(GVariant) data = NULL;
+  g_autoptr(GBytes) bytes = NULL;
+  char *contents;
+  gsize len;
+
+  if (!g_file_get_contents (path, &contents, &len, error))
+    return NULL;
+
+  bytes = g_bytes_new_take (contents, len);
+  data = g_variant_new_from_bytes (G_VARIANT_TYPE ("a(xusssss)"),
+                                   bytes, FALSE);
+
+  /* the file is untrusted, make sure it is valid */
+  return g_variant_get_normal_form (data);
+}
+
+static void
+print_event (gint64      time,
+             guint       level,
+             const char *topic,
+             const char *msgid,
+             const char *uid,
+             const char *location,
+             const char *message)
+{
+  g_autoptr(GDateTime) dt = NULL;
+  g_autofree char *ts = NULL;
+  const char *tree_branch = bolt_glyph (TREE_BRANCH);
+  const char *tree_right = bolt_glyph (TREE_RIGHT);
+
+  dt = g_date_time_new_from_unix_local (time / G_USEC_PER_SEC);
+  ts = g_date_time_format (dt, "%T");
+
+  g_print ("%s.%06d %-8s ", ts, (int) (time % G_USEC_PER_SEC),
+           level_to_string (level));
+
+  if (*uid)
+    g_print ("[%.13s] ", uid);
+
+  if (*topic)
+    g_print ("%s: ", topic);
+
+  if (*message)
+    g_print ("%s\n", message);
+  else
+    g_print ("<not logged>\n");
+
+  if (*msgid)
+    g_print ("   %s id: %s\n", *location ? tree_branch : tree_right, msgid);
+
+  if (*location)
+    g_print ("   %s at: %s\n", tree_right, location);
+}
+
+int
+recorder (BoltClient *client, int argc, char **argv)
+{
+  g_autoptr(GOptionContext) optctx = NULL;
+  g_autoptr(GVariant) events = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree char *file = NULL;
+  GVariantIter iter;
+  const char *topic, *msgid, *uid, *location, *message;
+  guint level;
+  gint64 time;
+  GOptionEntry options[] = {
+    { "file", 'f', 0, G_OPTION_ARG_FILENAME, &file, "Read the events from a dump", "FILE" },
+    { NULL }
+  };
+
+  optctx = g_option_context_new ("- Show the recent events of the daemon");
+  g_option_context_add_main_entries (optctx, options, NULL);
+
+  if (!g_option_context_parse (optctx, &argc, &argv, &error))
+    return usage_error (error);
+
+  if (argc > 1)
+    return usage_error_too_many_args ();
+
+  if (file != NULL)
+    events = load_recorder_file (file, &error);
+  else
+    events = bolt_client_dump_flight_recorder (client, &error);
+
+  if (events == NULL)
+    {
+      g_printerr ("Failed to get the recorded events: %s\n",
+                  error->message);
+      return EXIT_FAILURE;
+    }
+
+  g_variant_iter_init (&iter, events);
+  while (g_variant_iter_next (&iter, "(xu&s&s&s&s&s)",
+                              &time, &level, &topic, &msgid,
+                              &uid, &location, &message))
+    print_event (time, level, topic, msgid, uid, location, message);
+
+  return EXIT_SUCCESS;
+}
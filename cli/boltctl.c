@@ -68,6 +68,24 @@ usage_error_too_many_args (void)
   return usage_error (error);
 }
 
+/* async helpers */
+void
+capture_result (GObject      *source,
+                GAsyncResult *res,
+                gpointer      user_data)
+{
+  GAsyncResult **out = user_data;
+
+  *out = g_object_ref (res);
+}
+
+void
+wait_for_result (GAsyncResult **res)
+{
+  while (*res == NULL)
+    g_main_context_iteration (NULL, TRUE);
+}
+
 
 /* device related commands */
 static gboolean
@@ -279,13 +297,16 @@ typedef struct SubCommand
 
 static SubCommand subcommands[] = {
   {"authorize",    authorize,     "Authorize a device"},
+  {"batch",        batch,         "Run commands read from stdin or a file"},
+  {"bench",        bench,         "Measure the latency of the daemon"},
   {"domains",      list_domains,  "List the active thunderbolt domains"},
   {"enroll",       enroll,        "Authorize and store a device in the database"},
   {"forget",       forget,        "Remove a stored device from the database"},
   {"info",         info,          "Show information about a device"},
   {"list",         list_devices,  "List connected and stored devices"},
   {"monitor",      monitor,       "Listen and print changes"},
-  {"power",        power,         "Force power configuration of the controller"}
+  {"power",        power,         "Force power configuration of the controller"},
+  {"recorder",     recorder,      "Show the recent events of the daemon"}
 };
 
 #define SUMMARY_SPACING 17
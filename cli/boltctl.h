@@ -31,4 +31,9 @@ int      usage_error_too_many_args (void);
 
 void     print_device (BoltDevice *dev,
                        gboolean    verbose);
+
+void     capture_result (GObject      *source,
+                         GAsyncResult *res,
+                         gpointer      user_data);
+void     wait_for_result (GAsyncResult **res);
 G_END_DECLS
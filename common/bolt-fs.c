@@ -23,6 +23,7 @@
 #include "bolt-error.h"
 #include "bolt-io.h"
 #include "bolt-fs.h"
+#include "bolt-names.h"
 
 #include <dirent.h>
 #include <errno.h>
@@ -150,3 +151,14 @@ bolt_fs_touch (GFile   *target,
 
   return r != -1 && ok;
 }
+
+const char *
+bolt_get_rundir (void)
+{
+  const char *rundir = g_getenv ("BOLT_RUNDIR");
+
+  if (rundir == NULL || *rundir == '\0')
+    rundir = BOLT_DEFAULT_RUNDIR;
+
+  return rundir;
+}
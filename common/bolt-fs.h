@@ -37,4 +37,6 @@ gboolean     bolt_fs_touch (GFile   *target,
                             guint64  mtime,
                             GError **error);
 
+const char * bolt_get_rundir (void);
+
 G_END_DECLS
@@ -397,6 +397,59 @@ bolt_read_value_at (int         dirfd,
   return g_strdup (line);
 }
 
+/* Read a set of small (sysfs) attributes relative to dirfd with
+ * one pread(2) each, directly into the fixed buffers of attrs, i.e.
+ * without stdio or heap allocations. Values that are too long get
+ * truncated; failures are indicated by attr->len being -errno. */
+guint
+bolt_read_attrs_at (int       dirfd,
+                    BoltAttr *attrs,
+                    guint     n_attrs)
+{
+  guint count = 0;
+
+  g_return_val_if_fail (attrs != NULL || n_attrs == 0, 0);
+
+  for (guint i = 0; i < n_attrs; i++)
+    {
+      BoltAttr *attr = &attrs[i];
+      ssize_t n;
+      int fd;
+
+      attr->value[0] = '\0';
+
+      fd = openat (dirfd, attr->name, O_NOFOLLOW | O_CLOEXEC | O_RDONLY);
+
+      if (fd < 0)
+        {
+          attr->len = -errno;
+          continue;
+        }
+
+      do
+        n = pread (fd, attr->value, sizeof (attr->value) - 1, 0);
+      while (n < 0 && errno == EINTR);
+
+      if (n < 0)
+        {
+          attr->len = -errno;
+          (void) close (fd);
+          continue;
+        }
+
+      (void) close (fd);
+
+      while (n > 0 && g_ascii_isspace (attr->value[n - 1]))
+        n--;
+
+      attr->value[n] = '\0';
+      attr->len = n;
+      count++;
+    }
+
+  return count;
+}
+
 gboolean
 bolt_write_char_at (int         dirfd,
                     const char *name,
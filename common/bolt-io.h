@@ -85,6 +85,20 @@ char *     bolt_read_value_at (int         dirfd,
                                const char *name,
                                GError    **error);
 
+/* batched attribute reading */
+#define BOLT_ATTR_VALUE_MAX 128
+
+typedef struct _BoltAttr
+{
+  const char *name;                        /* in: name relative to dirfd */
+  gssize      len;                         /* out: length or -errno */
+  char        value[BOLT_ATTR_VALUE_MAX];  /* out: trailing space stripped */
+} BoltAttr;
+
+guint      bolt_read_attrs_at (int       dirfd,
+                               BoltAttr *attrs,
+                               guint     n_attrs);
+
 gboolean   bolt_write_char_at (int         dirfd,
                                const char *name,
                                char        value,
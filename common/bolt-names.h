@@ -37,10 +37,13 @@
 #define BOLT_LOG_VERSION "BOLT_VERSION"
 #define BOLT_LOG_CONTEXT "BOLT_LOG_CONTEXT"
 #define BOLT_LOG_BUG_MARK "BOLT_LOG_BUG"
+#define BOLT_LOG_SUPPRESSED "BOLT_LOG_SUPPRESSED"
 
 /* logging - message ids */
 #define BOLT_LOG_MSG_IDLEN 33
 #define BOLT_LOG_MSG_ID_STARTUP "dd11929c788e48bdbb6276fb5f26b08a"
+#define BOLT_LOG_MSG_ID_UEVENT_OVERFLOW "6e678dcab03f413aad873b4cd0f37dd2"
+#define BOLT_LOG_MSG_ID_LOG_SUPPRESSED "0c6f3a9de4b24a1b8f5e2d7c91a4b3e6"
 
 
 /* dbus */
@@ -49,11 +52,21 @@
 #define BOLT_DBUS_PATH "/org/freedesktop/bolt"
 #define BOLT_DBUS_PATH_DOMAINS BOLT_DBUS_PATH "/domains"
 #define BOLT_DBUS_PATH_DEVICES BOLT_DBUS_PATH "/devices"
+
+/* Each element must only contain the ASCII characters "[A-Z][a-z][0-9]_" */
+#define BOLT_DBUS_OPATH_VALID_CHARS "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789_"
 #define BOLT_DBUS_INTERFACE "org.freedesktop.bolt1.Manager"
 
 #define BOLT_DBUS_DEVICE_INTERFACE "org.freedesktop.bolt1.Device"
 #define BOLT_DBUS_DOMAIN_INTERFACE "org.freedesktop.bolt1.Domain"
 #define BOLT_DBUS_POWER_INTERFACE "org.freedesktop.bolt1.Power"
+#define BOLT_DBUS_STATS_INTERFACE "org.freedesktop.bolt1.Stats"
+
+/* runtime directory of the daemon, see bolt_get_rundir() */
+#define BOLT_DEFAULT_RUNDIR "/run/boltd"
+
+/* direct peer-to-peer connections, see boltd --peer-socket */
+#define BOLT_PEER_SOCKET_NAME "peer.socket"
 
 /* other well known names */
 #define INTEL_WMI_THUNDERBOLT_GUID "86CCFD48-205E-4A77-9C48-2021CBEDE341"
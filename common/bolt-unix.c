@@ -22,6 +22,11 @@
 
 #include "bolt-unix.h"
 
+#include <gio/gio.h>
+
+#include <errno.h>
+#include <string.h>
+
 gboolean
 bolt_pid_is_alive (pid_t pid)
 {
@@ -35,3 +40,50 @@ bolt_pid_is_alive (pid_t pid)
 
   return g_file_test (path, G_FILE_TEST_EXISTS);
 }
+
+/* The start time of the process, in clock ticks after boot, as
+ * found in /proc/<pid>/stat; together with the pid this is what
+ * identifies a process, since pids get reused. */
+guint64
+bolt_pid_get_start_time (pid_t    pid,
+                         GError **error)
+{
+  g_autofree char *path = NULL;
+  g_autofree char *data = NULL;
+  g_auto(GStrv) fields = NULL;
+  const char *comm_end;
+  guint64 start;
+  char *end;
+
+  path = g_strdup_printf ("/proc/%lu/stat", (gulong) pid);
+
+  if (!g_file_get_contents (path, &data, NULL, error))
+    return 0;
+
+  /* the command (field 2) can contain spaces and parentheses,
+   * but it is the only field that ends with a ')' */
+  comm_end = strrchr (data, ')');
+
+  if (comm_end != NULL)
+    fields = g_strsplit (comm_end + 1, " ", 22);
+
+  /* fields[1] is the state (field 3), start time is field 22 */
+  if (fields == NULL || g_strv_length (fields) < 21)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "could not parse '%s'", path);
+      return 0;
+    }
+
+  errno = 0;
+  start = g_ascii_strtoull (fields[20], &end, 10);
+
+  if (errno != 0 || end == fields[20] || start == 0)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "invalid start time in '%s'", path);
+      return 0;
+    }
+
+  return start;
+}
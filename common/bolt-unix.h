@@ -27,4 +27,7 @@ G_BEGIN_DECLS
 
 gboolean     bolt_pid_is_alive (pid_t pid);
 
+guint64      bolt_pid_get_start_time (pid_t    pid,
+                                      GError **error);
+
 G_END_DECLS
@@ -0,0 +1,127 @@
+/*
+ * Copyright © 2018 Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *       Christian J. Kellner <christian@kellner.me>
+ */
+
+#include "config.h"
+
+#include "bolt-enums.h"
+
+#include "bench.h"
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include <locale.h>
+
+typedef struct
+{
+  GFlagsClass *klass;
+  guint        value;
+  const char  *str;
+} BenchFlags;
+
+static void
+bench_enum_to_string (guint64 n, gpointer user_data)
+{
+  static const BoltSecurity values[] = {
+    BOLT_SECURITY_NONE,
+    BOLT_SECURITY_DPONLY,
+    BOLT_SECURITY_USER,
+    BOLT_SECURITY_SECURE,
+    BOLT_SECURITY_USBONLY,
+  };
+
+  for (guint64 i = 0; i < n; i++)
+    {
+      g_autoptr(GError) err = NULL;
+      const char *str;
+
+      str = bolt_enum_to_string (BOLT_TYPE_SECURITY,
+                                 values[i % G_N_ELEMENTS (values)],
+                                 &err);
+      g_assert_no_error (err);
+      g_assert_nonnull (str);
+    }
+}
+
+static void
+bench_flags_to_string (guint64 n, gpointer user_data)
+{
+  BenchFlags *bf = user_data;
+
+  for (guint64 i = 0; i < n; i++)
+    {
+      g_autoptr(GError) err = NULL;
+      g_autofree char *str = NULL;
+
+      str = bolt_flags_class_to_string (bf->klass, bf->value, &err);
+      g_assert_no_error (err);
+      g_assert_nonnull (str);
+    }
+}
+
+static void
+bench_flags_from_string (guint64 n, gpointer user_data)
+{
+  BenchFlags *bf = user_data;
+
+  for (guint64 i = 0; i < n; i++)
+    {
+      g_autoptr(GError) err = NULL;
+      gboolean ok;
+      guint val;
+
+      ok = bolt_flags_class_from_string (bf->klass, bf->str, &val, &err);
+      g_assert_no_error (err);
+      g_assert_true (ok);
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  BenchFlags none = {NULL, BOLT_AUTH_NONE, "none"};
+  BenchFlags one = {NULL, BOLT_AUTH_SECURE, "secure"};
+  BenchFlags all = {NULL,
+                    BOLT_AUTH_NOPCIE | BOLT_AUTH_SECURE |
+                    BOLT_AUTH_NOKEY | BOLT_AUTH_BOOT,
+                    "nopcie | secure | nokey | boot"};
+  GFlagsClass *klass;
+
+  setlocale (LC_ALL, "");
+
+  bench_init (&argc, &argv);
+
+  klass = g_type_class_ref (BOLT_TYPE_AUTH_FLAGS);
+  none.klass = one.klass = all.klass = klass;
+
+  bench_run ("enums/enum/to-string", bench_enum_to_string, NULL);
+
+  bench_run ("enums/flags/to-string/0", bench_flags_to_string, &none);
+  bench_run ("enums/flags/to-string/1", bench_flags_to_string, &one);
+  bench_run ("enums/flags/to-string/4", bench_flags_to_string, &all);
+
+  bench_run ("enums/flags/from-string/0", bench_flags_from_string, &none);
+  bench_run ("enums/flags/from-string/1", bench_flags_from_string, &one);
+  bench_run ("enums/flags/from-string/4", bench_flags_from_string, &all);
+
+  g_type_class_unref (klass);
+
+  return bench_finish ();
+}
@@ -0,0 +1,392 @@
+/*
+ * Copyright © 2018 Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *       Christian J. Kellner <christian@kellner.me>
+ */
+
+#include "config.h"
+
+#include "bolt-exported.h"
+
+#include "bolt-enums.h"
+
+#include "bench.h"
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include <locale.h>
+#include <sys/socket.h>
+
+#define DBUS_IFACE "org.freedesktop.bolt1.Bench"
+#define DBUS_OPATH "/org/freedesktop/bolt/bench"
+
+static const char bench_xml[] =
+  "<node>"
+  "  <interface name='" DBUS_IFACE "'>"
+  "    <property name='Name' type='s' access='read'/>"
+  "    <property name='Count' type='u' access='read'/>"
+  "    <property name='Flags' type='s' access='read'/>"
+  "  </interface>"
+  "</node>";
+
+/* *** Exported object with a string, uint and flags property */
+#define BB_TYPE_OBJECT bb_object_get_type ()
+G_DECLARE_FINAL_TYPE (BbObject, bb_object, BB, OBJECT, BoltExported);
+
+struct _BbObject
+{
+  BoltExported  parent;
+
+  char         *name;
+  guint         count;
+  BoltAuthFlags flags;
+};
+
+G_DEFINE_TYPE (BbObject, bb_object, BOLT_TYPE_EXPORTED);
+
+enum {
+  PROP_0,
+
+  PROP_NAME,
+  PROP_COUNT,
+  PROP_FLAGS,
+
+  PROP_LAST
+};
+
+static GParamSpec *props[PROP_LAST] = {NULL, };
+
+static void
+bb_object_finalize (GObject *object)
+{
+  BbObject *bb = BB_OBJECT (object);
+
+  g_free (bb->name);
+
+  G_OBJECT_CLASS (bb_object_parent_class)->finalize (object);
+}
+
+static void
+bb_object_init (BbObject *bb)
+{
+  bb->name = g_strdup ("Thunderbolt Dock");
+  bb->flags = BOLT_AUTH_SECURE | BOLT_AUTH_BOOT;
+}
+
+static void
+bb_object_get_property (GObject    *object,
+                        guint       prop_id,
+                        GValue     *value,
+                        GParamSpec *pspec)
+{
+  BbObject *bb = BB_OBJECT (object);
+
+  switch (prop_id)
+    {
+    case PROP_NAME:
+      g_value_set_string (value, bb->name);
+      break;
+
+    case PROP_COUNT:
+      g_value_set_uint (value, bb->count);
+      break;
+
+    case PROP_FLAGS:
+      g_value_set_flags (value, bb->flags);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+bb_object_set_property (GObject      *object,
+                        guint         prop_id,
+                        const GValue *value,
+                        GParamSpec   *pspec)
+{
+  BbObject *bb = BB_OBJECT (object);
+
+  switch (prop_id)
+    {
+    case PROP_NAME:
+      g_clear_pointer (&bb->name, g_free);
+      bb->name = g_value_dup_string (value);
+      break;
+
+    case PROP_COUNT:
+      bb->count = g_value_get_uint (value);
+      break;
+
+    case PROP_FLAGS:
+      bb->flags = g_value_get_flags (value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+bb_object_class_init (BbObjectClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  BoltExportedClass *exported_class = BOLT_EXPORTED_CLASS (klass);
+
+  gobject_class->finalize = bb_object_finalize;
+  gobject_class->get_property = bb_object_get_property;
+  gobject_class->set_property = bb_object_set_property;
+
+  bolt_exported_class_set_interface_name (exported_class, DBUS_IFACE);
+  bolt_exported_class_set_interface_info_from_xml (exported_class, bench_xml);
+  bolt_exported_class_set_object_path (exported_class, DBUS_OPATH);
+
+  props[PROP_NAME] =
+    g_param_spec_string ("name", "Name", NULL,
+                         NULL,
+                         G_PARAM_READWRITE |
+                         G_PARAM_STATIC_NICK |
+                         G_PARAM_STATIC_BLURB);
+
+  props[PROP_COUNT] =
+    g_param_spec_uint ("count", "Count", NULL,
+                       0, G_MAXUINT, 0,
+                       G_PARAM_READWRITE |
+                       G_PARAM_STATIC_NICK |
+                       G_PARAM_STATIC_BLURB);
+
+  props[PROP_FLAGS] =
+    g_param_spec_flags ("flags", "Flags", NULL,
+                        BOLT_TYPE_AUTH_FLAGS,
+                        BOLT_AUTH_NONE,
+                        G_PARAM_READWRITE |
+                        G_PARAM_STATIC_NICK |
+                        G_PARAM_STATIC_BLURB);
+
+  g_object_class_install_properties (gobject_class,
+                                     PROP_LAST,
+                                     props);
+
+  bolt_exported_class_export_properties (exported_class, PROP_NAME, PROP_LAST, props);
+}
+
+/* *** */
+
+typedef struct
+{
+  GDBusConnection *server;
+  GDBusConnection *client;
+  BbObject        *obj;
+} BenchExported;
+
+typedef struct
+{
+  BenchExported *be;
+  const char    *method;
+  const char    *prop;
+} BenchCall;
+
+static void
+got_server_connection (GObject      *source,
+                       GAsyncResult *res,
+                       gpointer      user_data)
+{
+  g_autoptr(GError) err = NULL;
+  GDBusConnection **server = user_data;
+
+  *server = g_dbus_connection_new_finish (res, &err);
+  g_assert_no_error (err);
+}
+
+static GIOStream *
+bench_stream_new (int fd)
+{
+  g_autoptr(GSocket) socket = NULL;
+  g_autoptr(GError) err = NULL;
+
+  socket = g_socket_new_from_fd (fd, &err);
+  g_assert_no_error (err);
+
+  return G_IO_STREAM (g_socket_connection_factory_create_connection (socket));
+}
+
+/* a direct peer-to-peer connection, so the numbers are not
+ * dominated by the message bus daemon */
+static void
+bench_exported_setup (BenchExported *be)
+{
+  g_autoptr(GIOStream) s0 = NULL;
+  g_autoptr(GIOStream) s1 = NULL;
+  g_autoptr(GError) err = NULL;
+  g_autofree char *guid = NULL;
+  gboolean ok;
+  int fds[2];
+  int r;
+
+  r = socketpair (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds);
+  g_assert_cmpint (r, ==, 0);
+
+  s0 = bench_stream_new (fds[0]);
+  s1 = bench_stream_new (fds[1]);
+  guid = g_dbus_generate_guid ();
+
+  g_dbus_connection_new (s0, guid,
+                         G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_SERVER,
+                         NULL, NULL,
+                         got_server_connection,
+                         &be->server);
+
+  be->client = g_dbus_connection_new_sync (s1, NULL,
+                                           G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT,
+                                           NULL, NULL, &err);
+  g_assert_no_error (err);
+
+  while (be->server == NULL)
+    g_main_context_iteration (NULL, TRUE);
+
+  be->obj = g_object_new (BB_TYPE_OBJECT, NULL);
+
+  ok = bolt_exported_export (BOLT_EXPORTED (be->obj),
+                             be->server,
+                             DBUS_OPATH,
+                             &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+}
+
+static void
+bench_exported_tear_down (BenchExported *be)
+{
+  bolt_exported_unexport (BOLT_EXPORTED (be->obj));
+
+  g_clear_object (&be->obj);
+  g_clear_object (&be->client);
+  g_clear_object (&be->server);
+}
+
+static void
+bench_call_done (GObject      *source,
+                 GAsyncResult *res,
+                 gpointer      user_data)
+{
+  g_autoptr(GVariant) val = NULL;
+  g_autoptr(GError) err = NULL;
+  gboolean *done = user_data;
+
+  val = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source), res, &err);
+  g_assert_no_error (err);
+  g_assert_nonnull (val);
+
+  *done = TRUE;
+}
+
+static void
+bench_exported_call (guint64 n, gpointer user_data)
+{
+  BenchCall *call = user_data;
+  BenchExported *be = call->be;
+
+  for (guint64 i = 0; i < n; i++)
+    {
+      gboolean done = FALSE;
+      GVariant *params;
+
+      if (call->prop)
+        params = g_variant_new ("(ss)", DBUS_IFACE, call->prop);
+      else
+        params = g_variant_new ("(s)", DBUS_IFACE);
+
+      g_dbus_connection_call (be->client,
+                              NULL,
+                              DBUS_OPATH,
+                              "org.freedesktop.DBus.Properties",
+                              call->method,
+                              params,
+                              NULL,
+                              G_DBUS_CALL_FLAGS_NONE,
+                              -1,
+                              NULL,
+                              bench_call_done,
+                              &done);
+
+      while (!done)
+        g_main_context_iteration (NULL, TRUE);
+    }
+}
+
+static void
+bench_exported_changed (guint64 n, gpointer user_data)
+{
+  BenchExported *be = user_data;
+
+  for (guint64 i = 0; i < n; i++)
+    g_object_set (be->obj, "count", (guint) i, NULL);
+
+  g_dbus_connection_flush_sync (be->server, NULL, NULL);
+}
+
+static void
+bench_exported_changed_many (guint64 n, gpointer user_data)
+{
+  BenchExported *be = user_data;
+
+  /* all changes are collected into a single signal */
+  for (guint64 i = 0; i < n; i++)
+    g_object_set (be->obj,
+                  "name", (i % 2) ? "Thunderbolt Dock" : "Thunderbolt Cable",
+                  "count", (guint) i,
+                  "flags", (i % 2) ? BOLT_AUTH_SECURE : BOLT_AUTH_NOKEY,
+                  NULL);
+
+  g_dbus_connection_flush_sync (be->server, NULL, NULL);
+}
+
+int
+main (int argc, char **argv)
+{
+  BenchExported be = {NULL, };
+  BenchCall calls[] = {
+    {&be, "Get", "Name"},
+    {&be, "Get", "Count"},
+    {&be, "Get", "Flags"},
+    {&be, "GetAll", NULL},
+  };
+  const char *names[] = {
+    "exported/get/string",
+    "exported/get/uint",
+    "exported/get/flags",
+    "exported/getall",
+  };
+
+  setlocale (LC_ALL, "");
+
+  bench_init (&argc, &argv);
+
+  bench_exported_setup (&be);
+
+  for (guint i = 0; i < G_N_ELEMENTS (calls); i++)
+    bench_run (names[i], bench_exported_call, &calls[i]);
+
+  bench_run ("exported/changed/1", bench_exported_changed, &be);
+  bench_run ("exported/changed/3", bench_exported_changed_many, &be);
+
+  bench_exported_tear_down (&be);
+
+  return bench_finish ();
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright © 2018 Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *       Christian J. Kellner <christian@kellner.me>
+ */
+
+#include "config.h"
+
+#include "bolt-error.h"
+#include "bolt-log.h"
+
+#include "bench.h"
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include <locale.h>
+
+static void
+bench_log_debug_direct (guint64 n, gpointer user_data)
+{
+  /* bypasses the level check of the macro, i.e. the
+   * filtering happens inside bolt_logv */
+  for (guint64 i = 0; i < n; i++)
+    bolt_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG,
+              LOG_DIRECT ("CODE_FILE", __FILE__),
+              LOG_DIRECT ("CODE_LINE", G_STRINGIFY (__LINE__)),
+              LOG_DIRECT ("CODE_FUNC", G_STRFUNC),
+              LOG_TOPIC ("bench"),
+              "iteration %" G_GUINT64_FORMAT, i);
+}
+
+static void
+bench_log_debug_macro (guint64 n, gpointer user_data)
+{
+  for (guint64 i = 0; i < n; i++)
+    bolt_debug (LOG_TOPIC ("bench"), "iteration %" G_GUINT64_FORMAT, i);
+}
+
+static void
+bench_log_info_error (guint64 n, gpointer user_data)
+{
+  g_autoptr(GError) err = NULL;
+
+  g_set_error_literal (&err, BOLT_ERROR, BOLT_ERROR_FAILED,
+                       "benchmark error");
+
+  for (guint64 i = 0; i < n; i++)
+    bolt_info (LOG_TOPIC ("bench"), LOG_ERR (err),
+               "iteration %" G_GUINT64_FORMAT, i);
+}
+
+int
+main (int argc, char **argv)
+{
+  GLogLevelFlags mask;
+
+  setlocale (LC_ALL, "");
+
+  bench_init (&argc, &argv);
+
+  mask = bolt_log_get_level_mask ();
+
+  /* measure the formatting, not the suppression */
+  bolt_log_set_rate_limit (0, 1);
+
+  bolt_log_set_debug (FALSE);
+  bench_run ("log/debug/disabled/logv", bench_log_debug_direct, NULL);
+  bench_run ("log/debug/disabled/macro", bench_log_debug_macro, NULL);
+
+  bolt_log_set_debug (TRUE);
+  bench_run ("log/debug/enabled/logv", bench_log_debug_direct, NULL);
+  bench_run ("log/debug/enabled/macro", bench_log_debug_macro, NULL);
+
+  bolt_log_set_debug_topics ("dbus");
+  bench_run ("log/debug/filtered/macro", bench_log_debug_macro, NULL);
+  bolt_log_set_debug_topics (NULL);
+
+  bench_run ("log/info/gerror", bench_log_info_error, NULL);
+
+  bolt_log_set_level_mask (mask);
+
+  return bench_finish ();
+}
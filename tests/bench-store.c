@@ -0,0 +1,177 @@
+/*
+ * Copyright © 2018 Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *       Christian J. Kellner <christian@kellner.me>
+ */
+
+#include "config.h"
+
+#include "bolt-fs.h"
+#include "bolt-store.h"
+
+#include "bolt-daemon-resource.h"
+
+#include "bench.h"
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include <locale.h>
+
+typedef struct
+{
+  char      *path;
+  BoltStore *store;
+  GPtrArray *devices;
+} BenchStore;
+
+static BenchStore *
+bench_store_new (guint size)
+{
+  g_autoptr(GError) err = NULL;
+  BenchStore *bs;
+
+  bs = g_new0 (BenchStore, 1);
+
+  bs->path = g_dir_make_tmp ("bolt.bench.XXXXXX", &err);
+  g_assert_no_error (err);
+
+  bs->store = bolt_store_new (bs->path);
+  g_assert_nonnull (bs->store);
+
+  bs->devices = g_ptr_array_new_with_free_func (g_object_unref);
+
+  for (guint i = 0; i < size; i++)
+    {
+      g_autofree char *uid = NULL;
+      BoltDevice *dev;
+      gboolean ok;
+
+      uid = g_strdup_printf ("%08x-0000-4000-8000-000000000000", i);
+      dev = g_object_new (BOLT_TYPE_DEVICE,
+                          "uid", uid,
+                          "name", "Thunderbolt Dock",
+                          "vendor", "GNOME.org",
+                          "status", BOLT_STATUS_DISCONNECTED,
+                          NULL);
+
+      ok = bolt_store_put_device (bs->store, dev, BOLT_POLICY_AUTO, NULL, &err);
+      g_assert_no_error (err);
+      g_assert_true (ok);
+
+      g_ptr_array_add (bs->devices, dev);
+    }
+
+  return bs;
+}
+
+static void
+bench_store_free (BenchStore *bs)
+{
+  g_autoptr(GError) err = NULL;
+  gboolean ok;
+
+  g_clear_object (&bs->store);
+  g_ptr_array_unref (bs->devices);
+
+  ok = bolt_fs_cleanup_dir (bs->path, &err);
+  if (!ok)
+    g_warning ("Could not clean up dir: %s", err->message);
+
+  g_free (bs->path);
+  g_free (bs);
+}
+
+static void
+bench_store_put (guint64 n, gpointer user_data)
+{
+  BenchStore *bs = user_data;
+
+  for (guint64 i = 0; i < n; i++)
+    {
+      g_autoptr(GError) err = NULL;
+      BoltDevice *dev;
+      gboolean ok;
+
+      dev = g_ptr_array_index (bs->devices, i % bs->devices->len);
+      ok = bolt_store_put_device (bs->store, dev, BOLT_POLICY_AUTO, NULL, &err);
+      g_assert_no_error (err);
+      g_assert_true (ok);
+    }
+}
+
+static void
+bench_store_get (guint64 n, gpointer user_data)
+{
+  BenchStore *bs = user_data;
+
+  for (guint64 i = 0; i < n; i++)
+    {
+      g_autoptr(BoltDevice) stored = NULL;
+      g_autoptr(GError) err = NULL;
+      BoltDevice *dev;
+
+      dev = g_ptr_array_index (bs->devices, i % bs->devices->len);
+      stored = bolt_store_get_device (bs->store, bolt_device_get_uid (dev), &err);
+      g_assert_no_error (err);
+      g_assert_nonnull (stored);
+    }
+}
+
+static void
+bench_store_list (guint64 n, gpointer user_data)
+{
+  BenchStore *bs = user_data;
+
+  for (guint64 i = 0; i < n; i++)
+    {
+      g_auto(GStrv) uids = NULL;
+      g_autoptr(GError) err = NULL;
+
+      uids = bolt_store_list_uids (bs->store, &err);
+      g_assert_no_error (err);
+      g_assert_cmpuint (g_strv_length (uids), ==, bs->devices->len);
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  static const guint sizes[] = {1, 16, 128};
+
+  setlocale (LC_ALL, "");
+
+  bench_init (&argc, &argv);
+
+  g_resources_register (bolt_daemon_get_resource ());
+
+  for (guint i = 0; i < G_N_ELEMENTS (sizes); i++)
+    {
+      g_autofree char *put = g_strdup_printf ("store/put/%u", sizes[i]);
+      g_autofree char *get = g_strdup_printf ("store/get/%u", sizes[i]);
+      g_autofree char *lst = g_strdup_printf ("store/list/%u", sizes[i]);
+      BenchStore *bs = bench_store_new (sizes[i]);
+
+      bench_run (put, bench_store_put, bs);
+      bench_run (get, bench_store_get, bs);
+      bench_run (lst, bench_store_list, bs);
+
+      bench_store_free (bs);
+    }
+
+  return bench_finish ();
+}
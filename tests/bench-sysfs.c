@@ -0,0 +1,142 @@
+/*
+ * Copyright © 2018 Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *       Christian J. Kellner <christian@kellner.me>
+ */
+
+#include "config.h"
+
+#include "bolt-sysfs.h"
+
+#include "mock-sysfs.h"
+
+#include "bench.h"
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include <libudev.h>
+#include <locale.h>
+
+typedef struct
+{
+  struct udev *udev;
+  GPtrArray   *devices;
+  const char  *leaf;
+  guint        threads;
+} BenchSysfs;
+
+static void
+bench_sysfs_info (guint64 n, gboolean full, gpointer user_data)
+{
+  BenchSysfs *bs = user_data;
+
+  /* libudev caches attribute values per udev_device, a fresh
+   * one is created like the daemon does for every uevent */
+  for (guint64 i = 0; i < n; i++)
+    {
+      g_autoptr(GError) err = NULL;
+      struct udev_device *dev;
+      BoltDevInfo info;
+      gboolean ok;
+
+      dev = udev_device_new_from_syspath (bs->udev, bs->leaf);
+      g_assert_nonnull (dev);
+
+      ok = bolt_sysfs_info_for_device (dev, full, &info, &err);
+      g_assert_no_error (err);
+      g_assert_true (ok);
+
+      udev_device_unref (dev);
+    }
+}
+
+static void
+bench_sysfs_info_basic (guint64 n, gpointer user_data)
+{
+  bench_sysfs_info (n, FALSE, user_data);
+}
+
+static void
+bench_sysfs_info_full (guint64 n, gpointer user_data)
+{
+  bench_sysfs_info (n, TRUE, user_data);
+}
+
+static void
+bench_sysfs_scan (guint64 n, gpointer user_data)
+{
+  BenchSysfs *bs = user_data;
+
+  for (guint64 i = 0; i < n; i++)
+    {
+      g_autoptr(GPtrArray) scan = NULL;
+      g_autoptr(GError) err = NULL;
+
+      scan = bolt_sysfs_scan (NULL, bs->threads, &err);
+      g_assert_no_error (err);
+      g_assert_nonnull (scan);
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  g_autoptr(MockSysfs) sysfs = NULL;
+  g_autofree char *name = NULL;
+  BenchSysfs bs = {NULL, };
+  MockTree tree = {
+    .security   = BOLT_SECURITY_SECURE,
+    .depth      = 3,
+    .fanout     = 4,
+    .authorized = 0,
+    .key        = TRUE,
+    .boot       = 1,
+  };
+  const char *id;
+
+  setlocale (LC_ALL, "");
+
+  bench_init (&argc, &argv);
+
+  sysfs = mock_sysfs_new ();
+  bs.udev = udev_new ();
+
+  id = mock_sysfs_tree_add (sysfs, &tree);
+  g_assert_nonnull (id);
+
+  bs.devices = mock_sysfs_device_list (sysfs, id);
+  bs.leaf = g_ptr_array_index (bs.devices, bs.devices->len - 1);
+
+  bench_run ("sysfs/info/basic", bench_sysfs_info_basic, &bs);
+  bench_run ("sysfs/info/full", bench_sysfs_info_full, &bs);
+
+  for (guint threads = 1; threads <= 4; threads *= 4)
+    {
+      g_free (name);
+      name = g_strdup_printf ("sysfs/scan/%u/%u",
+                              bs.devices->len,
+                              threads);
+      bs.threads = threads;
+      bench_run (name, bench_sysfs_scan, &bs);
+    }
+
+  g_ptr_array_unref (bs.devices);
+  udev_unref (bs.udev);
+
+  return bench_finish ();
+}
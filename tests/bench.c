@@ -0,0 +1,168 @@
+/*
+ * Copyright © 2018 Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *       Christian J. Kellner <christian@kellner.me>
+ */
+
+#include "config.h"
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCH_DEFAULT_TIME_MS 50
+#define BENCH_DEFAULT_ROUNDS  5
+#define BENCH_MAX_ITERATIONS  (G_GUINT64_CONSTANT (1) << 32)
+
+static char *bench_filter = NULL;
+static gint bench_time_ms = BENCH_DEFAULT_TIME_MS;
+static gint bench_rounds = BENCH_DEFAULT_ROUNDS;
+static gboolean bench_list = FALSE;
+
+static GLogWriterOutput
+bench_log_writer (GLogLevelFlags   log_level,
+                  const GLogField *fields,
+                  gsize            n_fields,
+                  gpointer         user_data)
+{
+  /* only the results should end up on stdout, and the
+   * cost of the actual log sink is not what we measure */
+  if (log_level & (G_LOG_FLAG_FATAL | G_LOG_LEVEL_ERROR | G_LOG_LEVEL_CRITICAL))
+    return g_log_writer_standard_streams (log_level, fields, n_fields, user_data);
+
+  return G_LOG_WRITER_HANDLED;
+}
+
+static gint64
+bench_now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return (gint64) ts.tv_sec * G_GINT64_CONSTANT (1000000000) + ts.tv_nsec;
+}
+
+static gint64
+bench_time (BenchFunc func,
+            gpointer  user_data,
+            guint64   n)
+{
+  gint64 start;
+
+  start = bench_now ();
+  func (n, user_data);
+
+  return bench_now () - start;
+}
+
+static int
+bench_cmp_double (gconstpointer a,
+                  gconstpointer b)
+{
+  const double *x = a;
+  const double *y = b;
+
+  return (*x > *y) - (*x < *y);
+}
+
+void
+bench_init (int    *argc,
+            char ***argv)
+{
+  g_autoptr(GOptionContext) optctx = NULL;
+  g_autoptr(GError) err = NULL;
+  GOptionEntry options[] = {
+    { "filter", 'f', 0, G_OPTION_ARG_STRING, &bench_filter, "Only run benchmarks starting with PREFIX", "PREFIX" },
+    { "time", 't', 0, G_OPTION_ARG_INT, &bench_time_ms, "Minimum duration of a round", "MS" },
+    { "rounds", 'r', 0, G_OPTION_ARG_INT, &bench_rounds, "Number of rounds", "N" },
+    { "list", 'l', 0, G_OPTION_ARG_NONE, &bench_list, "List benchmarks", NULL },
+    { NULL }
+  };
+
+  optctx = g_option_context_new ("- run benchmarks");
+  g_option_context_add_main_entries (optctx, options, NULL);
+
+  if (!g_option_context_parse (optctx, argc, argv, &err))
+    {
+      g_printerr ("%s\n", err->message);
+      exit (EXIT_FAILURE);
+    }
+
+  bench_time_ms = MAX (bench_time_ms, 1);
+  bench_rounds = MAX (bench_rounds, 1);
+
+  g_log_set_writer_func (bench_log_writer, NULL, NULL);
+}
+
+void
+bench_run (const char *name,
+           BenchFunc   func,
+           gpointer    user_data)
+{
+  g_autofree double *ns = NULL;
+  char buf[3][G_ASCII_DTOSTR_BUF_SIZE];
+  gint64 target;
+  guint64 n;
+
+  if (bench_filter && !g_str_has_prefix (name, bench_filter))
+    return;
+
+  if (bench_list)
+    {
+      g_print ("%s\n", name);
+      return;
+    }
+
+  /* warm up, then find the number of iterations that makes
+   * a single round last at least the requested time */
+  target = (gint64) bench_time_ms * G_GINT64_CONSTANT (1000000);
+
+  bench_time (func, user_data, 1);
+
+  for (n = 1; n < BENCH_MAX_ITERATIONS; n *= 2)
+    if (bench_time (func, user_data, n) >= target)
+      break;
+
+  ns = g_new0 (double, bench_rounds);
+
+  for (gint i = 0; i < bench_rounds; i++)
+    ns[i] = (double) bench_time (func, user_data, n) / (double) n;
+
+  qsort (ns, bench_rounds, sizeof (double), bench_cmp_double);
+
+  /* one json object per line, with a fixed set and order
+   * of keys, formatted independently of the locale */
+  g_print ("{\"benchmark\":\"%s\",\"iterations\":%" G_GUINT64_FORMAT ","
+           "\"rounds\":%d,\"min_ns\":%s,\"median_ns\":%s,\"max_ns\":%s}\n",
+           name, n, bench_rounds,
+           g_ascii_formatd (buf[0], sizeof (buf[0]), "%.1f", ns[0]),
+           g_ascii_formatd (buf[1], sizeof (buf[1]), "%.1f", ns[bench_rounds / 2]),
+           g_ascii_formatd (buf[2], sizeof (buf[2]), "%.1f", ns[bench_rounds - 1]));
+
+  fflush (stdout);
+}
+
+int
+bench_finish (void)
+{
+  g_clear_pointer (&bench_filter, g_free);
+
+  return EXIT_SUCCESS;
+}
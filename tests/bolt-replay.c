@@ -0,0 +1,670 @@
+/*
+ * Copyright © 2018 Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *       Christian J. Kellner <christian@kellner.me>
+ */
+
+/* Replays a uevent recording of boltd (--record-uevents)
+ * on top of a mock sysfs, driving an in-process manager.
+ * Must be run with the umockdev preload library. */
+
+#include "config.h"
+
+#include "bolt-fs.h"
+#include "bolt-log.h"
+#include "bolt-manager.h"
+#include "bolt-record.h"
+#include "bolt-store.h"
+#include "bolt-str.h"
+#include "bolt-udev.h"
+
+#include "mock-sysfs.h"
+
+#include "bolt-daemon-resource.h"
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include <libudev.h>
+#include <locale.h>
+#include <stdlib.h>
+
+typedef struct
+{
+  GPtrArray  *records;
+  guint       next;
+  gdouble     speed;
+  gint64      base;      /* time of the first live record */
+
+  MockSysfs   *sysfs;
+  BoltUdev    *udev;
+  BoltManager *manager;
+  GHashTable  *domains;   /* recorded syspath -> mock domain id */
+  GHashTable  *devices;   /* recorded syspath -> mock syspath */
+  GHashTable  *pending;   /* mock syspath -> time of the add, µs */
+  GArray      *latency;   /* add to authorized, µs */
+
+  /* time spent dispatching uevents, i.e. between the first
+   * and the last subscriber, which bracket the manager's */
+  gint64       dispatch_start;
+  gint64       dispatch_total;
+  gint64       dispatch_max;
+  guint        uevents;
+
+  gint64       start;
+  guint        wait;      /* for pending devices, s */
+  gboolean     done;
+  guint        replayed;
+  guint        skipped;
+
+  GMainLoop   *loop;
+} Replay;
+
+static gint
+replay_attr_int (const BoltRecord *rec,
+                 const char       *name,
+                 gint              fallback)
+{
+  const char *val = bolt_record_get_attr (rec, name);
+
+  if (val == NULL || *val == '\0')
+    return fallback;
+
+  return (gint) g_ascii_strtoll (val, NULL, 10);
+}
+
+/* the port is the highest byte of the route, which
+ * is encoded in the sysname, e.g. "0-301" */
+static guint
+replay_record_port (const char *syspath)
+{
+  const char *sysname;
+  guint64 route;
+
+  sysname = strrchr (syspath, '/');
+  sysname = strchr (sysname ? sysname : syspath, '-');
+
+  if (sysname == NULL)
+    return 0;
+
+  route = g_ascii_strtoull (sysname + 1, NULL, 16);
+
+  while (route > 0xff)
+    route >>= 8;
+
+  return (guint) route;
+}
+
+static void
+replay_forget (Replay     *rp,
+               const char *syspath)
+{
+  g_autofree char *prefix = g_strconcat (syspath, "/", NULL);
+  GHashTableIter iter;
+  gpointer key, val;
+
+  g_hash_table_iter_init (&iter, rp->devices);
+  while (g_hash_table_iter_next (&iter, &key, &val))
+    {
+      if (!bolt_streq (key, syspath) && !g_str_has_prefix (key, prefix))
+        continue;
+
+      g_hash_table_remove (rp->pending, val);
+      g_hash_table_iter_remove (&iter);
+    }
+}
+
+static gboolean
+replay_domain_add (Replay           *rp,
+                   const BoltRecord *rec)
+{
+  const char *security;
+  const char *id;
+
+  security = bolt_record_get_attr (rec, "security");
+  id = mock_sysfs_domain_add (rp->sysfs, bolt_security_from_string (security));
+
+  if (id == NULL)
+    return FALSE;
+
+  g_hash_table_insert (rp->domains, g_strdup (rec->syspath), g_strdup (id));
+
+  return TRUE;
+}
+
+static gboolean
+replay_device_add (Replay           *rp,
+                   const BoltRecord *rec,
+                   gboolean          live)
+{
+  g_autofree char *parent = NULL;
+  const char *domain;
+  const char *mparent;
+  const char *uid;
+  const char *path = NULL;
+
+  parent = g_path_get_dirname (rec->syspath);
+  domain = g_hash_table_lookup (rp->domains, parent);
+  mparent = g_hash_table_lookup (rp->devices, parent);
+  uid = bolt_record_get_attr (rec, "unique_id");
+
+  if (domain != NULL)
+    {
+      path = mock_sysfs_host_add (rp->sysfs, domain, uid);
+    }
+  else if (mparent != NULL)
+    {
+      const char *name = bolt_record_get_attr (rec, "device_name");
+      guint port = replay_record_port (rec->syspath);
+      gint authorized = replay_attr_int (rec, "authorized", 0);
+
+      if (port == 0 || port > MOCK_ROUTE_MAX_PORT)
+        return FALSE;
+
+      path = mock_sysfs_device_add (rp->sysfs, mparent, port,
+                                    name ? : "Device", uid,
+                                    authorized,
+                                    bolt_record_get_attr (rec, "key"),
+                                    replay_attr_int (rec, "boot", -1));
+
+      /* measure the time until the daemon authorized it */
+      if (path != NULL && live && authorized == 0)
+        {
+          gint64 *now = g_new (gint64, 1);
+
+          *now = g_get_monotonic_time ();
+          g_hash_table_insert (rp->pending, g_strdup (path), now);
+        }
+    }
+
+  if (path == NULL)
+    return FALSE;
+
+  g_hash_table_insert (rp->devices, g_strdup (rec->syspath), g_strdup (path));
+
+  return TRUE;
+}
+
+static gboolean
+replay_apply (Replay           *rp,
+              const BoltRecord *rec,
+              gboolean          live)
+{
+  BoltUdevAction action;
+  const char *path;
+  gboolean is_domain;
+  gint level;
+
+  /* only the thunderbolt bits can be recreated */
+  if (!bolt_streq (rec->subsystem, "thunderbolt"))
+    return FALSE;
+
+  is_domain = bolt_streq (rec->devtype, "thunderbolt_domain");
+
+  if (!is_domain && !bolt_streq (rec->devtype, "thunderbolt_device"))
+    return FALSE;
+
+  if (bolt_streq (rec->action, BOLT_RECORD_PRESENT))
+    action = BOLT_UDEV_ACTION_ADD;
+  else
+    action = bolt_udev_action_from_string (rec->action);
+
+  switch (action)
+    {
+    case BOLT_UDEV_ACTION_ADD:
+      if (is_domain)
+        return replay_domain_add (rp, rec);
+
+      return replay_device_add (rp, rec, live);
+
+    case BOLT_UDEV_ACTION_REMOVE:
+      if (is_domain)
+        {
+          g_autofree char *id = g_strdup (g_hash_table_lookup (rp->domains, rec->syspath));
+
+          if (id == NULL)
+            return FALSE;
+
+          replay_forget (rp, rec->syspath);
+          g_hash_table_remove (rp->domains, rec->syspath);
+
+          return mock_sysfs_domain_remove (rp->sysfs, id);
+        }
+      else
+        {
+          g_autofree char *mpath = g_strdup (g_hash_table_lookup (rp->devices, rec->syspath));
+
+          if (mpath == NULL)
+            return FALSE;
+
+          replay_forget (rp, rec->syspath);
+
+          return mock_sysfs_device_remove (rp->sysfs, mpath);
+        }
+
+    case BOLT_UDEV_ACTION_CHANGE:
+      path = g_hash_table_lookup (rp->devices, rec->syspath);
+      level = replay_attr_int (rec, "authorized", -1);
+
+      if (is_domain || path == NULL || level < 0)
+        return FALSE;
+
+      return mock_sysfs_device_authorize (rp->sysfs, path, level);
+
+    default:
+      return FALSE;
+    }
+}
+
+static gboolean replay_step (gpointer user_data);
+
+static void
+replay_schedule (Replay *rp)
+{
+  BoltRecord *rec;
+  gint64 due;
+  gint64 now;
+
+  if (rp->next >= rp->records->len)
+    {
+      rp->done = TRUE;
+
+      g_timeout_add_seconds (MAX (rp->wait, 1), replay_deadline, rp);
+      replay_check_done (rp);
+      return;
+    }
+
+  rec = g_ptr_array_index (rp->records, rp->next);
+
+  now = g_get_monotonic_time ();
+  due = now;
+
+  if (rp->speed > 0)
+    due = rp->start + (gint64) ((gdouble) (rec->time - rp->base) / rp->speed);
+
+  /* at idle priority, so the uevents of the previous
+   * record are handled by the manager first */
+  if (due <= now)
+    g_idle_add (replay_step, rp);
+  else
+    g_timeout_add ((guint) ((due - now + 999) / 1000), replay_step, rp);
+}
+
+static gboolean
+replay_step (gpointer user_data)
+{
+  Replay *rp = user_data;
+  BoltRecord *rec;
+
+  rec = g_ptr_array_index (rp->records, rp->next++);
+
+  if (replay_apply (rp, rec, TRUE))
+    rp->replayed++;
+  else
+    rp->skipped++;
+
+  replay_schedule (rp);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+replay_deadline (gpointer user_data)
+{
+  Replay *rp = user_data;
+
+  g_main_loop_quit (rp->loop);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+replay_check_done (Replay *rp)
+{
+  if (!rp->done)
+    return;
+
+  if (g_hash_table_size (rp->pending) == 0)
+    g_main_loop_quit (rp->loop);
+}
+
+static void
+replay_device_status_changed (BoltDevice *dev,
+                              BoltStatus  old,
+                              gpointer    user_data)
+{
+  Replay *rp = user_data;
+  const char *syspath;
+  gint64 *added;
+  gint64 latency;
+
+  if (!bolt_status_is_authorized (bolt_device_get_status (dev)))
+    return;
+
+  syspath = bolt_device_get_syspath (dev);
+  added = syspath ? g_hash_table_lookup (rp->pending, syspath) : NULL;
+
+  if (added == NULL)
+    return;
+
+  latency = g_get_monotonic_time () - *added;
+  g_array_append_val (rp->latency, latency);
+  g_hash_table_remove (rp->pending, syspath);
+
+  g_signal_handlers_disconnect_by_func (dev,
+                                        replay_device_status_changed,
+                                        rp);
+  replay_check_done (rp);
+}
+
+static gboolean
+replay_uevent_begin (BoltUdev         *udev,
+                     const BoltUevent *event,
+                     gpointer          user_data)
+{
+  Replay *rp = user_data;
+
+  rp->dispatch_start = g_get_monotonic_time ();
+
+  return FALSE;
+}
+
+static gboolean
+replay_uevent_end (BoltUdev         *udev,
+                   const BoltUevent *event,
+                   gpointer          user_data)
+{
+  g_autoptr(BoltDevice) dev = NULL;
+  Replay *rp = user_data;
+  const char *uid;
+  gint64 dt;
+
+  dt = g_get_monotonic_time () - rp->dispatch_start;
+  rp->dispatch_total += dt;
+  rp->dispatch_max = MAX (rp->dispatch_max, dt);
+  rp->uevents++;
+
+  /* the device the manager just created, watch it until
+   * it gets authorized */
+  if (event->action != BOLT_UDEV_ACTION_ADD ||
+      event->devtype != BOLT_UDEV_DEVTYPE_DEVICE ||
+      !g_hash_table_contains (rp->pending, event->syspath))
+    return FALSE;
+
+  uid = udev_device_get_sysattr_value (event->device, "unique_id");
+  dev = uid ? bolt_manager_get_device (rp->manager, uid, NULL) : NULL;
+
+  if (dev == NULL)
+    return FALSE;
+
+  g_signal_connect (dev, "status-changed",
+                    G_CALLBACK (replay_device_status_changed),
+                    rp);
+
+  replay_device_status_changed (dev, BOLT_STATUS_UNKNOWN, rp);
+
+  return FALSE;
+}
+
+static void
+replay_enroll (GPtrArray  *records,
+               const char *path)
+{
+  g_autoptr(GHashTable) domains = NULL;
+  g_autoptr(BoltStore) store = NULL;
+
+  store = bolt_store_new (path);
+  domains = g_hash_table_new (g_str_hash, g_str_equal);
+
+  for (guint i = 0; i < records->len; i++)
+    {
+      g_autoptr(BoltDevice) dev = NULL;
+      g_autoptr(GError) err = NULL;
+      g_autofree char *parent = NULL;
+      BoltRecord *rec = g_ptr_array_index (records, i);
+      const char *uid;
+      const char *name;
+      const char *vendor;
+
+      if (bolt_streq (rec->devtype, "thunderbolt_domain"))
+        g_hash_table_add (domains, rec->syspath);
+
+      if (!bolt_streq (rec->devtype, "thunderbolt_device"))
+        continue;
+
+      /* the host is always authorized */
+      parent = g_path_get_dirname (rec->syspath);
+      if (g_hash_table_contains (domains, parent))
+        continue;
+
+      uid = bolt_record_get_attr (rec, "unique_id");
+      if (uid == NULL)
+        continue;
+
+      name = bolt_record_get_attr (rec, "device_name");
+      vendor = bolt_record_get_attr (rec, "vendor_name");
+
+      dev = g_object_new (BOLT_TYPE_DEVICE,
+                          "uid", uid,
+                          "name", name ? : "Device",
+                          "vendor", vendor ? : "Vendor",
+                          "status", BOLT_STATUS_DISCONNECTED,
+                          NULL);
+
+      if (!bolt_store_put_device (store, dev, BOLT_POLICY_AUTO, NULL, &err))
+        g_printerr ("could not enroll %s: %s\n", uid, err->message);
+    }
+}
+
+static int
+replay_cmp_int64 (gconstpointer a,
+                  gconstpointer b)
+{
+  const gint64 *x = a;
+  const gint64 *y = b;
+
+  return (*x > *y) - (*x < *y);
+}
+
+static void
+replay_report (Replay *rp,
+               guint   present,
+               gint64  duration)
+{
+  guint n;
+
+  g_array_sort (rp->latency, replay_cmp_int64);
+  n = rp->latency->len;
+
+  /* one json object, like the benchmarks */
+  g_print ("{\"records\":%u,\"present\":%u,\"replayed\":%u,\"skipped\":%u,"
+           "\"duration_us\":%" G_GINT64_FORMAT ","
+           "\"uevents\":%u,"
+           "\"dispatch_us\":{\"total\":%" G_GINT64_FORMAT
+           ",\"mean\":%" G_GINT64_FORMAT
+           ",\"max\":%" G_GINT64_FORMAT "},"
+           "\"authorized\":%u,\"pending\":%u",
+           rp->records->len, present, rp->replayed, rp->skipped,
+           duration, rp->uevents,
+           rp->dispatch_total,
+           rp->dispatch_total / MAX (rp->uevents, 1),
+           rp->dispatch_max,
+           n, g_hash_table_size (rp->pending));
+
+  if (n > 0)
+    g_print (",\"latency_us\":{\"min\":%" G_GINT64_FORMAT
+             ",\"median\":%" G_GINT64_FORMAT
+             ",\"p95\":%" G_GINT64_FORMAT
+             ",\"max\":%" G_GINT64_FORMAT "}",
+             g_array_index (rp->latency, gint64, 0),
+             g_array_index (rp->latency, gint64, n / 2),
+             g_array_index (rp->latency, gint64, (n * 95) / 100),
+             g_array_index (rp->latency, gint64, n - 1));
+
+  g_print ("}\n");
+}
+
+int
+main (int argc, char **argv)
+{
+  g_autoptr(GOptionContext) optctx = NULL;
+  g_autoptr(GTestDBus) bus = NULL;
+  g_autoptr(GError) err = NULL;
+  g_autofree char *dbpath = NULL;
+  Replay rp = {NULL, };
+  gboolean enroll = FALSE;
+  gboolean verbose = FALSE;
+  gdouble speed = 1.0;
+  gint wait = 10;
+  gint64 start;
+  guint present;
+  GOptionEntry options[] = {
+    { "speed", 's', 0, G_OPTION_ARG_DOUBLE, &speed, "Replay speed factor, 0 for as fast as possible", "FACTOR" },
+    { "enroll", 'e', 0, G_OPTION_ARG_NONE, &enroll, "Enroll all recorded devices with the 'auto' policy", NULL },
+    { "wait", 'w', 0, G_OPTION_ARG_INT, &wait, "Seconds to wait for pending authorizations at the end", "SECONDS" },
+    { "verbose", 'v', 0, G_OPTION_ARG_NONE, &verbose, "Print debug output", NULL },
+    { NULL }
+  };
+
+  setlocale (LC_ALL, "");
+
+  optctx = g_option_context_new ("RECORDING - replay a uevent recording");
+  g_option_context_add_main_entries (optctx, options, NULL);
+
+  if (!g_option_context_parse (optctx, &argc, &argv, &err) || argc != 2)
+    {
+      g_printerr ("%s\n", err ? err->message : "missing or too many arguments");
+      return EXIT_FAILURE;
+    }
+
+  g_resources_register (bolt_daemon_get_resource ());
+  bolt_log_set_debug (verbose);
+
+  rp.records = bolt_record_load (argv[1], &err);
+
+  if (rp.records == NULL)
+    {
+      g_printerr ("could not load recording: %s\n", err->message);
+      return EXIT_FAILURE;
+    }
+
+  /* private store, pre-populated on request */
+  dbpath = g_dir_make_tmp ("bolt.replay.XXXXXX", &err);
+
+  if (dbpath == NULL)
+    {
+      g_printerr ("could not create store: %s\n", err->message);
+      return EXIT_FAILURE;
+    }
+
+  g_setenv ("BOLT_DBPATH", dbpath, TRUE);
+
+  if (enroll)
+    replay_enroll (rp.records, dbpath);
+
+  /* polkit needs a system bus, even if it is never asked */
+  if (g_getenv ("DBUS_SYSTEM_BUS_ADDRESS") == NULL)
+    {
+      bus = g_test_dbus_new (G_TEST_DBUS_NONE);
+      g_test_dbus_up (bus);
+      g_setenv ("DBUS_SYSTEM_BUS_ADDRESS", g_test_dbus_get_bus_address (bus), TRUE);
+    }
+
+  rp.speed = speed;
+  rp.wait = (guint) MAX (wait, 0);
+  rp.sysfs = mock_sysfs_new ();
+  rp.domains = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  rp.devices = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  rp.pending = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  rp.latency = g_array_new (FALSE, FALSE, sizeof (gint64));
+  rp.loop = g_main_loop_new (NULL, FALSE);
+
+  /* the devices that were there before the daemon started */
+  for (rp.next = 0; rp.next < rp.records->len; rp.next++)
+    {
+      BoltRecord *rec = g_ptr_array_index (rp.records, rp.next);
+
+      if (!bolt_streq (rec->action, BOLT_RECORD_PRESENT))
+        break;
+
+      replay_apply (&rp, rec, FALSE);
+    }
+
+  present = rp.next;
+
+  if (rp.next < rp.records->len)
+    rp.base = ((BoltRecord *) g_ptr_array_index (rp.records, rp.next))->time;
+
+  rp.udev = bolt_udev_new ("udev", NULL, &err);
+
+  if (rp.udev == NULL)
+    {
+      g_printerr ("could not create udev monitor: %s\n", err->message);
+      return EXIT_FAILURE;
+    }
+
+  /* subscription order is dispatch order */
+  bolt_udev_subscribe (rp.udev,
+                       BOLT_UDEV_SUBSYSTEM_ANY,
+                       BOLT_UDEV_DEVTYPE_ANY,
+                       replay_uevent_begin,
+                       &rp);
+
+  rp.manager = g_initable_new (BOLT_TYPE_MANAGER, NULL, &err,
+                               "udev", rp.udev,
+                               NULL);
+
+  if (rp.manager == NULL)
+    {
+      g_printerr ("could not create manager: %s\n", err->message);
+      return EXIT_FAILURE;
+    }
+
+  bolt_udev_subscribe (rp.udev,
+                       BOLT_UDEV_SUBSYSTEM_ANY,
+                       BOLT_UDEV_DEVTYPE_ANY,
+                       replay_uevent_end,
+                       &rp);
+
+  start = rp.start = g_get_monotonic_time ();
+
+  replay_schedule (&rp);
+
+  g_main_loop_run (rp.loop);
+
+  replay_report (&rp, present, g_get_monotonic_time () - start);
+
+  bolt_udev_unsubscribe_by_data (rp.udev, &rp);
+  g_clear_object (&rp.manager);
+  g_clear_object (&rp.udev);
+  g_clear_object (&rp.sysfs);
+
+  g_hash_table_destroy (rp.domains);
+  g_hash_table_destroy (rp.devices);
+  g_hash_table_destroy (rp.pending);
+  g_array_unref (rp.latency);
+  g_main_loop_unref (rp.loop);
+  g_ptr_array_unref (rp.records);
+
+  if (!bolt_fs_cleanup_dir (dbpath, &err))
+    g_printerr ("could not clean up store: %s\n", err->message);
+
+  if (bus != NULL)
+    g_test_dbus_down (bus);
+
+  return EXIT_SUCCESS;
+}
@@ -32,6 +32,7 @@
 #include <sys/stat.h>
 
 typedef struct _MockDomain MockDomain;
+typedef struct _MockDevice MockDevice;
 
 struct _MockDomain
 {
@@ -40,14 +41,38 @@ struct _MockDomain
   char *idstr;
   char *path;
 
-  gint  devices;
+  /* the host is the first device */
+  GPtrArray *devices;
 };
 
+struct _MockDevice
+{
+  MockDomain *domain;
+  MockDevice *parent;
+
+  char       *path;
+  char       *uid;
+  guint64     route;
+  guint       depth;
+};
+
+static void
+mock_device_destroy (gpointer data)
+{
+  MockDevice *dev = data;
+
+  g_free (dev->path);
+  g_free (dev->uid);
+  g_free (dev);
+}
+
 static void
 mock_domain_destory (gpointer data)
 {
   MockDomain *domain = data;
 
+  g_ptr_array_unref (domain->devices);
+  g_free (domain->idstr);
   g_free (domain->path);
   g_free (domain);
 }
@@ -62,6 +87,7 @@ struct _MockSysfs
   /* state tracking */
   char       *force_power;
   GHashTable *domains;
+  GHashTable *devices; /* syspath -> MockDevice */
 };
 
 
@@ -86,6 +112,7 @@ mock_sysfs_finalize (GObject *object)
   MockSysfs *ms = MOCK_SYSFS (object);
 
   g_clear_object (&ms->bed);
+  g_clear_pointer (&ms->devices, g_hash_table_unref);
   g_clear_pointer (&ms->domains, g_hash_table_unref);
 
   G_OBJECT_CLASS (mock_sysfs_parent_class)->finalize (object);
@@ -102,6 +129,7 @@ mock_sysfs_init (MockSysfs *ms)
   ms->bed = umockdev_testbed_new ();
   ms->domains = g_hash_table_new_full (g_str_hash, g_str_equal,
                                        NULL, mock_domain_destory);
+  ms->devices = g_hash_table_new (g_str_hash, g_str_equal);
 
   /* udev_enumerate_scan_devices() will return -ENOENT, if
    * sys/bus or sys/class directories can not be found
@@ -310,9 +338,10 @@ mock_sysfs_domain_add (MockSysfs   *ms,
 
   domain = g_new0 (MockDomain, 1);
 
-  domain->id = 0;
-  domain->idstr = path;
+  domain->id = id;
+  domain->idstr = idstr;
   domain->path = path;
+  domain->devices = g_ptr_array_new_with_free_func (mock_device_destroy);
 
   g_hash_table_insert (ms->domains, idstr, domain);
 
@@ -333,7 +362,7 @@ mock_sysfs_domain_get_syspath (MockSysfs  *ms,
   if (domain == NULL)
     return NULL;
 
-  return domain->idstr;
+  return domain->path;
 }
 
 gboolean
@@ -350,6 +379,12 @@ mock_sysfs_domain_remove (MockSysfs  *ms,
   if (domain == NULL)
     return FALSE;
 
+  if (domain->devices->len > 0)
+    {
+      MockDevice *host = g_ptr_array_index (domain->devices, 0);
+      mock_sysfs_device_remove (ms, host->path);
+    }
+
   umockdev_testbed_uevent (ms->bed, domain->path, "remove");
   umockdev_testbed_remove_device (ms->bed, domain->path);
 
@@ -357,3 +392,333 @@ mock_sysfs_domain_remove (MockSysfs  *ms,
 
   return TRUE;
 }
+
+/* public methods: devices */
+
+static MockDevice *
+mock_device_add (MockSysfs  *ms,
+                 MockDomain *domain,
+                 MockDevice *parent,
+                 guint       port,
+                 const char *name,
+                 const char *uid,
+                 gint        authorized,
+                 const char *key,
+                 gint        boot)
+{
+  const char *props[] = {"DEVTYPE", "thunderbolt_device", NULL};
+  const char *attrs[17];
+  g_autofree char *sysname = NULL;
+  g_autofree char *auth = NULL;
+  g_autofree char *bootstr = NULL;
+  MockDevice *dev;
+  const char *parent_path;
+  guint64 route = 0;
+  guint depth = 0;
+  guint n = 0;
+  char *path;
+
+  if (parent != NULL)
+    {
+      depth = parent->depth + 1;
+      route = parent->route | ((guint64) port << (8 * parent->depth));
+      parent_path = parent->path;
+    }
+  else
+    {
+      parent_path = domain->path;
+    }
+
+  sysname = g_strdup_printf ("%u-%" G_GINT64_MODIFIER "x", domain->id, route);
+  auth = g_strdup_printf ("%d", authorized);
+
+  attrs[n++] = "device_name";
+  attrs[n++] = name;
+  attrs[n++] = "device";
+  attrs[n++] = "0x23";
+  attrs[n++] = "vendor_name";
+  attrs[n++] = "GNOME.org";
+  attrs[n++] = "vendor";
+  attrs[n++] = "0x23";
+  attrs[n++] = "authorized";
+  attrs[n++] = auth;
+
+  dev = g_new0 (MockDevice, 1);
+
+  if (uid != NULL)
+    dev->uid = g_strdup (uid);
+  else /* stable, so tests can predict them */
+    dev->uid = g_strdup_printf ("%08x-0000-4000-8000-%012" G_GINT64_MODIFIER "x",
+                                domain->id, route);
+
+  attrs[n++] = "unique_id";
+  attrs[n++] = dev->uid;
+
+  if (key != NULL)
+    {
+      attrs[n++] = "key";
+      attrs[n++] = key;
+    }
+
+  if (boot > -1)
+    {
+      bootstr = g_strdup_printf ("%d", boot);
+      attrs[n++] = "boot";
+      attrs[n++] = bootstr;
+    }
+
+  attrs[n] = NULL;
+
+  path = umockdev_testbed_add_devicev (ms->bed, "thunderbolt", sysname,
+                                       parent_path, attrs, props);
+
+  if (path == NULL)
+    {
+      mock_device_destroy (dev);
+      return NULL;
+    }
+
+  dev->domain = domain;
+  dev->parent = parent;
+  dev->path = path;
+  dev->route = route;
+  dev->depth = depth;
+
+  g_ptr_array_add (domain->devices, dev);
+  g_hash_table_insert (ms->devices, dev->path, dev);
+
+  return dev;
+}
+
+const char *
+mock_sysfs_host_add (MockSysfs  *ms,
+                     const char *domain,
+                     const char *uid)
+{
+  MockDomain *dom;
+  MockDevice *dev;
+
+  g_return_val_if_fail (MOCK_IS_SYSFS (ms), NULL);
+  g_return_val_if_fail (domain != NULL, NULL);
+
+  dom = g_hash_table_lookup (ms->domains, domain);
+
+  g_return_val_if_fail (dom != NULL, NULL);
+  g_return_val_if_fail (dom->devices->len == 0, NULL);
+
+  dev = mock_device_add (ms, dom, NULL, 0, "Host", uid, 1, NULL, -1);
+
+  return dev ? dev->path : NULL;
+}
+
+const char *
+mock_sysfs_device_add (MockSysfs  *ms,
+                       const char *parent,
+                       guint       port,
+                       const char *name,
+                       const char *uid,
+                       gint        authorized,
+                       const char *key,
+                       gint        boot)
+{
+  MockDevice *pdev;
+  MockDevice *dev;
+
+  g_return_val_if_fail (MOCK_IS_SYSFS (ms), NULL);
+  g_return_val_if_fail (parent != NULL, NULL);
+  g_return_val_if_fail (port > 0 && port <= MOCK_ROUTE_MAX_PORT, NULL);
+
+  pdev = g_hash_table_lookup (ms->devices, parent);
+
+  g_return_val_if_fail (pdev != NULL, NULL);
+  g_return_val_if_fail (pdev->depth < MOCK_ROUTE_MAX_DEPTH, NULL);
+
+  dev = mock_device_add (ms, pdev->domain, pdev, port,
+                         name, uid, authorized, key, boot);
+
+  return dev ? dev->path : NULL;
+}
+
+const char *
+mock_sysfs_device_get_uid (MockSysfs  *ms,
+                           const char *syspath)
+{
+  MockDevice *dev;
+
+  g_return_val_if_fail (MOCK_IS_SYSFS (ms), NULL);
+  g_return_val_if_fail (syspath != NULL, NULL);
+
+  dev = g_hash_table_lookup (ms->devices, syspath);
+
+  return dev ? dev->uid : NULL;
+}
+
+gboolean
+mock_sysfs_device_authorize (MockSysfs  *ms,
+                             const char *syspath,
+                             gint        level)
+{
+  g_autofree char *auth = NULL;
+
+  g_return_val_if_fail (MOCK_IS_SYSFS (ms), FALSE);
+  g_return_val_if_fail (syspath != NULL, FALSE);
+
+  if (!g_hash_table_contains (ms->devices, syspath))
+    return FALSE;
+
+  auth = g_strdup_printf ("%d", level);
+  umockdev_testbed_set_attribute (ms->bed, syspath, "authorized", auth);
+  umockdev_testbed_uevent (ms->bed, syspath, "change");
+
+  return TRUE;
+}
+
+gboolean
+mock_sysfs_device_remove (MockSysfs  *ms,
+                          const char *syspath)
+{
+  MockDomain *domain;
+  MockDevice *dev;
+
+  g_return_val_if_fail (MOCK_IS_SYSFS (ms), FALSE);
+  g_return_val_if_fail (syspath != NULL, FALSE);
+
+  dev = g_hash_table_lookup (ms->devices, syspath);
+
+  if (dev == NULL)
+    return FALSE;
+
+  domain = dev->domain;
+
+  /* children were added after their parents, so going
+   * backwards removes the leaves first, like the kernel */
+  for (guint i = domain->devices->len; i > 0; i--)
+    {
+      MockDevice *iter = g_ptr_array_index (domain->devices, i - 1);
+      MockDevice *p = iter;
+
+      while (p != NULL && p != dev)
+        p = p->parent;
+
+      if (p == NULL)
+        continue;
+
+      umockdev_testbed_uevent (ms->bed, iter->path, "remove");
+      umockdev_testbed_remove_device (ms->bed, iter->path);
+
+      g_hash_table_remove (ms->devices, iter->path);
+      g_ptr_array_remove_index (domain->devices, i - 1);
+    }
+
+  return TRUE;
+}
+
+GPtrArray *
+mock_sysfs_device_list (MockSysfs  *ms,
+                        const char *domain)
+{
+  MockDomain *dom;
+  GPtrArray *res;
+
+  g_return_val_if_fail (MOCK_IS_SYSFS (ms), NULL);
+  g_return_val_if_fail (domain != NULL, NULL);
+
+  dom = g_hash_table_lookup (ms->domains, domain);
+
+  if (dom == NULL)
+    return NULL;
+
+  res = g_ptr_array_sized_new (dom->devices->len);
+
+  for (guint i = 0; i < dom->devices->len; i++)
+    {
+      MockDevice *dev = g_ptr_array_index (dom->devices, i);
+      g_ptr_array_add (res, dev->path);
+    }
+
+  return res;
+}
+
+/* public methods: topologies */
+
+static void
+mock_tree_grow (MockSysfs      *ms,
+                MockDomain     *domain,
+                const MockTree *tree)
+{
+  /* breadth first: new devices are appended to the list
+   * that is being walked, so every level is complete, and
+   * its uevents sent, before the next one is started */
+  for (guint i = 0; i < domain->devices->len; i++)
+    {
+      MockDevice *parent = g_ptr_array_index (domain->devices, i);
+
+      if (parent->depth >= tree->depth)
+        break;
+
+      for (guint port = 1; port <= tree->fanout; port++)
+        {
+          g_autofree char *name = NULL;
+          MockDevice *dev;
+
+          name = g_strdup_printf ("Mock %u.%u", parent->depth + 1, port);
+          dev = mock_device_add (ms, domain, parent, port,
+                                 name, NULL,
+                                 tree->authorized,
+                                 tree->key ? "" : NULL,
+                                 tree->boot);
+
+          if (dev == NULL)
+            g_warning ("could not add device at port %u", port);
+        }
+    }
+}
+
+const char *
+mock_sysfs_tree_add (MockSysfs      *ms,
+                     const MockTree *tree)
+{
+  MockDomain *domain;
+  MockDevice *host;
+  const char *id;
+
+  g_return_val_if_fail (MOCK_IS_SYSFS (ms), NULL);
+  g_return_val_if_fail (tree != NULL, NULL);
+  g_return_val_if_fail (tree->depth <= MOCK_ROUTE_MAX_DEPTH, NULL);
+  g_return_val_if_fail (tree->fanout <= MOCK_ROUTE_MAX_PORT, NULL);
+
+  id = mock_sysfs_domain_add (ms, tree->security);
+
+  if (id == NULL)
+    return NULL;
+
+  domain = g_hash_table_lookup (ms->domains, id);
+  host = mock_device_add (ms, domain, NULL, 0, "Host", NULL, 1, NULL, -1);
+
+  if (host == NULL)
+    {
+      mock_sysfs_domain_remove (ms, id);
+      return NULL;
+    }
+
+  mock_tree_grow (ms, domain, tree);
+
+  return id;
+}
+
+guint
+mock_tree_count_devices (const MockTree *tree)
+{
+  guint n = 0;
+  guint level = 1;
+
+  g_return_val_if_fail (tree != NULL, 0);
+
+  for (guint i = 0; i < tree->depth; i++)
+    {
+      level *= tree->fanout;
+      n += level;
+    }
+
+  return n;
+}
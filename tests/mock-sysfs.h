@@ -54,6 +54,58 @@ const char *     mock_sysfs_domain_get_syspath (MockSysfs  *ms,
 gboolean         mock_sysfs_domain_remove (MockSysfs  *ms,
                                            const char *id);
 
+/* every hop in the route string is one byte, which
+ * limits the depth of the tree below the host */
+#define MOCK_ROUTE_MAX_DEPTH 6
+#define MOCK_ROUTE_MAX_PORT 63
+
+/* devices: 'key' is the content of the key attribute, which
+ * is missing if NULL; 'boot' is omitted if negative */
+const char *     mock_sysfs_host_add (MockSysfs  *ms,
+                                      const char *domain,
+                                      const char *uid);
+
+const char *     mock_sysfs_device_add (MockSysfs  *ms,
+                                        const char *parent,
+                                        guint       port,
+                                        const char *name,
+                                        const char *uid,
+                                        gint        authorized,
+                                        const char *key,
+                                        gint        boot);
+
+const char *     mock_sysfs_device_get_uid (MockSysfs  *ms,
+                                            const char *syspath);
+
+gboolean         mock_sysfs_device_authorize (MockSysfs  *ms,
+                                              const char *syspath,
+                                              gint        level);
+
+gboolean         mock_sysfs_device_remove (MockSysfs  *ms,
+                                           const char *syspath);
+
+GPtrArray *      mock_sysfs_device_list (MockSysfs  *ms,
+                                         const char *domain);
+
+/* topologies: a domain with a host and 'depth' levels of
+ * devices below it, each host or device has 'fanout' children */
+typedef struct MockTree
+{
+  BoltSecurity security;
+  guint        depth;
+  guint        fanout;
+
+  /* for all devices but the host */
+  gint         authorized;
+  gboolean     key;
+  gint         boot;
+} MockTree;
+
+const char *     mock_sysfs_tree_add (MockSysfs      *ms,
+                                      const MockTree *tree);
+
+guint            mock_tree_count_devices (const MockTree *tree);
+
 /* helper macro */
 
 /* *INDENT-OFF* */
@@ -0,0 +1,805 @@
+/*
+ * Copyright © 2018 Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *       Christian J. Kellner <christian@kellner.me>
+ */
+
+#include "config.h"
+
+#include "bolt-client.h"
+
+#include "bolt-json.h"
+#include "bolt-names.h"
+#include "bolt-str.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include <locale.h>
+#include <math.h>
+#include <string.h>
+
+/* every method call to the mock daemon is answered after
+ * MOCK_LATENCY milliseconds, so the time needed to list N
+ * objects one by one is at least (N + 1) * MOCK_LATENCY */
+#define MOCK_LATENCY 100
+#define MOCK_DEVICES 16
+#define MOCK_DOMAINS 4
+
+#define MOCK_DEVICE_PATH "/org/freedesktop/bolt/devices/"
+#define MOCK_DOMAIN_PATH "/org/freedesktop/bolt/domains/"
+
+typedef struct
+{
+  /* mock daemon */
+  GDBusConnection *server;
+  guint            filter_id;
+  guint            n_devices;
+  guint            n_domains;
+  gboolean         fail_list;
+  gint             inflight;
+  gint             max_inflight;
+
+  /* direct peer connections */
+  GDBusServer     *peer;
+  char            *peer_dir;
+  char            *peer_path;
+
+  /* client */
+  BoltClient *client;
+} TestClient;
+
+typedef struct
+{
+  TestClient   *tt;
+  GDBusMessage *call;
+} MockCall;
+
+static void
+got_result (GObject      *source,
+            GAsyncResult *res,
+            gpointer      user_data)
+{
+  GAsyncResult **out = user_data;
+
+  *out = g_object_ref (res);
+}
+
+static void
+wait_for_result (GAsyncResult **res)
+{
+  while (*res == NULL)
+    g_main_context_iteration (NULL, TRUE);
+}
+
+static GVariant *
+mock_list_paths (const char *prefix,
+                 const char *name,
+                 guint       n)
+{
+  GVariantBuilder b;
+
+  g_variant_builder_init (&b, G_VARIANT_TYPE ("ao"));
+
+  for (guint i = 0; i < n; i++)
+    {
+      g_autofree char *p = g_strdup_printf ("%s%s%02u", prefix, name, i);
+      g_variant_builder_add (&b, "o", p);
+    }
+
+  return g_variant_new ("(ao)", &b);
+}
+
+static GVariant *
+mock_get_all (const char *path)
+{
+  GVariantBuilder b;
+
+  g_variant_builder_init (&b, G_VARIANT_TYPE ("a{sv}"));
+
+  if (g_str_has_prefix (path, MOCK_DEVICE_PATH "dev"))
+    {
+      const char *idx = path + strlen (MOCK_DEVICE_PATH "dev");
+      g_autofree char *uid = g_strdup_printf ("uid-%s", idx);
+
+      g_variant_builder_add (&b, "{sv}", "Uid", g_variant_new_string (uid));
+      g_variant_builder_add (&b, "{sv}", "Name", g_variant_new_string ("Mock"));
+    }
+  else if (g_str_has_prefix (path, MOCK_DOMAIN_PATH "domain"))
+    {
+      const char *id = path + strlen (MOCK_DOMAIN_PATH);
+
+      g_variant_builder_add (&b, "{sv}", "Id", g_variant_new_string (id));
+    }
+  else if (bolt_streq (path, BOLT_DBUS_PATH))
+    {
+      g_variant_builder_add (&b, "{sv}", "Version",
+                             g_variant_new_uint32 (BOLT_DBUS_API_VERSION));
+    }
+
+  return g_variant_new ("(a{sv})", &b);
+}
+
+static gboolean
+mock_bus_reply (gpointer user_data)
+{
+  g_autoptr(GDBusMessage) reply = NULL;
+  MockCall *mc = user_data;
+  TestClient *tt = mc->tt;
+  GVariant *body = NULL;
+  const char *member;
+  const char *path;
+
+  member = g_dbus_message_get_member (mc->call);
+  path = g_dbus_message_get_path (mc->call);
+
+  if (tt->fail_list && g_str_has_prefix (member, "List"))
+    body = NULL;
+  else if (bolt_streq (member, "ListDevices"))
+    body = mock_list_paths (MOCK_DEVICE_PATH, "dev", tt->n_devices);
+  else if (bolt_streq (member, "ListDomains"))
+    body = mock_list_paths (MOCK_DOMAIN_PATH, "domain", tt->n_domains);
+  else if (bolt_streq (member, "GetAll"))
+    body = mock_get_all (path);
+
+  if (body != NULL)
+    {
+      reply = g_dbus_message_new_method_reply (mc->call);
+      g_dbus_message_set_body (reply, body);
+    }
+  else
+    {
+      reply = g_dbus_message_new_method_error_literal (mc->call,
+                                                       "org.freedesktop.DBus.Error.AccessDenied",
+                                                       "mock access denied");
+    }
+
+  g_dbus_connection_send_message (tt->server, reply,
+                                  G_DBUS_SEND_MESSAGE_FLAGS_NONE,
+                                  NULL, NULL);
+
+  g_object_unref (mc->call);
+  g_free (mc);
+
+  g_atomic_int_add (&tt->inflight, -1);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* called in the GDBus worker thread */
+static GDBusMessage *
+mock_bus_filter (GDBusConnection *connection,
+                 GDBusMessage    *message,
+                 gboolean         incoming,
+                 gpointer         user_data)
+{
+  g_autoptr(GSource) source = NULL;
+  TestClient *tt = user_data;
+  GDBusMessageType type;
+  MockCall *mc;
+  gint max;
+  gint n;
+
+  type = g_dbus_message_get_message_type (message);
+
+  if (!incoming || type != G_DBUS_MESSAGE_TYPE_METHOD_CALL)
+    return message;
+
+  n = g_atomic_int_add (&tt->inflight, 1) + 1;
+
+  do
+    max = g_atomic_int_get (&tt->max_inflight);
+  while (n > max && !g_atomic_int_compare_and_exchange (&tt->max_inflight, max, n));
+
+  mc = g_new0 (MockCall, 1);
+  mc->tt = tt;
+  mc->call = message;
+
+  source = g_timeout_source_new (MOCK_LATENCY);
+  g_source_set_callback (source, mock_bus_reply, mc, NULL);
+  g_source_attach (source, NULL);
+
+  return NULL;
+}
+
+static void
+test_client_connect (TestClient *tt)
+{
+  g_autoptr(GAsyncResult) res = NULL;
+  g_autoptr(GError) err = NULL;
+  GDBusConnection *bus;
+
+  bolt_client_new_async (NULL, got_result, &res);
+  wait_for_result (&res);
+
+  tt->client = bolt_client_new_finish (res, &err);
+  g_assert_no_error (err);
+  g_assert_nonnull (tt->client);
+
+  bus = g_dbus_proxy_get_connection (G_DBUS_PROXY (tt->client));
+  g_dbus_connection_set_exit_on_close (bus, FALSE);
+
+  g_assert_cmpuint (bolt_client_get_version (tt->client), ==, BOLT_DBUS_API_VERSION);
+
+  g_atomic_int_set (&tt->max_inflight, 0);
+}
+
+static void
+test_client_setup (TestClient *tt, gconstpointer data)
+{
+  g_autoptr(GVariant) val = NULL;
+  g_autoptr(GError) err = NULL;
+  const char *address;
+
+  tt->n_devices = MOCK_DEVICES;
+  tt->n_domains = MOCK_DOMAINS;
+
+  address = g_getenv ("DBUS_SYSTEM_BUS_ADDRESS");
+  tt->server = g_dbus_connection_new_for_address_sync (address,
+                                                       G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                                       G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+                                                       NULL, NULL, &err);
+  g_assert_no_error (err);
+  g_assert_nonnull (tt->server);
+
+  val = g_dbus_connection_call_sync (tt->server,
+                                     "org.freedesktop.DBus",
+                                     "/org/freedesktop/DBus",
+                                     "org.freedesktop.DBus",
+                                     "RequestName",
+                                     g_variant_new ("(su)", BOLT_DBUS_NAME, 0),
+                                     G_VARIANT_TYPE ("(u)"),
+                                     G_DBUS_CALL_FLAGS_NONE,
+                                     -1, NULL, &err);
+  g_assert_no_error (err);
+  g_assert_nonnull (val);
+
+  tt->filter_id = g_dbus_connection_add_filter (tt->server,
+                                                mock_bus_filter,
+                                                tt, NULL);
+
+  test_client_connect (tt);
+}
+
+static gboolean
+mock_peer_new_connection (GDBusServer     *server,
+                          GDBusConnection *connection,
+                          gpointer         user_data)
+{
+  TestClient *tt = user_data;
+
+  g_assert_null (tt->server);
+
+  tt->server = g_object_ref (connection);
+  tt->filter_id = g_dbus_connection_add_filter (tt->server,
+                                                mock_bus_filter,
+                                                tt, NULL);
+  return TRUE;
+}
+
+static void
+test_client_peer_setup (TestClient *tt, gconstpointer data)
+{
+  g_autoptr(GError) err = NULL;
+  g_autofree char *escaped = NULL;
+  g_autofree char *address = NULL;
+  g_autofree char *guid = NULL;
+
+  tt->n_devices = MOCK_DEVICES;
+  tt->n_domains = MOCK_DOMAINS;
+
+  tt->peer_dir = g_dir_make_tmp ("bolt.client.XXXXXX", &err);
+  g_assert_no_error (err);
+
+  tt->peer_path = g_build_filename (tt->peer_dir, BOLT_PEER_SOCKET_NAME, NULL);
+  escaped = g_dbus_address_escape_value (tt->peer_path);
+  address = g_strdup_printf ("unix:path=%s", escaped);
+  guid = g_dbus_generate_guid ();
+
+  tt->peer = g_dbus_server_new_sync (address,
+                                     G_DBUS_SERVER_FLAGS_NONE,
+                                     guid, NULL, NULL, &err);
+  g_assert_no_error (err);
+  g_assert_nonnull (tt->peer);
+
+  g_signal_connect (tt->peer, "new-connection",
+                    G_CALLBACK (mock_peer_new_connection), tt);
+  g_dbus_server_start (tt->peer);
+
+  g_setenv ("BOLT_PEER_SOCKET", tt->peer_path, TRUE);
+  test_client_connect (tt);
+}
+
+static void
+test_client_tear_down (TestClient *tt, gconstpointer user)
+{
+  while (g_atomic_int_get (&tt->inflight) > 0)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_clear_object (&tt->client);
+
+  g_dbus_connection_remove_filter (tt->server, tt->filter_id);
+  g_dbus_connection_close_sync (tt->server, NULL, NULL);
+  g_clear_object (&tt->server);
+}
+
+static void
+test_client_peer_tear_down (TestClient *tt, gconstpointer user)
+{
+  test_client_tear_down (tt, user);
+
+  g_dbus_server_stop (tt->peer);
+  g_clear_object (&tt->peer);
+
+  g_unlink (tt->peer_path);
+  g_rmdir (tt->peer_dir);
+  g_clear_pointer (&tt->peer_path, g_free);
+  g_clear_pointer (&tt->peer_dir, g_free);
+
+  g_setenv ("BOLT_PEER_SOCKET", "", TRUE);
+}
+
+static void
+test_client_list_devices (TestClient *tt, gconstpointer user)
+{
+  g_autoptr(GAsyncResult) res = NULL;
+  g_autoptr(GPtrArray) devices = NULL;
+  g_autoptr(GError) err = NULL;
+  gint64 start;
+  gint64 elapsed;
+
+  start = g_get_monotonic_time ();
+
+  bolt_client_list_devices_async (tt->client, NULL, got_result, &res);
+  wait_for_result (&res);
+
+  devices = bolt_client_list_devices_finish (tt->client, res, &err);
+  elapsed = (g_get_monotonic_time () - start) / 1000;
+
+  g_assert_no_error (err);
+  g_assert_nonnull (devices);
+  g_assert_cmpuint (devices->len, ==, MOCK_DEVICES);
+
+  /* the result is in the order the daemon returned the paths */
+  for (guint i = 0; i < devices->len; i++)
+    {
+      g_autofree char *uid = g_strdup_printf ("uid-%02u", i);
+      BoltDevice *dev = g_ptr_array_index (devices, i);
+
+      g_assert_true (BOLT_IS_DEVICE (dev));
+      g_assert_cmpstr (bolt_device_get_uid (dev), ==, uid);
+      g_assert_cmpstr (bolt_device_get_name (dev), ==, "Mock");
+    }
+
+  /* all proxies were initialized concurrently */
+  g_assert_cmpint (g_atomic_int_get (&tt->max_inflight), ==, MOCK_DEVICES);
+  g_assert_cmpint (elapsed, <, (MOCK_DEVICES + 1) * MOCK_LATENCY);
+}
+
+static void
+test_client_list_domains (TestClient *tt, gconstpointer user)
+{
+  g_autoptr(GAsyncResult) res = NULL;
+  g_autoptr(GPtrArray) domains = NULL;
+  g_autoptr(GError) err = NULL;
+
+  bolt_client_list_domains_async (tt->client, NULL, got_result, &res);
+  wait_for_result (&res);
+
+  domains = bolt_client_list_domains_finish (tt->client, res, &err);
+
+  g_assert_no_error (err);
+  g_assert_nonnull (domains);
+  g_assert_cmpuint (domains->len, ==, MOCK_DOMAINS);
+
+  for (guint i = 0; i < domains->len; i++)
+    {
+      g_autofree char *id = g_strdup_printf ("domain%02u", i);
+      BoltDomain *dom = g_ptr_array_index (domains, i);
+
+      g_assert_true (BOLT_IS_DOMAIN (dom));
+      g_assert_cmpstr (bolt_domain_get_id (dom), ==, id);
+    }
+
+  g_assert_cmpint (g_atomic_int_get (&tt->max_inflight), ==, MOCK_DOMAINS);
+}
+
+static void
+test_client_list_empty (TestClient *tt, gconstpointer user)
+{
+  g_autoptr(GAsyncResult) res = NULL;
+  g_autoptr(GPtrArray) devices = NULL;
+  g_autoptr(GError) err = NULL;
+
+  tt->n_devices = 0;
+
+  bolt_client_list_devices_async (tt->client, NULL, got_result, &res);
+  wait_for_result (&res);
+
+  devices = bolt_client_list_devices_finish (tt->client, res, &err);
+
+  g_assert_no_error (err);
+  g_assert_nonnull (devices);
+  g_assert_cmpuint (devices->len, ==, 0);
+}
+
+static void
+test_client_list_error (TestClient *tt, gconstpointer user)
+{
+  g_autoptr(GAsyncResult) res = NULL;
+  g_autoptr(GPtrArray) devices = NULL;
+  g_autoptr(GError) err = NULL;
+
+  tt->fail_list = TRUE;
+
+  bolt_client_list_devices_async (tt->client, NULL, got_result, &res);
+  wait_for_result (&res);
+
+  devices = bolt_client_list_devices_finish (tt->client, res, &err);
+
+  g_assert_error (err, G_DBUS_ERROR, G_DBUS_ERROR_ACCESS_DENIED);
+  g_assert_null (devices);
+  g_assert_false (g_dbus_error_is_remote_error (err));
+}
+
+static void
+mock_emit_changed (TestClient *tt,
+                   const char *uid,
+                   const char *status,
+                   const char *name)
+{
+  g_autofree char *opath = NULL;
+  g_autoptr(GError) err = NULL;
+  GVariantBuilder b;
+  gboolean ok;
+
+  opath = bolt_device_path_for_uid (uid);
+  g_variant_builder_init (&b, G_VARIANT_TYPE_VARDICT);
+
+  if (status)
+    g_variant_builder_add (&b, "{sv}", "Status", g_variant_new_string (status));
+
+  if (name)
+    g_variant_builder_add (&b, "{sv}", "Name", g_variant_new_string (name));
+
+  ok = g_dbus_connection_emit_signal (tt->server, NULL, opath,
+                                      "org.freedesktop.DBus.Properties",
+                                      "PropertiesChanged",
+                                      g_variant_new ("(sa{sv}as)",
+                                                     BOLT_DBUS_DEVICE_INTERFACE,
+                                                     &b, NULL),
+                                      &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+}
+
+static void
+handle_changed (BoltClient *client,
+                const char *opath,
+                GVariant   *changed,
+                gpointer    user_data)
+{
+  GPtrArray *events = user_data;
+  g_autofree char *str = g_variant_print (changed, FALSE);
+  char *ev = g_strdup_printf ("%s %s", opath, str);
+
+  g_ptr_array_add (events, ev);
+}
+
+static void
+test_client_subscribe (TestClient *tt, gconstpointer user)
+{
+  g_autoptr(GPtrArray) events = NULL;
+  g_autoptr(GVariant) val = NULL;
+  g_autoptr(GError) err = NULL;
+  g_autofree char *expected = NULL;
+  g_autofree char *opath = NULL;
+  const char *uids[] = {"dev-00", NULL};
+  const char *props[] = {"Status", NULL};
+  GDBusConnection *bus;
+  guint id;
+
+  opath = bolt_device_path_for_uid ("dev-00");
+  g_assert_cmpstr (opath, ==, BOLT_DBUS_PATH_DEVICES "/dev_00");
+
+  events = g_ptr_array_new_with_free_func (g_free);
+  id = bolt_client_subscribe_devices (tt->client, uids, props,
+                                      handle_changed, events, NULL);
+  g_assert_cmpuint (id, >, 0);
+
+  /* a round trip to the bus makes sure the match rules are in place */
+  bus = g_dbus_proxy_get_connection (G_DBUS_PROXY (tt->client));
+  val = g_dbus_connection_call_sync (bus,
+                                     "org.freedesktop.DBus",
+                                     "/org/freedesktop/DBus",
+                                     "org.freedesktop.DBus",
+                                     "GetId",
+                                     NULL, NULL,
+                                     G_DBUS_CALL_FLAGS_NONE,
+                                     -1, NULL, &err);
+  g_assert_no_error (err);
+
+  /* another device, a property that is not allowed, and
+   * finally a change of which only Status must be seen */
+  mock_emit_changed (tt, "dev-01", "authorized", NULL);
+  mock_emit_changed (tt, "dev-00", NULL, "Renamed");
+  mock_emit_changed (tt, "dev-00", "authorized", "Renamed");
+
+  while (events->len < 1)
+    g_main_context_iteration (NULL, TRUE);
+
+  expected = g_strdup_printf ("%s {'Status': <'authorized'>}", opath);
+  g_assert_cmpuint (events->len, ==, 1);
+  g_assert_cmpstr (g_ptr_array_index (events, 0), ==, expected);
+
+  bolt_client_unsubscribe (tt->client, id);
+}
+
+static void
+test_client_peer (TestClient *tt, gconstpointer user)
+{
+  g_autoptr(GAsyncResult) res = NULL;
+  g_autoptr(GPtrArray) devices = NULL;
+  g_autoptr(GError) err = NULL;
+  GDBusConnection *bus;
+
+  /* no bus daemon in between, so no names either */
+  bus = g_dbus_proxy_get_connection (G_DBUS_PROXY (tt->client));
+  g_assert_null (g_dbus_connection_get_unique_name (bus));
+  g_assert_null (g_dbus_proxy_get_name (G_DBUS_PROXY (tt->client)));
+  g_assert_true (bolt_proxy_has_name_owner (BOLT_PROXY (tt->client)));
+
+  bolt_client_list_devices_async (tt->client, NULL, got_result, &res);
+  wait_for_result (&res);
+
+  devices = bolt_client_list_devices_finish (tt->client, res, &err);
+
+  g_assert_no_error (err);
+  g_assert_nonnull (devices);
+  g_assert_cmpuint (devices->len, ==, MOCK_DEVICES);
+
+  for (guint i = 0; i < devices->len; i++)
+    {
+      BoltDevice *dev = g_ptr_array_index (devices, i);
+      g_assert_null (g_dbus_proxy_get_name (G_DBUS_PROXY (dev)));
+    }
+}
+
+static void
+test_client_peer_fallback (TestClient *tt, gconstpointer user)
+{
+  g_autoptr(BoltClient) client = NULL;
+  g_autoptr(GAsyncResult) res = NULL;
+  g_autoptr(GError) err = NULL;
+
+  /* the socket does not exist: use the system bus */
+  g_setenv ("BOLT_PEER_SOCKET", "/nonexistent/bolt/" BOLT_PEER_SOCKET_NAME, TRUE);
+
+  bolt_client_new_async (NULL, got_result, &res);
+  wait_for_result (&res);
+
+  client = bolt_client_new_finish (res, &err);
+  g_setenv ("BOLT_PEER_SOCKET", "", TRUE);
+
+  g_assert_no_error (err);
+  g_assert_nonnull (client);
+
+  g_assert_cmpstr (g_dbus_proxy_get_name (G_DBUS_PROXY (client)), ==, BOLT_DBUS_NAME);
+  g_assert_cmpuint (bolt_client_get_version (client), ==, BOLT_DBUS_API_VERSION);
+}
+
+static char *
+json_string (const char *str)
+{
+  GString *out = g_string_new (NULL);
+
+  bolt_json_append_string (out, str);
+
+  return g_string_free (out, FALSE);
+}
+
+static char *
+json_variant (GVariant *v)
+{
+  g_autoptr(GVariant) sunk = g_variant_ref_sink (v);
+  GString *out = g_string_new (NULL);
+
+  bolt_json_append_variant (out, sunk);
+
+  return g_string_free (out, FALSE);
+}
+
+static void
+test_client_json_string (TestClient *tt, gconstpointer user)
+{
+  struct
+  {
+    const char *in;
+    const char *out;
+  } table[] = {
+    {"",                      "\"\""},
+    {"plain",                 "\"plain\""},
+    {"say \"hi\"",            "\"say \\\"hi\\\"\""},
+    {"back\\slash",           "\"back\\\\slash\""},
+    {"a\nb\tc",               "\"a\\nb\\tc\""},
+    {"\r\x01\x1f\x7f",        "\"\\u000d\\u0001\\u001f\\u007f\""},
+    {"Gr\xc3\xbc\xc3\x9f",    "\"Gr\xc3\xbc\xc3\x9f\""}, /* Gruess */
+    {"\xe2\x9a\xa1 dock",     "\"\xe2\x9a\xa1 dock\""},  /* U+26A1 */
+    {"\xf0\x9f\x94\x8c",      "\"\xf0\x9f\x94\x8c\""},  /* U+1F50C */
+    {"bad\xff",               "\"bad\\ufffd\""},
+    {"cut\xe2\x9a",           "\"cut\\ufffd\\ufffd\""},
+  };
+
+  for (guint i = 0; i < G_N_ELEMENTS (table); i++)
+    {
+      g_autofree char *res = json_string (table[i].in);
+
+      g_assert_cmpstr (res, ==, table[i].out);
+      g_assert_true (g_utf8_validate (res, -1, NULL));
+    }
+}
+
+static void
+test_client_json_variant (TestClient *tt, gconstpointer user)
+{
+  g_autoptr(GVariantBuilder) dict = NULL;
+  char *res;
+
+  res = json_variant (g_variant_new_boolean (TRUE));
+  g_assert_cmpstr (res, ==, "true");
+  g_free (res);
+
+  res = json_variant (g_variant_new_uint64 (G_MAXUINT64));
+  g_assert_cmpstr (res, ==, "18446744073709551615");
+  g_free (res);
+
+  res = json_variant (g_variant_new_int32 (-42));
+  g_assert_cmpstr (res, ==, "-42");
+  g_free (res);
+
+  res = json_variant (g_variant_new_double (0.5));
+  g_assert_cmpstr (res, ==, "0.5");
+  g_free (res);
+
+  res = json_variant (g_variant_new_double (INFINITY));
+  g_assert_cmpstr (res, ==, "null");
+  g_free (res);
+
+  res = json_variant (g_variant_new_object_path ("/org/freedesktop/bolt"));
+  g_assert_cmpstr (res, ==, "\"/org/freedesktop/bolt\"");
+  g_free (res);
+
+  res = json_variant (g_variant_new_variant (g_variant_new_string ("\"q\"")));
+  g_assert_cmpstr (res, ==, "\"\\\"q\\\"\"");
+  g_free (res);
+
+  res = json_variant (g_variant_new ("(sub)", "a\nb", 7, FALSE));
+  g_assert_cmpstr (res, ==, "[\"a\\nb\", 7, false]");
+  g_free (res);
+
+  res = json_variant (g_variant_new ("as", NULL));
+  g_assert_cmpstr (res, ==, "[]");
+  g_free (res);
+
+  res = json_variant (g_variant_new ("ms", NULL));
+  g_assert_cmpstr (res, ==, "null");
+  g_free (res);
+
+  /* dictionaries become objects, keys are escaped as well */
+  dict = g_variant_builder_new (G_VARIANT_TYPE ("a{sv}"));
+  g_variant_builder_add (dict, "{sv}", "Label", g_variant_new_string ("Gr\xc3\xbc\xc3\x9f\x01"));
+  g_variant_builder_add (dict, "{sv}", "key \"x\"", g_variant_new_uint32 (1));
+
+  res = json_variant (g_variant_builder_end (dict));
+  g_assert_cmpstr (res, ==,
+                   "{\"Label\": \"Gr\xc3\xbc\xc3\x9f\\u0001\", "
+                   "\"key \\\"x\\\"\": 1}");
+  g_free (res);
+
+  res = json_variant (g_variant_new_parsed ("{1: 'one'}"));
+  g_assert_cmpstr (res, ==, "{\"1\": \"one\"}");
+  g_free (res);
+}
+
+int
+main (int argc, char **argv)
+{
+  g_autoptr(GTestDBus) bus = NULL;
+  int res;
+
+  setlocale (LC_ALL, "");
+
+  g_test_init (&argc, &argv, NULL);
+
+  /* the client talks to the system bus, if not connected directly */
+  bus = g_test_dbus_new (G_TEST_DBUS_NONE);
+  g_test_dbus_up (bus);
+  g_setenv ("DBUS_SYSTEM_BUS_ADDRESS", g_test_dbus_get_bus_address (bus), TRUE);
+
+  /* unless a test asks for it, do not try a direct connection */
+  g_setenv ("BOLT_PEER_SOCKET", "", TRUE);
+
+  g_test_add ("/client/list/devices",
+              TestClient,
+              NULL,
+              test_client_setup,
+              test_client_list_devices,
+              test_client_tear_down);
+
+  g_test_add ("/client/list/domains",
+              TestClient,
+              NULL,
+              test_client_setup,
+              test_client_list_domains,
+              test_client_tear_down);
+
+  g_test_add ("/client/list/empty",
+              TestClient,
+              NULL,
+              test_client_setup,
+              test_client_list_empty,
+              test_client_tear_down);
+
+  g_test_add ("/client/list/error",
+              TestClient,
+              NULL,
+              test_client_setup,
+              test_client_list_error,
+              test_client_tear_down);
+
+  g_test_add ("/client/subscribe",
+              TestClient,
+              NULL,
+              test_client_setup,
+              test_client_subscribe,
+              test_client_tear_down);
+
+  g_test_add ("/client/peer/connect",
+              TestClient,
+              NULL,
+              test_client_peer_setup,
+              test_client_peer,
+              test_client_peer_tear_down);
+
+  g_test_add ("/client/peer/fallback",
+              TestClient,
+              NULL,
+              test_client_setup,
+              test_client_peer_fallback,
+              test_client_tear_down);
+
+  g_test_add ("/client/json/string",
+              TestClient,
+              NULL,
+              NULL,
+              test_client_json_string,
+              NULL);
+
+  g_test_add ("/client/json/variant",
+              TestClient,
+              NULL,
+              NULL,
+              test_client_json_variant,
+              NULL);
+
+  res = g_test_run ();
+
+  g_test_dbus_down (bus);
+
+  return res;
+}
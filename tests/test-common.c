@@ -27,6 +27,7 @@
 #include "bolt-list.h"
 #include "bolt-rnd.h"
 #include "bolt-str.h"
+#include "bolt-unix.h"
 
 #include "test-enums.h"
 
@@ -34,6 +35,7 @@
 #include <gio/gio.h>
 #include <glib/gprintf.h>
 
+#include <errno.h>
 #include <fcntl.h>
 #include <locale.h>
 #include <string.h>
@@ -523,6 +525,61 @@ test_io_file_write_all (TestIO *tt, gconstpointer user_data)
   g_assert_true (strncmp (data, ref, 5) == 0);
 }
 
+static void
+test_io_read_attrs (TestIO *tt, gconstpointer user_data)
+{
+  g_autoptr(GError) error = NULL;
+  g_autoptr(DIR) d = NULL;
+  g_autofree char *path = NULL;
+  g_autofree char *big = NULL;
+  BoltAttr attrs[4];
+  guint n;
+  gboolean ok;
+
+  path = g_build_filename (tt->path, "authorized", NULL);
+  ok = g_file_set_contents (path, "1\n", -1, &error);
+  g_assert_no_error (error);
+  g_assert_true (ok);
+  g_clear_pointer (&path, g_free);
+
+  path = g_build_filename (tt->path, "key", NULL);
+  ok = g_file_set_contents (path, "\n", -1, &error);
+  g_assert_no_error (error);
+  g_assert_true (ok);
+  g_clear_pointer (&path, g_free);
+
+  big = g_strnfill (BOLT_ATTR_VALUE_MAX * 2, 'a');
+  path = g_build_filename (tt->path, "big", NULL);
+  ok = g_file_set_contents (path, big, -1, &error);
+  g_assert_no_error (error);
+  g_assert_true (ok);
+
+  d = bolt_opendir (tt->path, &error);
+  g_assert_no_error (error);
+  g_assert_nonnull (d);
+
+  attrs[0].name = "authorized";
+  attrs[1].name = "key";
+  attrs[2].name = "nonexistent";
+  attrs[3].name = "big";
+
+  n = bolt_read_attrs_at (dirfd (d), attrs, G_N_ELEMENTS (attrs));
+  g_assert_cmpuint (n, ==, 3);
+
+  g_assert_cmpint (attrs[0].len, ==, 1);
+  g_assert_cmpstr (attrs[0].value, ==, "1");
+
+  g_assert_cmpint (attrs[1].len, ==, 0);
+  g_assert_cmpstr (attrs[1].value, ==, "");
+
+  g_assert_cmpint (attrs[2].len, ==, -ENOENT);
+  g_assert_cmpstr (attrs[2].value, ==, "");
+
+  /* too long: truncated */
+  g_assert_cmpint (attrs[3].len, ==, BOLT_ATTR_VALUE_MAX - 1);
+  g_assert_cmpuint (strlen (attrs[3].value), ==, BOLT_ATTR_VALUE_MAX - 1);
+}
+
 static void
 test_autoclose (TestIO *tt, gconstpointer user_data)
 {
@@ -960,6 +1017,34 @@ test_swap (TestRng *tt, gconstpointer user_data)
   g_assert_cmpint (*pa, ==, ib);
 }
 
+static void
+test_unix_start_time (TestRng *tt, gconstpointer user_data)
+{
+  g_autoptr(GError) err = NULL;
+  guint64 self;
+  guint64 again;
+  guint64 parent;
+
+  self = bolt_pid_get_start_time (getpid (), &err);
+  g_assert_no_error (err);
+  g_assert_cmpuint (self, >, 0);
+
+  /* stable for the same process */
+  again = bolt_pid_get_start_time (getpid (), &err);
+  g_assert_no_error (err);
+  g_assert_cmpuint (again, ==, self);
+
+  /* the parent was started before us */
+  parent = bolt_pid_get_start_time (getppid (), &err);
+  g_assert_no_error (err);
+  g_assert_cmpuint (parent, <=, self);
+
+  /* pid_max is at most 2^22 */
+  parent = bolt_pid_get_start_time ((pid_t) (1 << 23), &err);
+  g_assert_nonnull (err);
+  g_assert_cmpuint (parent, ==, 0);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -1003,6 +1088,13 @@ main (int argc, char **argv)
               test_io_file_write_all,
               test_io_tear_down);
 
+  g_test_add ("/common/io/read_attrs",
+              TestIO,
+              NULL,
+              test_io_setup,
+              test_io_read_attrs,
+              test_io_tear_down);
+
   g_test_add ("/common/io/autoclose",
               TestIO,
               NULL,
@@ -1080,5 +1172,12 @@ main (int argc, char **argv)
               test_swap,
               NULL);
 
+  g_test_add ("/common/unix/start_time",
+              TestRng,
+              NULL,
+              NULL,
+              test_unix_start_time,
+              NULL);
+
   return g_test_run ();
 }
@@ -24,6 +24,8 @@
 
 #include "bolt-enums.h"
 #include "bolt-error.h"
+#include "bolt-fs.h"
+#include "bolt-peer.h"
 #include "bolt-str.h"
 
 #include "bolt-test-resources.h"
@@ -32,7 +34,10 @@
 #include <gio/gio.h>
 #include <glib/gprintf.h>
 
+#include <grp.h>
 #include <locale.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 /* *** Tiny object with only an "id" property */
 #define BT_TYPE_ID bt_id_get_type ()
@@ -1163,6 +1168,91 @@ test_exported_props_object (TestExported *tt, gconstpointer data)
   g_assert_error (ctx->error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS);
 }
 
+static void
+peer_connected (GObject      *source,
+                GAsyncResult *res,
+                gpointer      user_data)
+{
+  GDBusConnection **connection = user_data;
+  g_autoptr(GError) err = NULL;
+
+  *connection = g_dbus_connection_new_for_address_finish (res, &err);
+  g_assert_no_error (err);
+}
+
+static void
+peer_check_socket (const char *path,
+                   const char *group)
+{
+  g_autoptr(GDBusConnection) client = NULL;
+  g_autoptr(GError) err = NULL;
+  g_autofree char *address = NULL;
+  struct stat st;
+  gboolean ok;
+  int r;
+
+  ok = bolt_peer_server_start (path, group, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+  g_assert_true (bolt_peer_server_is_active ());
+
+  r = stat (path, &st);
+  g_assert_cmpint (r, ==, 0);
+
+  if (group == NULL)
+    {
+      g_assert_cmpuint (st.st_mode & 0777, ==, 0600);
+    }
+  else
+    {
+      g_assert_cmpuint (st.st_mode & 0777, ==, 0660);
+      g_assert_cmpuint (st.st_gid, ==, getgrnam (group)->gr_gid);
+    }
+
+  address = g_strdup_printf ("unix:path=%s", path);
+  g_dbus_connection_new_for_address (address,
+                                     G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT,
+                                     NULL, NULL,
+                                     peer_connected, &client);
+
+  while (client == NULL || bolt_peer_server_count_clients () == 0)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_cmpuint (bolt_peer_server_count_clients (), ==, 1);
+
+  bolt_peer_server_stop ();
+  g_assert_false (bolt_peer_server_is_active ());
+  g_assert_false (g_file_test (path, G_FILE_TEST_EXISTS));
+}
+
+static void
+test_exported_peer (TestExported *tt, gconstpointer data)
+{
+  g_autoptr(GError) err = NULL;
+  g_autofree char *dir = NULL;
+  g_autofree char *path = NULL;
+  struct group *gr;
+  mode_t mask;
+
+  dir = g_dir_make_tmp ("bolt.peer.XXXXXX", &err);
+  g_assert_no_error (err);
+
+  path = g_build_filename (dir, "peer.socket", NULL);
+
+  /* the umask must not matter for the socket */
+  mask = umask (0);
+
+  peer_check_socket (path, NULL);
+
+  gr = getgrgid (getegid ());
+  if (gr != NULL)
+    peer_check_socket (path, gr->gr_name);
+
+  umask (mask);
+
+  bolt_fs_cleanup_dir (dir, NULL);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -1216,6 +1306,13 @@ main (int argc, char **argv)
               test_exported_props_object,
               test_exported_teardown);
 
+  g_test_add ("/exported/peer",
+              TestExported,
+              NULL,
+              NULL,
+              test_exported_peer,
+              NULL);
+
   test_bus = g_test_dbus_new (G_TEST_DBUS_NONE);
   g_test_dbus_up (test_bus);
   g_assert_nonnull (test_bus);
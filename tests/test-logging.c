@@ -26,16 +26,20 @@
 #include "bolt-term.h"
 
 #include "bolt-log.h"
+#include "bolt-trace.h"
 
 #include "bolt-daemon-resource.h"
 
 #include <glib.h>
 #include <gio/gio.h>
 #include <glib/gprintf.h>
+#include <glib/gstdio.h>
 
 #include <locale.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 
 typedef struct _LogData
 {
@@ -241,6 +245,573 @@ test_log_macros (TestLog *tt, gconstpointer user_data)
   bolt_bug (msg);
 }
 
+static GLogWriterOutput
+counting_writer (GLogLevelFlags   log_level,
+                 const GLogField *fields,
+                 gsize            n_fields,
+                 gpointer         user_data)
+{
+  guint *count = user_data;
+
+  (*count)++;
+
+  return G_LOG_WRITER_HANDLED;
+}
+
+static const char *
+count_evaluation (guint *evaluated)
+{
+  (*evaluated)++;
+  return "evaluated";
+}
+
+static void
+test_log_mask (TestLog *tt, gconstpointer user_data)
+{
+  GLogLevelFlags mask;
+  guint evaluated = 0;
+  guint count = 0;
+
+  mask = bolt_log_get_level_mask ();
+  g_log_set_writer_func (counting_writer, &count, NULL);
+
+  /* everything enabled by default */
+  bolt_debug ("%s", count_evaluation (&evaluated));
+  g_assert_cmpuint (evaluated, ==, 1);
+  g_assert_cmpuint (count, ==, 1);
+
+  /* disabled debug: arguments must not be evaluated */
+  bolt_log_set_debug (FALSE);
+  g_assert_false (bolt_log_level_enabled (G_LOG_LEVEL_DEBUG));
+
+  bolt_debug ("%s", count_evaluation (&evaluated));
+  bolt_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "direct");
+  g_assert_cmpuint (evaluated, ==, 1);
+  g_assert_cmpuint (count, ==, 1);
+
+  /* warnings can not be disabled */
+  bolt_log_set_level_mask (0);
+  g_assert_true (bolt_log_level_enabled (G_LOG_LEVEL_WARNING));
+  g_assert_false (bolt_log_level_enabled (G_LOG_LEVEL_INFO));
+
+  bolt_info ("%s", count_evaluation (&evaluated));
+  bolt_msg ("message");
+  g_assert_cmpuint (evaluated, ==, 1);
+  g_assert_cmpuint (count, ==, 1);
+
+  /* live re-enabling */
+  bolt_log_set_level_mask (G_LOG_LEVEL_MASK);
+  bolt_debug (LOG_TOPIC ("udev"), "debug");
+  bolt_msg ("message");
+  g_assert_cmpuint (count, ==, 3);
+
+  /* topic filter */
+  bolt_log_set_debug_topics ("dbus,power");
+  g_assert_true (bolt_log_topic_enabled ("dbus"));
+  g_assert_true (bolt_log_topic_enabled ("power"));
+  g_assert_false (bolt_log_topic_enabled ("udev"));
+  g_assert_false (bolt_log_topic_enabled (NULL));
+
+  bolt_debug (LOG_TOPIC ("udev"), "debug");
+  bolt_debug ("no topic");
+  g_assert_cmpuint (count, ==, 3);
+
+  /* filtered by topic before the arguments are evaluated */
+  bolt_debug (LOG_TOPIC ("udev"), "%s", count_evaluation (&evaluated));
+  g_assert_cmpuint (evaluated, ==, 1);
+  g_assert_cmpuint (count, ==, 3);
+
+  bolt_debug (LOG_TOPIC ("power"), "%s", count_evaluation (&evaluated));
+  g_assert_cmpuint (evaluated, ==, 2);
+  g_assert_cmpuint (count, ==, 4);
+
+  bolt_debug (LOG_TOPIC ("power"), "debug");
+  g_assert_cmpuint (count, ==, 5);
+
+  /* only debug messages are filtered by topic */
+  bolt_info (LOG_TOPIC ("udev"), "info");
+  g_assert_cmpuint (count, ==, 6);
+
+  bolt_log_set_debug_topics (NULL);
+  g_assert_true (bolt_log_topic_enabled ("udev"));
+  bolt_debug (LOG_TOPIC ("udev"), "debug");
+  g_assert_cmpuint (count, ==, 7);
+
+  bolt_log_set_level_mask (mask);
+  g_log_set_writer_func (g_log_writer_standard_streams, NULL, NULL);
+}
+
+typedef struct
+{
+  GMutex lock;
+  guint  count;
+  char   last[256];
+  char   domain[64];
+  char   file[64];
+} AsyncSink;
+
+static GLogWriterOutput
+async_sink (GLogLevelFlags   log_level,
+            const GLogField *fields,
+            gsize            n_fields,
+            gpointer         user_data)
+{
+  AsyncSink *sink = user_data;
+
+  g_mutex_lock (&sink->lock);
+
+  sink->count++;
+
+  for (gsize i = 0; i < n_fields; i++)
+    if (bolt_streq (fields[i].key, "MESSAGE"))
+      g_strlcpy (sink->last, fields[i].value, sizeof (sink->last));
+    else if (bolt_streq (fields[i].key, "GLIB_DOMAIN"))
+      g_strlcpy (sink->domain, fields[i].value, sizeof (sink->domain));
+    else if (bolt_streq (fields[i].key, "CODE_FILE"))
+      g_strlcpy (sink->file, fields[i].value, sizeof (sink->file));
+
+  g_mutex_unlock (&sink->lock);
+
+  return G_LOG_WRITER_HANDLED;
+}
+
+static void
+async_push (const char *message)
+{
+  g_autoptr(BoltLogCtx) ctx = NULL;
+  GLogField fields[] = {
+    {"MESSAGE", message, -1},
+    {"PRIORITY", "5", -1},
+    {"GLIB_DOMAIN", "bolt-test", -1},
+  };
+  GLogWriterOutput res;
+
+  ctx = bolt_log_ctx_acquire (fields, G_N_ELEMENTS (fields));
+  g_assert_nonnull (ctx);
+
+  res = bolt_log_async_push (ctx, G_LOG_LEVEL_MESSAGE);
+  g_assert_cmpint (res, ==, G_LOG_WRITER_HANDLED);
+}
+
+/* like the daemon's writer */
+static GLogWriterOutput
+async_writer (GLogLevelFlags   log_level,
+              const GLogField *fields,
+              gsize            n_fields,
+              gpointer         user_data)
+{
+  g_autoptr(BoltLogCtx) ctx = NULL;
+
+  ctx = bolt_log_ctx_acquire (fields, n_fields);
+
+  if (ctx == NULL)
+    return G_LOG_WRITER_UNHANDLED;
+
+  return bolt_log_async_push (ctx, log_level);
+}
+
+static void
+test_log_async (TestLog *tt, gconstpointer user_data)
+{
+  g_autoptr(GError) err = NULL;
+  AsyncSink sink = {0, };
+  gboolean ok;
+  guint dropped;
+
+  g_mutex_init (&sink.lock);
+
+  g_assert_false (bolt_log_async_is_active ());
+
+  ok = bolt_log_async_start (4, async_sink, &sink, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+  g_assert_true (bolt_log_async_is_active ());
+
+  async_push ("one");
+  async_push ("two");
+  bolt_log_async_flush ();
+
+  g_assert_cmpuint (sink.count, ==, 2);
+  g_assert_cmpstr (sink.last, ==, "two");
+  g_assert_cmpuint (bolt_log_async_get_dropped (), ==, 0);
+
+  /* messages from other libraries keep all their fields */
+  g_log_set_writer_func (async_writer, NULL, NULL);
+  g_log_structured ("bolt-foreign", G_LOG_LEVEL_MESSAGE,
+                    "CODE_FILE", "gdbusconnection.c",
+                    "CODE_LINE", "42",
+                    "MESSAGE", "foreign %d", 3);
+  g_log_set_writer_func (g_log_writer_standard_streams, NULL, NULL);
+  bolt_log_async_flush ();
+
+  g_assert_cmpuint (sink.count, ==, 3);
+  g_assert_cmpstr (sink.last, ==, "foreign 3");
+  g_assert_cmpstr (sink.domain, ==, "bolt-foreign");
+  g_assert_cmpstr (sink.file, ==, "gdbusconnection.c");
+
+  /* block the writer thread, so that the ring fills up */
+  g_mutex_lock (&sink.lock);
+
+  for (guint i = 0; i < 16; i++)
+    async_push ("spam");
+
+  dropped = bolt_log_async_get_dropped ();
+  g_assert_cmpuint (dropped, >, 0);
+
+  g_mutex_unlock (&sink.lock);
+  bolt_log_async_flush ();
+
+  /* every message was either written or dropped */
+  g_assert_cmpuint (sink.count + dropped, ==, 3 + 16);
+  g_assert_cmpstr (sink.last, ==, "spam");
+
+  bolt_log_async_stop ();
+  g_assert_false (bolt_log_async_is_active ());
+
+  g_mutex_clear (&sink.lock);
+}
+
+static gboolean
+flight_find (GVariant   *events,
+             const char *needle,
+             const char *topic,
+             guint      *level)
+{
+  const char *t, *msgid, *uid, *location, *message;
+  GVariantIter iter;
+  gint64 time;
+  guint l;
+
+  g_variant_iter_init (&iter, events);
+  while (g_variant_iter_next (&iter, "(xu&s&s&s&s&s)",
+                              &time, &l, &t, &msgid,
+                              &uid, &location, &message))
+    {
+      if (!strstr (message, needle) && !strstr (location, needle))
+        continue;
+
+      if (topic)
+        g_assert_cmpstr (t, ==, topic);
+
+      if (level)
+        *level = l;
+
+      return TRUE;
+    }
+
+  return FALSE;
+}
+
+static void
+flight_disabled_site (void)
+{
+  bolt_debug (LOG_TOPIC ("probing"),
+              LOG_DEV_UID ("flight-uid"),
+              "never formatted, %s", "argument");
+}
+
+static void
+test_log_flight (TestLog *tt, gconstpointer user_data)
+{
+  g_autoptr(GVariant) events = NULL;
+  GLogLevelFlags mask;
+  guint count = 0;
+  guint level;
+
+  mask = bolt_log_get_level_mask ();
+  g_log_set_writer_func (counting_writer, &count, NULL);
+
+  bolt_log_flight_clear ();
+  events = g_variant_ref_sink (bolt_log_flight_dump ());
+  g_assert_true (g_variant_is_of_type (events, G_VARIANT_TYPE (BOLT_LOG_FLIGHT_TYPE)));
+  g_assert_cmpuint (g_variant_n_children (events), ==, 0);
+  g_clear_pointer (&events, g_variant_unref);
+
+  /* emitted messages are recorded with their text */
+  bolt_msg (LOG_TOPIC ("flight"), "recorded %d", 42);
+
+  /* disabled ones with their static call site, unformatted */
+  bolt_log_set_debug (FALSE);
+  flight_disabled_site ();
+  bolt_log_set_level_mask (mask);
+
+  events = g_variant_ref_sink (bolt_log_flight_dump ());
+  g_assert_cmpuint (g_variant_n_children (events), ==, 2);
+
+  g_assert_true (flight_find (events, "recorded 42", "flight", &level));
+  g_assert_cmpuint (level, ==, G_LOG_LEVEL_MESSAGE);
+
+  g_assert_true (flight_find (events, "flight_disabled_site", "probing", &level));
+  g_assert_cmpuint (level, ==, G_LOG_LEVEL_DEBUG);
+  g_assert_true (flight_find (events, "never formatted, %s", NULL, NULL));
+  g_assert_false (flight_find (events, "argument", NULL, NULL));
+  g_clear_pointer (&events, g_variant_unref);
+
+  /* the ring wraps around and keeps the latest entries */
+  bolt_log_set_rate_limit (0, 0);
+  for (guint i = 0; i < 2000; i++)
+    bolt_info ("entry %u", i);
+  bolt_log_set_rate_limit (BOLT_LOG_RATELIMIT_BURST,
+                           BOLT_LOG_RATELIMIT_INTERVAL);
+
+  events = g_variant_ref_sink (bolt_log_flight_dump ());
+  g_assert_cmpuint (g_variant_n_children (events), >, 0);
+  g_assert_cmpuint (g_variant_n_children (events), <, 2000);
+  g_assert_true (flight_find (events, "entry 1999", NULL, NULL));
+  g_assert_false (flight_find (events, "recorded 42", NULL, NULL));
+
+  if (g_test_perf ())
+    {
+      const guint n = 1000000;
+      g_autoptr(GTimer) timer = g_timer_new ();
+      gdouble elapsed;
+
+      /* the cost of a disabled call site */
+      bolt_log_set_debug (FALSE);
+
+      for (guint i = 0; i < n; i++)
+        bolt_debug (LOG_TOPIC ("flight"), "entry %u", i);
+
+      bolt_log_set_level_mask (mask);
+
+      elapsed = g_timer_elapsed (timer, NULL);
+      g_test_minimized_result (elapsed * 1e9 / n,
+                               "flight record: %.1f ns/call",
+                               elapsed * 1e9 / n);
+    }
+
+  bolt_log_flight_clear ();
+  g_log_set_writer_func (g_log_writer_standard_streams, NULL, NULL);
+}
+
+typedef struct
+{
+  guint          count;
+  guint          summaries;
+  char           suppressed[16];
+  GLogLevelFlags level;
+} RateLog;
+
+static GLogWriterOutput
+ratelimit_writer (GLogLevelFlags   log_level,
+                  const GLogField *fields,
+                  gsize            n_fields,
+                  gpointer         user_data)
+{
+  RateLog *rl = user_data;
+
+  rl->count++;
+
+  for (gsize i = 0; i < n_fields; i++)
+    if (bolt_streq (fields[i].key, BOLT_LOG_SUPPRESSED))
+      {
+        g_strlcpy (rl->suppressed, fields[i].value, sizeof (rl->suppressed));
+        rl->level = log_level;
+        rl->summaries++;
+      }
+
+  return G_LOG_WRITER_HANDLED;
+}
+
+static void
+ratelimit_storm (const char *uid, guint n)
+{
+  for (guint i = 0; i < n; i++)
+    bolt_info (LOG_DEV_UID (uid), "change event %u", i);
+}
+
+static void
+test_log_ratelimit (TestLog *tt, gconstpointer user_data)
+{
+  g_autoptr(BoltClock) clock = bolt_clock_new_virtual ();
+  g_autofree char *long_a = NULL;
+  g_autofree char *long_b = NULL;
+  RateLog rl = {0, };
+  guint suppressed;
+
+  g_log_set_writer_func (ratelimit_writer, &rl, NULL);
+  bolt_log_set_clock (clock);
+
+  /* disabled */
+  bolt_log_set_rate_limit (0, 1);
+  ratelimit_storm ("a", 10);
+  g_assert_cmpuint (rl.count, ==, 10);
+
+  /* the burst passes, the rest is suppressed */
+  bolt_log_set_rate_limit (3, 1);
+  suppressed = bolt_log_get_suppressed ();
+
+  ratelimit_storm ("a", 10);
+  g_assert_cmpuint (rl.count, ==, 10 + 3);
+  g_assert_cmpuint (bolt_log_get_suppressed () - suppressed, ==, 7);
+
+  /* every device has its own bucket */
+  ratelimit_storm ("b", 10);
+  g_assert_cmpuint (rl.count, ==, 10 + 3 + 3);
+  g_assert_cmpuint (rl.summaries, ==, 0);
+
+  /* once tokens are available again, the suppressed
+   * messages are summarized before the next one */
+  rl.count = 0;
+  bolt_clock_advance (clock, G_USEC_PER_SEC / 2);
+
+  ratelimit_storm ("a", 1);
+  g_assert_cmpuint (rl.summaries, ==, 1);
+  g_assert_cmpuint (rl.count, ==, 2);
+  g_assert_cmpstr (rl.suppressed, ==, "7");
+  g_assert_cmpuint (rl.level & G_LOG_LEVEL_WARNING, !=, 0);
+
+  /* long ids are part of the key as a whole */
+  rl.count = 0;
+  long_a = g_strnfill (200, 'u');
+  long_b = g_strdup_printf ("%.199sv", long_a);
+
+  ratelimit_storm (long_a, 3);
+  ratelimit_storm (long_b, 3);
+  g_assert_cmpuint (rl.count, ==, 6);
+
+  /* warnings are never suppressed */
+  rl.count = 0;
+  suppressed = bolt_log_get_suppressed ();
+
+  for (guint i = 0; i < 10; i++)
+    bolt_warn (LOG_DEV_UID ("a"), "warning %u", i);
+
+  g_assert_cmpuint (rl.count, ==, 10);
+  g_assert_cmpuint (bolt_log_get_suppressed (), ==, suppressed);
+
+  bolt_log_set_clock (NULL);
+  bolt_log_set_rate_limit (BOLT_LOG_RATELIMIT_BURST,
+                           BOLT_LOG_RATELIMIT_INTERVAL);
+  g_log_set_writer_func (g_log_writer_standard_streams, NULL, NULL);
+}
+
+static void
+test_log_ctx_pool (TestLog *tt, gconstpointer user_data)
+{
+  BoltLogCtx *ctx[8];
+  BoltLogCtx *first;
+  GLogField fields[] = {
+    {"MESSAGE", "foreign message", -1},
+    {"PRIORITY", "6", -1},
+    {"CODE_FILE", __FILE__, -1},
+    {"CODE_LINE", G_STRINGIFY (__LINE__), -1},
+    {"GLIB_DOMAIN", "GLib-GIO", -1},
+  };
+  GLogField nomsg[] = {
+    {"PRIORITY", "6", -1},
+  };
+
+  /* contexts for foreign messages are reused */
+  first = bolt_log_ctx_acquire (fields, G_N_ELEMENTS (fields));
+  g_assert_nonnull (first);
+  g_assert_cmpstr (blot_log_ctx_get_domain (first), ==, "GLib-GIO");
+  bolt_log_ctx_free (first);
+
+  ctx[0] = bolt_log_ctx_acquire (fields, G_N_ELEMENTS (fields));
+  g_assert_true (ctx[0] == first);
+  bolt_log_ctx_free (ctx[0]);
+
+  /* nesting deeper than the pool */
+  for (guint i = 0; i < G_N_ELEMENTS (ctx); i++)
+    {
+      ctx[i] = bolt_log_ctx_acquire (fields, G_N_ELEMENTS (fields));
+      g_assert_nonnull (ctx[i]);
+
+      for (guint k = 0; k < i; k++)
+        g_assert_true (ctx[i] != ctx[k]);
+    }
+
+  for (guint i = G_N_ELEMENTS (ctx); i > 0; i--)
+    bolt_log_ctx_free (ctx[i - 1]);
+
+  /* the pool is available again */
+  ctx[0] = bolt_log_ctx_acquire (fields, G_N_ELEMENTS (fields));
+  g_assert_true (ctx[0] == first);
+  bolt_log_ctx_free (ctx[0]);
+
+  /* no message, no context */
+  ctx[0] = bolt_log_ctx_acquire (nomsg, G_N_ELEMENTS (nomsg));
+  g_assert_null (ctx[0]);
+
+  ctx[0] = bolt_log_ctx_acquire (fields, G_N_ELEMENTS (fields));
+  g_assert_true (ctx[0] == first);
+  bolt_log_ctx_free (ctx[0]);
+
+  if (g_test_perf ())
+    {
+      const guint n = 1000000;
+      g_autoptr(GTimer) timer = g_timer_new ();
+      gdouble elapsed;
+
+      for (guint i = 0; i < n; i++)
+        {
+          BoltLogCtx *c = bolt_log_ctx_acquire (fields, G_N_ELEMENTS (fields));
+          bolt_log_ctx_free (c);
+        }
+
+      elapsed = g_timer_elapsed (timer, NULL);
+      g_test_minimized_result (elapsed * 1e9 / n,
+                               "ctx acquire/free: %.1f ns/call",
+                               elapsed * 1e9 / n);
+    }
+}
+
+static void
+trace_span (const char *name)
+{
+  g_auto(BoltTraceSpan) span = BOLT_TRACE_SPAN_ARG ("test", name, "arg", "\"quoted\"");
+
+  g_usleep (10);
+}
+
+static void
+test_log_trace (TestLog *tt, gconstpointer user_data)
+{
+  g_autoptr(GError) err = NULL;
+  g_autofree char *path = NULL;
+  g_autofree char *data = NULL;
+  gboolean ok;
+  int fd;
+
+  fd = g_file_open_tmp ("bolt.trace.XXXXXX", &path, &err);
+  g_assert_no_error (err);
+  g_assert_cmpint (fd, >, -1);
+  close (fd);
+
+  /* not active: nothing is recorded */
+  g_assert_false (bolt_trace_enabled ());
+  trace_span ("disabled");
+
+  ok = bolt_trace_start (path, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+  g_assert_true (bolt_trace_enabled ());
+
+  trace_span ("enabled");
+
+  bolt_trace_stop ();
+  g_assert_false (bolt_trace_enabled ());
+
+  /* spans after stopping are ignored */
+  trace_span ("stopped");
+
+  ok = g_file_get_contents (path, &data, NULL, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  g_assert_true (g_str_has_prefix (data, "[\n"));
+  g_assert_true (g_str_has_suffix (data, "}\n]\n"));
+
+  g_assert_nonnull (strstr (data, "\"name\":\"enabled\",\"cat\":\"test\",\"ph\":\"X\""));
+  g_assert_nonnull (strstr (data, "\"args\":{\"arg\":\"\\\"quoted\\\"\"}"));
+  g_assert_nonnull (strstr (data, "\"thread_name\""));
+  g_assert_null (strstr (data, "\"disabled\""));
+  g_assert_null (strstr (data, "\"stopped\""));
+
+  (void) g_unlink (path);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -279,5 +850,47 @@ main (int argc, char **argv)
               test_log_macros,
               test_log_tear_down);
 
+  g_test_add ("/logging/mask",
+              TestLog,
+              NULL,
+              test_log_setup,
+              test_log_mask,
+              test_log_tear_down);
+
+  g_test_add ("/logging/async",
+              TestLog,
+              NULL,
+              test_log_setup,
+              test_log_async,
+              test_log_tear_down);
+
+  g_test_add ("/logging/flight",
+              TestLog,
+              NULL,
+              test_log_setup,
+              test_log_flight,
+              test_log_tear_down);
+
+  g_test_add ("/logging/ratelimit",
+              TestLog,
+              NULL,
+              test_log_setup,
+              test_log_ratelimit,
+              test_log_tear_down);
+
+  g_test_add ("/logging/ctx_pool",
+              TestLog,
+              NULL,
+              test_log_setup,
+              test_log_ctx_pool,
+              test_log_tear_down);
+
+  g_test_add ("/logging/trace",
+              TestLog,
+              NULL,
+              test_log_setup,
+              test_log_trace,
+              test_log_tear_down);
+
   return g_test_run ();
 }
@@ -0,0 +1,524 @@
+/*
+ * Copyright © 2018 Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *       Christian J. Kellner <christian@kellner.me>
+ */
+
+#include "config.h"
+
+#include "bolt-manager.h"
+
+#include "bolt-clock.h"
+#include "bolt-fs.h"
+#include "bolt-snapshot.h"
+#include "bolt-store.h"
+#include "bolt-str.h"
+#include "bolt-stats.h"
+#include "bolt-udev.h"
+#include "mock-sysfs.h"
+
+#include "bolt-daemon-resource.h"
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include <umockdev.h>
+
+#include <locale.h>
+
+#define DOCK_UID "884c6edd-7118-4b21-b186-b02d396ecca0"
+#define CABLE_UID "e2ee4f2b-a3d3-4c44-9fc2-0d8a96a14fdb"
+
+typedef struct
+{
+  MockSysfs *sysfs;
+  BoltUdev  *udev;
+  BoltClock *clock;
+  char      *dbpath;
+  char      *rundir;
+} TestManager;
+
+
+static void
+test_manager_setup (TestManager *tt, gconstpointer data)
+{
+  g_autoptr(GError) err = NULL;
+
+  bolt_stats_reset ();
+
+  tt->sysfs = mock_sysfs_new ();
+  tt->udev = bolt_udev_new ("udev", NULL, &err);
+
+  g_assert_no_error (err);
+  g_assert_nonnull (tt->udev);
+
+  tt->clock = bolt_clock_new_virtual ();
+
+  tt->dbpath = g_dir_make_tmp ("bolt.manager.db.XXXXXX", &err);
+  g_assert_no_error (err);
+
+  tt->rundir = g_dir_make_tmp ("bolt.manager.run.XXXXXX", &err);
+  g_assert_no_error (err);
+
+  g_setenv ("BOLT_DBPATH", tt->dbpath, TRUE);
+  g_setenv ("BOLT_RUNDIR", tt->rundir, TRUE);
+}
+
+static void
+test_manager_tear_down (TestManager *tt, gconstpointer user)
+{
+  bolt_fs_cleanup_dir (tt->dbpath, NULL);
+  bolt_fs_cleanup_dir (tt->rundir, NULL);
+
+  g_unsetenv ("BOLT_DBPATH");
+  g_unsetenv ("BOLT_RUNDIR");
+
+  g_clear_object (&tt->clock);
+  g_clear_object (&tt->udev);
+  g_clear_object (&tt->sysfs);
+  g_clear_pointer (&tt->dbpath, g_free);
+  g_clear_pointer (&tt->rundir, g_free);
+
+  bolt_stats_reset ();
+}
+
+static BoltManager *
+make_bolt_manager (TestManager *tt)
+{
+  g_autoptr(GError) err = NULL;
+  BoltManager *mgr;
+
+  mgr = g_initable_new (BOLT_TYPE_MANAGER,
+                        NULL, &err,
+                        "udev", tt->udev,
+                        "clock", tt->clock,
+                        NULL);
+
+  g_assert_no_error (err);
+  g_assert_nonnull (mgr);
+
+  return mgr;
+}
+
+static BoltStatus
+manager_device_status (BoltManager *mgr,
+                       const char  *uid)
+{
+  g_autoptr(BoltDevice) dev = NULL;
+  g_autoptr(GError) err = NULL;
+
+  dev = bolt_manager_get_device (mgr, uid, &err);
+
+  if (dev == NULL)
+    {
+      g_assert_error (err, G_IO_ERROR, G_IO_ERROR_NOT_FOUND);
+      return BOLT_STATUS_UNKNOWN;
+    }
+
+  return bolt_device_get_status (dev);
+}
+
+static const char *
+add_dock_and_cable (TestManager *tt,
+                    const char **cable)
+{
+  const char *domain;
+  const char *host;
+  const char *dock;
+
+  domain = mock_sysfs_domain_add (tt->sysfs, BOLT_SECURITY_USER);
+  g_assert_nonnull (domain);
+
+  host = mock_sysfs_host_add (tt->sysfs, domain, NULL);
+  g_assert_nonnull (host);
+
+  dock = mock_sysfs_device_add (tt->sysfs, host, 1, "Dock",
+                                DOCK_UID, 0, NULL, -1);
+  g_assert_nonnull (dock);
+
+  *cable = mock_sysfs_device_add (tt->sysfs, host, 3, "Cable",
+                                  CABLE_UID, 1, NULL, -1);
+  g_assert_nonnull (*cable);
+
+  return dock;
+}
+
+static void
+test_manager_resync (TestManager *tt, gconstpointer user)
+{
+  g_autoptr(UMockdevTestbed) bed = NULL;
+  g_autoptr(BoltManager) mgr = NULL;
+  const char *dock;
+  const char *cable;
+  guint64 overflows;
+  guint64 resyncs = 0;
+
+  dock = add_dock_and_cable (tt, &cable);
+
+  mgr = make_bolt_manager (tt);
+
+  g_assert_cmpint (manager_device_status (mgr, DOCK_UID), ==, BOLT_STATUS_CONNECTED);
+  g_assert_cmpint (manager_device_status (mgr, CABLE_UID), ==, BOLT_STATUS_AUTHORIZED);
+
+  /* changes whose uevents got lost: the dock got
+   * authorized and the cable was unplugged */
+  g_object_get (tt->sysfs, "testbed", &bed, NULL);
+  umockdev_testbed_set_attribute (bed, dock, "authorized", "1");
+  umockdev_testbed_remove_device (bed, cable);
+
+  /* overflows in a row result in a single resync */
+  bolt_udev_inject_overflow (tt->udev);
+  bolt_udev_inject_overflow (tt->udev);
+
+  g_assert_cmpuint (bolt_udev_get_overflows (tt->udev), ==, 2);
+
+  while (bolt_stats_get_overflows (&resyncs) > 0 && resyncs == 0)
+    g_main_context_iteration (NULL, TRUE);
+
+  /* drain whatever else is pending */
+  while (g_main_context_iteration (NULL, FALSE))
+    ;
+
+  overflows = bolt_stats_get_overflows (&resyncs);
+  g_assert_cmpuint (overflows, ==, 2);
+  g_assert_cmpuint (resyncs, ==, 1);
+
+  g_assert_cmpint (manager_device_status (mgr, DOCK_UID), ==, BOLT_STATUS_AUTHORIZED);
+  g_assert_cmpint (manager_device_status (mgr, CABLE_UID), ==, BOLT_STATUS_UNKNOWN);
+}
+
+static gboolean
+manager_is_probing (BoltManager *mgr)
+{
+  gboolean probing;
+
+  g_object_get (mgr, "probing", &probing, NULL);
+
+  return probing;
+}
+
+typedef struct
+{
+  BoltUdevAction action;
+  char          *syspath;
+} UeventWait;
+
+static gboolean
+on_uevent_seen (BoltUdev         *udev,
+                const BoltUevent *event,
+                gpointer          user_data)
+{
+  UeventWait *wait = user_data;
+
+  if (event->action == wait->action &&
+      bolt_streq (event->syspath, wait->syspath))
+    g_clear_pointer (&wait->syspath, g_free);
+
+  return FALSE;
+}
+
+static void
+wait_for_uevent (TestManager   *tt,
+                 BoltUdevAction action,
+                 const char    *syspath)
+{
+  UeventWait wait = {action, g_strdup (syspath)};
+
+  /* subscribed after the manager, i.e. called after it */
+  bolt_udev_subscribe (tt->udev,
+                       BOLT_UDEV_SUBSYSTEM_ANY,
+                       BOLT_UDEV_DEVTYPE_ANY,
+                       on_uevent_seen,
+                       &wait);
+
+  while (wait.syspath != NULL)
+    g_main_context_iteration (NULL, TRUE);
+
+  bolt_udev_unsubscribe_by_data (tt->udev, &wait);
+}
+
+static void
+test_manager_probing (TestManager *tt, gconstpointer user)
+{
+  g_autoptr(UMockdevTestbed) bed = NULL;
+  g_autoptr(BoltManager) mgr = NULL;
+  g_autofree char *root = NULL;
+  g_autofree char *bridge = NULL;
+  g_autofree char *nhi = NULL;
+  g_autofree char *child = NULL;
+
+  mgr = make_bolt_manager (tt);
+  g_assert_false (manager_is_probing (mgr));
+
+  g_object_get (tt->sysfs, "testbed", &bed, NULL);
+
+  /* the thunderbolt controller, two levels below
+   * the pci root that becomes the probing root */
+  root = umockdev_testbed_add_device (bed, "pci", "0000:00:1c.4", NULL,
+                                      NULL, NULL);
+  bridge = umockdev_testbed_add_device (bed, "pci", "0000:05:00.0", root,
+                                        NULL, NULL);
+  nhi = umockdev_testbed_add_device (bed, "pci", "0000:06:00.0", bridge,
+                                     NULL,
+                                     "DRIVER", "thunderbolt",
+                                     NULL);
+  g_assert_nonnull (nhi);
+
+  wait_for_uevent (tt, BOLT_UDEV_ACTION_ADD, nhi);
+  g_assert_true (manager_is_probing (mgr));
+
+  /* the first check happens after half the settle time */
+  bolt_clock_advance (tt->clock, 1000 * 1000 - 1);
+  g_assert_true (manager_is_probing (mgr));
+
+  /* activity below the root, just before the check */
+  child = umockdev_testbed_add_device (bed, "pci", "0000:07:00.0", nhi,
+                                       NULL, NULL);
+  g_assert_nonnull (child);
+
+  wait_for_uevent (tt, BOLT_UDEV_ACTION_ADD, child);
+
+  bolt_clock_advance (tt->clock, 1);
+  g_assert_true (manager_is_probing (mgr));
+
+  /* without the activity this would be the end ... */
+  bolt_clock_advance (tt->clock, 1000 * 1000);
+  g_assert_true (manager_is_probing (mgr));
+
+  /* ... but it is the settle time after the last one */
+  bolt_clock_advance (tt->clock, 1000 * 1000);
+  g_assert_false (manager_is_probing (mgr));
+}
+
+static void
+store_add_device (TestManager *tt,
+                  const char  *uid)
+{
+  g_autoptr(BoltStore) store = NULL;
+  g_autoptr(BoltDevice) dev = NULL;
+  g_autoptr(GError) err = NULL;
+  gboolean ok;
+
+  store = bolt_store_new (tt->dbpath);
+  g_assert_nonnull (store);
+
+  dev = g_object_new (BOLT_TYPE_DEVICE,
+                      "uid", uid,
+                      "name", "Dock",
+                      "vendor", "GNOME.org",
+                      "status", BOLT_STATUS_DISCONNECTED,
+                      NULL);
+
+  ok = bolt_store_put_device (store, dev, BOLT_POLICY_MANUAL, NULL, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+}
+
+static void
+snapshot_save (TestManager *tt,
+               const char  *stamp,
+               const char  *uid)
+{
+  g_autoptr(GError) err = NULL;
+  g_autofree char *path = NULL;
+  GVariantBuilder devices;
+  GVariantBuilder b;
+  gboolean ok;
+
+  g_variant_builder_init (&devices, G_VARIANT_TYPE ("aa{sv}"));
+  g_variant_builder_open (&devices, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&devices, "{sv}", "uid", g_variant_new_string (uid));
+  g_variant_builder_add (&devices, "{sv}", "name", g_variant_new_string ("Cable"));
+  g_variant_builder_add (&devices, "{sv}", "vendor", g_variant_new_string ("GNOME.org"));
+  g_variant_builder_add (&devices, "{sv}", "type", g_variant_new_uint32 (BOLT_DEVICE_PERIPHERAL));
+  g_variant_builder_add (&devices, "{sv}", "policy", g_variant_new_uint32 (BOLT_POLICY_MANUAL));
+  g_variant_builder_add (&devices, "{sv}", "key", g_variant_new_uint32 (BOLT_KEY_MISSING));
+  g_variant_builder_add (&devices, "{sv}", "storetime", g_variant_new_uint64 (1));
+  g_variant_builder_add (&devices, "{sv}", "conntime", g_variant_new_uint64 (2));
+  g_variant_builder_add (&devices, "{sv}", "authtime", g_variant_new_uint64 (3));
+  g_variant_builder_close (&devices);
+
+  g_variant_builder_init (&b, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&b, "{sv}", "store", g_variant_new_string (stamp));
+  g_variant_builder_add (&b, "{sv}", "devices", g_variant_builder_end (&devices));
+
+  path = bolt_snapshot_path ();
+  ok = bolt_snapshot_save (path, g_variant_builder_end (&b), &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+}
+
+static void
+test_manager_restore (TestManager *tt, gconstpointer user)
+{
+  g_autoptr(BoltStore) store = NULL;
+  g_autoptr(BoltManager) mgr = NULL;
+  g_autofree char *stamp = NULL;
+  g_autofree char *path = NULL;
+
+  store_add_device (tt, DOCK_UID);
+
+  store = bolt_store_new (tt->dbpath);
+  stamp = bolt_store_get_stamp (store);
+
+  /* the snapshot only knows the cable, so if it is used
+   * the dock, which is in the store, must be missing */
+  snapshot_save (tt, stamp, CABLE_UID);
+
+  mgr = make_bolt_manager (tt);
+
+  g_assert_cmpint (manager_device_status (mgr, CABLE_UID), ==, BOLT_STATUS_DISCONNECTED);
+  g_assert_cmpint (manager_device_status (mgr, DOCK_UID), ==, BOLT_STATUS_UNKNOWN);
+
+  /* a snapshot is only ever good for one start */
+  path = bolt_snapshot_path ();
+  g_assert_false (g_file_test (path, G_FILE_TEST_EXISTS));
+}
+
+static void
+test_manager_restore_stale (TestManager *tt, gconstpointer user)
+{
+  g_autoptr(BoltManager) mgr = NULL;
+  g_autofree char *path = NULL;
+
+  store_add_device (tt, DOCK_UID);
+
+  /* the store changed after the snapshot was taken */
+  snapshot_save (tt, "1.2:-:-", CABLE_UID);
+
+  mgr = make_bolt_manager (tt);
+
+  g_assert_cmpint (manager_device_status (mgr, DOCK_UID), ==, BOLT_STATUS_DISCONNECTED);
+  g_assert_cmpint (manager_device_status (mgr, CABLE_UID), ==, BOLT_STATUS_UNKNOWN);
+
+  path = bolt_snapshot_path ();
+  g_assert_false (g_file_test (path, G_FILE_TEST_EXISTS));
+}
+
+static void
+on_idle_count (BoltManager *mgr,
+               gpointer     user_data)
+{
+  guint *count = user_data;
+
+  (*count)++;
+}
+
+static void
+test_manager_idle (TestManager *tt, gconstpointer user)
+{
+  g_autoptr(UMockdevTestbed) bed = NULL;
+  g_autoptr(BoltManager) mgr = NULL;
+  const char *dock;
+  const char *cable;
+  guint idle = 0;
+
+  dock = add_dock_and_cable (tt, &cable);
+
+  mgr = make_bolt_manager (tt);
+
+  g_signal_connect (mgr, "idle",
+                    G_CALLBACK (on_idle_count),
+                    &idle);
+
+  /* checked every 2s */
+  bolt_manager_enable_idle_exit (mgr, 8);
+
+  /* connected peripherals keep us busy */
+  bolt_clock_advance (tt->clock, 8 * G_USEC_PER_SEC);
+  g_assert_cmpuint (idle, ==, 0);
+
+  g_object_get (tt->sysfs, "testbed", &bed, NULL);
+  umockdev_testbed_remove_device (bed, dock);
+  umockdev_testbed_remove_device (bed, cable);
+
+  wait_for_uevent (tt, BOLT_UDEV_ACTION_REMOVE, cable);
+
+  /* the timeout starts with the last busy check */
+  bolt_clock_advance (tt->clock, 8 * G_USEC_PER_SEC - 1);
+  g_assert_cmpuint (idle, ==, 0);
+
+  bolt_clock_advance (tt->clock, 1);
+  g_assert_cmpuint (idle, ==, 1);
+
+  /* and it is only ever emitted once */
+  bolt_clock_advance (tt->clock, 16 * G_USEC_PER_SEC);
+  g_assert_cmpuint (idle, ==, 1);
+}
+
+int
+main (int argc, char **argv)
+{
+  g_autoptr(GTestDBus) bus = NULL;
+  int res;
+
+  setlocale (LC_ALL, "");
+
+  g_test_init (&argc, &argv, NULL);
+
+  g_resources_register (bolt_daemon_get_resource ());
+
+  /* the daemon warns about the things missing in the
+   * mock environment, like force power support */
+  g_log_set_always_fatal (G_LOG_FATAL_MASK | G_LOG_LEVEL_CRITICAL);
+
+  /* polkit needs a system bus, even if it is never asked */
+  bus = g_test_dbus_new (G_TEST_DBUS_NONE);
+  g_test_dbus_up (bus);
+  g_setenv ("DBUS_SYSTEM_BUS_ADDRESS", g_test_dbus_get_bus_address (bus), TRUE);
+
+  g_test_add ("/manager/resync",
+              TestManager,
+              NULL,
+              test_manager_setup,
+              test_manager_resync,
+              test_manager_tear_down);
+
+  g_test_add ("/manager/probing",
+              TestManager,
+              NULL,
+              test_manager_setup,
+              test_manager_probing,
+              test_manager_tear_down);
+
+  g_test_add ("/manager/restore",
+              TestManager,
+              NULL,
+              test_manager_setup,
+              test_manager_restore,
+              test_manager_tear_down);
+
+  g_test_add ("/manager/restore/stale",
+              TestManager,
+              NULL,
+              test_manager_setup,
+              test_manager_restore_stale,
+              test_manager_tear_down);
+
+  g_test_add ("/manager/idle",
+              TestManager,
+              NULL,
+              test_manager_setup,
+              test_manager_idle,
+              test_manager_tear_down);
+
+  res = g_test_run ();
+
+  g_test_dbus_down (bus);
+
+  return res;
+}
@@ -106,6 +106,26 @@ make_bolt_power_timeout (TestPower *tt, guint timeout)
   return power;
 }
 
+static BoltPower *
+make_bolt_power_clock (TestPower *tt, guint timeout, BoltClock *clock)
+{
+  g_autoptr(GError) err = NULL;
+  BoltPower *power;
+
+  power =  g_initable_new (BOLT_TYPE_POWER,
+                           NULL, &err,
+                           "udev", tt->udev,
+                           "timeout", timeout,
+                           "rundir", tt->rundir,
+                           "clock", clock,
+                           NULL);
+
+  g_assert_no_error (err);
+  g_assert_nonnull (power);
+
+  return power;
+}
+
 static void
 test_power_basic (TestPower *tt, gconstpointer user)
 {
@@ -306,25 +326,37 @@ on_timeout_warn_quit_loop (gpointer user_data)
   return G_SOURCE_CONTINUE;
 }
 
+static void
+on_notify_count (GObject    *gobject,
+                 GParamSpec *pspec,
+                 gpointer    user_data)
+{
+  guint *count = user_data;
+
+  (*count)++;
+}
+
 static void
 test_power_timeout (TestPower *tt, gconstpointer user)
 {
+  g_autoptr(BoltClock) clock = NULL;
   g_autoptr(BoltPower) power = NULL;
   g_autoptr(GError) err = NULL;
   g_autoptr(BoltPowerGuard) guard = NULL;
-  g_autoptr(GMainLoop) loop = NULL;
   BoltPowerState state;
   gboolean supported;
   gboolean on;
   const char *fp;
   guint timeout;
-  guint tid;
+  guint notified = 0;
+  guint n;
 
   fp = mock_sysfs_force_power_add (tt->sysfs);
   g_assert_nonnull (fp);
 
   /* non-zero timeout */
-  power = make_bolt_power_timeout (tt, 10);
+  clock = bolt_clock_new_virtual ();
+  power = make_bolt_power_clock (tt, 10, clock);
 
   g_object_get (power,
                 "supported", &supported,
@@ -355,21 +387,138 @@ test_power_timeout (TestPower *tt, gconstpointer user)
   on = mock_sysfs_force_power_enabled (tt->sysfs);
   g_assert_true (on);
 
-  loop = g_main_loop_new (NULL, FALSE);
-  tid = g_timeout_add_seconds (5, on_timeout_warn_quit_loop, loop);
   g_signal_connect (power, "notify::state",
-                    G_CALLBACK (on_notify_quit_loop),
-                    loop);
+                    G_CALLBACK (on_notify_count),
+                    &notified);
 
-  /* now we wait for a state change */
-  g_main_loop_run (loop);
-  g_source_remove (tid);
+  /* nothing happens until the timeout is reached */
+  n = bolt_clock_advance (clock, 10 * 1000 - 1);
+  g_assert_cmpuint (n, ==, 0);
+  g_assert_cmpuint (notified, ==, 0);
+
+  state = bolt_power_get_state (power);
+  g_assert (state == BOLT_FORCE_POWER_WAIT);
+
+  /* now exactly the wait timer fires, the reaper does not */
+  n = bolt_clock_advance (clock, 1);
+  g_assert_cmpuint (n, ==, 1);
+  g_assert_cmpuint (notified, ==, 1);
 
   /* we should have one now */
   state = bolt_power_get_state (power);
   g_assert (state == BOLT_FORCE_POWER_OFF);
   on = mock_sysfs_force_power_enabled (tt->sysfs);
   g_assert_false (on);
+
+  /* only the reaper is left */
+  g_assert_cmpuint (bolt_clock_pending (clock), ==, 1);
+}
+
+static void
+test_power_timeout_virtual (TestPower *tt, gconstpointer user)
+{
+  g_autoptr(BoltClock) clock = NULL;
+  g_autoptr(BoltPower) power = NULL;
+  g_autoptr(GError) err = NULL;
+  g_autoptr(BoltPowerGuard) guard = NULL;
+  BoltPowerState state;
+  gboolean on;
+  const char *fp;
+  guint n;
+
+  fp = mock_sysfs_force_power_add (tt->sysfs);
+  g_assert_nonnull (fp);
+
+  /* the default timeout, which is way too long to wait for */
+  clock = bolt_clock_new_virtual ();
+  power = make_bolt_power_clock (tt, 20 * 1000, clock);
+
+  guard = bolt_power_acquire (power, &err);
+  g_assert_no_error (err);
+  g_assert_nonnull (guard);
+  state = bolt_power_get_state (power);
+  g_assert_cmpint (state, ==, BOLT_FORCE_POWER_ON);
+
+  g_clear_object (&guard);
+  state = bolt_power_get_state (power);
+  g_assert_cmpint (state, ==, BOLT_FORCE_POWER_WAIT);
+
+  /* the wait timer plus the reaper */
+  g_assert_cmpuint (bolt_clock_pending (clock), ==, 2);
+
+  /* just before the timeout, we are still waiting */
+  n = bolt_clock_advance (clock, 20 * G_USEC_PER_SEC - 1);
+  g_assert_cmpuint (n, ==, 0);
+
+  state = bolt_power_get_state (power);
+  g_assert_cmpint (state, ==, BOLT_FORCE_POWER_WAIT);
+  on = mock_sysfs_force_power_enabled (tt->sysfs);
+  g_assert_true (on);
+
+  /* the last µs: the wait timer and the reaper fire */
+  n = bolt_clock_advance (clock, 1);
+  g_assert_cmpuint (n, ==, 2);
+
+  state = bolt_power_get_state (power);
+  g_assert_cmpint (state, ==, BOLT_FORCE_POWER_OFF);
+  on = mock_sysfs_force_power_enabled (tt->sysfs);
+  g_assert_false (on);
+
+  g_assert_cmpuint (bolt_clock_pending (clock), ==, 0);
+}
+
+static void
+test_power_reaper (TestPower *tt, gconstpointer user)
+{
+  g_autoptr(BoltClock) clock = NULL;
+  g_autoptr(BoltPower) power = NULL;
+  g_autoptr(GError) err = NULL;
+  BoltPowerGuard *guard;
+  BoltPowerState state;
+  const char *fp;
+  guint guards;
+  pid_t pid;
+  int r;
+
+  fp = mock_sysfs_force_power_add (tt->sysfs);
+  g_assert_nonnull (fp);
+
+  clock = bolt_clock_new_virtual ();
+  power = make_bolt_power_clock (tt, 10, clock);
+
+  /* a process that is gone by the time the reaper runs */
+  pid = fork ();
+  g_assert_cmpint (pid, !=, -1);
+
+  if (pid == 0)
+    exit (0);
+
+  pid = waitpid (pid, &r, 0);
+  g_assert_cmpint (pid, >, 0);
+
+  /* the reaper drops the reference of the dead client */
+  guard = bolt_power_acquire_full (power, "test", pid, &err);
+  g_assert_no_error (err);
+  g_assert_nonnull (guard);
+
+  state = bolt_power_get_state (power);
+  g_assert_cmpint (state, ==, BOLT_FORCE_POWER_ON);
+
+  bolt_clock_advance (clock, 19 * G_USEC_PER_SEC);
+  g_object_get (power, "guards", &guards, NULL);
+  g_assert_cmpuint (guards, ==, 1);
+
+  /* reaper (20s) and then the wait timeout (10ms) */
+  bolt_clock_advance (clock, G_USEC_PER_SEC + 10 * 1000);
+  g_object_get (power, "guards", &guards, NULL);
+  g_assert_cmpuint (guards, ==, 0);
+
+  state = bolt_power_get_state (power);
+  g_assert_cmpint (state, ==, BOLT_FORCE_POWER_OFF);
+
+  /* the reaper removes itself once there are no guards left */
+  bolt_clock_advance (clock, 20 * G_USEC_PER_SEC);
+  g_assert_cmpuint (bolt_clock_pending (clock), ==, 0);
 }
 
 static void
@@ -722,6 +871,20 @@ main (int argc, char **argv)
               test_power_timeout,
               test_power_tear_down);
 
+  g_test_add ("/power/timeout/virtual",
+              TestPower,
+              NULL,
+              test_power_setup,
+              test_power_timeout_virtual,
+              test_power_tear_down);
+
+  g_test_add ("/power/reaper",
+              TestPower,
+              NULL,
+              test_power_setup,
+              test_power_reaper,
+              test_power_tear_down);
+
   g_test_add ("/power/recover",
               TestPower,
               NULL,
@@ -0,0 +1,469 @@
+/*
+ * Copyright © 2018 Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *       Christian J. Kellner <christian@kellner.me>
+ */
+
+#include "config.h"
+
+#include "bolt-stats.h"
+
+#include "bolt-fs.h"
+#include "bolt-log.h"
+#include "bolt-metrics.h"
+#include "bolt-str.h"
+#include "bolt-watchdog.h"
+
+#include "bolt-daemon-resource.h"
+
+#include <glib.h>
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+#include <locale.h>
+#include <string.h>
+
+typedef struct
+{
+  BoltStats *stats;
+} TestStats;
+
+
+static void
+test_stats_setup (TestStats *tt, gconstpointer data)
+{
+  bolt_stats_reset ();
+  tt->stats = bolt_stats_new ();
+}
+
+static void
+test_stats_tear_down (TestStats *tt, gconstpointer user)
+{
+  g_clear_object (&tt->stats);
+  bolt_stats_reset ();
+}
+
+static guint64
+stats_lookup (BoltStats  *stats,
+              const char *prop,
+              const char *key)
+{
+  g_autoptr(GVariant) var = NULL;
+  guint64 val = 0;
+  gboolean ok;
+
+  g_object_get (stats, prop, &var, NULL);
+  g_assert_nonnull (var);
+
+  ok = g_variant_lookup (var, key, "t", &val);
+  g_assert_true (ok);
+
+  return val;
+}
+
+static void
+test_stats_buckets (TestStats *tt, gconstpointer user)
+{
+  g_assert_cmpuint (bolt_stats_bucket_for (-1), ==, 0);
+  g_assert_cmpuint (bolt_stats_bucket_for (0), ==, 0);
+  g_assert_cmpuint (bolt_stats_bucket_for (1), ==, 0);
+  g_assert_cmpuint (bolt_stats_bucket_for (2), ==, 1);
+  g_assert_cmpuint (bolt_stats_bucket_for (3), ==, 1);
+  g_assert_cmpuint (bolt_stats_bucket_for (4), ==, 2);
+  g_assert_cmpuint (bolt_stats_bucket_for (1023), ==, 9);
+  g_assert_cmpuint (bolt_stats_bucket_for (1024), ==, 10);
+  g_assert_cmpuint (bolt_stats_bucket_for (G_USEC_PER_SEC * 3600),
+                    ==, BOLT_STATS_BUCKETS - 1);
+}
+
+static void
+test_stats_counters (TestStats *tt, gconstpointer user)
+{
+  g_autoptr(GVariant) uevents = NULL;
+  g_autoptr(GVariant) auth = NULL;
+  guint64 received, handled;
+  guint64 attempted, succeeded, failed;
+  gboolean ok;
+
+  bolt_stats_uevent_received (BOLT_UDEV_ACTION_ADD);
+  bolt_stats_uevent_received (BOLT_UDEV_ACTION_ADD);
+  bolt_stats_uevent_handled (BOLT_UDEV_ACTION_ADD);
+  bolt_stats_uevent_received ((BoltUdevAction) (BOLT_UDEV_ACTION_LAST + 1));
+
+  g_object_get (tt->stats, "uevents", &uevents, NULL);
+
+  ok = g_variant_lookup (uevents, "add", "(tt)", &received, &handled);
+  g_assert_true (ok);
+  g_assert_cmpuint (received, ==, 2);
+  g_assert_cmpuint (handled, ==, 1);
+
+  ok = g_variant_lookup (uevents, "unknown", "(tt)", &received, &handled);
+  g_assert_true (ok);
+  g_assert_cmpuint (received, ==, 1);
+  g_assert_cmpuint (handled, ==, 0);
+
+  bolt_stats_authorize (BOLT_SECURITY_SECURE, BOLT_STATS_AUTH_ATTEMPTED);
+  bolt_stats_authorize (BOLT_SECURITY_SECURE, BOLT_STATS_AUTH_SUCCEEDED);
+  bolt_stats_authorize (BOLT_SECURITY_USER, BOLT_STATS_AUTH_ATTEMPTED);
+  bolt_stats_authorize (BOLT_SECURITY_USER, BOLT_STATS_AUTH_FAILED);
+
+  g_object_get (tt->stats, "authorizations", &auth, NULL);
+
+  ok = g_variant_lookup (auth, "secure", "(ttt)", &attempted, &succeeded, &failed);
+  g_assert_true (ok);
+  g_assert_cmpuint (attempted, ==, 1);
+  g_assert_cmpuint (succeeded, ==, 1);
+  g_assert_cmpuint (failed, ==, 0);
+
+  ok = g_variant_lookup (auth, "user", "(ttt)", &attempted, &succeeded, &failed);
+  g_assert_true (ok);
+  g_assert_cmpuint (attempted, ==, 1);
+  g_assert_cmpuint (succeeded, ==, 0);
+  g_assert_cmpuint (failed, ==, 1);
+
+  bolt_stats_store_read ();
+  bolt_stats_store_write ();
+  bolt_stats_store_write ();
+
+  g_assert_cmpuint (stats_lookup (tt->stats, "store", "reads"), ==, 1);
+  g_assert_cmpuint (stats_lookup (tt->stats, "store", "writes"), ==, 2);
+
+  bolt_stats_polkit_check (TRUE);
+  bolt_stats_polkit_check (FALSE);
+  bolt_stats_polkit_check (FALSE);
+
+  g_assert_cmpuint (stats_lookup (tt->stats, "polkit", "checks"), ==, 1);
+  g_assert_cmpuint (stats_lookup (tt->stats, "polkit", "skipped"), ==, 2);
+
+  bolt_stats_udev_overflow ();
+  bolt_stats_udev_overflow ();
+  bolt_stats_udev_resync ();
+
+  g_assert_cmpuint (stats_lookup (tt->stats, "udev", "overflows"), ==, 2);
+  g_assert_cmpuint (stats_lookup (tt->stats, "udev", "resyncs"), ==, 1);
+}
+
+static void
+test_stats_latency (TestStats *tt, gconstpointer user)
+{
+  g_autoptr(GVariant) latency = NULL;
+  g_autoptr(GVariant) buckets = NULL;
+  const guint64 *bv;
+  guint64 count, sum;
+  gsize n;
+  gboolean ok;
+
+  bolt_stats_observe (BOLT_STATS_AUTHORIZE, 1);
+  bolt_stats_observe (BOLT_STATS_AUTHORIZE, 5);
+  bolt_stats_observe (BOLT_STATS_AUTHORIZE, 6);
+  bolt_stats_observe (BOLT_STATS_AUTHORIZE, -10);
+
+  /* status changes outside of uevents are not recorded */
+  bolt_stats_status_changed ();
+
+  bolt_stats_uevent_begin ();
+  bolt_stats_status_changed ();
+  bolt_stats_uevent_end ();
+
+  g_object_get (tt->stats, "latency", &latency, NULL);
+
+  ok = g_variant_lookup (latency, "authorize", "(tt@at)", &count, &sum, &buckets);
+  g_assert_true (ok);
+  g_assert_cmpuint (count, ==, 4);
+  g_assert_cmpuint (sum, ==, 12);
+
+  bv = g_variant_get_fixed_array (buckets, &n, sizeof (guint64));
+  g_assert_cmpuint (n, ==, BOLT_STATS_BUCKETS);
+  g_assert_cmpuint (bv[0], ==, 2);
+  g_assert_cmpuint (bv[2], ==, 2);
+  g_clear_pointer (&buckets, g_variant_unref);
+
+  ok = g_variant_lookup (latency, "uevent-status", "(tt@at)", &count, &sum, &buckets);
+  g_assert_true (ok);
+  g_assert_cmpuint (count, ==, 1);
+  g_clear_pointer (&buckets, g_variant_unref);
+
+  ok = g_variant_lookup (latency, "method-call", "(tt@at)", &count, &sum, &buckets);
+  g_assert_true (ok);
+  g_assert_cmpuint (count, ==, 0);
+}
+
+#define N_THREADS 4
+#define N_ITERATIONS (64 * 1024)
+
+static gpointer
+stats_thread (gpointer data)
+{
+  for (guint i = 0; i < N_ITERATIONS; i++)
+    {
+      bolt_stats_store_read ();
+      bolt_stats_observe (BOLT_STATS_METHOD_CALL, i % 64);
+    }
+
+  return NULL;
+}
+
+static void
+test_stats_threads (TestStats *tt, gconstpointer user)
+{
+  g_autoptr(GVariant) latency = NULL;
+  GThread *threads[N_THREADS];
+  guint64 count, sum;
+  gboolean ok;
+
+  for (guint i = 0; i < N_THREADS; i++)
+    threads[i] = g_thread_new ("stats", stats_thread, NULL);
+
+  for (guint i = 0; i < N_THREADS; i++)
+    g_thread_join (threads[i]);
+
+  g_assert_cmpuint (stats_lookup (tt->stats, "store", "reads"),
+                    ==, N_THREADS * N_ITERATIONS);
+
+  g_object_get (tt->stats, "latency", &latency, NULL);
+
+  ok = g_variant_lookup (latency, "method-call", "(tt@at)", &count, &sum, NULL);
+  g_assert_true (ok);
+  g_assert_cmpuint (count, ==, N_THREADS * N_ITERATIONS);
+  g_assert_cmpuint (sum, ==, N_THREADS * (N_ITERATIONS / 64) * (63 * 64 / 2));
+}
+
+static void
+test_stats_metrics_format (TestStats *tt, gconstpointer user)
+{
+  g_autoptr(GString) out = g_string_new ("");
+
+  bolt_metrics_add_family (out, "boltd_test", "gauge", "A test.");
+  bolt_metrics_add_sample (out, "boltd_test", "status", "authorized", 3);
+  bolt_metrics_add_sample (out, "boltd_test", NULL, NULL, 0.5);
+
+  g_assert_cmpstr (out->str, ==,
+                   "# TYPE boltd_test gauge\n"
+                   "# HELP boltd_test A test.\n"
+                   "boltd_test{status=\"authorized\"} 3\n"
+                   "boltd_test 0.5\n");
+
+  g_string_truncate (out, 0);
+
+  bolt_stats_observe (BOLT_STATS_AUTHORIZE, 1);
+  bolt_stats_observe (BOLT_STATS_AUTHORIZE, 3);
+  bolt_stats_observe (BOLT_STATS_AUTHORIZE, G_USEC_PER_SEC * 3600);
+
+  bolt_metrics_add_histogram (out, "boltd_auth_seconds", NULL,
+                              BOLT_STATS_AUTHORIZE);
+
+  g_assert_true (g_str_has_prefix (out->str, "# TYPE boltd_auth_seconds histogram\n"));
+  g_assert_nonnull (strstr (out->str, "boltd_auth_seconds_bucket{le=\"2e-06\"} 1\n"));
+  g_assert_nonnull (strstr (out->str, "boltd_auth_seconds_bucket{le=\"4e-06\"} 2\n"));
+  g_assert_nonnull (strstr (out->str, "boltd_auth_seconds_bucket{le=\"8.38861\"} 2\n"));
+  g_assert_nonnull (strstr (out->str, "boltd_auth_seconds_bucket{le=\"+Inf\"} 3\n"));
+  g_assert_nonnull (strstr (out->str, "boltd_auth_seconds_count 3\n"));
+  g_assert_nonnull (strstr (out->str, "boltd_auth_seconds_sum 3600.000004\n"));
+}
+
+static void
+metrics_collect (GString *out,
+                 gpointer user_data)
+{
+  guint *calls = user_data;
+
+  *calls += 1;
+  bolt_metrics_add_sample (out, "boltd_calls", NULL, NULL, *calls);
+}
+
+static void
+test_stats_metrics_file (TestStats *tt, gconstpointer user)
+{
+  g_autoptr(GError) err = NULL;
+  g_autoptr(BoltMetrics) metrics = NULL;
+  g_autofree char *dir = NULL;
+  g_autofree char *path = NULL;
+  g_autofree char *data = NULL;
+  guint calls = 0;
+  gboolean ok;
+
+  dir = g_dir_make_tmp ("bolt.metrics.XXXXXX", &err);
+  g_assert_no_error (err);
+
+  path = g_build_filename (dir, "metrics", BOLT_METRICS_FILE, NULL);
+  metrics = bolt_metrics_new (path, 60, metrics_collect, &calls);
+
+  /* nothing changed, nothing written */
+  g_assert_false (bolt_metrics_is_dirty (metrics));
+  g_assert_false (g_file_test (path, G_FILE_TEST_EXISTS));
+
+  bolt_metrics_mark_dirty (metrics);
+  bolt_metrics_mark_dirty (metrics);
+  g_assert_true (bolt_metrics_is_dirty (metrics));
+  g_assert_cmpuint (calls, ==, 0);
+
+  ok = bolt_metrics_flush (metrics, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  g_assert_false (bolt_metrics_is_dirty (metrics));
+  g_assert_cmpuint (calls, ==, 1);
+
+  ok = g_file_get_contents (path, &data, NULL, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+  g_assert_cmpstr (data, ==, "boltd_calls 1\n# EOF\n");
+
+  g_clear_object (&metrics);
+  bolt_fs_cleanup_dir (dir, NULL);
+}
+
+static GLogWriterOutput
+stall_writer (GLogLevelFlags   log_level,
+              const GLogField *fields,
+              gsize            n_fields,
+              gpointer         user_data)
+{
+  char *report = user_data;
+  const char *message = NULL;
+  gboolean watchdog = FALSE;
+
+  for (gsize i = 0; i < n_fields; i++)
+    if (bolt_streq (fields[i].key, "MESSAGE"))
+      message = fields[i].value;
+    else if (bolt_streq (fields[i].key, BOLT_LOG_TOPIC))
+      watchdog = bolt_streq (fields[i].value, "watchdog");
+
+  /* only written from the watchdog thread */
+  if (watchdog && message && g_str_has_prefix (message, "main loop stalled"))
+    g_strlcpy (report, message, 256);
+
+  return G_LOG_WRITER_HANDLED;
+}
+
+static gboolean
+stall_callback (gpointer user_data)
+{
+  g_auto(BoltWatchdogScope) scope = BOLT_WATCHDOG_SCOPE_INIT;
+  gboolean *done = user_data;
+
+  bolt_watchdog_scope_enter (&scope, G_STRFUNC);
+
+  bolt_msg (LOG_TOPIC ("stall-test"), "stalling the main loop");
+
+  g_usleep (150 * 1000);
+  *done = TRUE;
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+test_stats_watchdog (TestStats *tt, gconstpointer user)
+{
+  g_autoptr(GError) err = NULL;
+  char report[256] = {0, };
+  gboolean done = FALSE;
+  guint64 stalls, worst;
+  gboolean ok;
+  guint id;
+
+  /* the stall is reported as warning */
+  g_log_set_always_fatal (G_LOG_FATAL_MASK | G_LOG_LEVEL_CRITICAL);
+  g_log_set_writer_func (stall_writer, report, NULL);
+
+  ok = bolt_watchdog_start (50, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+  g_assert_true (bolt_watchdog_is_active ());
+
+  id = g_idle_add (stall_callback, &done);
+  g_source_set_name_by_id (id, "[test] stall");
+
+  while (!done)
+    g_main_context_iteration (NULL, TRUE);
+
+  /* the iteration is over once the loop polls again */
+  g_main_context_iteration (NULL, FALSE);
+
+  bolt_watchdog_stop ();
+  g_assert_false (bolt_watchdog_is_active ());
+
+  stalls = bolt_stats_get_stalls (&worst);
+  g_assert_cmpuint (stalls, >=, 1);
+  g_assert_cmpuint (worst, >=, 150 * 1000);
+
+  /* the report names what was running at the time */
+  g_assert_nonnull (strstr (report, "source: '[test] stall'"));
+  g_assert_nonnull (strstr (report, "callback: stall_callback"));
+  g_assert_nonnull (strstr (report, "topic: 'stall-test'"));
+}
+
+int
+main (int argc, char **argv)
+{
+  setlocale (LC_ALL, "");
+
+  g_test_init (&argc, &argv, NULL);
+
+  g_resources_register (bolt_daemon_get_resource ());
+
+  g_test_add ("/stats/buckets",
+              TestStats,
+              NULL,
+              test_stats_setup,
+              test_stats_buckets,
+              test_stats_tear_down);
+
+  g_test_add ("/stats/counters",
+              TestStats,
+              NULL,
+              test_stats_setup,
+              test_stats_counters,
+              test_stats_tear_down);
+
+  g_test_add ("/stats/latency",
+              TestStats,
+              NULL,
+              test_stats_setup,
+              test_stats_latency,
+              test_stats_tear_down);
+
+  g_test_add ("/stats/threads",
+              TestStats,
+              NULL,
+              test_stats_setup,
+              test_stats_threads,
+              test_stats_tear_down);
+
+  g_test_add ("/stats/metrics/format",
+              TestStats,
+              NULL,
+              test_stats_setup,
+              test_stats_metrics_format,
+              test_stats_tear_down);
+
+  g_test_add ("/stats/metrics/file",
+              TestStats,
+              NULL,
+              test_stats_setup,
+              test_stats_metrics_file,
+              test_stats_tear_down);
+
+  g_test_add ("/stats/watchdog",
+              TestStats,
+              NULL,
+              test_stats_setup,
+              test_stats_watchdog,
+              test_stats_tear_down);
+
+  return g_test_run ();
+}
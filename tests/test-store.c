@@ -23,6 +23,7 @@
 #include "bolt-error.h"
 #include "bolt-fs.h"
 #include "bolt-io.h"
+#include "bolt-snapshot.h"
 #include "bolt-store.h"
 
 #include "bolt-daemon-resource.h"
@@ -498,6 +499,123 @@ test_store_times (TestStore *tt, gconstpointer user_data)
   g_assert_cmpuint (connout, ==, 0);
 }
 
+static void
+test_store_stamp (TestStore *tt, gconstpointer user_data)
+{
+  g_autoptr(BoltDevice) dev = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree char *empty = NULL;
+  g_autofree char *stamp = NULL;
+  g_autofree char *again = NULL;
+  char uid[] = "fbc83890-e9bf-45e5-a777-b3728490989c";
+  gboolean ok;
+
+  /* nothing stored yet, i.e. no directories */
+  empty = bolt_store_get_stamp (tt->store);
+  g_assert_cmpstr (empty, ==, "-:-:-");
+
+  dev = g_object_new (BOLT_TYPE_DEVICE,
+                      "uid", uid,
+                      "name", "Laptop",
+                      "vendor", "GNOME.org",
+                      "status", BOLT_STATUS_DISCONNECTED,
+                      NULL);
+
+  ok = bolt_store_put_device (tt->store, dev, BOLT_POLICY_AUTO, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_true (ok);
+
+  stamp = bolt_store_get_stamp (tt->store);
+  g_assert_cmpstr (stamp, !=, empty);
+
+  /* reading does not change anything */
+  g_clear_object (&dev);
+  dev = bolt_store_get_device (tt->store, uid, &error);
+  g_assert_no_error (error);
+  g_assert_nonnull (dev);
+
+  again = bolt_store_get_stamp (tt->store);
+  g_assert_cmpstr (again, ==, stamp);
+}
+
+static void
+test_store_snapshot (TestStore *tt, gconstpointer user_data)
+{
+  g_autoptr(GVariant) state = NULL;
+  g_autoptr(GVariant) bogus = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree char *rundir = NULL;
+  g_autofree char *path = NULL;
+  g_autofree char *stamp = NULL;
+  GVariantBuilder b;
+  GDir *dir = NULL;
+  gboolean ok;
+
+  rundir = g_build_filename (tt->path, "run", NULL);
+  path = g_build_filename (rundir, BOLT_SNAPSHOT_FILE, NULL);
+
+  g_variant_builder_init (&b, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&b, "{sv}", "store", g_variant_new_string ("1.2:-:-"));
+  g_variant_builder_add (&b, "{sv}", "time", g_variant_new_uint64 (0));
+
+  ok = bolt_snapshot_save (path, g_variant_builder_end (&b), &error);
+  g_assert_no_error (error);
+  g_assert_true (ok);
+  g_assert_true (g_file_test (path, G_FILE_TEST_IS_REGULAR));
+
+  /* written via a temporary file, which is gone now */
+  dir = g_dir_open (rundir, 0, &error);
+  g_assert_no_error (error);
+
+  for (const char *name = g_dir_read_name (dir); name; name = g_dir_read_name (dir))
+    g_assert_cmpstr (name, ==, BOLT_SNAPSHOT_FILE);
+
+  g_clear_pointer (&dir, g_dir_close);
+
+  state = bolt_snapshot_load (path, &error);
+  g_assert_no_error (error);
+  g_assert_nonnull (state);
+
+  ok = g_variant_lookup (state, "store", "s", &stamp);
+  g_assert_true (ok);
+  g_assert_cmpstr (stamp, ==, "1.2:-:-");
+
+  /* a snapshot can only be used once */
+  g_assert_false (g_file_test (path, G_FILE_TEST_EXISTS));
+  g_clear_pointer (&state, g_variant_unref);
+
+  state = bolt_snapshot_load (path, &error);
+  g_assert_error (error, G_FILE_ERROR, G_FILE_ERROR_NOENT);
+  g_assert_null (state);
+  g_clear_error (&error);
+
+  /* unknown version */
+  bogus = g_variant_new ("(u@a{sv})", BOLT_SNAPSHOT_VERSION + 1,
+                         g_variant_new ("a{sv}", NULL));
+  g_variant_ref_sink (bogus);
+
+  ok = bolt_file_write_all (path,
+                            g_variant_get_data (bogus),
+                            g_variant_get_size (bogus),
+                            &error);
+  g_assert_no_error (error);
+  g_assert_true (ok);
+
+  state = bolt_snapshot_load (path, &error);
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED);
+  g_assert_null (state);
+  g_clear_error (&error);
+
+  /* garbage */
+  ok = g_file_set_contents (path, "garbage", -1, &error);
+  g_assert_no_error (error);
+  g_assert_true (ok);
+
+  state = bolt_snapshot_load (path, &error);
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+  g_assert_null (state);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -536,5 +654,19 @@ main (int argc, char **argv)
               test_store_times,
               test_store_tear_down);
 
+  g_test_add ("/daemon/store/stamp",
+              TestStore,
+              NULL,
+              test_store_setup,
+              test_store_stamp,
+              test_store_tear_down);
+
+  g_test_add ("/daemon/store/snapshot",
+              TestStore,
+              NULL,
+              test_store_setup,
+              test_store_snapshot,
+              test_store_tear_down);
+
   return g_test_run ();
 }
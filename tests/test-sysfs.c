@@ -175,6 +175,199 @@ test_sysfs_domains (TestSysfs *tt, gconstpointer user)
     g_assert_null (all[i]);
 }
 
+static void
+test_sysfs_scan (TestSysfs *tt, gconstpointer user)
+{
+  g_autoptr(GError) err = NULL;
+  g_autoptr(GPtrArray) scan = NULL;
+  const char *ids[2];
+  const char *fp;
+  guint n_domains = 0;
+  guint n_power = 0;
+
+  scan = bolt_sysfs_scan (NULL, 1, &err);
+  g_assert_no_error (err);
+  g_assert_nonnull (scan);
+
+  for (guint i = 0; i < scan->len; i++)
+    {
+      BoltScanEntry *entry = g_ptr_array_index (scan, i);
+      g_assert_cmpint (entry->kind, ==, BOLT_SCAN_OTHER);
+    }
+
+  g_clear_pointer (&scan, g_ptr_array_unref);
+
+  ids[0] = mock_sysfs_domain_add (tt->sysfs, BOLT_SECURITY_SECURE);
+  ids[1] = mock_sysfs_domain_add (tt->sysfs, BOLT_SECURITY_USER);
+  fp = mock_sysfs_force_power_add (tt->sysfs);
+  g_assert_nonnull (fp);
+
+  scan = bolt_sysfs_scan (NULL, 4, &err);
+  g_assert_no_error (err);
+  g_assert_nonnull (scan);
+
+  for (guint i = 0; i < scan->len; i++)
+    {
+      BoltScanEntry *entry = g_ptr_array_index (scan, i);
+
+      if (entry->kind == BOLT_SCAN_DOMAIN)
+        {
+          const char *syspath;
+
+          g_assert_cmpuint (n_domains, <, G_N_ELEMENTS (ids));
+          syspath = mock_sysfs_domain_get_syspath (tt->sysfs,
+                                                   ids[n_domains]);
+
+          g_assert_cmpstr (entry->syspath, ==, syspath);
+          g_assert_cmpstr (entry->sysname, ==, ids[n_domains]);
+          g_assert_null (entry->uid);
+          n_domains++;
+        }
+      else if (entry->kind == BOLT_SCAN_FORCE_POWER)
+        {
+          g_assert_cmpstr (entry->syspath, ==, fp);
+          n_power++;
+        }
+    }
+
+  g_assert_cmpuint (n_domains, ==, G_N_ELEMENTS (ids));
+  g_assert_cmpuint (n_power, ==, 1);
+}
+
+static void
+test_sysfs_tree (TestSysfs *tt, gconstpointer user)
+{
+  g_autoptr(udev_device) leaf = NULL;
+  g_autoptr(udev_device) dom = NULL;
+  g_autoptr(GPtrArray) devices = NULL;
+  g_autoptr(GPtrArray) scan = NULL;
+  g_autoptr(GError) err = NULL;
+  MockTree tree = {
+    .security   = BOLT_SECURITY_SECURE,
+    .depth      = 3,
+    .fanout     = 4,
+    .authorized = 0,
+    .key        = TRUE,
+    .boot       = 1,
+  };
+  BoltDevInfo info;
+  const char *id;
+  const char *syspath;
+  const char *parent;
+  guint n_devices = 0;
+  guint total;
+  gboolean ok;
+
+  total = mock_tree_count_devices (&tree);
+  g_assert_cmpuint (total, ==, 4 + 16 + 64);
+
+  id = mock_sysfs_tree_add (tt->sysfs, &tree);
+  g_assert_nonnull (id);
+
+  devices = mock_sysfs_device_list (tt->sysfs, id);
+  g_assert_nonnull (devices);
+  g_assert_cmpuint (devices->len, ==, total + 1);
+
+  scan = bolt_sysfs_scan (NULL, 4, &err);
+  g_assert_no_error (err);
+  g_assert_nonnull (scan);
+
+  for (guint i = 0; i < scan->len; i++)
+    {
+      g_autoptr(udev_device) udevice = NULL;
+      BoltScanEntry *entry = g_ptr_array_index (scan, i);
+      BoltDevInfo have;
+      const char *uid;
+
+      if (entry->kind != BOLT_SCAN_DEVICE)
+        continue;
+
+      uid = mock_sysfs_device_get_uid (tt->sysfs, entry->syspath);
+      g_assert_nonnull (uid);
+      g_assert_cmpstr (entry->uid, ==, uid);
+
+      if (g_str_has_suffix (entry->sysname, "-0"))
+        g_assert_cmpint (entry->authorized, ==, 1);
+      else
+        g_assert_cmpint (entry->authorized, ==, 0);
+
+      /* the scan must see what libudev sees */
+      udevice = udev_device_new_from_syspath (tt->udev, entry->syspath);
+      g_assert_nonnull (udevice);
+
+      ok = bolt_sysfs_info_for_device (udevice, TRUE, &info, &err);
+      g_assert_no_error (err);
+      g_assert_true (ok);
+
+      ok = bolt_sysfs_info_for_entry (entry, &have, &err);
+      g_assert_no_error (err);
+      g_assert_true (ok);
+
+      g_assert_cmpint (have.authorized, ==, info.authorized);
+      g_assert_cmpint (have.keysize, ==, info.keysize);
+      g_assert_cmpint (have.boot, ==, info.boot);
+      g_assert_cmpint (have.ctim, ==, info.ctim);
+      g_assert_cmpstr (have.syspath, ==, info.syspath);
+      g_assert_cmpstr (have.parent, ==, info.parent);
+
+      g_assert_cmpstr (entry->name, ==,
+                       udev_device_get_sysattr_value (udevice, "device_name"));
+      g_assert_cmpstr (entry->vendor, ==,
+                       udev_device_get_sysattr_value (udevice, "vendor_name"));
+
+      n_devices++;
+    }
+
+  g_assert_cmpuint (n_devices, ==, total + 1);
+
+  /* the last device is a leaf at the maximum depth */
+  syspath = g_ptr_array_index (devices, devices->len - 1);
+  g_assert_true (g_str_has_suffix (syspath, "/0-40404"));
+
+  leaf = udev_device_new_from_syspath (tt->udev, syspath);
+  g_assert_nonnull (leaf);
+
+  ok = bolt_sysfs_info_for_device (leaf, TRUE, &info, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  g_assert_cmpint (info.authorized, ==, 0);
+  g_assert_cmpint (info.keysize, ==, 0);
+  g_assert_cmpint (info.boot, ==, 1);
+
+  parent = mock_sysfs_device_get_uid (tt->sysfs,
+                                      g_ptr_array_index (devices, 1 + 4 + 15));
+  g_assert_cmpstr (info.parent, ==, parent);
+
+  dom = bolt_sysfs_domain_for_device (leaf);
+  g_assert_nonnull (dom);
+  g_assert_cmpstr (udev_device_get_sysname (dom), ==, id);
+  g_assert_cmpint (bolt_sysfs_security_for_device (leaf, NULL),
+                   ==,
+                   BOLT_SECURITY_SECURE);
+
+  /* removing a device removes everything below it */
+  ok = mock_sysfs_device_remove (tt->sysfs, g_ptr_array_index (devices, 1));
+  g_assert_true (ok);
+
+  g_clear_pointer (&devices, g_ptr_array_unref);
+  devices = mock_sysfs_device_list (tt->sysfs, id);
+  g_assert_cmpuint (devices->len, ==, total + 1 - (1 + 4 + 16));
+
+  ok = mock_sysfs_domain_remove (tt->sysfs, id);
+  g_assert_true (ok);
+
+  g_clear_pointer (&scan, g_ptr_array_unref);
+  scan = bolt_sysfs_scan (NULL, 1, &err);
+  g_assert_no_error (err);
+
+  for (guint i = 0; i < scan->len; i++)
+    {
+      BoltScanEntry *entry = g_ptr_array_index (scan, i);
+      g_assert_cmpint (entry->kind, !=, BOLT_SCAN_DEVICE);
+    }
+}
+
 int
 main (int argc, char **argv)
 {
@@ -192,5 +385,19 @@ main (int argc, char **argv)
               test_sysfs_domains,
               test_sysfs_tear_down);
 
+  g_test_add ("/sysfs/scan",
+              TestSysfs,
+              NULL,
+              test_sysfs_setup,
+              test_sysfs_scan,
+              test_sysfs_tear_down);
+
+  g_test_add ("/sysfs/tree",
+              TestSysfs,
+              NULL,
+              test_sysfs_setup,
+              test_sysfs_tree,
+              test_sysfs_tear_down);
+
   return g_test_run ();
 }
@@ -22,6 +22,9 @@
 
 #include "bolt-udev.h"
 
+#include "bolt-fs.h"
+#include "bolt-record.h"
+#include "bolt-stats.h"
 #include "bolt-str.h"
 #include "mock-sysfs.h"
 
@@ -205,6 +208,453 @@ test_udev_basic (TestUdev *tt, gconstpointer user)
   uevent_clear (&ev);
 }
 
+typedef struct
+{
+  BoltUdevAction    action;
+  BoltUdevSubsystem subsystem;
+  BoltUdevDevtype   devtype;
+  char             *syspath;
+
+  gint              have;
+  GMainLoop        *loop;
+} TypedEvent;
+
+static gboolean
+got_typed_uevent (BoltUdev         *udev,
+                  const BoltUevent *event,
+                  gpointer          user_data)
+{
+  TypedEvent *ev = user_data;
+
+  ev->action = event->action;
+  ev->subsystem = event->subsystem;
+  ev->devtype = event->devtype;
+  bolt_set_strdup (&ev->syspath, event->syspath);
+
+  ev->have++;
+
+  if (ev->loop)
+    g_main_loop_quit (ev->loop);
+
+  return TRUE;
+}
+
+static gboolean
+got_typed_uevent_unexpected (BoltUdev         *udev,
+                             const BoltUevent *event,
+                             gpointer          user_data)
+{
+  gint *count = user_data;
+
+  (*count)++;
+
+  return TRUE;
+}
+
+static gboolean
+got_typed_uevent_observed (BoltUdev         *udev,
+                           const BoltUevent *event,
+                           gpointer          user_data)
+{
+  gint *count = user_data;
+
+  (*count)++;
+
+  /* only looked at it */
+  return FALSE;
+}
+
+static gboolean
+typed_timeout (gpointer user_data)
+{
+  TypedEvent *ev = user_data;
+
+  g_main_loop_quit (ev->loop);
+  return G_SOURCE_REMOVE;
+}
+
+static void
+typed_wait (TypedEvent *ev, guint timeout)
+{
+  guint tid;
+
+  ev->have = 0;
+  tid = g_timeout_add_seconds (timeout, typed_timeout, ev);
+  g_main_loop_run (ev->loop);
+
+  if (ev->have > 0)
+    g_source_remove (tid);
+}
+
+static void
+test_udev_subscribe (TestUdev *tt, gconstpointer user)
+{
+  g_autoptr(GError) err = NULL;
+  g_autoptr(BoltUdev) udev = NULL;
+  TypedEvent ev = {0, };
+  const char *filter[] = {"thunderbolt", NULL};
+  const char *domain;
+  const char *syspath;
+  g_autoptr(GVariant) uevents = NULL;
+  guint64 received, handled;
+  gint unexpected = 0;
+  gint observed = 0;
+  guint id;
+  guint n;
+
+  g_assert_cmpint (bolt_udev_action_from_string ("add"), ==,
+                   BOLT_UDEV_ACTION_ADD);
+  g_assert_cmpint (bolt_udev_action_from_string ("unbind"), ==,
+                   BOLT_UDEV_ACTION_UNBIND);
+  g_assert_cmpint (bolt_udev_action_from_string ("foobar"), ==,
+                   BOLT_UDEV_ACTION_UNKNOWN);
+  g_assert_cmpint (bolt_udev_action_from_string (NULL), ==,
+                   BOLT_UDEV_ACTION_UNKNOWN);
+  g_assert_cmpstr (bolt_udev_action_to_string (BOLT_UDEV_ACTION_REMOVE),
+                   ==, "remove");
+
+  udev = bolt_udev_new ("udev", filter, &err);
+
+  g_assert_nonnull (udev);
+  g_assert_no_error (err);
+
+  ev.loop = g_main_loop_new (NULL, FALSE);
+  bolt_stats_reset ();
+
+  /* sees everything, but never handles anything */
+  bolt_udev_subscribe (udev,
+                       BOLT_UDEV_SUBSYSTEM_ANY,
+                       BOLT_UDEV_DEVTYPE_ANY,
+                       got_typed_uevent_observed,
+                       &observed);
+
+  id = bolt_udev_subscribe (udev,
+                            BOLT_UDEV_SUBSYSTEM_THUNDERBOLT,
+                            BOLT_UDEV_DEVTYPE_DOMAIN,
+                            got_typed_uevent,
+                            &ev);
+  g_assert_cmpuint (id, >, 0);
+
+  /* must never be called */
+  bolt_udev_subscribe (udev,
+                       BOLT_UDEV_SUBSYSTEM_WMI,
+                       BOLT_UDEV_DEVTYPE_ANY,
+                       got_typed_uevent_unexpected,
+                       &unexpected);
+
+  bolt_udev_subscribe (udev,
+                       BOLT_UDEV_SUBSYSTEM_THUNDERBOLT,
+                       BOLT_UDEV_DEVTYPE_DEVICE,
+                       got_typed_uevent_unexpected,
+                       &unexpected);
+
+  domain = mock_sysfs_domain_add (tt->sysfs, BOLT_SECURITY_NONE);
+  syspath = mock_sysfs_domain_get_syspath (tt->sysfs, domain);
+  typed_wait (&ev, 2);
+
+  g_assert_cmpint (ev.have, ==, 1);
+  g_assert_cmpint (ev.action, ==, BOLT_UDEV_ACTION_ADD);
+  g_assert_cmpint (ev.subsystem, ==, BOLT_UDEV_SUBSYSTEM_THUNDERBOLT);
+  g_assert_cmpint (ev.devtype, ==, BOLT_UDEV_DEVTYPE_DOMAIN);
+  g_assert_true (g_str_has_suffix (ev.syspath, syspath));
+
+  mock_sysfs_domain_remove (tt->sysfs, domain);
+  typed_wait (&ev, 2);
+
+  g_assert_cmpint (ev.have, ==, 1);
+  g_assert_cmpint (ev.action, ==, BOLT_UDEV_ACTION_REMOVE);
+  g_assert_cmpint (ev.devtype, ==, BOLT_UDEV_DEVTYPE_DOMAIN);
+  g_assert_cmpint (unexpected, ==, 0);
+
+  /* after unsubscribing, we must not get any events */
+  bolt_udev_unsubscribe (udev, id);
+  domain = mock_sysfs_domain_add (tt->sysfs, BOLT_SECURITY_NONE);
+  typed_wait (&ev, 1);
+  g_assert_cmpint (ev.have, ==, 0);
+
+  /* only events a handler acted on count as handled */
+  g_assert_cmpint (observed, >=, 3);
+
+  uevents = g_variant_ref_sink (bolt_stats_get_uevents ());
+  g_assert_true (g_variant_lookup (uevents, "add", "(tt)",
+                                   &received, &handled));
+  g_assert_cmpuint (received, >=, 2);
+  g_assert_cmpuint (handled, ==, 1);
+
+  g_assert_true (g_variant_lookup (uevents, "remove", "(tt)",
+                                   &received, &handled));
+  g_assert_cmpuint (received, >=, 1);
+  g_assert_cmpuint (handled, ==, 1);
+
+  n = bolt_udev_unsubscribe_by_data (udev, &unexpected);
+  g_assert_cmpuint (n, ==, 2);
+
+  n = bolt_udev_unsubscribe_by_data (udev, &unexpected);
+  g_assert_cmpuint (n, ==, 0);
+
+  g_clear_pointer (&ev.syspath, g_free);
+  g_clear_pointer (&ev.loop, g_main_loop_unref);
+}
+
+typedef struct
+{
+  GPtrArray *events; /* "action syspath" */
+  gboolean   timedout;
+} TreeEvents;
+
+static gboolean
+got_tree_uevent (BoltUdev         *udev,
+                 const BoltUevent *event,
+                 gpointer          user_data)
+{
+  TreeEvents *te = user_data;
+  char *str;
+
+  str = g_strdup_printf ("%s %s",
+                         bolt_udev_action_to_string (event->action),
+                         event->syspath);
+
+  g_ptr_array_add (te->events, str);
+
+  return TRUE;
+}
+
+static gboolean
+tree_timeout (gpointer user_data)
+{
+  TreeEvents *te = user_data;
+
+  te->timedout = TRUE;
+  return G_SOURCE_REMOVE;
+}
+
+static void
+tree_wait (TreeEvents *te, guint n)
+{
+  guint tid;
+
+  g_ptr_array_set_size (te->events, 0);
+  te->timedout = FALSE;
+  tid = g_timeout_add_seconds (5, tree_timeout, te);
+
+  while (te->events->len < n && !te->timedout)
+    g_main_context_iteration (NULL, TRUE);
+
+  if (!te->timedout)
+    g_source_remove (tid);
+
+  g_assert_false (te->timedout);
+  g_assert_cmpuint (te->events->len, ==, n);
+}
+
+static void
+test_udev_tree (TestUdev *tt, gconstpointer user)
+{
+  g_autoptr(GPtrArray) devices = NULL;
+  g_autoptr(BoltUdev) udev = NULL;
+  g_autoptr(GError) err = NULL;
+  const char *filter[] = {"thunderbolt", NULL};
+  TreeEvents te = {NULL, };
+  MockTree tree = {
+    .security   = BOLT_SECURITY_USER,
+    .depth      = 2,
+    .fanout     = 2,
+    .authorized = 0,
+    .key        = FALSE,
+    .boot       = -1,
+  };
+  g_autofree char *syspath = NULL;
+  const char *domain;
+  guint total;
+
+  udev = bolt_udev_new ("udev", filter, &err);
+  g_assert_no_error (err);
+  g_assert_nonnull (udev);
+
+  te.events = g_ptr_array_new_with_free_func (g_free);
+
+  bolt_udev_subscribe (udev,
+                       BOLT_UDEV_SUBSYSTEM_THUNDERBOLT,
+                       BOLT_UDEV_DEVTYPE_DEVICE,
+                       got_tree_uevent,
+                       &te);
+
+  /* host plus 2 + 4 devices, added parents first */
+  total = mock_tree_count_devices (&tree) + 1;
+  domain = mock_sysfs_tree_add (tt->sysfs, &tree);
+  g_assert_nonnull (domain);
+
+  tree_wait (&te, total);
+
+  devices = mock_sysfs_device_list (tt->sysfs, domain);
+  g_assert_cmpuint (devices->len, ==, total);
+
+  for (guint i = 0; i < total; i++)
+    {
+      const char *ev = g_ptr_array_index (te.events, i);
+
+      g_assert_true (g_str_has_prefix (ev, "add "));
+      g_assert_true (g_str_has_suffix (ev, g_ptr_array_index (devices, i)));
+    }
+
+  /* authorizing emits a change */
+  syspath = g_strdup (g_ptr_array_index (devices, 1));
+  g_assert_true (mock_sysfs_device_authorize (tt->sysfs, syspath, 1));
+  tree_wait (&te, 1);
+
+  g_assert_true (g_str_has_prefix (g_ptr_array_index (te.events, 0), "change "));
+  g_assert_true (g_str_has_suffix (g_ptr_array_index (te.events, 0), syspath));
+
+  /* unplugging: the children go first */
+  g_assert_true (mock_sysfs_device_remove (tt->sysfs, syspath));
+  tree_wait (&te, 3);
+
+  for (guint i = 0; i < te.events->len; i++)
+    g_assert_true (g_str_has_prefix (g_ptr_array_index (te.events, i), "remove "));
+
+  g_assert_true (g_str_has_suffix (g_ptr_array_index (te.events, 2), syspath));
+
+  bolt_udev_unsubscribe_by_data (udev, &te);
+  g_ptr_array_unref (te.events);
+}
+
+static void
+test_udev_record (TestUdev *tt, gconstpointer user)
+{
+  g_autoptr(GPtrArray) records = NULL;
+  g_autoptr(BoltRecord) parsed = NULL;
+  g_autoptr(BoltUdev) udev = NULL;
+  g_autoptr(GError) err = NULL;
+  g_autofree char *dir = NULL;
+  g_autofree char *path = NULL;
+  g_autofree char *syspath = NULL;
+  const char *filter[] = {"thunderbolt", NULL};
+  TreeEvents te = {NULL, };
+  const char *domain;
+  const char *host;
+  const char *dev;
+  BoltRecord *rec;
+  gboolean ok;
+
+  /* present when the recording starts */
+  domain = mock_sysfs_domain_add (tt->sysfs, BOLT_SECURITY_SECURE);
+  g_assert_nonnull (domain);
+
+  host = mock_sysfs_host_add (tt->sysfs, domain, NULL);
+  g_assert_nonnull (host);
+
+  dir = g_dir_make_tmp ("bolt.record.XXXXXX", &err);
+  g_assert_no_error (err);
+  g_assert_nonnull (dir);
+
+  path = g_build_filename (dir, "uevents", NULL);
+
+  ok = bolt_record_start (path, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+  g_assert_true (bolt_record_enabled ());
+
+  udev = bolt_udev_new ("udev", filter, &err);
+  g_assert_no_error (err);
+  g_assert_nonnull (udev);
+
+  te.events = g_ptr_array_new_with_free_func (g_free);
+
+  bolt_udev_subscribe (udev,
+                       BOLT_UDEV_SUBSYSTEM_THUNDERBOLT,
+                       BOLT_UDEV_DEVTYPE_DEVICE,
+                       got_tree_uevent,
+                       &te);
+
+  dev = mock_sysfs_device_add (tt->sysfs, host, 1, "Dock",
+                               NULL, 0, "deadbeef", 1);
+  g_assert_nonnull (dev);
+  syspath = g_strdup (dev);
+  tree_wait (&te, 1);
+
+  g_assert_true (mock_sysfs_device_authorize (tt->sysfs, syspath, 2));
+  tree_wait (&te, 1);
+
+  g_assert_true (mock_sysfs_device_remove (tt->sysfs, syspath));
+  tree_wait (&te, 1);
+
+  bolt_record_stop ();
+  g_assert_false (bolt_record_enabled ());
+
+  records = bolt_record_load (path, &err);
+  g_assert_no_error (err);
+  g_assert_nonnull (records);
+  g_assert_cmpuint (records->len, ==, 5);
+
+  /* the snapshot: parents first */
+  rec = g_ptr_array_index (records, 0);
+  g_assert_cmpstr (rec->action, ==, BOLT_RECORD_PRESENT);
+  g_assert_cmpint (rec->time, ==, 0);
+  g_assert_cmpstr (rec->subsystem, ==, "thunderbolt");
+  g_assert_cmpstr (rec->devtype, ==, "thunderbolt_domain");
+  g_assert_cmpstr (rec->syspath, ==, mock_sysfs_domain_get_syspath (tt->sysfs, domain));
+  g_assert_cmpstr (bolt_record_get_attr (rec, "security"), ==, "secure");
+
+  rec = g_ptr_array_index (records, 1);
+  g_assert_cmpstr (rec->action, ==, BOLT_RECORD_PRESENT);
+  g_assert_cmpstr (rec->devtype, ==, "thunderbolt_device");
+  g_assert_cmpstr (rec->syspath, ==, host);
+  g_assert_cmpstr (bolt_record_get_attr (rec, "unique_id"), ==,
+                   mock_sysfs_device_get_uid (tt->sysfs, host));
+
+  /* the live events, with the key redacted */
+  rec = g_ptr_array_index (records, 2);
+  g_assert_cmpstr (rec->action, ==, "add");
+  g_assert_cmpstr (rec->syspath, ==, syspath);
+  g_assert_cmpstr (bolt_record_get_attr (rec, "device_name"), ==, "Dock");
+  g_assert_cmpstr (bolt_record_get_attr (rec, "authorized"), ==, "0");
+  g_assert_cmpstr (bolt_record_get_attr (rec, "boot"), ==, "1");
+  g_assert_cmpstr (bolt_record_get_attr (rec, "key"), ==, "00000000");
+  g_assert_null (bolt_record_get_attr (rec, "nonexistent"));
+
+  rec = g_ptr_array_index (records, 3);
+  g_assert_cmpstr (rec->action, ==, "change");
+  g_assert_cmpstr (bolt_record_get_attr (rec, "authorized"), ==, "2");
+
+  rec = g_ptr_array_index (records, 4);
+  g_assert_cmpstr (rec->action, ==, "remove");
+  g_assert_cmpstr (rec->syspath, ==, syspath);
+
+  for (guint i = 1; i < records->len; i++)
+    {
+      BoltRecord *a = g_ptr_array_index (records, i - 1);
+      BoltRecord *b = g_ptr_array_index (records, i);
+
+      g_assert_cmpint (a->time, <=, b->time);
+    }
+
+  /* escaping and invalid lines */
+  parsed = bolt_record_parse ("1\tadd\t-\t-\t/sys/a\\tb\tname=x\\ny", &err);
+  g_assert_no_error (err);
+  g_assert_nonnull (parsed);
+  g_assert_null (parsed->subsystem);
+  g_assert_cmpstr (parsed->syspath, ==, "/sys/a\tb");
+  g_assert_cmpstr (bolt_record_get_attr (parsed, "name"), ==, "x\ny");
+  g_clear_pointer (&parsed, bolt_record_free);
+
+  parsed = bolt_record_parse ("x\tadd\t-\t-\t/sys/a", &err);
+  g_assert_error (err, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+  g_assert_null (parsed);
+  g_clear_error (&err);
+
+  parsed = bolt_record_parse ("1\tadd\t-\t-", &err);
+  g_assert_error (err, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+  g_assert_null (parsed);
+  g_clear_error (&err);
+
+  bolt_udev_unsubscribe_by_data (udev, &te);
+  g_ptr_array_unref (te.events);
+
+  ok = bolt_fs_cleanup_dir (dir, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -222,5 +672,26 @@ main (int argc, char **argv)
               test_udev_basic,
               test_udev_tear_down);
 
+  g_test_add ("/udev/subscribe",
+              TestUdev,
+              NULL,
+              test_udev_setup,
+              test_udev_subscribe,
+              test_udev_tear_down);
+
+  g_test_add ("/udev/tree",
+              TestUdev,
+              NULL,
+              test_udev_setup,
+              test_udev_tree,
+              test_udev_tear_down);
+
+  g_test_add ("/udev/record",
+              TestUdev,
+              NULL,
+              test_udev_setup,
+              test_udev_record,
+              test_udev_tear_down);
+
   return g_test_run ();
 }